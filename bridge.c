@@ -33,11 +33,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 
 #include "common.h"
+#include "probes.h"
+#include "profile.h"
 
 
 //
@@ -77,77 +80,245 @@ typedef struct
     // DNS decode/encode internal state
     dns_state_t                 dns_state;
 
+    // Kernel event notifier for the thread
+    int                         event_fd;
+
+    // Timers for the thread
+    timer_wheel_t               timer_wheel;
+
+    // Monitor for system interface changes, and the timer for interface checks
+    int                         monitor_fd;
+    wheel_timer_t               check_timer;
+
+    // Configuration in use by the thread, and notification of a new configuration
+    const config_t *            config;
+    unsigned int                generation;
+    int                         notify_pipe[2];
+
     // Receive and send packets
     packet_t                    recv_packet;
     packet_t                    send_packet;
 } thread_local_storage_t;
 
+// Thread local storage of the running bridge threads, indexed by ip type
+static thread_local_storage_t * bridge_storage[NUM_IP_TYPES] = { NULL, NULL };
+
+// Synchronization for configuration publication
+static pthread_mutex_t          publish_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           publish_cond = PTHREAD_COND_INITIALIZER;
+
+// Delay between an interface change message and checking the interface
+// NB: Interface changes usually arrive as a burst of messages. The delay
+//     allows the burst to complete before the interfaces are checked.
+#define INTERFACE_CHECK_DELAY_MSEC      250
+
+
+//
+// Check if a forwarding policy allows a packet to be sent to a peer
+//
+static inline unsigned int policy_allowed(
+    unsigned char               policy,
+    unsigned char               kind,
+    const interface_t *         peer,
+    ip_type_t                   ip_type,
+    uint64_t                    now)
+{
+    if (policy & kind)
+    {
+        return 1;
+    }
+
+    // Solicited responses are allowed if the peer has recently sent a query
+    if (kind == POLICY_RESPONSES && (policy & POLICY_SOLICITED) &&
+        now - peer->last_query[ip_type] <= POLICY_SOLICIT_MSEC / TIMER_TICK_MSEC)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+//
+// Send a packet to a peer
+//
+//   Returns the clock at completion of the send.
+//
+static uint64_t send_packet(
+    thread_local_storage_t *    local_storage,
+    interface_t *               peer,
+    const packet_t *            packet)
+{
+    ip_type_t                   ip_type = local_storage->ip_type;
+    socket_address_t *          dst_addr = &local_storage->dst_addr;
+    thread_stats_t *            stats = &thread_stats[ip_type];
+    uint64_t                    start_nsec;
+    uint64_t                    end_nsec;
+    ssize_t                     bytes;
+
+    if (ip_type == IPV6)
+    {
+        // Set the destination scope ID
+        dst_addr->sin6.sin6_scope_id = peer->if_index[IPV6];
+    }
+
+    start_nsec = stats_latency_clock();
+    PROFILE_START(profile_start);
+    bytes = sendto(peer->sock[ip_type], packet->buffer, packet->bytes, 0, &dst_addr->sa, local_storage->dst_addr_len);
+    PROFILE_END(ip_type, PROFILE_SEND, profile_start);
+    end_nsec = stats_latency_clock();
+    stats_latency_record(&stats->latency[LATENCY_SEND], end_nsec - start_nsec);
+    PROBE4(send, peer->index, ip_type, packet->bytes, bytes == -1 ? -errno : bytes);
+
+    if (bytes == -1)
+    {
+        logger("sendto error on interface %s: %s\n", peer->name, strerror(errno));
+        STATS_ADD(stats->interface[peer->index].sendto_errors, 1);
+    }
+    else
+    {
+        STATS_ADD(stats->interface[peer->index].packets_out, 1);
+        STATS_ADD(stats->interface[peer->index].bytes_out, bytes);
+    }
+
+    return end_nsec;
+}
 
 
 //
 // Process an incoming packet
 //
-static void receive(
+//   Returns the number of packets sent.
+//
+static unsigned int receive_packet(
     thread_local_storage_t *    local_storage,
     interface_t *               interface)
 {
     packet_t *                  packet = &local_storage->recv_packet;
+    const config_t *            config = local_storage->config;
     ip_type_t                   ip_type = local_storage->ip_type;
     ssize_t                     bytes;
-    socket_address_t *          dst_addr = &local_storage->dst_addr;
-    socklen_t                   dst_addr_len = local_storage->dst_addr_len;
     interface_t *               peer;
     unsigned int                peer_index;
     unsigned int                filter_index;
     filter_list_t *             filter_list;
+    const unsigned char *       policy_row = NULL;
+    unsigned char               kind = 0;
+    uint64_t                    now = 0;
+    thread_stats_t *            stats = &thread_stats[ip_type];
+    uint64_t                    kernel_nsec;
+    uint64_t                    receive_nsec;
+    uint64_t                    start_nsec;
+    uint64_t                    end_nsec = 0;
+    unsigned int                sent = 0;
     unsigned int                r;
 
+    // Ignore events for an interface that became inactive during the current event batch
+    if (interface->active[ip_type] == 0)
+    {
+        return 0;
+    }
+
     // Receive the packet
-    packet->src_addr_len = sizeof(packet->src_addr.storage);
-    bytes = recvfrom(interface->sock[ip_type],
-                            packet->buffer, sizeof(packet->buffer), 0,
-                            &packet->src_addr.sa, &packet->src_addr_len);
+    PROFILE_START(profile_start);
+    bytes = os_receive_packet(interface->sock[ip_type], packet, &kernel_nsec);
     if (bytes == -1)
     {
         logger("recvfrom error on interface %s: %s\n", interface->name, strerror(errno));
-        return;
+        STATS_ADD(stats->recv_errors, 1);
+        return 0;
+    }
+    PROFILE_PACKET(ip_type, bytes);
+    PROFILE_END(ip_type, PROFILE_RECEIVE, profile_start);
+    receive_nsec = stats_latency_clock();
+    if (kernel_nsec)
+    {
+        stats_latency_record(&stats->latency[LATENCY_KERNEL], kernel_nsec);
     }
     packet->bytes = bytes;
+    STATS_ADD(stats->interface[interface->index].packets_in, 1);
+    STATS_ADD(stats->interface[interface->index].bytes_in, bytes);
+
+    // If forwarding policies are in use, classify the packet
+    if (config->policy_matrix)
+    {
+        if (bytes < DNS_HEADER_SIZE)
+        {
+            // Too short to classify, drop the packet
+            if (TAP_ENABLED())
+            {
+                tap_packet(ip_type, interface, TAP_INGRESS, NULL, TAP_DROPPED, packet);
+            }
+            return 0;
+        }
+
+        policy_row = &config->policy_matrix[interface->index * configured_interface_count];
+        kind = DNS_IS_RESPONSE(packet->buffer) ? POLICY_RESPONSES : POLICY_QUERIES;
+        if (config->policy_solicited)
+        {
+            now = timer_clock_ticks();
+            if (kind == POLICY_QUERIES)
+            {
+                interface->last_query[ip_type] = now;
+            }
+        }
+    }
 
     // If filter is enabled, decode the packet
-    if (filtering_enabled)
+    if (config->filtering_enabled)
     {
-        r = dns_decode_packet(local_storage->dns_state, packet, interface);
+        start_nsec = stats_latency_clock();
+        PROFILE_START(decode_start);
+        r = dns_decode_packet(local_storage->dns_state, packet, config, interface);
+        PROFILE_END(ip_type, PROFILE_DECODE, decode_start);
+        stats_latency_record(&stats->latency[LATENCY_DECODE], stats_latency_clock() - start_nsec);
+        PROBE4(decode, interface->index, ip_type, packet->bytes, r);
         if (r == 0)
         {
             // If the decoder found a problem with the packet, or everything has been filtered, drop the packet
-            return;
+            if (TAP_ENABLED())
+            {
+                tap_packet(ip_type, interface, TAP_INGRESS, NULL, TAP_DROPPED, packet);
+            }
+            return 0;
         }
     }
+    if (TAP_ENABLED())
+    {
+        tap_packet(ip_type, interface, TAP_INGRESS, NULL, TAP_FORWARDED, packet);
+    }
 
     // Forward the packet to peers that do not have outbound filters
     if (interface->peer_nofilter_count[ip_type])
     {
-        if (global_filter_list || interface->inbound_filter_list)
+        if (config->global_filter_list || config->interface_config[interface->index].inbound_filter_list)
         {
-            dns_encode_packet(local_storage->dns_state, &local_storage->recv_packet, &local_storage->send_packet, NULL);
-            packet = &local_storage->send_packet;
+            start_nsec = stats_latency_clock();
+            PROFILE_START(encode_start);
+            r = dns_encode_packet(local_storage->dns_state, &local_storage->recv_packet, &local_storage->send_packet, NULL);
+            PROFILE_END(ip_type, PROFILE_ENCODE, encode_start);
+            stats_latency_record(&stats->latency[LATENCY_ENCODE_INBOUND], stats_latency_clock() - start_nsec);
+            PROBE6(encode, interface->index, ip_type, ENCODE_INBOUND, -1, local_storage->send_packet.bytes, r);
+            if (TAP_ENABLED())
+            {
+                tap_packet(ip_type, interface, TAP_EGRESS_INBOUND, NULL, r ? TAP_FORWARDED : TAP_DROPPED, &local_storage->send_packet);
+            }
+            STATS_ADD(stats->encodes[ENCODE_INBOUND], 1);
+
+            // If everything was filtered, or the packet could not be encoded, skip the peers
+            packet = r ? &local_storage->send_packet : NULL;
        }
 
-        for (peer_index = 0; peer_index < interface->peer_count[ip_type]; peer_index++)
+        if (packet)
         {
-            peer = interface->peer_list[ip_type][peer_index];
-            if (peer->outbound_filter_list == NULL)
+            for (peer_index = 0; peer_index < interface->peer_count[ip_type]; peer_index++)
             {
-                if (ip_type == IPV6)
-                {
-                    // Set the destination scope ID
-                    dst_addr->sin6.sin6_scope_id = peer->if_index;
-                }
-                bytes = sendto(peer->sock[ip_type], packet->buffer, packet->bytes, 0, &dst_addr->sa, dst_addr_len);
-                if (bytes == -1)
+                peer = interface->peer_list[ip_type][peer_index];
+                if (config->interface_config[peer->index].outbound_filter_list == NULL &&
+                    (policy_row == NULL || policy_allowed(policy_row[peer->index], kind, peer, ip_type, now)))
                 {
-                    logger("sendto error on interface %s: %s\n", peer->name, strerror(errno));
+                    end_nsec = send_packet(local_storage, peer, packet);
+                    sent++;
                 }
             }
         }
@@ -162,7 +333,17 @@ static void receive(
         {
             filter_list = interface->peer_filter_list[ip_type][filter_index];
 
+            start_nsec = stats_latency_clock();
+            PROFILE_START(encode_start);
             r = dns_encode_packet(local_storage->dns_state, &local_storage->recv_packet, &local_storage->send_packet, filter_list);
+            PROFILE_END(ip_type, PROFILE_ENCODE, encode_start);
+            stats_latency_record(&stats->latency[LATENCY_ENCODE_OUTBOUND], stats_latency_clock() - start_nsec);
+            PROBE6(encode, interface->index, ip_type, ENCODE_OUTBOUND, filter_list->index, local_storage->send_packet.bytes, r);
+            if (TAP_ENABLED())
+            {
+                tap_packet(ip_type, interface, TAP_EGRESS_OUTBOUND, filter_list, r ? TAP_FORWARDED : TAP_DROPPED, &local_storage->send_packet);
+            }
+            STATS_ADD(stats->encodes[ENCODE_OUTBOUND], 1);
             if (r == 0)
             {
                 // If everything has been filtered, skip the packet
@@ -172,22 +353,211 @@ static void receive(
             for (peer_index = 0; peer_index < interface->peer_count[ip_type]; peer_index++)
             {
                 peer = interface->peer_list[ip_type][peer_index];
-                if (peer->outbound_filter_list == filter_list)
+                if (config->interface_config[peer->index].outbound_filter_list == filter_list &&
+                    (policy_row == NULL || policy_allowed(policy_row[peer->index], kind, peer, ip_type, now)))
                 {
-                    if (ip_type == IPV6)
-                    {
-                        // Set the destination scope ID
-                        dst_addr->sin6.sin6_scope_id = peer->if_index;
-                    }
-                    bytes = sendto(peer->sock[ip_type], packet->buffer, packet->bytes, 0, &dst_addr->sa, dst_addr_len);
-                    if (bytes == -1)
-                    {
-                        logger("sendto error on interface %s: %s\n", peer->name, strerror(errno));
-                    }
+                    end_nsec = send_packet(local_storage, peer, packet);
+                    sent++;
                 }
             }
         }
     }
+
+    // If the packet was forwarded, record the total time
+    if (end_nsec)
+    {
+        stats_latency_record(&stats->latency[LATENCY_TOTAL], kernel_nsec + (end_nsec - receive_nsec));
+    }
+
+    return sent;
+}
+
+
+//
+// Process an incoming packet, with entry and exit probes
+//
+static void receive(
+    thread_local_storage_t *    local_storage,
+    interface_t *               interface)
+{
+    unsigned int                sent;
+
+    PROBE2(receive_entry, interface->index, local_storage->ip_type);
+    PROFILE_START(profile_start);
+    sent = receive_packet(local_storage, interface);
+    PROFILE_END(local_storage->ip_type, PROFILE_TOTAL, profile_start);
+    PROBE4(receive_exit, interface->index, local_storage->ip_type, local_storage->recv_packet.bytes, sent);
+    (void) sent;
+}
+
+
+//
+// Adopt the current configuration
+//
+static void adopt_config(
+    thread_local_storage_t *    local_storage)
+{
+    const config_t *            config;
+    char                        buffer[16];
+
+    // Drain the notification pipe
+    while (read(local_storage->notify_pipe[0], buffer, sizeof(buffer)) > 0)
+    {
+        continue;
+    }
+
+    config = __atomic_load_n(&current_config, __ATOMIC_ACQUIRE);
+    if (config != local_storage->config)
+    {
+        // Rebuild the peer lists for the new configuration
+        set_interface_peer_lists(config, local_storage->ip_type);
+        local_storage->config = config;
+    }
+
+    // The thread no longer holds references to any previous configuration
+    pthread_mutex_lock(&publish_mutex);
+    local_storage->generation = config->generation;
+    pthread_cond_broadcast(&publish_cond);
+    pthread_mutex_unlock(&publish_mutex);
+}
+
+
+//
+// Add a file descriptor to the kernel event notifier
+//
+static void add_event(
+    thread_local_storage_t *    local_storage,
+    int                         fd,
+    void *                      data)
+{
+#if defined(HAVE_EPOLL)
+    struct epoll_event          event;
+
+    event.events = EPOLLIN;
+    event.data.ptr = data;
+    if (epoll_ctl(local_storage->event_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        fatal("epoll_ctl (EPOLL_CTL_ADD): %s\n", strerror(errno));
+    }
+#elif defined(HAVE_KQUEUE)
+    struct kevent               event;
+
+    EV_SET(&event, fd, EVFILT_READ, EV_ADD, 0, 0, data);
+    if (kevent(local_storage->event_fd, &event, 1, NULL, 0, NULL) < 0)
+    {
+        fatal("kevent (EV_SET): %s\n", strerror(errno));
+    }
+#endif
+}
+
+
+//
+// Remove a file descriptor from the kernel event notifier
+//
+static void remove_event(
+    thread_local_storage_t *    local_storage,
+    int                         fd)
+{
+#if defined(HAVE_EPOLL)
+    struct epoll_event          event;
+
+    // NB: A non-null event is required by kernels before 2.6.9
+    if (epoll_ctl(local_storage->event_fd, EPOLL_CTL_DEL, fd, &event) < 0)
+    {
+        logger("epoll_ctl (EPOLL_CTL_DEL): %s\n", strerror(errno));
+    }
+#elif defined(HAVE_KQUEUE)
+    struct kevent               event;
+
+    EV_SET(&event, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    if (kevent(local_storage->event_fd, &event, 1, NULL, 0, NULL) < 0)
+    {
+        logger("kevent (EV_DELETE): %s\n", strerror(errno));
+    }
+#endif
+}
+
+
+//
+// Add the socket of a newly bound interface to the kernel event notifier
+//
+static void interface_bound(
+    interface_t *               interface,
+    void *                      arg)
+{
+    thread_local_storage_t *    local_storage = (thread_local_storage_t *) arg;
+
+    add_event(local_storage, interface->sock[local_storage->ip_type], interface);
+}
+
+
+//
+// Remove the socket of an interface that is about to be closed from the
+// kernel event notifier
+//
+static void interface_unbound(
+    interface_t *               interface,
+    void *                      arg)
+{
+    thread_local_storage_t *    local_storage = (thread_local_storage_t *) arg;
+
+    remove_event(local_storage, interface->sock[local_storage->ip_type]);
+}
+
+
+//
+// Check interfaces following system interface changes
+//
+static void check_interfaces(
+    wheel_timer_t *             timer,
+    void *                      arg)
+{
+    thread_local_storage_t *    local_storage = (thread_local_storage_t *) arg;
+
+    (void) timer;
+    os_check_interfaces(local_storage->config, local_storage->ip_type, interface_bound, interface_unbound, local_storage);
+}
+
+
+//
+// Process system interface change messages
+//
+static void monitor_interfaces(
+    thread_local_storage_t *    local_storage)
+{
+    // NB: The check timer is not restarted by subsequent messages so that a
+    //     continuously flapping interface cannot defer checks indefinitely.
+    if (os_monitor_read(local_storage->monitor_fd, local_storage->ip_type) &&
+        !timer_pending(&local_storage->check_timer))
+    {
+        timer_start(&local_storage->timer_wheel, &local_storage->check_timer,
+                    INTERFACE_CHECK_DELAY_MSEC, check_interfaces, local_storage);
+    }
+}
+
+
+//
+// Add the fixed event sources and the active interface sockets to the kernel event notifier
+//
+static void add_events(
+    thread_local_storage_t *    local_storage)
+{
+    ip_type_t                   ip_type = local_storage->ip_type;
+    interface_t *               interface;
+    unsigned int                index;
+
+    add_event(local_storage, local_storage->timer_wheel.fd, &local_storage->timer_wheel);
+    add_event(local_storage, local_storage->notify_pipe[0], local_storage->notify_pipe);
+    add_event(local_storage, local_storage->monitor_fd, &local_storage->monitor_fd);
+
+    for (index = 0; index < ip_interface_count[ip_type]; index++)
+    {
+        interface = ip_interface_list[ip_type][index];
+        if (interface->active[ip_type])
+        {
+            add_event(local_storage, interface->sock[ip_type], interface);
+        }
+    }
 }
 
 
@@ -203,50 +573,57 @@ static void * bridge_thread(
     thread_local_storage_t *    local_storage = (thread_local_storage_t *) arg;
     ip_type_t                   ip_type = local_storage->ip_type;
 
-    interface_t *               interface;
     unsigned int                index;
-    int                         event_fd;
-    struct epoll_event          event;
+    unsigned int                event_count;
     struct epoll_event *        events;
     int                         num_events;
 
     // Create the kernel event notifier
-    event_fd = epoll_create(ip_interface_count[ip_type]);
-    if (event_fd < 0)
+    // NB: The +3 is for the timer wheel, the notification pipe, and the interface monitor
+    event_count = ip_interface_count[ip_type] + 3;
+    local_storage->event_fd = epoll_create(event_count);
+    if (local_storage->event_fd < 0)
     {
         fatal("epoll_create: %s\n", strerror(errno));
     }
-    event.events = EPOLLIN;
+    add_events(local_storage);
 
-    // Add the sockets to the event notifier
-    events = calloc(ip_interface_count[ip_type], sizeof(struct epoll_event));
+    events = calloc(event_count, sizeof(struct epoll_event));
     if (events == NULL)
     {
         fatal("Cannot allocate memory: %s\n", strerror(errno));
     }
 
-    for (index = 0; index < ip_interface_count[ip_type]; index++)
-    {
-        interface = ip_interface_list[ip_type][index];
-
-        event.data.ptr = interface;
-        if (epoll_ctl(event_fd, EPOLL_CTL_ADD, interface->sock[ip_type], &event) < 0)
-        {
-            fatal("epoll_ctl (EPOLL_CTL_ADD): %s\n", strerror(errno));
-        }
-    }
-
     // Loop forever waiting for events
     while (1)
     {
-        num_events = epoll_wait(event_fd, events, ip_interface_count[ip_type], -1);
+        num_events = epoll_wait(local_storage->event_fd, events, event_count, -1);
         if (num_events < 0)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             fatal("epoll_wait: %s\n", strerror(errno));
         }
 
         for (index = 0; index < (unsigned int) num_events; index++)
         {
+            if (events[index].data.ptr == &local_storage->timer_wheel)
+            {
+                timer_wheel_run(&local_storage->timer_wheel);
+                continue;
+            }
+            if (events[index].data.ptr == local_storage->notify_pipe)
+            {
+                adopt_config(local_storage);
+                continue;
+            }
+            if (events[index].data.ptr == &local_storage->monitor_fd)
+            {
+                monitor_interfaces(local_storage);
+                continue;
+            }
             receive(local_storage, (interface_t *) events[index].data.ptr);
         }
     }
@@ -260,51 +637,57 @@ static void * bridge_thread(
 {
     thread_local_storage_t *    local_storage = (thread_local_storage_t *) arg;
     ip_type_t                   ip_type = local_storage->ip_type;
-    interface_t *               interface;
     unsigned int                index;
-    int                         event_fd;
-    struct kevent               event;
+    unsigned int                event_count;
     struct kevent *             events;
     int                         num_events;
-    int                         r;
 
     // Create the kernel event notifier
-    event_fd = kqueue();
-    if (event_fd < 0)
+    local_storage->event_fd = kqueue();
+    if (local_storage->event_fd < 0)
     {
         fatal("kqueue: %s\n", strerror(errno));
     }
+    add_events(local_storage);
 
-    // Add the sockets to the event notifier
-    events = calloc(ip_interface_count[ip_type], sizeof(struct kevent));
+    // NB: The +3 is for the timer wheel, the notification pipe, and the interface monitor
+    event_count = ip_interface_count[ip_type] + 3;
+    events = calloc(event_count, sizeof(struct kevent));
     if (events == NULL)
     {
         fatal("Cannot allocate memory: %s\n", strerror(errno));
     }
 
-    for (index = 0; index < ip_interface_count[ip_type]; index++)
-    {
-        interface = ip_interface_list[ip_type][index];
-
-        EV_SET(&event, interface->sock[ip_type], EVFILT_READ, EV_ADD, 0, 0, interface);
-        r = kevent(event_fd, &event, 1, NULL, 0, NULL);
-        if (r < 0)
-        {
-            fatal("kevent (EV_SET): %s\n", strerror(errno));
-        }
-    }
-
     // Loop forever waiting for events
     while (1)
     {
-        num_events = kevent(event_fd, NULL, 0, events, ip_interface_count[ip_type], NULL);
+        num_events = kevent(local_storage->event_fd, NULL, 0, events, event_count, NULL);
         if (num_events < 0)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             fatal("kevent: %s\n", strerror(errno));
         }
 
         for (index = 0; index < (unsigned int) num_events; index++)
         {
+            if (events[index].udata == &local_storage->timer_wheel)
+            {
+                timer_wheel_run(&local_storage->timer_wheel);
+                continue;
+            }
+            if (events[index].udata == local_storage->notify_pipe)
+            {
+                adopt_config(local_storage);
+                continue;
+            }
+            if (events[index].udata == &local_storage->monitor_fd)
+            {
+                monitor_interfaces(local_storage);
+                continue;
+            }
             receive(local_storage, (interface_t *) events[index].udata);
         }
     }
@@ -328,7 +711,23 @@ static thread_local_storage_t * local_storage_create(
     }
 
     // DNS state for the thread
-    local_storage->dns_state = dns_state_create();
+    local_storage->dns_state = dns_state_create(ip_type);
+
+    // Timer wheel for the thread
+    timer_wheel_init(&local_storage->timer_wheel);
+
+    // Interface monitor for the thread
+    local_storage->monitor_fd = os_monitor_open(ip_type);
+
+    // Configuration for the thread
+    local_storage->config = current_config;
+    local_storage->generation = current_config->generation;
+    if (pipe(local_storage->notify_pipe) == -1)
+    {
+        fatal("pipe: %s\n", strerror(errno));
+    }
+    (void) fcntl(local_storage->notify_pipe[0], F_SETFL, fcntl(local_storage->notify_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+    (void) fcntl(local_storage->notify_pipe[1], F_SETFL, fcntl(local_storage->notify_pipe[1], F_GETFL, 0) | O_NONBLOCK);
 
     // IP type and destination address for the thread
     local_storage->ip_type = ip_type;
@@ -379,6 +778,7 @@ void start_bridges(void)
         // The the interface list and count
         local_storage->interface_list = ip_interface_list[IPV4];
         local_storage->interface_count = ip_interface_count[IPV4];
+        bridge_storage[IPV4] = local_storage;
 
         // Start the thread
         r = pthread_create(&thread_id, NULL, &bridge_thread, local_storage);
@@ -397,6 +797,7 @@ void start_bridges(void)
         // The the interface list and count
         local_storage->interface_list = ip_interface_list[IPV6];
         local_storage->interface_count = ip_interface_count[IPV6];
+        bridge_storage[IPV6] = local_storage;
 
         // Start the thread
         r = pthread_create(&thread_id, NULL, &bridge_thread, local_storage);
@@ -406,3 +807,45 @@ void start_bridges(void)
         }
     }
 }
+
+
+//
+// Publish a new configuration to the bridge threads
+//
+//   NOTE: Each bridge thread adopts the new configuration between packets,
+//         rebuilding its peer filter lists as it does so. Forwarding is never
+//         stopped. Once this function returns, no bridge thread holds any
+//         reference to a previous configuration.
+//
+void bridge_publish_config(
+    config_t *                  config)
+{
+    thread_local_storage_t *    local_storage;
+    const char                  notify = 0;
+    unsigned int                ip_type;
+
+    __atomic_store_n(&current_config, config, __ATOMIC_RELEASE);
+
+    // Notify the bridge threads
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        local_storage = bridge_storage[ip_type];
+        if (local_storage)
+        {
+            // NB: If the pipe is full, a notification is already pending
+            (void) write(local_storage->notify_pipe[1], &notify, sizeof(notify));
+        }
+    }
+
+    // Wait for the bridge threads to pass a quiescent point
+    pthread_mutex_lock(&publish_mutex);
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        local_storage = bridge_storage[ip_type];
+        while (local_storage && local_storage->generation != config->generation)
+        {
+            pthread_cond_wait(&publish_cond, &publish_mutex);
+        }
+    }
+    pthread_mutex_unlock(&publish_mutex);
+}
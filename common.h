@@ -32,6 +32,8 @@
 #define _COMMON_H 1
 
 #include <stdint.h>
+#include <stdarg.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
@@ -49,6 +51,10 @@
 #define DNS_MAX_LABEL_LEN       64      // Includes leading length byte
 #define DNS_MAX_NUM_LABELS      128     // Number of labels in a name
 
+// DNS header size, and check for the response (QR) flag in a packet
+#define DNS_HEADER_SIZE         12
+#define DNS_IS_RESPONSE(buffer) (((buffer)[2] & 0x80) != 0)
+
 
 //
 // Common types and structures
@@ -95,6 +101,15 @@ typedef struct
 } dns_match_name_t;
 
 
+// Interface IP type
+typedef enum
+{
+    IPV4                        = 0,
+    IPV6                        = 1
+} ip_type_t;
+#define NUM_IP_TYPES            2
+
+
 // Filter list strucure
 typedef enum
 {
@@ -107,27 +122,36 @@ typedef struct
     filter_allow_deny_t         allow_deny;
     unsigned int                count;
     const dns_match_name_t **   names;
-} filter_list_t;
 
+    // Position in the configuration's filter lists
+    unsigned int                index;
+
+    // Number of records matched by each name, indexed by [ip type][name]
+    // NB: Each array is written only by the bridge thread of the ip type
+    uint64_t *                  hits[NUM_IP_TYPES];
+
+    // Number of records filtered by the list, indexed by [ip type]
+    // NB: Each counter is the entry following the names in the hits array
+    //     of the ip type, so that it is written only by that bridge thread
+    uint64_t *                  filtered[NUM_IP_TYPES];
+} filter_list_t;
 
-// Interface IP type
-typedef enum
-{
-    IPV4                        = 0,
-    IPV6                        = 1
-} ip_type_t;
-#define NUM_IP_TYPES            2
 
 // Interface structure
 typedef struct interface
 {
     const char *                name;
-    filter_list_t *             inbound_filter_list;
-    filter_list_t *             outbound_filter_list;
+    unsigned int                index;          // Position in the configured interface list
 
-    unsigned int                if_index;
     unsigned int                disable_ip[NUM_IP_TYPES];
 
+    // NB: Following startup, the fields below that are indexed by ip type are
+    //     owned by the bridge thread for that ip type. The ipv4 and ipv6
+    //     addresses are owned by the IPv4 and IPv6 threads respectively.
+    unsigned int                if_index[NUM_IP_TYPES];
+    unsigned int                active[NUM_IP_TYPES];
+    unsigned int                check_pending[NUM_IP_TYPES];
+
     struct in_addr              ipv4_addr;
     struct in6_addr             ipv6_addr;
     char                        ipv4_addr_str[INET_ADDRSTRLEN];
@@ -135,6 +159,9 @@ typedef struct interface
 
     int                         sock[NUM_IP_TYPES];
 
+    // Time (in timer ticks) that a query was last received on the interface
+    uint64_t                    last_query[NUM_IP_TYPES];
+
     struct interface **         peer_list[NUM_IP_TYPES];
     unsigned int                peer_count[NUM_IP_TYPES];
     filter_list_t **            peer_filter_list[NUM_IP_TYPES];
@@ -142,10 +169,124 @@ typedef struct interface
     unsigned int                peer_nofilter_count[NUM_IP_TYPES];
 } interface_t;
 
+// Forwarding domains
+// NB: Interfaces are peers if they are members of at least one common domain
+#define MAX_DOMAINS             64
+#define DEFAULT_DOMAIN          "default"
+typedef uint64_t                domain_mask_t;
+
+// Forwarding policies, applied per (ingress, egress) interface pair
+// NB: Solicited responses are only forwarded to an interface that has
+//     sent a query within the solicitation window.
+#define POLICY_QUERIES          0x01
+#define POLICY_RESPONSES        0x02
+#define POLICY_SOLICITED        0x04
+#define POLICY_ALL              (POLICY_QUERIES | POLICY_RESPONSES)
+#define POLICY_SOLICIT_MSEC     1000
+
+// Interface configuration that may be changed by a configuration reload
+typedef struct
+{
+    unsigned int                disable_ip[NUM_IP_TYPES];
+    domain_mask_t               domains;
+    filter_list_t *             inbound_filter_list;
+    filter_list_t *             outbound_filter_list;
+} interface_config_t;
+
+// Configuration that may be changed by a configuration reload
+// NB: A new instance is built by each (re)load of the configuration file and
+//     published to the bridge threads. An instance is never modified after
+//     it has been published.
+typedef struct
+{
+    // Generation of the configuration (incremented on each load)
+    unsigned int                generation;
+
+    // Global settings
+    unsigned int                disable_ip[NUM_IP_TYPES];
+    unsigned int                filtering_enabled;
+    filter_list_t *             global_filter_list;
+
+    // Interface settings, indexed by interface index
+    interface_config_t *        interface_config;
+
+    // Forwarding domain names, indexed by domain bit
+    char *                      domain_names[MAX_DOMAINS];
+    unsigned int                domain_count;
+
+    // Path of the control socket, and address of the metrics listener (NULL if none)
+    // NB: The metrics address is either a unix socket path or a TCP address and port
+    char *                      control_socket;
+    char *                      metrics_listen;
+
+    // Path of the packet tap file (NULL if none)
+    char *                      tap_file;
+
+    // Maximum number of service inventory records for each ip type
+    // NB: Only used at startup
+    unsigned int                inventory_size;
+
+    // Forwarding policy matrix, indexed by [ingress index][egress index]
+    // NB: NULL if no policies are configured
+    unsigned char *             policy_matrix;
+    unsigned int                policy_solicited;
+
+    // Count of unique outbound filters in use across all interfaces
+    unsigned int                unique_outbound_filter_count;
+
+    // All filter lists owned by the configuration
+    filter_list_t **            filter_lists;
+    unsigned int                filter_list_count;
+    unsigned int                filter_list_allocated;
+
+    // Time the configuration was loaded, in ticks
+    uint64_t                    load_ticks;
+} config_t;
+
 // DNS state/closure (private to dns decode/encode files)
 typedef void *                  dns_state_t;
 
 
+// Timer wheel parameters
+#define TIMER_TICK_MSEC         10      // Resolution of the wheel
+#define TIMER_LEVEL_BITS        6
+#define TIMER_SLOTS             (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS            4       // 2^24 ticks, approximately 46 hours
+
+// Timer structure
+// NB: Timers are owned by the caller and are linked directly into the
+//     wheel, so no allocation is performed. A zeroed timer is idle.
+struct wheel_timer;
+typedef void (* timer_callback_t)(
+    struct wheel_timer *        timer,
+    void *                      arg);
+
+typedef struct wheel_timer
+{
+    struct wheel_timer *        next;
+    struct wheel_timer **       prev;
+    uint64_t                    expires;
+    timer_callback_t            callback;
+    void *                      arg;
+} wheel_timer_t;
+
+// Timer wheel structure (one per bridge thread)
+typedef struct
+{
+    // Kernel timer source, added to the bridge thread event notifier
+    int                         fd;
+
+    // Tick the kernel timer is armed for (zero if disarmed)
+    uint64_t                    deadline;
+
+    // Current position of the wheel, and the number of pending timers
+    uint64_t                    tick;
+    unsigned int                count;
+
+    wheel_timer_t *             slots[TIMER_LEVELS][TIMER_SLOTS];
+} timer_wheel_t;
+
+
 //
 // Global definitions
 //
@@ -153,20 +294,97 @@ typedef void *                  dns_state_t;
 // Configuration filename, defined in main.c
 extern const char *             config_filename;
 
+// Statistics
+// NB: Each counter is only written by the bridge thread for its ip type, and
+//     is updated and read with relaxed atomics. Reading the counters never
+//     blocks the bridge threads.
+#define STATS_ADD(counter, value)   __atomic_store_n(&(counter), (counter) + (value), __ATOMIC_RELAXED)
+#define STATS_READ(counter)         __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+// Packet decode error reasons
+typedef enum
+{
+    DECODE_ERROR_SHORT          = 0,    // Packet too small for the header
+    DECODE_ERROR_COUNT          = 1,    // Too many queries or resource records
+    DECODE_ERROR_NAME           = 2,    // Bad label pointer or length, too many labels, or name overrun
+    DECODE_ERROR_RECORD         = 3,    // Malformed query or resource record
+    DECODE_ERROR_RDATA          = 4,    // Corrupt name in a record's rdata
+    DECODE_ERROR_TYPE           = 5,    // Unsupported query or record type (record dropped)
+    DECODE_ERROR_LENGTH         = 6     // Decoded length differs from the packet length
+} decode_error_t;
+#define NUM_DECODE_ERRORS       7
+
+// Packet encode classes
+typedef enum
+{
+    ENCODE_INBOUND              = 0,    // Encoded after inbound filtering only
+    ENCODE_OUTBOUND             = 1     // Encoded for an outbound filter list
+} encode_class_t;
+#define NUM_ENCODE_CLASSES      2
+
+// Forwarding latency stages
+typedef enum
+{
+    LATENCY_KERNEL              = 0,    // Kernel receive timestamp to receipt by the bridge thread
+    LATENCY_DECODE              = 1,    // Packet decode and inbound filtering
+    LATENCY_ENCODE_INBOUND      = 2,    // Encode after inbound filtering
+    LATENCY_ENCODE_OUTBOUND     = 3,    // Encode for an outbound filter list
+    LATENCY_SEND                = 4,    // Each sendto
+    LATENCY_TOTAL               = 5     // Kernel receive timestamp to the last sendto completion
+} latency_stage_t;
+#define NUM_LATENCY_STAGES      6
+
+// Latency histogram buckets
+// NB: Buckets are logarithmic, with 2^LATENCY_SUB_BUCKET_BITS linear sub
+//     buckets per power of two, giving a relative error of 1/8th. Values are
+//     in nanoseconds, and larger values are recorded in the last bucket.
+#define LATENCY_SUB_BUCKET_BITS 3
+#define LATENCY_MAX_BITS        36      // About 68 seconds
+#define NUM_LATENCY_BUCKETS     ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS)
+
+// Latency histogram
+typedef struct
+{
+    uint64_t                    count;
+    uint64_t                    sum;
+    uint64_t                    max;
+    uint64_t                    buckets[NUM_LATENCY_BUCKETS];
+} latency_histogram_t;
+
+// Interface statistics
+typedef struct
+{
+    uint64_t                    packets_in;
+    uint64_t                    bytes_in;
+    uint64_t                    packets_out;
+    uint64_t                    bytes_out;
+    uint64_t                    sendto_errors;
+} interface_stats_t;
+
+// Bridge thread statistics
+typedef struct
+{
+    // Interface statistics, indexed by interface index
+    interface_stats_t *         interface;
+
+    uint64_t                    recv_errors;
+    uint64_t                    decode_errors[NUM_DECODE_ERRORS];
+    uint64_t                    encodes[NUM_ENCODE_CLASSES];
+    latency_histogram_t         latency[NUM_LATENCY_STAGES];
+} thread_stats_t;
+
+// Statistics by ip type, defined in stats.c
+extern thread_stats_t           thread_stats[NUM_IP_TYPES];
+
 // Socket addresses, defined in socket.c
 extern struct sockaddr_in       ipv4_any_sockaddr;
 extern struct sockaddr_in       ipv4_mcast_sockaddr;
 extern struct sockaddr_in6      ipv6_any_sockaddr;
 extern struct sockaddr_in6      ipv6_mcast_sockaddr;
 
-// Packet filtering enable flag, defined in filter.c
-extern unsigned int             filtering_enabled;
-
-// Global filter list, defined in filter.c
-extern filter_list_t *          global_filter_list;
-
-// Count of unique outbound filters in use across all interfaces, defined in filter.c
-extern unsigned int             unique_outbound_filter_count;
+// Current configuration, defined in config.c
+// NB: Bridge threads must not access this directly. See bridge_publish_config().
+extern config_t *               current_config;
 
 // Interface lists, defined in interface.c
 extern interface_t *            configured_interface_list;
@@ -180,11 +398,30 @@ extern unsigned int             ip_interface_count[NUM_IP_TYPES];
 //
 
 // Log for abnormal events
+// NB: Once the logging thread is started, messages are queued and written by
+//     the logging thread, and are rate limited by format.
 __attribute__ ((format (printf, 1, 2)))
 extern void logger(
     const char *       format,
     ...);
 
+// Log for abnormal events caused by a host
+extern void vlogger_host(
+    const socket_address_t *    address,
+    const char *                what,
+    const char *                format,
+    va_list                     args);
+
+// Set the log destination
+extern void logger_initialize(
+    unsigned int                use_syslog);
+
+// Start the logging thread
+extern void logger_start(void);
+
+// Write any queued log messages
+extern void logger_flush(void);
+
 // Fatal error
 __attribute__ ((noreturn, format (printf, 1, 2)))
 extern void fatal(
@@ -193,8 +430,17 @@ extern void fatal(
 
 // Config processing
 extern void read_config(void);
+extern void reload_config(void);
 extern void dump_config(void);
 
+// Serializes configuration destruction with readers outside the bridge threads
+extern pthread_mutex_t          config_mutex;
+
+// Create and destroy a configuration instance
+extern config_t * config_create(void);
+extern void config_destroy(
+    config_t *                  config);
+
 
 // Set the interface list
 extern unsigned int set_interface_list(
@@ -205,49 +451,138 @@ extern unsigned int set_interface_list(
 extern interface_t * get_interface_by_name(
     const char *                name);
 
+// Get the interfaces that match a name or pattern
+extern unsigned int get_interfaces_by_pattern(
+    const char *                pattern,
+    interface_t **              list);
+
 // Set the configured interface list
 extern void set_ip_interface_lists(void);
 
+// Build the peer lists and peer outbound filter lists for each interface
+extern void set_interface_peer_lists(
+    const config_t *            config,
+    ip_type_t                   ip_type);
+
+// Add an interface that has become active to the peer lists
+extern void add_interface_peer(
+    const config_t *            config,
+    interface_t *               interface,
+    ip_type_t                   ip_type);
+
+// Remove an interface that is no longer active from the peer lists
+extern void remove_interface_peer(
+    const config_t *            config,
+    interface_t *               interface,
+    ip_type_t                   ip_type);
+
 // Validate configured interfaces against the system interface list
 extern void os_validate_interfaces(void);
 
 // Initialize the socket infrastructure
 extern void os_initialize_sockets(void);
 
+// Dump the socket setup timing
+extern void os_dump_socket_timing(void);
+
+// Adopt a bound socket from another process
+extern int os_adopt_socket(
+    int                         sock,
+    const char *                name);
+
+// Adopt the sockets passed by a service manager (LISTEN_FDS)
+extern void os_adopt_listen_fds(void);
+
+// Receive a packet. Returns the number of bytes, or -1 on error. If the
+// kernel provided a receive timestamp, kernel_nsec is set to the time since
+// the kernel received the packet (at least 1), otherwise it is set to 0.
+extern ssize_t os_receive_packet(
+    int                         sock,
+    packet_t *                  packet,
+    uint64_t *                  kernel_nsec);
+
+// Callback for an interface that has been bound to a new socket, or whose
+// socket is about to be closed
+typedef void (* interface_bound_callback_t)(
+    interface_t *               interface,
+    void *                      arg);
+
+// Check interfaces with a pending check against the system interface list,
+// binding, closing or rebinding their sockets as required
+extern void os_check_interfaces(
+    const config_t *            config,
+    ip_type_t                   ip_type,
+    interface_bound_callback_t  bound_callback,
+    interface_bound_callback_t  unbound_callback,
+    void *                      arg);
+
+// Open a monitor for system interface and address changes
+extern int os_monitor_open(
+    ip_type_t                   ip_type);
+
+// Read interface change messages from the monitor, marking the interfaces
+// that require a check. Returns the number of interfaces marked.
+extern unsigned int os_monitor_read(
+    int                         monitor_fd,
+    ip_type_t                   ip_type);
+
 
 // Set the global filter list
 extern unsigned int set_global_filter_list(
+    config_t *                  config,
     const filter_allow_deny_t   allow_deny,
     char **                     list,
     unsigned int                count);
 
-// Set an interface inbound filter list
+// Set the inbound filter list for a set of interfaces
 extern unsigned int set_interface_inbound_filter_list(
-    interface_t *               interface,
+    config_t *                  config,
+    interface_t * const *       interfaces,
+    unsigned int                interface_count,
     filter_allow_deny_t         allow_deny,
     char **                     list,
     unsigned int                count);
 
-// Set an interface outbound filter list
+// Set the outbound filter list for a set of interfaces
 extern unsigned int set_interface_outbound_filter_list(
-    interface_t *               interface,
+    config_t *                  config,
+    interface_t * const *       interfaces,
+    unsigned int                interface_count,
     filter_allow_deny_t         allow_deny,
     char **                     list,
     unsigned int                count);
 
+// Create a filter list. The list of names is sorted, and duplicates are removed.
+extern filter_list_t * filter_list_create(
+    const filter_allow_deny_t   allow_deny,
+    char **                     list,
+    unsigned int                count);
+
+// Destroy a filter list
+extern void filter_list_destroy(
+   filter_list_t *              filter_list);
+
 // Check if an inbound name is allowed by the global and inbound interface filter lists
 extern unsigned int allowed_inbound(
+    const config_t *            config,
     const interface_t *         interface,
+    ip_type_t                   ip_type,
     const dns_name_t *          name);
 
 // Check if an inbound name is allowed by an outbound interface filter list
 unsigned int allowed_outbound(
     const filter_list_t *       filter_list,
+    ip_type_t                   ip_type,
     const dns_name_t *          name);
 
 
 // Create the internal DNS decode state structure
-extern dns_state_t dns_state_create(void);
+extern dns_state_t dns_state_create(
+    ip_type_t                   ip_type);
+
+// Check if a string is a valid DNS match name
+extern unsigned int dns_valid_match_name(
+    const char *                string);
 
 // Save a string as a DNS match name
 extern const dns_match_name_t * dns_save_match_name(
@@ -268,6 +603,7 @@ extern void dns_labels_to_string(
 extern unsigned int dns_decode_packet(
     dns_state_t *               dns_state,
     const packet_t *            recv_packet,
+    const config_t *            config,
     const interface_t *         interface);
 
 // Encode a DNS packet with outbound filtering
@@ -277,12 +613,223 @@ extern unsigned int dns_encode_packet(
     packet_t *                  send_packet,
     const filter_list_t *       send_filter_list);
 
-// Create a new DNS packet with outbound filtering
+// Decode a DNS packet without filtering (for tools)
 extern unsigned int test_dns_packet_decode(
     const packet_t *            packet);
 
 
+// Get the current monotonic time in timer ticks
+extern uint64_t timer_clock_ticks(void);
+
+// Initialize a timer wheel
+extern void timer_wheel_init(
+    timer_wheel_t *             wheel);
+
+// Process timer wheel expirations (called when the wheel fd is readable)
+extern void timer_wheel_run(
+    timer_wheel_t *             wheel);
+
+// Start (or restart) a timer
+extern void timer_start(
+    timer_wheel_t *             wheel,
+    wheel_timer_t *             timer,
+    unsigned int                msec,
+    timer_callback_t            callback,
+    void *                      arg);
+
+// Stop a timer
+extern void timer_stop(
+    timer_wheel_t *             wheel,
+    wheel_timer_t *             timer);
+
+// Check if a timer is pending
+#define timer_pending(timer)    ((timer)->prev != NULL)
+
+
 // The main bridge loops
 extern void start_bridges(void);
 
+// Publish a new configuration to the bridge threads
+// NB: Returns once all bridge threads have adopted the new configuration,
+//     after which the previous configuration may be destroyed.
+extern void bridge_publish_config(
+    config_t *                  config);
+
+
+// Allocate the statistics
+extern void stats_initialize(void);
+
+// Read the monotonic clock used for latency, in nanoseconds
+extern uint64_t stats_latency_clock(void);
+
+// Record a latency in a histogram
+// NB: Each histogram is only written by a single bridge thread.
+extern void stats_latency_record(
+    latency_histogram_t *       histogram,
+    uint64_t                    nsec);
+
+// Service type accounting
+#define TOPK_SIZE               8       // Service types tracked per interface and ip type
+#define TOPK_MAX_SERVICES       8       // Service types accounted per packet
+
+// Service type accounting entry
+typedef struct
+{
+    char                        name[DNS_MAX_LABEL_LEN];
+    uint64_t                    packets;
+    uint64_t                    bytes;
+} topk_entry_t;
+
+// Allocate the service type accounting
+extern void topk_initialize(void);
+
+// Record a packet for the service types it contains
+// NB: Only called by the bridge thread for the ip type.
+extern void topk_record(
+    ip_type_t                   ip_type,
+    unsigned int                interface_index,
+    const char                  services[][DNS_MAX_LABEL_LEN],
+    unsigned int                count,
+    unsigned int                bytes);
+
+// Read the top service types for an interface, sorted by bytes. Returns the
+// number of entries.
+extern unsigned int topk_read(
+    unsigned int                interface_index,
+    topk_entry_t                entries[NUM_IP_TYPES * TOPK_SIZE]);
+
+// Service inventory entry
+typedef struct
+{
+    unsigned int                interface_index;
+    unsigned int                type;
+    uint32_t                    ttl;
+    uint32_t                    age;            // Seconds since the record was last seen
+    char                        owner[DNS_MAX_NAME_LEN];
+    char                        target[DNS_MAX_NAME_LEN];
+} inventory_entry_t;
+
+// Default maximum number of service inventory records for each ip type
+#define INVENTORY_DEFAULT_SIZE  1536
+
+// Allocate the service inventory, with a maximum number of records for each ip type
+extern void inventory_initialize(
+    unsigned int                size);
+
+// Read the clock used for the inventory, in seconds
+extern uint32_t inventory_clock(void);
+
+// Record a resource record seen on an interface
+// NB: Only called by the bridge thread for the ip type.
+extern void inventory_record(
+    ip_type_t                   ip_type,
+    unsigned int                interface_index,
+    unsigned int                type,
+    const unsigned char *       owner,
+    unsigned int                owner_len,
+    const unsigned char *       target,
+    unsigned int                target_len,
+    uint32_t                    ttl,
+    uint32_t                    now);
+
+// Read the service inventory, sorted by interface, owner, type and target.
+// Returns the number of entries, an allocated array of entries, and the
+// number of records that have expired or been evicted.
+extern unsigned int inventory_read(
+    inventory_entry_t **        entries,
+    uint64_t *                  expired,
+    uint64_t *                  evicted);
+
+// Statistics formats
+typedef enum
+{
+    STATS_FORMAT_TEXT           = 0,
+    STATS_FORMAT_JSON           = 1,
+    STATS_FORMAT_PROMETHEUS     = 2
+} stats_format_t;
+
+// Format the statistics. Returns an allocated string.
+extern char * stats_format(
+    stats_format_t              format);
+
+// Format the service inventory. Returns an allocated string.
+extern char * stats_format_inventory(void);
+
+// Format the filter list names and their matches in the filter window. If
+// unused is set, only names without matches in the window are listed.
+// Returns an allocated string.
+extern char * stats_format_filters(
+    unsigned int                unused);
+
+// Start a new filter window
+extern void stats_filter_window_start(void);
+
+// Packet tap record kinds
+typedef enum
+{
+    TAP_INGRESS                 = 0,    // Packet as received
+    TAP_EGRESS_INBOUND          = 1,    // Packet encoded after inbound filtering
+    TAP_EGRESS_OUTBOUND         = 2     // Packet encoded for an outbound filter list
+} tap_kind_t;
+
+// Packet tap verdicts
+typedef enum
+{
+    TAP_FORWARDED               = 0,    // The packet was forwarded
+    TAP_DROPPED                 = 1     // The packet was dropped, or everything was filtered
+} tap_verdict_t;
+
+// Packet tap state, defined in tap.c
+// NB: Read by the bridge threads with a relaxed load before each tap.
+extern unsigned int             tap_enabled;
+#define TAP_ENABLED()           __atomic_load_n(&tap_enabled, __ATOMIC_RELAXED)
+
+// Queue a packet for the tap
+// NB: Only called by the bridge thread for the ip type. Never blocks.
+extern void tap_packet(
+    ip_type_t                   ip_type,
+    const interface_t *         interface,
+    tap_kind_t                  kind,
+    const filter_list_t *       filter_list,
+    tap_verdict_t               verdict,
+    const packet_t *            packet);
+
+// Start the packet tap. Returns NULL on success, or an error message.
+extern const char * tap_start(
+    unsigned int                file_megabytes,
+    unsigned int                file_count);
+
+// Stop the packet tap
+extern void tap_stop(void);
+
+// Format the packet tap status. Returns an allocated string.
+extern char * tap_status(void);
+
+
+// Start the control socket and metrics listener (if configured)
+extern void control_start(void);
+
+// Remove the control socket and metrics listener unix sockets
+extern void control_cleanup(void);
+
+// Get the TCP metrics listener to hand off to a new process (-1 if none)
+extern int control_metrics_listener(void);
+
+// Use a TCP metrics listener received by handoff from a previous process
+extern void control_adopt_metrics_listener(
+    int                         fd);
+
+
+// Hand the interface sockets off to a new process. Returns if the handoff fails.
+extern void handoff_start(
+    char * const                argv[]);
+
+// Receive the interface sockets from a previous process. Returns the
+// handoff socket, or -1 if the process was not started by a handoff.
+extern int handoff_receive(void);
+
+// Confirm to the previous process that this process is running
+extern void handoff_complete(
+    int                         fd);
+
 #endif // _COMMON_H
@@ -31,8 +31,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
 #include <ctype.h>
 
+#include <errno.h>
+
 #include "common.h"
 
 
@@ -43,27 +47,159 @@
 // Global section
 #define GLOBAL_SECTION                  "[global]"
 
-// Keys specific to the global section
+// Prefixes for group and policy section names
+#define GROUP_SECTION_PREFIX            "group:"
+#define POLICY_SECTION_PREFIX           "policy:"
+
+// Keys specific to the global and group sections
 #define KEY_INTERFACES                  "interfaces"
 #define KEY_DISABLE_PACKET_FILTERING 	"disable-packet-filtering"
+#define KEY_CONTROL_SOCKET              "control-socket"
+#define KEY_METRICS_LISTEN              "metrics-listen"
+#define KEY_TAP_FILE                    "tap-file"
+#define KEY_INVENTORY_SIZE              "inventory-size"
+
+// Limits of the inventory size
+#define INVENTORY_SIZE_MIN              64
+#define INVENTORY_SIZE_MAX              1048576
 
 // Keys common to global and interface sections
 #define KEY_DISABLE_IPV4                "disable-ipv4"
 #define KEY_DISABLE_IPV6                "disable-ipv6"
 
-// Keys specific tointerface sections
+// Keys specific to interface and group sections
 #define KEY_ALLOW_INBOUND_FILTERS     	"allow-inbound-filters"
 #define KEY_DENY_INBOUND_FILTERS      	"deny-inbound-filters"
 #define KEY_ALLOW_OUTBOUND_FILTERS    	"allow-outbound-filters"
 #define KEY_DENY_OUTBOUND_FILTERS     	"deny-outbound-filters"
+#define KEY_DOMAINS                     "domains"
+
+// Keys specific to policy sections
+#define KEY_FROM                        "from"
+#define KEY_TO                          "to"
+#define KEY_FORWARD                     "forward"
 
-// Global config flags
-static unsigned int                     global_disable_ipv4 = 0;
-static unsigned int                     global_disable_ipv6 = 0;
+// Values for the forward key
+#define FORWARD_ALL                     "all"
+#define FORWARD_QUERIES                 "queries"
+#define FORWARD_RESPONSES               "responses"
+#define FORWARD_SOLICITED_RESPONSES     "solicited-responses"
 
-// Current configuration line
+// Current configuration
+config_t *                              current_config = NULL;
+pthread_mutex_t                         config_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Generation of the most recently created configuration
+static unsigned int                     config_generation = 0;
+
+// Current configuration file and line
+static FILE *                           config_fp = NULL;
 static unsigned int                     config_lineno = 0;
 
+// Configuration reload state
+static unsigned int                     config_reloading = 0;
+static jmp_buf                          config_reload_env;
+
+// The interface list as specified in the config file, sorted
+static char **                          interface_spec = NULL;
+static unsigned int                     interface_spec_count = 0;
+
+// Working storage for the interfaces of a section
+// NB: These are sized by the configured interface count, which does not change
+static interface_t **                   section_interfaces = NULL;
+static interface_t **                   policy_interfaces = NULL;
+static interface_t **                   pattern_interfaces = NULL;
+static unsigned char *                  section_seen = NULL;
+
+
+
+//
+// Report a configuration error
+//
+//   NOTE: During a reload, this returns to reload_config() rather than exiting
+//
+__attribute__ ((noreturn, format (printf, 1, 2)))
+static void config_error(
+    const char *                format,
+    ...)
+{
+    char                        error_str[1024];
+    va_list                     args;
+
+    va_start(args, format);
+    vsnprintf(error_str, sizeof(error_str), format, args);
+    va_end(args);
+
+    if (config_reloading)
+    {
+        logger("%s", error_str);
+        longjmp(config_reload_env, 1);
+    }
+
+    fatal("%s", error_str);
+}
+
+
+//
+// Create a configuration instance
+//
+config_t * config_create(void)
+{
+    config_t *                  config;
+
+    config = calloc(1, sizeof(config_t));
+    if (config == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+
+    config_generation += 1;
+    config->generation = config_generation;
+    config->load_ticks = timer_clock_ticks();
+    config->filtering_enabled = 1;
+    config->inventory_size = INVENTORY_DEFAULT_SIZE;
+
+    return config;
+}
+
+
+//
+// Destroy a configuration instance
+//
+void config_destroy(
+    config_t *                  config)
+{
+    unsigned int                index;
+
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_list_destroy(config->filter_lists[index]);
+    }
+
+    for (index = 0; index < config->domain_count; index++)
+    {
+        free(config->domain_names[index]);
+    }
+
+    free(config->control_socket);
+    free(config->metrics_listen);
+    free(config->tap_file);
+    free(config->policy_matrix);
+    free(config->filter_lists);
+    free(config->interface_config);
+    free(config);
+}
+
+
+//
+// Compare two strings for sort
+//
+static int qsort_strcmp(
+    const void *                p1,
+    const void *                p2)
+{
+    return strcmp(*(const char **) p1, *(const char **) p2);
+}
 
 
 //
@@ -110,7 +246,7 @@ static char * split_keyvalue(
     value = strchr(line, '=');
     if (value == NULL)
     {
-        fatal("%s line %d: Syntax error - missing assignment\n", config_filename, config_lineno);
+        config_error("%s line %d: Syntax error - missing assignment\n", config_filename, config_lineno);
     }
     *value = 0;
 
@@ -118,7 +254,7 @@ static char * split_keyvalue(
     value = trim_leading_whitespace(value + 1);
     if (*value == 0)
     {
-        fatal("%s line %d: Syntax error - missing value\n", config_filename, config_lineno);
+        config_error("%s line %d: Syntax error - missing value\n", config_filename, config_lineno);
     }
 
     // Trim the key
@@ -147,7 +283,7 @@ static unsigned int split_comma_list(
         {
             if (index + 1 >= MAX_LIST_ARRAY)
             {
-                fatal("%s line %d: Invalid list - elements exceed max allowed (%u)\n", config_filename, config_lineno, MAX_LIST_ARRAY);
+                config_error("%s line %d: Invalid list - elements exceed max allowed (%u)\n", config_filename, config_lineno, MAX_LIST_ARRAY);
             }
 
             // Terminate the current element
@@ -157,14 +293,14 @@ static unsigned int split_comma_list(
             // Ensure the current element is not empty
             if (array[index] == str)
             {
-                fatal("%s line %d: Invalid list - empty element\n", config_filename, config_lineno);
+                config_error("%s line %d: Invalid list - empty element\n", config_filename, config_lineno);
             }
 
             // Insure the next element is not empty
             str = trim_leading_whitespace(str + 1);
             if (*str == 0)
             {
-                fatal("%s line %d: Invalid list - empty element\n", config_filename, config_lineno);
+                config_error("%s line %d: Invalid list - empty element\n", config_filename, config_lineno);
             }
 
             // Add the new element to the array
@@ -181,6 +317,30 @@ static unsigned int split_comma_list(
 }
 
 
+//
+// Convert a comma separated list of filters into an array, validating each filter
+// NB: The array MUST be at least MAX_LIST_ARRAY in size
+//
+static unsigned int split_filter_list(
+    char *                      str,
+    char **                     array)
+{
+    unsigned int                count;
+    unsigned int                index;
+
+    count = split_comma_list(str, array);
+    for (index = 0; index < count; index++)
+    {
+        if (dns_valid_match_name(array[index]) == 0)
+        {
+            config_error("%s line %d: Invalid filter \"%s\"\n", config_filename, config_lineno, array[index]);
+        }
+    }
+
+    return count;
+}
+
+
 //
 // Read a line from the config file
 // NB: The buffer MUST be at least MAX_INPUT_LINE in size
@@ -213,33 +373,471 @@ static char * read_line(
 }
 
 
+//
+// Save the interface list as specified in the config file
+//
+static void save_interface_spec(
+    char **                     list,
+    unsigned int                count)
+{
+    unsigned int                index;
+
+    interface_spec = calloc(count, sizeof(char *));
+    if (interface_spec == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        interface_spec[index] = strdup(list[index]);
+        if (interface_spec[index] == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+    }
+    qsort(interface_spec, count, sizeof(char *), qsort_strcmp);
+    interface_spec_count = count;
+}
+
+
+//
+// Check a reloaded interface list against the interface list specified at startup
+//
+//   NOTE: Patterns are compared as written rather than expanded, so a reload
+//         does not pick up new interfaces that match a pattern.
+//
+static void check_interface_list(
+    char **                     list,
+    unsigned int                count)
+{
+    unsigned int                index;
+
+    if (count != interface_spec_count)
+    {
+        config_error("%s line %d: Changes to the interface list require a restart\n", config_filename, config_lineno);
+    }
+
+    qsort(list, count, sizeof(char *), qsort_strcmp);
+    for (index = 0; index < count; index++)
+    {
+        if (strcmp(list[index], interface_spec[index]) != 0)
+        {
+            config_error("%s line %d: Changes to the interface list require a restart\n", config_filename, config_lineno);
+        }
+    }
+}
+
+
+//
+// Get the mask for a forwarding domain, adding the domain if it does not exist
+//
+static domain_mask_t get_domain(
+    config_t *                  config,
+    const char *                name)
+{
+    unsigned int                index;
+
+    for (index = 0; index < config->domain_count; index++)
+    {
+        if (strcmp(name, config->domain_names[index]) == 0)
+        {
+            return (domain_mask_t) 1 << index;
+        }
+    }
+
+    if (config->domain_count >= MAX_DOMAINS)
+    {
+        config_error("%s line %d: Too many domains (max %u)\n", config_filename, config_lineno, MAX_DOMAINS);
+    }
+
+    config->domain_names[index] = strdup(name);
+    if (config->domain_names[index] == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    config->domain_count += 1;
+
+    return (domain_mask_t) 1 << index;
+}
+
+
+//
+// Build a list of interfaces from a list of names and patterns
+//
+//   NOTE: The interfaces array MUST be at least configured_interface_count in size.
+//
+static unsigned int build_section_interfaces(
+    char **                     list,
+    unsigned int                count,
+    interface_t **              interfaces)
+{
+    interface_t *               interface;
+    unsigned int                section_count = 0;
+    unsigned int                pattern_count;
+    unsigned int                index;
+    unsigned int                i;
+
+    for (index = 0; index < count; index++)
+    {
+        pattern_count = get_interfaces_by_pattern(list[index], pattern_interfaces);
+        if (pattern_count == 0)
+        {
+            if (strpbrk(list[index], "*?[") == NULL)
+            {
+                config_error("%s line %d: Interface \"%s\" is not in the [global] interfaces list\n", config_filename, config_lineno, list[index]);
+            }
+            logger("%s line %d: Interface pattern \"%s\" does not match any interfaces\n", config_filename, config_lineno, list[index]);
+            continue;
+        }
+
+        // Add the interfaces that are not already in the section
+        for (i = 0; i < pattern_count; i++)
+        {
+            interface = pattern_interfaces[i];
+            if (section_seen[interface->index] == 0)
+            {
+                section_seen[interface->index] = 1;
+                interfaces[section_count] = interface;
+                section_count += 1;
+            }
+        }
+    }
+
+    // Reset the seen flags for the next list
+    for (index = 0; index < section_count; index++)
+    {
+        section_seen[interfaces[index]->index] = 0;
+    }
+
+    return section_count;
+}
+
+
+//
+// Process a parameter for a set of interfaces (an interface or group section)
+//
+//   Returns 0 if the parameter is unknown.
+//
+static unsigned int parse_interface_parameter(
+    config_t *                  config,
+    interface_t **              interfaces,
+    unsigned int                interface_count,
+    const char *                key,
+    char *                      value)
+{
+    char *                      list_array[MAX_LIST_ARRAY];
+    unsigned int                list_array_count;
+    domain_mask_t               domains;
+    unsigned int                index;
+
+    if (strcmp(key, KEY_DISABLE_IPV4) == 0)
+    {
+        if (strcmp(value, "yes") == 0)
+        {
+            for (index = 0; index < interface_count; index++)
+            {
+                config->interface_config[interfaces[index]->index].disable_ip[IPV4] = 1;
+            }
+        }
+        else if (strcmp(value, "no") == 0)
+        {
+            if (config->disable_ip[IPV4])
+            {
+                config_error("%s line %d: IPv4 is globally disabled\n", config_filename, config_lineno);
+            }
+            for (index = 0; index < interface_count; index++)
+            {
+                config->interface_config[interfaces[index]->index].disable_ip[IPV4] = 0;
+            }
+        }
+        else
+        {
+            config_error("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV4, value);
+        }
+    }
+    else if (strcmp(key, KEY_DISABLE_IPV6) == 0)
+    {
+        if (strcmp(value, "yes") == 0)
+        {
+            for (index = 0; index < interface_count; index++)
+            {
+                config->interface_config[interfaces[index]->index].disable_ip[IPV6] = 1;
+            }
+        }
+        else if (strcmp(value, "no") == 0)
+        {
+            if (config->disable_ip[IPV6])
+            {
+                config_error("%s line %d: IPv6 is globally disabled\n", config_filename, config_lineno);
+            }
+            for (index = 0; index < interface_count; index++)
+            {
+                config->interface_config[interfaces[index]->index].disable_ip[IPV6] = 0;
+            }
+        }
+        else
+        {
+            config_error("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV6, value);
+        }
+    }
+    else if (strcmp(key, KEY_ALLOW_INBOUND_FILTERS) == 0)
+    {
+        if (config->filtering_enabled == 0)
+        {
+            config_error("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
+                  KEY_ALLOW_INBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
+        }
+
+        list_array_count = split_filter_list(value, list_array);
+        if (set_interface_inbound_filter_list(config, interfaces, interface_count, ALLOW, list_array, list_array_count))
+        {
+            config_error("%s line %d: Only one inbound filter list per interface is allowed\n", config_filename, config_lineno);
+        }
+    }
+    else if (strcmp(key, KEY_DENY_INBOUND_FILTERS) == 0)
+    {
+        if (config->filtering_enabled == 0)
+        {
+            config_error("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
+                  KEY_DENY_INBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
+        }
+
+        list_array_count = split_filter_list(value, list_array);
+        if (set_interface_inbound_filter_list(config, interfaces, interface_count, DENY, list_array, list_array_count))
+        {
+            config_error("%s line %d: Only one inbound filter list per interface is allowed\n", config_filename, config_lineno);
+        }
+    }
+    else if (strcmp(key, KEY_ALLOW_OUTBOUND_FILTERS) == 0)
+    {
+        if (config->filtering_enabled == 0)
+        {
+            config_error("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
+                  KEY_ALLOW_OUTBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
+        }
+
+        list_array_count = split_filter_list(value, list_array);
+        if (set_interface_outbound_filter_list(config, interfaces, interface_count, ALLOW, list_array, list_array_count))
+        {
+            config_error("%s line %d: Only one outbound filter list per interface is allowed\n", config_filename, config_lineno);
+        }
+    }
+    else if (strcmp(key, KEY_DENY_OUTBOUND_FILTERS) == 0)
+    {
+        if (config->filtering_enabled == 0)
+        {
+            config_error("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
+                  KEY_DENY_OUTBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
+        }
+
+        list_array_count = split_filter_list(value, list_array);
+        if (set_interface_outbound_filter_list(config, interfaces, interface_count, DENY, list_array, list_array_count))
+        {
+            config_error("%s line %d: Only one outbound filter list per interface is allowed\n", config_filename, config_lineno);
+        }
+    }
+    else if (strcmp(key, KEY_DOMAINS) == 0)
+    {
+        // NB: Domains are cumulative across the sections an interface appears in
+        list_array_count = split_comma_list(value, list_array);
+        domains = 0;
+        for (index = 0; index < list_array_count; index++)
+        {
+            domains |= get_domain(config, list_array[index]);
+        }
+        for (index = 0; index < interface_count; index++)
+        {
+            config->interface_config[interfaces[index]->index].domains |= domains;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+//
+// Set a string parameter
+//
+static void set_string_parameter(
+    char **                     parameter,
+    const char *                key,
+    const char *                value)
+{
+    if (*parameter)
+    {
+        config_error("%s line %d: Only one %s parameter is allowed\n", config_filename, config_lineno, key);
+    }
+    if (*value == 0)
+    {
+        config_error("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, key, value);
+    }
+
+    *parameter = strdup(value);
+    if (*parameter == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+}
+
+
+//
+// Process the parameters of a policy section
+//
+//   Returns the line following the section.
+//
+static char * parse_policy_section(
+    config_t *                  config,
+    FILE *                      fp,
+    char *                      buffer)
+{
+    char *                      list_array[MAX_LIST_ARRAY];
+    unsigned int                list_array_count;
+    unsigned int                from_count = 0;
+    unsigned int                to_count = 0;
+    unsigned int                from_found = 0;
+    unsigned int                to_found = 0;
+    unsigned int                policy = 0;
+    unsigned int                from;
+    unsigned int                to;
+    char *                      line;
+    char *                      value;
+
+    while ((line = read_line(fp, buffer)))
+    {
+        if (*line == '[')
+        {
+            break;
+        }
+
+        // Split the key/value pair
+        value = split_keyvalue(line);
+
+        if (strcmp(line, KEY_FROM) == 0)
+        {
+            if (from_found)
+            {
+                config_error("%s line %d: Only one %s parameter per policy is allowed\n", config_filename, config_lineno, KEY_FROM);
+            }
+            list_array_count = split_comma_list(value, list_array);
+            from_count = build_section_interfaces(list_array, list_array_count, section_interfaces);
+            from_found = 1;
+        }
+        else if (strcmp(line, KEY_TO) == 0)
+        {
+            if (to_found)
+            {
+                config_error("%s line %d: Only one %s parameter per policy is allowed\n", config_filename, config_lineno, KEY_TO);
+            }
+            list_array_count = split_comma_list(value, list_array);
+            to_count = build_section_interfaces(list_array, list_array_count, policy_interfaces);
+            to_found = 1;
+        }
+        else if (strcmp(line, KEY_FORWARD) == 0)
+        {
+            if (policy)
+            {
+                config_error("%s line %d: Only one %s parameter per policy is allowed\n", config_filename, config_lineno, KEY_FORWARD);
+            }
+            if (strcmp(value, FORWARD_ALL) == 0)
+            {
+                policy = POLICY_ALL;
+            }
+            else if (strcmp(value, FORWARD_QUERIES) == 0)
+            {
+                policy = POLICY_QUERIES;
+            }
+            else if (strcmp(value, FORWARD_RESPONSES) == 0)
+            {
+                policy = POLICY_RESPONSES;
+            }
+            else if (strcmp(value, FORWARD_SOLICITED_RESPONSES) == 0)
+            {
+                policy = POLICY_SOLICITED;
+            }
+            else
+            {
+                config_error("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_FORWARD, value);
+            }
+        }
+        else
+        {
+            config_error("%s line %d: Unknown policy parameter \"%s\"\n", config_filename, config_lineno, line);
+        }
+    }
+
+    if (from_found == 0 || to_found == 0 || policy == 0)
+    {
+        config_error("%s line %d: Policy section requires parameters \"%s\", \"%s\" and \"%s\"\n", config_filename, config_lineno,
+                     KEY_FROM, KEY_TO, KEY_FORWARD);
+    }
+
+    // Allocate the policy matrix on first use
+    if (config->policy_matrix == NULL)
+    {
+        config->policy_matrix = malloc(configured_interface_count * configured_interface_count);
+        if (config->policy_matrix == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        memset(config->policy_matrix, POLICY_ALL, configured_interface_count * configured_interface_count);
+    }
+
+    // Apply the policy
+    // NB: Later policies override earlier ones
+    for (from = 0; from < from_count; from++)
+    {
+        for (to = 0; to < to_count; to++)
+        {
+            config->policy_matrix[section_interfaces[from]->index * configured_interface_count + policy_interfaces[to]->index] = policy;
+        }
+    }
+    if (policy & POLICY_SOLICITED)
+    {
+        config->policy_solicited = 1;
+    }
+
+    return line;
+}
+
+
 //
 // Read and process the config file
 //
-void read_config(void)
+static void parse_config(
+    config_t *                  config)
 {
     FILE *                      fp;
     char                        buffer[MAX_INPUT_LINE];
     char *                      list_array[MAX_LIST_ARRAY];
     unsigned int                list_array_count;
     interface_t *               interface;
+    const char *                section_type;
+    unsigned int                section_count;
     char *                      line;
     char *                      value;
+    unsigned int                interfaces_found = 0;
     unsigned int                offset;
     unsigned int                index;
 
     // Open the config file
+    config_lineno = 0;
     fp = fopen(config_filename, "r");
     if (fp == NULL)
     {
-        fatal("Unable to open config file \"%s\"\n", config_filename);
+        config_error("Unable to open config file \"%s\"\n", config_filename);
     }
+    config_fp = fp;
 
     // Ensure the global section is the first section in the config file
     line = read_line(fp, buffer);
     if ((line == NULL) || strcmp(line, GLOBAL_SECTION) != 0)
     {
-        fatal("%s: File does not contain [global] as the first section\n", config_filename);
+        config_error("%s: File does not contain [global] as the first section\n", config_filename);
     }
 
     // Process the lines in the global section
@@ -256,154 +854,250 @@ void read_config(void)
         if (strcmp(line, KEY_INTERFACES) == 0)
         {
             list_array_count = split_comma_list(value, list_array);
-            if (list_array_count < 2)
+
+            if (interfaces_found)
             {
-                fatal("%s line %d: A minimum of 2 interfaces are required\n", config_filename, config_lineno);
+                config_error("%s line %d: Only one interface list is allowed\n", config_filename, config_lineno);
             }
+            interfaces_found = 1;
 
-            if (set_interface_list(list_array, list_array_count))
+            if (config_reloading)
+            {
+                check_interface_list(list_array, list_array_count);
+            }
+            else
             {
-                fatal("%s line %d: Only one interface list is allowed\n", config_filename, config_lineno);
+                save_interface_spec(list_array, list_array_count);
+                if (set_interface_list(list_array, list_array_count))
+                {
+                    config_error("%s line %d: Only one interface list is allowed\n", config_filename, config_lineno);
+                }
+                if (configured_interface_count < 2)
+                {
+                    config_error("%s line %d: A minimum of 2 interfaces are required\n", config_filename, config_lineno);
+                }
             }
         }
+        else if (strcmp(line, KEY_CONTROL_SOCKET) == 0)
+        {
+            set_string_parameter(&config->control_socket, KEY_CONTROL_SOCKET, value);
+        }
+        else if (strcmp(line, KEY_METRICS_LISTEN) == 0)
+        {
+            set_string_parameter(&config->metrics_listen, KEY_METRICS_LISTEN, value);
+        }
+        else if (strcmp(line, KEY_TAP_FILE) == 0)
+        {
+            set_string_parameter(&config->tap_file, KEY_TAP_FILE, value);
+        }
+        else if (strcmp(line, KEY_INVENTORY_SIZE) == 0)
+        {
+            char *              end;
+            unsigned long       size;
+
+            errno = 0;
+            size = strtoul(value, &end, 10);
+            if (errno || end == value || *end != 0 || !isdigit((unsigned char) value[0]) ||
+                size < INVENTORY_SIZE_MIN || size > INVENTORY_SIZE_MAX)
+            {
+                config_error("%s line %d: Invalid value for %s \"%s\" (%d to %d)\n", config_filename, config_lineno,
+                      KEY_INVENTORY_SIZE, value, INVENTORY_SIZE_MIN, INVENTORY_SIZE_MAX);
+            }
+            config->inventory_size = (unsigned int) size;
+        }
         else if (strcmp(line, KEY_DISABLE_IPV4) == 0)
         {
             if (strcmp(value, "yes") == 0)
             {
-                global_disable_ipv4 = 1;
+                config->disable_ip[IPV4] = 1;
             }
             else if (strcmp(value, "no") == 0)
             {
-                global_disable_ipv4 = 0;
+                config->disable_ip[IPV4] = 0;
             }
             else
             {
-                fatal("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV4, value);
+                config_error("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV4, value);
             }
         }
         else if (strcmp(line, KEY_DISABLE_IPV6) == 0)
         {
             if (strcmp(value, "yes") == 0)
             {
-                global_disable_ipv6 = 1;
+                config->disable_ip[IPV6] = 1;
             }
             else if (strcmp(value, "no") == 0)
             {
-                global_disable_ipv6 = 0;
+                config->disable_ip[IPV6] = 0;
             }
             else
             {
-                fatal("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV6, value);
+                config_error("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV6, value);
             }
         }
         else if (strcmp(line, KEY_DISABLE_PACKET_FILTERING) == 0)
         {
             if (strcmp(value, "yes") == 0)
             {
-                if (global_filter_list)
+                if (config->global_filter_list)
                 {
-                    fatal("%s line %d: %s cannot be combined with %s or %s\n", config_filename, config_lineno,
+                    config_error("%s line %d: %s cannot be combined with %s or %s\n", config_filename, config_lineno,
                           KEY_DISABLE_PACKET_FILTERING, KEY_ALLOW_INBOUND_FILTERS, KEY_DENY_INBOUND_FILTERS);
                 }
 
-                filtering_enabled = 0;
+                config->filtering_enabled = 0;
             }
             else if (strcmp(value, "no") == 0)
             {
-                filtering_enabled = 1;
+                config->filtering_enabled = 1;
             }
             else
             {
-                fatal("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno,
+                config_error("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno,
                       KEY_DISABLE_PACKET_FILTERING, value);
             }
         }
         else if (strcmp(line, KEY_ALLOW_INBOUND_FILTERS) == 0)
         {
-            if (filtering_enabled == 0)
+            if (config->filtering_enabled == 0)
             {
-                fatal("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
+                config_error("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
                       KEY_ALLOW_INBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
             }
-            list_array_count = split_comma_list(value, list_array);
-            if (set_global_filter_list(ALLOW, list_array, list_array_count))
+            list_array_count = split_filter_list(value, list_array);
+            if (set_global_filter_list(config, ALLOW, list_array, list_array_count))
             {
-                fatal("%s line %d: Only one global filter list is allowed\n", config_filename, config_lineno);
+                config_error("%s line %d: Only one global filter list is allowed\n", config_filename, config_lineno);
             }
         }
         else if (strcmp(line, KEY_DENY_INBOUND_FILTERS) == 0)
         {
-            if (filtering_enabled == 0)
+            if (config->filtering_enabled == 0)
             {
-                fatal("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
+                config_error("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
                       KEY_DENY_INBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
             }
-            list_array_count = split_comma_list(value, list_array);
-            if (set_global_filter_list(DENY, list_array, list_array_count))
+            list_array_count = split_filter_list(value, list_array);
+            if (set_global_filter_list(config, DENY, list_array, list_array_count))
             {
-                fatal("%s line %d: Only one global filter list is allowed\n", config_filename, config_lineno);
+                config_error("%s line %d: Only one global filter list is allowed\n", config_filename, config_lineno);
             }
         }
         else
         {
-            fatal("%s line %d: Unknown [global] parameter \"%s\"\n", config_filename, config_lineno, line);
+            config_error("%s line %d: Unknown [global] parameter \"%s\"\n", config_filename, config_lineno, line);
         }
     }
 
 
     // Ensure we found an interface list
-    if (configured_interface_list == NULL)
+    if (interfaces_found == 0)
     {
-        fatal("%s: [global] section missing required parameter \"%s\"\n", config_filename, KEY_INTERFACES);
+        config_error("%s: [global] section missing required parameter \"%s\"\n", config_filename, KEY_INTERFACES);
+    }
+
+    // Allocate the interface settings
+    config->interface_config = calloc(configured_interface_count, sizeof(interface_config_t));
+    if (config->interface_config == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
     }
 
     // Initialize the interface IP settings to match global settings
-    if (global_disable_ipv4)
+    for (index = 0; index < configured_interface_count; index++)
     {
-        for (index = 0; index < configured_interface_count; index++)
-        {
-            configured_interface_list[index].disable_ip[IPV4] = 1;
-        }
+        config->interface_config[index].disable_ip[IPV4] = config->disable_ip[IPV4];
+        config->interface_config[index].disable_ip[IPV6] = config->disable_ip[IPV6];
     }
-    if (global_disable_ipv6)
+
+    // Allocate the working storage for sections
+    if (section_interfaces == NULL)
     {
-        for (index = 0; index < configured_interface_count; index++)
+        section_interfaces = calloc(configured_interface_count, sizeof(interface_t *));
+        policy_interfaces = calloc(configured_interface_count, sizeof(interface_t *));
+        pattern_interfaces = calloc(configured_interface_count, sizeof(interface_t *));
+        section_seen = calloc(configured_interface_count, sizeof(unsigned char));
+        if (section_interfaces == NULL || policy_interfaces == NULL || pattern_interfaces == NULL || section_seen == NULL)
         {
-            configured_interface_list[index].disable_ip[IPV6] = 1;
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
         }
     }
 
-    // Process lines in interface sections
+    // NB: A failed reload may have left seen flags set (config_error does not return)
+    memset(section_seen, 0, configured_interface_count * sizeof(unsigned char));
+
+    // Process lines in interface, group and policy sections
     while (line && line[0] == '[')
     {
         // Ignore leading whitespace
         line = trim_leading_whitespace(line + 1);
 
-        // Ensure the section name (interface name)is terminated
+        // Ensure the section name is terminated
         offset = strlen(line) - 1;
         if (line[offset] != ']')
         {
-            fatal("%s line %d: Syntax error\n", config_filename, config_lineno);
+            config_error("%s line %d: Syntax error\n", config_filename, config_lineno);
         }
         line[offset] = 0;
 
         // Ignore trailing whitespace
         trim_trailing_whitespace(line);
 
-        // Insure the interface name is valid
+        // Insure the section name is valid
         if (strlen(line) == 0 || strpbrk(line, "[]") != NULL)
         {
-            fatal("%s line %d: Syntax error\n", config_filename, config_lineno);
+            config_error("%s line %d: Syntax error\n", config_filename, config_lineno);
         }
 
-        // Find the interface
-        interface = get_interface_by_name(line);
-        if (interface == NULL)
+        if (strncmp(line, POLICY_SECTION_PREFIX, strlen(POLICY_SECTION_PREFIX)) == 0)
+        {
+            // Ensure the policy has a name
+            if (*trim_leading_whitespace(line + strlen(POLICY_SECTION_PREFIX)) == 0)
+            {
+                config_error("%s line %d: Syntax error\n", config_filename, config_lineno);
+            }
+
+            line = parse_policy_section(config, fp, buffer);
+            continue;
+        }
+        else if (strncmp(line, GROUP_SECTION_PREFIX, strlen(GROUP_SECTION_PREFIX)) == 0)
+        {
+            // Ensure the group has a name
+            section_type = "group";
+            if (*trim_leading_whitespace(line + strlen(GROUP_SECTION_PREFIX)) == 0)
+            {
+                config_error("%s line %d: Syntax error\n", config_filename, config_lineno);
+            }
+
+            // The interface list must be the first parameter of a group
+            line = read_line(fp, buffer);
+            if (line == NULL || *line == '[')
+            {
+                config_error("%s line %d: Group section requires parameter \"%s\"\n", config_filename, config_lineno, KEY_INTERFACES);
+            }
+            value = split_keyvalue(line);
+            if (strcmp(line, KEY_INTERFACES) != 0)
+            {
+                config_error("%s line %d: \"%s\" must be the first parameter of a group section\n", config_filename, config_lineno, KEY_INTERFACES);
+            }
+
+            list_array_count = split_comma_list(value, list_array);
+            section_count = build_section_interfaces(list_array, list_array_count, section_interfaces);
+        }
+        else
         {
-            fatal("%s line %d: Interface \"%s\" is not in the [global] interfaces list\n", config_filename, config_lineno, line);
+            // Find the interface
+            section_type = "interface";
+            interface = get_interface_by_name(line);
+            if (interface == NULL)
+            {
+                config_error("%s line %d: Interface \"%s\" is not in the [global] interfaces list\n", config_filename, config_lineno, line);
+            }
+            section_interfaces[0] = interface;
+            section_count = 1;
         }
 
-        // Read the rest of the interface section
+        // Read the rest of the section
         while ((line = read_line(fp, buffer)))
         {
             if (*line == '[')
@@ -414,113 +1108,169 @@ void read_config(void)
             // Split the key/value pair
             value = split_keyvalue(line);
 
-            if (strcmp(line, KEY_DISABLE_IPV4) == 0)
+            if (parse_interface_parameter(config, section_interfaces, section_count, line, value) == 0)
             {
-                if (strcmp(value, "yes") == 0)
-                {
-                    interface->disable_ip[IPV4] = 1;
-                }
-                else if (strcmp(value, "no") == 0)
-                {
-                    if (global_disable_ipv4)
-                    {
-                        fatal("%s line %d: IPv4 is globally disabled\n", config_filename, config_lineno);
-                    }
-                    interface->disable_ip[IPV4] = 0;
-                }
-                else
-                {
-                    fatal("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV4, value);
-                }
+                config_error("%s line %d: Unknown %s parameter \"%s\"\n", config_filename, config_lineno, section_type, line);
             }
-            else if (strcmp(line, KEY_DISABLE_IPV6) == 0)
-            {
-                if (strcmp(value, "yes") == 0)
-                {
-                    interface->disable_ip[IPV6] = 1;
-                }
-                else if (strcmp(value, "no") == 0)
-                {
-                    if (global_disable_ipv6)
-                    {
-                        fatal("%s line %d: IPv6 is globally disabled\n", config_filename, config_lineno);
-                    }
-                    interface->disable_ip[IPV6] = 0;
-                }
-                else
-                {
-                    fatal("%s line %d: Invalid value for %s \"%s\"\n", config_filename, config_lineno, KEY_DISABLE_IPV6, value);
-                }
-            }
-            else if (strcmp(line, KEY_ALLOW_INBOUND_FILTERS) == 0)
-            {
-                if (filtering_enabled == 0)
-                {
-                    fatal("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
-                          KEY_ALLOW_INBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
-                }
+        }
+    }
 
-                list_array_count = split_comma_list(value, list_array);
-                if (set_interface_inbound_filter_list(interface, ALLOW, list_array, list_array_count))
-                {
-                    fatal("%s line %d: Only one inbound filter list per interface is allowed\n", config_filename, config_lineno);
-                }
-            }
-            else if (strcmp(line, KEY_DENY_INBOUND_FILTERS) == 0)
-            {
-                if (filtering_enabled == 0)
-                {
-                    fatal("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
-                          KEY_DENY_INBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
-                }
+    if (line != NULL)
+    {
+        config_error("%s line %d: Syntax error\n", config_filename, config_lineno);
+    }
 
-                list_array_count = split_comma_list(value, list_array);
-                if (set_interface_inbound_filter_list(interface, DENY, list_array, list_array_count))
-                {
-                    fatal("%s line %d: Only one inbound filter list per interface is allowed\n", config_filename, config_lineno);
-                }
-            }
-            else if (strcmp(line, KEY_ALLOW_OUTBOUND_FILTERS) == 0)
-            {
-                if (filtering_enabled == 0)
-                {
-                    fatal("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
-                          KEY_ALLOW_OUTBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
-                }
+    // Interfaces that are not in any domain are in the default domain
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        if (config->interface_config[index].domains == 0)
+        {
+            config->interface_config[index].domains = get_domain(config, DEFAULT_DOMAIN);
+        }
+    }
 
-                list_array_count = split_comma_list(value, list_array);
-                if (set_interface_outbound_filter_list(interface, ALLOW, list_array, list_array_count))
-                {
-                    fatal("%s line %d: Only one outbound filter list per interface is allowed\n", config_filename, config_lineno);
-                }
-            }
-            else if (strcmp(line, KEY_DENY_OUTBOUND_FILTERS) == 0)
-            {
-                if (filtering_enabled == 0)
-                {
-                    fatal("%s line %d: %s cannot be combined with %s\n", config_filename, config_lineno,
-                          KEY_DENY_OUTBOUND_FILTERS, KEY_DISABLE_PACKET_FILTERING);
-                }
+    fclose(fp);
+    config_fp = NULL;
+}
 
-                list_array_count = split_comma_list(value, list_array);
-                if (set_interface_outbound_filter_list(interface, DENY, list_array, list_array_count))
-                {
-                    fatal("%s line %d: Only one outbound filter list per interface is allowed\n", config_filename, config_lineno);
-                }
-            }
-            else
+
+//
+// Read and process the config file at startup
+//
+void read_config(void)
+{
+    config_t *                  config;
+    unsigned int                index;
+
+    config = config_create();
+    parse_config(config);
+
+    // Initialize the interface IP settings
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        configured_interface_list[index].disable_ip[IPV4] = config->interface_config[index].disable_ip[IPV4];
+        configured_interface_list[index].disable_ip[IPV6] = config->interface_config[index].disable_ip[IPV6];
+    }
+
+    current_config = config;
+}
+
+
+//
+// Retain the previous value of a string parameter that requires a restart to change
+//
+static void retain_string_parameter(
+    char **                     parameter,
+    char **                     previous_parameter,
+    const char *                key)
+{
+    if ((*parameter == NULL) != (*previous_parameter == NULL) ||
+        (*parameter && strcmp(*parameter, *previous_parameter) != 0))
+    {
+        logger("Change to %s requires a restart (ignored)\n", key);
+        free(*parameter);
+        *parameter = *previous_parameter;
+        *previous_parameter = NULL;
+    }
+}
+
+
+//
+// Reload the config file and publish the new configuration to the bridge threads
+//
+//   NOTE: Errors in the config file are logged, and the current configuration
+//         remains in effect.
+//
+void reload_config(void)
+{
+    config_t *                  config;
+    config_t *                  previous_config = current_config;
+    interface_t *               interface;
+    unsigned int                index;
+    ip_type_t                   ip_type;
+
+    config = config_create();
+
+    // Parse the config file, returning here on error
+    config_reloading = 1;
+    if (setjmp(config_reload_env))
+    {
+        config_reloading = 0;
+        if (config_fp)
+        {
+            fclose(config_fp);
+            config_fp = NULL;
+        }
+        config_destroy(config);
+        logger("Configuration reload failed, continuing with the previous configuration\n");
+        return;
+    }
+    parse_config(config);
+    config_reloading = 0;
+
+    // Changes to the IP settings require sockets to be created or destroyed, and
+    // are not supported by reload. Retain the previous settings.
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        if (config->disable_ip[ip_type] != previous_config->disable_ip[ip_type])
+        {
+            logger("Change to global %s requires a restart (ignored)\n",
+                   ip_type == IPV4 ? KEY_DISABLE_IPV4 : KEY_DISABLE_IPV6);
+            config->disable_ip[ip_type] = previous_config->disable_ip[ip_type];
+        }
+
+        for (index = 0; index < configured_interface_count; index++)
+        {
+            interface = &configured_interface_list[index];
+            if (config->interface_config[index].disable_ip[ip_type] != previous_config->interface_config[index].disable_ip[ip_type])
             {
-                fatal("%s line %d: Unknown interface parameter \"%s\"\n", config_filename, config_lineno, line);
+                logger("Change to %s for interface %s requires a restart (ignored)\n",
+                       ip_type == IPV4 ? KEY_DISABLE_IPV4 : KEY_DISABLE_IPV6, interface->name);
+                config->interface_config[index].disable_ip[ip_type] = previous_config->interface_config[index].disable_ip[ip_type];
             }
         }
     }
 
-    if (line != NULL)
+    // The control socket and metrics listener are only opened at startup.
+    // Retain the previous settings.
+    retain_string_parameter(&config->control_socket, &previous_config->control_socket, KEY_CONTROL_SOCKET);
+    retain_string_parameter(&config->metrics_listen, &previous_config->metrics_listen, KEY_METRICS_LISTEN);
+
+    // The service inventory is only allocated at startup. Retain the previous setting.
+    if (config->inventory_size != previous_config->inventory_size)
     {
-        fatal("%s line %d: Syntax error\n", config_filename, config_lineno);
+        logger("Change to global %s requires a restart (ignored)\n", KEY_INVENTORY_SIZE);
+        config->inventory_size = previous_config->inventory_size;
     }
 
-    fclose(fp);
+    // Publish the new configuration and destroy the previous one
+    // NB: The mutex excludes readers of the configuration outside the bridge threads
+    pthread_mutex_lock(&config_mutex);
+    bridge_publish_config(config);
+    config_destroy(previous_config);
+    pthread_mutex_unlock(&config_mutex);
+
+    logger("Configuration reloaded\n");
+}
+
+
+//
+// Get the name of a forwarding policy
+//
+static const char * policy_name(
+    unsigned int                policy)
+{
+    switch (policy)
+    {
+        case POLICY_QUERIES:
+            return FORWARD_QUERIES;
+        case POLICY_RESPONSES:
+            return FORWARD_RESPONSES;
+        case POLICY_SOLICITED:
+            return FORWARD_SOLICITED_RESPONSES;
+        default:
+            return FORWARD_ALL;
+    }
 }
 
 
@@ -555,31 +1305,47 @@ static void dump_filter_list(
 //
 void dump_config(void)
 {
+    config_t *                  config = current_config;
     interface_t *               interface;
     unsigned int                index;
     unsigned int                peer;
+    unsigned int                domain;
+    unsigned int                policy;
 
     // Global section
     printf("\nGlobal settings:\n");
-    if (global_disable_ipv4) {
+    if (config->disable_ip[IPV4]) {
         printf(" disable ipv4 = true\n");
     } else {
         printf(" disable ipv4 = false\n");
     }
-    if (global_disable_ipv6) {
+    if (config->disable_ip[IPV6]) {
         printf(" disable ipv6 = true\n");
     } else {
         printf(" disable ipv6 = false\n");
     }
-    dump_filter_list("global filter", global_filter_list);
+    dump_filter_list("global filter", config->global_filter_list);
+    if (config->control_socket)
+    {
+        printf(" control socket = %s\n", config->control_socket);
+    }
+    if (config->metrics_listen)
+    {
+        printf(" metrics listen = %s\n", config->metrics_listen);
+    }
+    if (config->tap_file)
+    {
+        printf(" tap file = %s\n", config->tap_file);
+    }
+    printf(" inventory size = %u\n", config->inventory_size);
 
     // Interfaces
     printf("\nInterface list:\n");
     for (index = 0; index < configured_interface_count; index++)
     {
         interface = &configured_interface_list[index];
-        printf(" %s (%u)\n", interface->name, interface->if_index);
-        if (interface->disable_ip[IPV4] == 0)
+        printf(" %s (%u)\n", interface->name, interface->if_index[IPV4]);
+        if (interface->active[IPV4])
         {
             printf("  ipv4 address %s\n", interface->ipv4_addr_str);
             printf("   peer interfaces:");
@@ -589,12 +1355,16 @@ void dump_config(void)
             }
             printf("\n");
         }
+        else if (interface->disable_ip[IPV4] == 0)
+        {
+            printf("  ipv4 inactive\n");
+        }
         else
         {
             printf("  ipv4 disabled\n");
         }
 
-        if (interface->disable_ip[IPV6] == 0)
+        if (interface->active[IPV6])
         {
             printf("  ipv6 address %s\n", interface->ipv6_addr_str);
             printf("   peer interfaces:");
@@ -604,18 +1374,45 @@ void dump_config(void)
             }
             printf("\n");
         }
+        else if (interface->disable_ip[IPV6] == 0)
+        {
+            printf("  ipv6 inactive\n");
+        }
         else
         {
             printf("  ipv6 disabled\n");
         }
 
-        if (interface->inbound_filter_list)
+        printf("  domains:");
+        for (domain = 0; domain < config->domain_count; domain++)
+        {
+            if (config->interface_config[index].domains & ((domain_mask_t) 1 << domain))
+            {
+                printf(" %s", config->domain_names[domain]);
+            }
+        }
+        printf("\n");
+
+        // Forwarding policies other than the default
+        if (config->policy_matrix)
+        {
+            for (peer = 0; peer < configured_interface_count; peer++)
+            {
+                policy = config->policy_matrix[index * configured_interface_count + peer];
+                if (peer != index && policy != POLICY_ALL)
+                {
+                    printf("  forward to %s: %s\n", configured_interface_list[peer].name, policy_name(policy));
+                }
+            }
+        }
+
+        if (config->interface_config[index].inbound_filter_list)
         {
-            dump_filter_list("inbound filter list", interface->inbound_filter_list);
+            dump_filter_list("inbound filter list", config->interface_config[index].inbound_filter_list);
         }
-        if (interface->outbound_filter_list)
+        if (config->interface_config[index].outbound_filter_list)
         {
-            dump_filter_list("outbound filter list", interface->outbound_filter_list);
+            dump_filter_list("outbound filter list", config->interface_config[index].outbound_filter_list);
         }
         printf("\n");
     }
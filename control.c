@@ -0,0 +1,602 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "common.h"
+
+
+// Maximum length of a control command
+#define CONTROL_COMMAND_LEN     256
+
+// Time allowed for a client to send a command or receive a response
+#define CONTROL_TIMEOUT_SEC     2
+
+// Maximum length of a metrics request
+#define METRICS_REQUEST_LEN     4096
+
+// Default address of the metrics listener if only a port is given
+#define METRICS_DEFAULT_ADDRESS "127.0.0.1"
+
+// Listeners, each served by its own thread
+typedef struct
+{
+    const char *                name;
+    int                         fd;
+    char *                      path;           // Unix socket path (NULL if TCP)
+    void                        (* client)(int fd);
+} listener_t;
+
+static listener_t               control_listener = { "control socket", -1, NULL, NULL };
+static listener_t               metrics_listener = { "metrics listener", -1, NULL, NULL };
+
+// TCP metrics listener received by handoff from a previous process
+static int                      handoff_metrics_fd = -1;
+
+
+
+//
+// Write a response to a control client
+//
+static void control_write(
+    int                         fd,
+    const char *                data,
+    size_t                      length)
+{
+    ssize_t                     rs;
+
+    while (length)
+    {
+        rs = write(fd, data, length);
+        if (rs == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += rs;
+        length -= (size_t) rs;
+    }
+}
+
+
+//
+// Read a command from a control client
+//
+//   The command is terminated by a newline or the end of the connection.
+//
+static void control_read_command(
+    int                         fd,
+    char *                      command)
+{
+    size_t                      length = 0;
+    ssize_t                     rs;
+    char *                      end;
+
+    while (length < CONTROL_COMMAND_LEN - 1)
+    {
+        rs = read(fd, command + length, CONTROL_COMMAND_LEN - 1 - length);
+        if (rs == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (rs <= 0)
+        {
+            break;
+        }
+        length += (size_t) rs;
+        if (memchr(command, '\n', length))
+        {
+            break;
+        }
+    }
+    command[length] = 0;
+
+    // Remove the line terminator and trailing whitespace
+    end = strpbrk(command, "\r\n");
+    if (end)
+    {
+        *end = 0;
+    }
+    for (end = command + strlen(command); end > command && (end[-1] == ' ' || end[-1] == '\t'); end--)
+    {
+        end[-1] = 0;
+    }
+}
+
+
+//
+// Set the time a client may hold a listener thread
+//
+static void control_set_timeout(
+    int                         fd)
+{
+    struct timeval              timeout;
+
+    timeout.tv_sec = CONTROL_TIMEOUT_SEC;
+    timeout.tv_usec = 0;
+    (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    (void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+
+//
+// Process a control client
+//
+static void control_client(
+    int                         fd)
+{
+    char                        command[CONTROL_COMMAND_LEN];
+    const char *                response = NULL;
+    char *                      output = NULL;
+    unsigned int                megabytes = 0;
+    unsigned int                files = 0;
+
+    control_set_timeout(fd);
+    control_read_command(fd, command);
+
+    if (command[0] == 0 || strcmp(command, "stats") == 0)
+    {
+        output = stats_format(STATS_FORMAT_TEXT);
+    }
+    else if (strcmp(command, "stats json") == 0)
+    {
+        output = stats_format(STATS_FORMAT_JSON);
+    }
+    else if (strcmp(command, "inventory") == 0)
+    {
+        output = stats_format_inventory();
+    }
+    else if (strcmp(command, "filters") == 0)
+    {
+        output = stats_format_filters(0);
+    }
+    else if (strcmp(command, "filters unused") == 0)
+    {
+        output = stats_format_filters(1);
+    }
+    else if (strcmp(command, "filters mark") == 0)
+    {
+        stats_filter_window_start();
+        response = "Filter window started\n";
+    }
+    else if (strcmp(command, "tap") == 0)
+    {
+        output = tap_status();
+    }
+    else if (strcmp(command, "tap on") == 0 || sscanf(command, "tap on %u %u", &megabytes, &files) >= 1)
+    {
+        response = tap_start(megabytes, files);
+        if (response == NULL)
+        {
+            output = tap_status();
+        }
+    }
+    else if (strcmp(command, "tap off") == 0)
+    {
+        tap_stop();
+        output = tap_status();
+    }
+    else if (strcmp(command, "help") == 0)
+    {
+        response = "Commands:\n"
+                   "  stats                       Display statistics\n"
+                   "  stats json                  Display statistics in JSON format\n"
+                   "  inventory                   Display the services and addresses seen on each interface\n"
+                   "  filters                     Display filter name matches in the filter window\n"
+                   "  filters unused              Display filter names without matches in the filter window\n"
+                   "  filters mark                Start a new filter window\n"
+                   "  tap                         Display the packet tap status\n"
+                   "  tap on [megabytes [files]]  Start the packet tap\n"
+                   "  tap off                     Stop the packet tap\n";
+    }
+    else
+    {
+        response = "Unknown command (try \"help\")\n";
+    }
+
+    if (output)
+    {
+        control_write(fd, output, strlen(output));
+        free(output);
+    }
+    else if (response)
+    {
+        control_write(fd, response, strlen(response));
+    }
+}
+
+
+//
+// Process a metrics (HTTP) client
+//
+static void metrics_client(
+    int                         fd)
+{
+    char                        request[METRICS_REQUEST_LEN];
+    char                        header[256];
+    const char *                status = "200 OK";
+    char *                      output = NULL;
+    size_t                      length = 0;
+    ssize_t                     rs;
+    int                         len;
+
+    control_set_timeout(fd);
+
+    // Read the request headers
+    while (length < sizeof(request) - 1)
+    {
+        rs = read(fd, request + length, sizeof(request) - 1 - length);
+        if (rs == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (rs <= 0)
+        {
+            break;
+        }
+        length += (size_t) rs;
+        request[length] = 0;
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+        {
+            break;
+        }
+    }
+    request[length] = 0;
+
+    // Check the request line
+    if (strncmp(request, "GET ", 4) != 0)
+    {
+        status = "405 Method Not Allowed";
+    }
+    else if (strncmp(request + 4, "/metrics ", 9) != 0 && strncmp(request + 4, "/ ", 2) != 0)
+    {
+        status = "404 Not Found";
+    }
+    else
+    {
+        output = stats_format(STATS_FORMAT_PROMETHEUS);
+    }
+
+    len = snprintf(header, sizeof(header),
+                   "HTTP/1.0 %s\r\n"
+                   "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Connection: close\r\n"
+                   "\r\n", status, output ? strlen(output) : 0);
+    control_write(fd, header, (size_t) len);
+    if (output)
+    {
+        control_write(fd, output, strlen(output));
+        free(output);
+    }
+}
+
+
+//
+// Listener thread
+//
+__attribute__ ((noreturn))
+static void * listener_thread(
+    void *                      arg)
+{
+    listener_t *                listener = arg;
+    int                         fd;
+
+    while (1)
+    {
+        fd = accept(listener->fd, NULL, NULL);
+        if (fd == -1)
+        {
+            if (errno != EINTR && errno != ECONNABORTED)
+            {
+                logger("%s accept failed: %s\n", listener->name, strerror(errno));
+                sleep(1);
+            }
+            continue;
+        }
+
+        listener->client(fd);
+        (void) close(fd);
+    }
+}
+
+
+//
+// Open a unix socket listener
+//
+static void listener_open_unix(
+    listener_t *                listener,
+    const char *                path)
+{
+    struct sockaddr_un          sun;
+
+    if (strlen(path) >= sizeof(sun.sun_path))
+    {
+        fatal("%s path %s is too long\n", listener->name, path);
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+
+    listener->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener->fd == -1)
+    {
+        fatal("%s socket creation failed: %s\n", listener->name, strerror(errno));
+    }
+
+    // Remove any stale socket
+    (void) unlink(path);
+    if (bind(listener->fd, (struct sockaddr *) &sun, sizeof(sun)) == -1)
+    {
+        fatal("Bind of %s %s failed: %s\n", listener->name, path, strerror(errno));
+    }
+    (void) chmod(path, 0660);
+
+    listener->path = strdup(path);
+    if (listener->path == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+}
+
+
+//
+// Check if a socket is bound to an address
+//
+static unsigned int listener_bound_to(
+    int                         fd,
+    const struct sockaddr *     addr)
+{
+    socket_address_t            bound;
+    socket_address_t            wanted;
+    socklen_t                   len = sizeof(bound);
+
+    if (getsockname(fd, &bound.sa, &len) == -1 || bound.sa.sa_family != addr->sa_family)
+    {
+        return 0;
+    }
+    if (addr->sa_family == AF_INET)
+    {
+        memcpy(&wanted.sin, addr, sizeof(wanted.sin));
+        return bound.sin.sin_port == wanted.sin.sin_port && bound.sin.sin_addr.s_addr == wanted.sin.sin_addr.s_addr;
+    }
+    if (addr->sa_family == AF_INET6)
+    {
+        memcpy(&wanted.sin6, addr, sizeof(wanted.sin6));
+        return bound.sin6.sin6_port == wanted.sin6.sin6_port &&
+               memcmp(&bound.sin6.sin6_addr, &wanted.sin6.sin6_addr, sizeof(wanted.sin6.sin6_addr)) == 0;
+    }
+    return 0;
+}
+
+
+//
+// Open a TCP listener
+//
+//   The address is "port", "address:port" or "[address]:port". A listener
+//   received by handoff is used if it is bound to the address, as the
+//   previous process is still listening on it.
+//
+static void listener_open_tcp(
+    listener_t *                listener,
+    const char *                address)
+{
+    char                        host[INET6_ADDRSTRLEN + 2];
+    const char *                port;
+    const char *                end;
+    struct addrinfo             hints;
+    struct addrinfo *           result;
+    const int                   on = 1;
+    size_t                      len;
+    int                         r;
+
+    // Split the address and port
+    port = strrchr(address, ':');
+    if (port == NULL)
+    {
+        strcpy(host, METRICS_DEFAULT_ADDRESS);
+        port = address;
+    }
+    else
+    {
+        end = port;
+        if (*address == '[' && end > address && end[-1] == ']')
+        {
+            address++;
+            end--;
+        }
+        len = (size_t) (end - address);
+        if (len == 0 || len >= sizeof(host))
+        {
+            fatal("Invalid %s address %s\n", listener->name, address);
+        }
+        memcpy(host, address, len);
+        host[len] = 0;
+        port++;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | AI_PASSIVE;
+    r = getaddrinfo(host, port, &hints, &result);
+    if (r != 0)
+    {
+        fatal("Invalid %s address %s:%s: %s\n", listener->name, host, port, gai_strerror(r));
+    }
+
+    if (handoff_metrics_fd != -1)
+    {
+        if (listener_bound_to(handoff_metrics_fd, result->ai_addr))
+        {
+            listener->fd = handoff_metrics_fd;
+            handoff_metrics_fd = -1;
+            freeaddrinfo(result);
+            return;
+        }
+        (void) close(handoff_metrics_fd);
+        handoff_metrics_fd = -1;
+    }
+
+    listener->fd = socket(result->ai_family, SOCK_STREAM, 0);
+    if (listener->fd == -1)
+    {
+        fatal("%s socket creation failed: %s\n", listener->name, strerror(errno));
+    }
+    (void) setsockopt(listener->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listener->fd, result->ai_addr, result->ai_addrlen) == -1)
+    {
+        fatal("Bind of %s %s:%s failed: %s\n", listener->name, host, port, strerror(errno));
+    }
+
+    freeaddrinfo(result);
+}
+
+
+//
+// Start a listener thread
+//
+static void listener_start(
+    listener_t *                listener,
+    void                        (* client)(int fd))
+{
+    pthread_t                   thread_id;
+    int                         r;
+
+    if (listen(listener->fd, 8) == -1)
+    {
+        fatal("Listen on %s failed: %s\n", listener->name, strerror(errno));
+    }
+
+    listener->client = client;
+    r = pthread_create(&thread_id, NULL, &listener_thread, listener);
+    if (r != 0)
+    {
+        fatal("cannot create %s thread: %s\n", listener->name, strerror(r));
+    }
+    (void) pthread_detach(thread_id);
+}
+
+
+//
+// Start the control socket and metrics listener (if configured)
+//
+//   NOTE: Each listener is served by its own thread, so that reading
+//         statistics never involves the bridge threads.
+//
+void control_start(void)
+{
+    const config_t *            config = current_config;
+
+    if (config->control_socket)
+    {
+        listener_open_unix(&control_listener, config->control_socket);
+        listener_start(&control_listener, control_client);
+    }
+
+    if (config->metrics_listen)
+    {
+        if (*config->metrics_listen == '/')
+        {
+            listener_open_unix(&metrics_listener, config->metrics_listen);
+        }
+        else
+        {
+            listener_open_tcp(&metrics_listener, config->metrics_listen);
+        }
+        listener_start(&metrics_listener, metrics_client);
+    }
+
+    // Close a received metrics listener that is no longer configured
+    if (handoff_metrics_fd != -1)
+    {
+        (void) close(handoff_metrics_fd);
+        handoff_metrics_fd = -1;
+    }
+}
+
+
+//
+// Get the TCP metrics listener to hand off to a new process
+//
+//   Returns -1 if there is no TCP metrics listener. Unix socket listeners
+//   are not handed off, as the new process can replace the socket file.
+//
+int control_metrics_listener(void)
+{
+    return metrics_listener.path ? -1 : metrics_listener.fd;
+}
+
+
+//
+// Use a TCP metrics listener received by handoff from a previous process
+//
+//   NOTE: This must be called before control_start(). If the listener is not
+//         bound to the configured address, it is closed.
+//
+void control_adopt_metrics_listener(
+    int                         fd)
+{
+    if (handoff_metrics_fd != -1)
+    {
+        (void) close(handoff_metrics_fd);
+    }
+    handoff_metrics_fd = fd;
+}
+
+
+//
+// Remove the control socket and metrics listener unix sockets
+//
+//   NOTE: This is called from the termination handler.
+//
+void control_cleanup(void)
+{
+    if (control_listener.path)
+    {
+        (void) unlink(control_listener.path);
+    }
+    if (metrics_listener.path)
+    {
+        (void) unlink(metrics_listener.path);
+    }
+}
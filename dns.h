@@ -182,12 +182,19 @@ typedef struct
     unsigned int                rr_count[NUM_RR_SECTION_TYPES];
     unsigned int                total_rr_count;
 
+    // IP type of the bridge thread that owns the state
+    ip_type_t                   ip_type;
+
     // Allocated query and resource records
     unsigned int                allocated_query_count;
     unsigned int                allocated_rr_count;
     dns_query_t *               query_list;
     dns_rr_t *                  rr_list;
 
+    // Service types of the allowed names, for the top-K accounting
+    unsigned int                service_count;
+    char                        services[TOPK_MAX_SERVICES][DNS_MAX_LABEL_LEN];
+
     // Name compression state
     unsigned int                used_clist_count;
     unsigned int                allocated_clist_count;
@@ -28,12 +28,15 @@
 //
 
 
+// NB: memmem is an extension on glibc
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
-#include <netdb.h>
+#include <ctype.h>
 
 #include "common.h"
 #include "dns.h"
@@ -47,33 +50,34 @@ static char * rr_section_name[NUM_RR_SECTION_TYPES]   = { "answer", "authority",
 //
 // Log a packet error
 //
-__attribute__ ((format (printf, 2, 3)))
+__attribute__ ((format (printf, 3, 4)))
 static void dns_packet_error(
     const packet_t *            packet,
+    decode_error_t              reason,
     const char *                format,
     ...)
 {
-    char                        error_str[1024];
-    char                        addr_str[INET6_ADDRSTRLEN];
     va_list                     args;
+    ip_type_t                   ip_type;
 
-    // Format the error string
-    va_start(args, format);
-    vsnprintf(error_str, sizeof(error_str), format, args);
-    va_end(args);
-
-    // Format the IP address string
-    getnameinfo(&packet->src_addr.sa, packet->src_addr_len, addr_str, sizeof(addr_str), NULL, 0, NI_NUMERICHOST);
+    // Count the error
+    // NB: The packet is being processed by the bridge thread for its address family
+    ip_type = packet->src_addr.sa.sa_family == AF_INET6 ? IPV6 : IPV4;
+    STATS_ADD(thread_stats[ip_type].decode_errors[reason], 1);
 
     // Log the error
-    logger("host %s error decoding packet: %s\n", addr_str, error_str);
+    // NB: The address is formatted by the logging thread
+    va_start(args, format);
+    vlogger_host(&packet->src_addr, "error decoding packet", format, args);
+    va_end(args);
 }
 
 
 //
 // Create the internal DNS decode state structure
 //
-dns_state_t dns_state_create(void)
+dns_state_t dns_state_create(
+    ip_type_t               ip_type)
 {
     _dns_state_t *          state;
 
@@ -83,6 +87,7 @@ dns_state_t dns_state_create(void)
     {
         fatal("Cannot allocate memory: %s\n", strerror(errno));
     }
+    state->ip_type = ip_type;
 
     // Allocate the query list
     state->query_list = calloc(INITIAL_QUERY_COUNT, sizeof(dns_query_t));
@@ -122,6 +127,42 @@ unsigned int dns_subset_match(
 }
 
 
+//
+// Check if a string is a valid DNS match name
+//
+unsigned int dns_valid_match_name(
+    const char *                string)
+{
+    unsigned int                string_len;
+    unsigned int                string_offset = 0;
+    unsigned int                label_count = 0;
+    unsigned int                label_len;
+
+    // Check the length
+    string_len = strlen(string);
+    if (string_len < 1 || string_len >= DNS_MAX_NAME_LEN)
+    {
+        return 0;
+    }
+
+    // Check the labels
+    while (string_offset < string_len)
+    {
+        label_len = strcspn(string + string_offset, ".");
+        label_count += 1;
+        if (label_len == 0 || label_len > DNS_MAX_LABEL_LEN || label_count > MAX_NUM_LABELS)
+        {
+            return 0;
+        }
+
+        // Skip the label and the dot/nul
+        string_offset += label_len + 1;
+    }
+
+    return 1;
+}
+
+
 //
 // Save a string as a DNS match name
 //
@@ -136,17 +177,17 @@ const dns_match_name_t * dns_save_match_name(
     unsigned int                name_len;
     unsigned int                string_offset = 0;
     unsigned int                name_offset = 0;
-    unsigned int                label_count = 0;
     unsigned int                label_len;
     unsigned int                i;
 
-    // Get the length
-    string_len = strlen(string);
-    if (string_len < 1 || string_len >= DNS_MAX_NAME_LEN)
+    // Ensure the name is valid
+    if (dns_valid_match_name(string) == 0)
     {
         fatal("Invalid DNS name \"%s\"\n", string);
     }
+
     // NB: +1 is for the initial length byte, other length bytes are accounted for by dots in the string
+    string_len = strlen(string);
     name_len = string_len + 1;
 
     // Allocate the name, but only as large as needed to hold the name
@@ -162,13 +203,7 @@ const dns_match_name_t * dns_save_match_name(
     // Save the labels
     while (string_offset < string_len)
     {
-        // Ensure we have a valid label
         label_len = strcspn(string + string_offset, ".");
-        label_count += 1;
-        if (label_len == 0 || label_len > DNS_MAX_LABEL_LEN || label_count > MAX_NUM_LABELS)
-        {
-            fatal("Invalid DNS name \"%s\"\n", string);
-        }
 
         // Copy the label
         name->labels[name_offset] = label_len;
@@ -258,18 +293,31 @@ static unsigned int dns_decode_name(
 
     while (1)
     {
+        // Bounds check on the label length
+        if (label_offset >= packet->bytes)
+        {
+            dns_packet_error(packet, DECODE_ERROR_NAME, "name overrun");
+            return 0;
+        }
         label_len = packet->buffer[label_offset];
 
         // Is it a pointer?
         if (IS_LABEL_POINTER(label_len))
         {
+            // Bounds check on the pointer's second byte
+            if (label_offset + 1 >= packet->bytes)
+            {
+                dns_packet_error(packet, DECODE_ERROR_NAME, "name overrun");
+                return 0;
+            }
+
             // Get the pointer
             pointer = POINTER_OFFSET(label_len, packet->buffer[label_offset + 1]);
 
             // Bounds check on the pointer -- must be after the dns header and before the current label
             if (pointer < sizeof(dns_header_t) || pointer >= label_offset)
             {
-                dns_packet_error(packet, "bad label pointer in a name");
+                dns_packet_error(packet, DECODE_ERROR_NAME, "bad label pointer in a name");
                 return 0;
             }
 
@@ -285,6 +333,13 @@ static unsigned int dns_decode_name(
             continue;
         }
 
+        // Labels are limited to 63 bytes; 0x40 and 0x80 are reserved label types
+        if (label_len >= DNS_MAX_LABEL_LEN)
+        {
+            dns_packet_error(packet, DECODE_ERROR_NAME, "bad label length in a name");
+            return 0;
+        }
+
         // Record the offset of the label in the name
         name->offset[label_count] = name_offset;
 
@@ -292,7 +347,7 @@ static unsigned int dns_decode_name(
         label_count += 1;
         if (label_count > MAX_NUM_LABELS)
         {
-            dns_packet_error(packet, "too many labels in a name");
+            dns_packet_error(packet, DECODE_ERROR_NAME, "too many labels in a name");
             return 0;
         }
 
@@ -316,7 +371,7 @@ static unsigned int dns_decode_name(
         copy_len = label_len + 1;
         if (label_offset + copy_len + 1 > packet->bytes || name_offset + copy_len + 1 > sizeof(name->labels))
         {
-            dns_packet_error(packet, "name overrun");
+            dns_packet_error(packet, DECODE_ERROR_NAME, "name overrun");
             return 0;
         }
 
@@ -333,6 +388,65 @@ static unsigned int dns_decode_name(
 }
 
 
+//
+// Note the service type of a name for the top-K accounting
+//
+//   The service type is the label preceding a _tcp or _udp label, such as
+//   _airplay in "Living Room._airplay._tcp.local". Service types are saved
+//   in lower case, once per packet.
+//
+static void dns_note_service(
+    _dns_state_t *              state,
+    const dns_name_t *          name)
+{
+    const unsigned char *       label;
+    char                        service[DNS_MAX_LABEL_LEN];
+    unsigned int                index;
+    unsigned int                len;
+
+    for (index = 1; index + 1 < name->count; index++)
+    {
+        label = &name->labels[name->offset[index]];
+        if (label[0] == 4 && label[1] == '_' && tolower(label[4]) == 'p' &&
+            ((tolower(label[2]) == 't' && tolower(label[3]) == 'c') ||
+             (tolower(label[2]) == 'u' && tolower(label[3]) == 'd')))
+        {
+            break;
+        }
+    }
+    if (index + 1 >= name->count)
+    {
+        return;
+    }
+
+    // The preceding label is the service type
+    // NB: The label is copied to the stack, so its length is checked here as well as by the decoder
+    label = &name->labels[name->offset[index - 1]];
+    if (label[0] >= DNS_MAX_LABEL_LEN || label[1] != '_')
+    {
+        return;
+    }
+    for (len = 0; len < label[0]; len++)
+    {
+        service[len] = (char) tolower(label[len + 1]);
+    }
+    service[len] = 0;
+
+    for (index = 0; index < state->service_count; index++)
+    {
+        if (strcmp(state->services[index], service) == 0)
+        {
+            return;
+        }
+    }
+    if (state->service_count < TOPK_MAX_SERVICES)
+    {
+        strcpy(state->services[state->service_count], service);
+        state->service_count += 1;
+    }
+}
+
+
 //
 // Decode the header of a DNS packet
 //
@@ -346,7 +460,7 @@ static unsigned int dns_decode_header(
 
     if (packet->bytes < sizeof(dns_header_t))
     {
-        dns_packet_error(packet, "dns_decode_header: packet too small");
+        dns_packet_error(packet, DECODE_ERROR_SHORT, "dns_decode_header: packet too small");
         return 0;
     }
 
@@ -363,7 +477,7 @@ static unsigned int dns_decode_header(
         // Sanity check
         if (state->recv_query_count > MAX_QUERY_COUNT)
         {
-            dns_packet_error(packet, "too many queries (%u)", state->recv_query_count);
+            dns_packet_error(packet, DECODE_ERROR_COUNT, "too many queries (%u)", state->recv_query_count);
             return 0;
         }
 
@@ -384,7 +498,7 @@ static unsigned int dns_decode_header(
         // Sanity check
         if (total_rr_count > MAX_RESOURCE_COUNT)
         {
-            dns_packet_error(packet, "too many resource records (%u)", total_rr_count);
+            dns_packet_error(packet, DECODE_ERROR_COUNT, "too many resource records (%u)", total_rr_count);
             // Drop the packet
             return 0;
         }
@@ -410,6 +524,7 @@ static unsigned int dns_decode_header(
 static unsigned int dns_decode_queries(
     _dns_state_t *              state,
     unsigned int                count,
+    const config_t *            config,
     const interface_t *         interface,
     const packet_t *            packet,
     unsigned int                packet_offset)
@@ -436,7 +551,7 @@ static unsigned int dns_decode_queries(
         if (packet_offset + sizeof(dns_query_header_t) > packet->bytes)
         {
             // Drop the packet
-            dns_packet_error(packet, "malformed query");
+            dns_packet_error(packet, DECODE_ERROR_RECORD, "malformed query");
             return 0;
         }
 
@@ -454,7 +569,7 @@ static unsigned int dns_decode_queries(
             case DNS_TYPE_SVCB:
             case DNS_TYPE_HTTPS:
             case DNS_TYPE_ANY:
-                allowed = allowed_inbound(interface, &query->name);
+                allowed = allowed_inbound(config, interface, state->ip_type, &query->name);
                 break;
 
             // These query types are not filtered
@@ -467,15 +582,16 @@ static unsigned int dns_decode_queries(
 
             // Report unknown query types
             default:
-                dns_packet_error(packet, "unsupported query type %d (dropped)", query->type);
+                dns_packet_error(packet, DECODE_ERROR_TYPE, "unsupported query type %d (dropped)", query->type);
                 dns_labels_to_string(query->name.labels, query->name.length, string);
-                logger("(name %s)\n", query->name.labels);
+                logger("(name %s)\n", string);
                 allowed = 0;
         }
 
         // Save the query
         if (allowed)
         {
+            dns_note_service(state, &query->name);
             state->query_count += 1;
         }
     }
@@ -491,6 +607,7 @@ static unsigned int dns_decode_rrs(
     _dns_state_t *              state,
     rr_section_type_t           section_type,
     unsigned int                count,
+    const config_t *            config,
     const interface_t *         interface,
     const packet_t *            packet,
     unsigned int                packet_offset)
@@ -521,7 +638,7 @@ static unsigned int dns_decode_rrs(
         if (packet_offset + sizeof(dns_rr_header_t) > packet->bytes)
         {
             // Drop the packet
-            dns_packet_error(packet, "malformed %s record", rr_section_name[section_type]);
+            dns_packet_error(packet, DECODE_ERROR_RECORD, "malformed %s record", rr_section_name[section_type]);
             return 0;
         }
 
@@ -535,7 +652,7 @@ static unsigned int dns_decode_rrs(
         if (data_len == 0 || packet_offset + data_len > packet->bytes)
         {
             // Drop the packet
-            dns_packet_error(packet, "invalid rdata length in %s record", rr_section_name[section_type]);
+            dns_packet_error(packet, DECODE_ERROR_RECORD, "invalid rdata length in %s record", rr_section_name[section_type]);
             return 0;
         }
 
@@ -549,7 +666,7 @@ static unsigned int dns_decode_rrs(
             case DNS_TYPE_HINFO:
             case DNS_TYPE_SVCB:
             case DNS_TYPE_HTTPS:
-                allowed = allowed_inbound(interface, &rr->name);
+                allowed = allowed_inbound(config, interface, state->ip_type, &rr->name);
                 break;
 
             // These resource types are filtered on a domain name in the rdata section
@@ -560,11 +677,11 @@ static unsigned int dns_decode_rrs(
                 if (tmp_offset != packet_offset + data_len)
                 {
                     // Drop the packet
-                    dns_packet_error(packet, "rdata ptr name corruption in %s record", rr_section_name[section_type]);
+                    dns_packet_error(packet, DECODE_ERROR_RDATA, "rdata ptr name corruption in %s record", rr_section_name[section_type]);
                     return 0;
                 }
 
-                allowed = allowed_inbound(interface, &rr->rdata_name);
+                allowed = allowed_inbound(config, interface, state->ip_type, &rr->rdata_name);
                 break;
 
             // These resource types are not filtered
@@ -577,9 +694,9 @@ static unsigned int dns_decode_rrs(
 
             // Report unknown resource record types
             default:
-                dns_packet_error(packet, "unsupported type %d in %s record (dropped)", rr->type, rr_section_name[section_type]);
+                dns_packet_error(packet, DECODE_ERROR_TYPE, "unsupported type %d in %s record (dropped)", rr->type, rr_section_name[section_type]);
                 dns_labels_to_string(rr->name.labels, rr->name.length, string);
-                logger("(name %s, data len %u)\n", rr->name.labels, data_len);
+                logger("(name %s, data len %u)\n", string, data_len);
                 allowed = 0;
                 break;
         }
@@ -597,7 +714,7 @@ static unsigned int dns_decode_rrs(
                     if (tmp_offset != packet_offset + data_len)
                     {
                         // Drop the packet
-                        dns_packet_error(packet, "rdata srv name corruption in %s record", rr_section_name[section_type]);
+                        dns_packet_error(packet, DECODE_ERROR_RDATA, "rdata srv name corruption in %s record", rr_section_name[section_type]);
                         return 0;
                     }
                     break;
@@ -605,10 +722,10 @@ static unsigned int dns_decode_rrs(
                 case DNS_TYPE_NSEC:
                     // This type has a domain name followed by variable length secondary data
                     tmp_offset = dns_decode_name(packet, packet_offset, &rr->rdata_name);
-                    if (tmp_offset > packet_offset + data_len)
+                    if (tmp_offset == 0 || tmp_offset > packet_offset + data_len)
                     {
                         // Drop the packet
-                        dns_packet_error(packet, "rdata nsec data name corruption in %s record", rr_section_name[section_type]);
+                        dns_packet_error(packet, DECODE_ERROR_RDATA, "rdata nsec data name corruption in %s record", rr_section_name[section_type]);
                         return 0;
                     }
 
@@ -626,6 +743,11 @@ static unsigned int dns_decode_rrs(
         // Save the resource record
         if (allowed)
         {
+            dns_note_service(state, &rr->name);
+            if (rr->type == DNS_TYPE_PTR)
+            {
+                dns_note_service(state, &rr->rdata_name);
+            }
             state->rr_count[section_type] += 1;
             state->total_rr_count += 1;
         }
@@ -636,14 +758,51 @@ static unsigned int dns_decode_rrs(
 
 
 //
-// Decode a DNS packet and apply source filtering
+// Record the allowed service and address records in the service inventory
 //
-unsigned int dns_decode_packet(
-    dns_state_t *               dns_state,
+static void dns_note_inventory(
+    _dns_state_t *              state,
+    const interface_t *         interface)
+{
+    const dns_rr_t *            rr;
+    uint32_t                    now = inventory_clock();
+    unsigned int                index;
+
+    for (index = 0; index < state->total_rr_count; index++)
+    {
+        rr = &state->rr_list[index];
+        switch (rr->type)
+        {
+            case DNS_TYPE_PTR:
+            case DNS_TYPE_SRV:
+                inventory_record(state->ip_type, interface->index, rr->type, rr->name.labels, rr->name.length,
+                                 rr->rdata_name.labels, rr->rdata_name.length, ntohl(rr->data->ttl), now);
+                break;
+
+            case DNS_TYPE_A:
+            case DNS_TYPE_AAAA:
+                inventory_record(state->ip_type, interface->index, rr->type, rr->name.labels, rr->name.length,
+                                 (const unsigned char *) (rr->data + 1), ntohs(rr->data->rdata_len), ntohl(rr->data->ttl), now);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+
+//
+// Decode the sections of a DNS packet and apply source filtering
+//
+//   Returns the decoded length, or zero if the packet is invalid.
+//
+static unsigned int dns_decode_sections(
+    _dns_state_t *              state,
     const packet_t *            packet,
+    const config_t *            config,
     const interface_t *         interface)
 {
-    _dns_state_t *              state = (_dns_state_t *) dns_state;
     unsigned int                packet_offset;
     rr_section_type_t           rr_section_type;
 
@@ -653,6 +812,7 @@ unsigned int dns_decode_packet(
     state->rr_count[RR_AUTHORITY] = 0;
     state->rr_count[RR_ADDITIONAL] = 0;
     state->total_rr_count = 0;
+    state->service_count = 0;
 
     // Decode the header
     packet_offset = dns_decode_header(state, packet);
@@ -660,7 +820,7 @@ unsigned int dns_decode_packet(
     // Decode the queries
     if (packet_offset && state->recv_query_count)
     {
-        packet_offset = dns_decode_queries(state, state->recv_query_count, interface, packet, packet_offset);
+        packet_offset = dns_decode_queries(state, state->recv_query_count, config, interface, packet, packet_offset);
     }
 
     // Decode resource record sections (answer, authority, additional)
@@ -668,15 +828,44 @@ unsigned int dns_decode_packet(
     {
         if (packet_offset && state->recv_rr_count[rr_section_type])
         {
-            packet_offset = dns_decode_rrs(state, rr_section_type, state->recv_rr_count[rr_section_type], interface, packet, packet_offset);
+            packet_offset = dns_decode_rrs(state, rr_section_type, state->recv_rr_count[rr_section_type], config, interface, packet, packet_offset);
         }
     }
 
+    // If an earlier stage failed, the error has already been reported
+    if (packet_offset == 0)
+    {
+        return 0;
+    }
+
     // Check the packet length
     if (packet_offset != packet->bytes)
     {
         // Drop the packet
-        dns_packet_error(packet, "decoded length (%u) != packet length (%u)", packet_offset, packet->bytes);
+        dns_packet_error(packet, DECODE_ERROR_LENGTH, "decoded length (%u) != packet length (%u)", packet_offset, packet->bytes);
+        return 0;
+    }
+
+    return (packet_offset);
+}
+
+
+//
+// Decode a DNS packet and apply source filtering
+//
+unsigned int dns_decode_packet(
+    dns_state_t *               dns_state,
+    const packet_t *            packet,
+    const config_t *            config,
+    const interface_t *         interface)
+{
+    _dns_state_t *              state = (_dns_state_t *) dns_state;
+    unsigned int                packet_offset;
+
+    // Decode the packet
+    packet_offset = dns_decode_sections(state, packet, config, interface);
+    if (packet_offset == 0)
+    {
         return 0;
     }
 
@@ -689,5 +878,44 @@ unsigned int dns_decode_packet(
         return 0;
     }
 
+    // Account the packet to its service types
+    if (state->service_count)
+    {
+        topk_record(state->ip_type, interface->index,
+                    (const char (*)[DNS_MAX_LABEL_LEN]) state->services, state->service_count, packet->bytes);
+    }
+
+    // Record the services and addresses in the inventory
+    if (state->total_rr_count)
+    {
+        dns_note_inventory(state, interface);
+    }
+
     return (packet_offset);
 }
+
+
+//
+// Decode a DNS packet without filtering
+//
+//   Returns the decoded length, or zero if the packet is invalid. This is
+//   intended for tools that validate packets outside of the bridge. Packets
+//   are not accounted to service types or recorded in the inventory.
+//
+//   NOTE: Not thread safe.
+//
+unsigned int test_dns_packet_decode(
+    const packet_t *            packet)
+{
+    static dns_state_t          state = NULL;
+    static interface_config_t   interface_config;
+    static config_t             config = { .interface_config = &interface_config };
+    static interface_t          interface;
+
+    if (state == NULL)
+    {
+        state = dns_state_create(packet->src_addr.sa.sa_family == AF_INET6 ? IPV6 : IPV4);
+    }
+
+    return dns_decode_sections((_dns_state_t *) state, packet, &config, &interface);
+}
@@ -64,6 +64,26 @@ static const compression_entry_t clist_initializer[] =
 static const unsigned int clist_initializer_count = sizeof(clist_initializer) / sizeof(compression_entry_t);
 
 
+//
+// Check that there is space in the send packet
+//
+//   NB: An encoded packet may be larger than the received packet, such as
+//       when the received packet compresses names against rdata or against
+//       records that have been filtered.
+//
+static inline unsigned int encode_space(
+    unsigned int                packet_offset,
+    unsigned int                len)
+{
+    if (packet_offset + len > MDNS_MAX_PACKET_SIZE)
+    {
+        logger("encoded packet exceeds %u bytes (dropped)\n", MDNS_MAX_PACKET_SIZE);
+        return 0;
+    }
+    return 1;
+}
+
+
 //
 // Allocate the compression list
 //
@@ -251,6 +271,8 @@ static unsigned int clist_get_child(
 //
 // Encode a DNS name with compression
 //
+//   Returns the new packet offset, or zero if the name cannot be encoded.
+//
 static unsigned int dns_encode_name(
     _dns_state_t *              state,
     packet_t *                  send_packet,
@@ -268,6 +290,10 @@ static unsigned int dns_encode_name(
     // If the name contians only the root label, it cannot be compressed
     if (name->count <= 1)
     {
+        if (encode_space(packet_offset, 1) == 0)
+        {
+            return 0;
+        }
         send_packet->buffer[packet_offset] = 0;
         packet_offset += 1;
         return packet_offset;
@@ -308,6 +334,10 @@ static unsigned int dns_encode_name(
         {
             // This name is fully a duplicate of a name already in the packet,
             // and can be encoded as a single pointer
+            if (encode_space(packet_offset, sizeof(state->clist[child_index].pointer)) == 0)
+            {
+                return 0;
+            }
             memcpy(send_packet->buffer + packet_offset, &state->clist[child_index].pointer, sizeof(state->clist[child_index].pointer));
             packet_offset += sizeof(state->clist[child_index].pointer);
 
@@ -332,8 +362,12 @@ static unsigned int dns_encode_name(
         }
     }
 
-    // Copy the labels to the packet
+    // Copy the labels to the packet, followed by the ancestor's pointer or the root zone
     copy_len = name->offset[name_index] + label[0] + 1;
+    if (encode_space(packet_offset, copy_len + (state->clist[ancestor_index].pointer ? sizeof(uint16_t) : 1)) == 0)
+    {
+        return 0;
+    }
     memcpy(send_packet->buffer + packet_offset, name->labels, copy_len);
 
     // Set the pointer for the current label
@@ -381,6 +415,8 @@ static unsigned int dns_encode_name(
 //
 // Encode queries
 //
+//   Returns the new packet offset, or zero if the queries cannot be encoded.
+//
 static unsigned int dns_encode_queries(
     _dns_state_t *              state,
     packet_t *                  send_packet,
@@ -408,7 +444,7 @@ static unsigned int dns_encode_queries(
             case DNS_TYPE_SRV:
             case DNS_TYPE_TXT:
             case DNS_TYPE_ANY:
-                allowed = allowed_outbound(send_filter_list, &query->name);
+                allowed = allowed_outbound(send_filter_list, state->ip_type, &query->name);
                break;
 
             // Other query types are not filtered
@@ -421,6 +457,10 @@ static unsigned int dns_encode_queries(
         {
             // Encode the name
             packet_offset = dns_encode_name(state, send_packet, packet_offset, &query->name);
+            if (packet_offset == 0 || encode_space(packet_offset, sizeof(dns_query_header_t)) == 0)
+            {
+                return 0;
+            }
 
             // Set the header elements
             query_header = (dns_query_header_t *) (send_packet->buffer + packet_offset);
@@ -437,7 +477,9 @@ static unsigned int dns_encode_queries(
 
 
 //
-// Encode a DNS packet with outbound filtering
+// Encode the resource records of a section
+//
+//   Returns the new packet offset, or zero if the records cannot be encoded.
 //
 static unsigned int dns_encode_rrs(
     _dns_state_t *              state,
@@ -471,14 +513,14 @@ static unsigned int dns_encode_rrs(
             case DNS_TYPE_SRV:
             case DNS_TYPE_TXT:
             case DNS_TYPE_HINFO:
-                allowed = allowed_outbound(send_filter_list, &rr->name);
+                allowed = allowed_outbound(send_filter_list, state->ip_type, &rr->name);
                 break;
 
             // These resource types are filtered on a domain name in the data section
             case DNS_TYPE_PTR:
             case DNS_TYPE_CNAME:
             case DNS_TYPE_DNAME:
-                allowed = allowed_outbound(send_filter_list, &rr->rdata_name);
+                allowed = allowed_outbound(send_filter_list, state->ip_type, &rr->rdata_name);
                 break;
 
             // Other resource types are not filtered
@@ -490,7 +532,11 @@ static unsigned int dns_encode_rrs(
         if (allowed)
         {
             // Encode the name
-            packet_offset = dns_encode_name(state, send_packet, packet_offset,&rr->name);
+            packet_offset = dns_encode_name(state, send_packet, packet_offset, &rr->name);
+            if (packet_offset == 0 || encode_space(packet_offset, sizeof(dns_rr_header_t)) == 0)
+            {
+                return 0;
+            }
 
             // Set the header elements
             rr_header = (dns_rr_header_t *) (send_packet->buffer + packet_offset);
@@ -514,6 +560,10 @@ static unsigned int dns_encode_rrs(
                 // This type has a fixed length secondary data structure followed by a domain name
                 case DNS_TYPE_SRV:
                     // Copy the secondary data from the original packet
+                    if (encode_space(packet_offset, rr->secondary_len) == 0)
+                    {
+                        return 0;
+                    }
                     secondary_data = (unsigned char *) rr->data + sizeof(dns_rr_header_t);
                     memcpy(send_packet->buffer + packet_offset, secondary_data, rr->secondary_len);
                     packet_offset += rr->secondary_len;
@@ -526,6 +576,10 @@ static unsigned int dns_encode_rrs(
                 case DNS_TYPE_NSEC:
                     // Encode the name
                     packet_offset = dns_encode_name(state, send_packet, packet_offset, &rr->rdata_name);
+                    if (packet_offset == 0 || encode_space(packet_offset, rr->secondary_len) == 0)
+                    {
+                        return 0;
+                    }
 
                     // Copy the secondary data from the original packet
                     secondary_data = (unsigned char *) rr->data + sizeof(dns_rr_header_t);
@@ -538,11 +592,21 @@ static unsigned int dns_encode_rrs(
                 default:
                     // Get the length and data from the original packet
                     len = ntohs(rr->data->rdata_len);
+                    if (encode_space(packet_offset, len) == 0)
+                    {
+                        return 0;
+                    }
                     memcpy(send_packet->buffer + packet_offset, (unsigned char *) rr->data + sizeof(dns_rr_header_t), len);
                     packet_offset += len;
                     break;
             }
 
+            // A name in the rdata could not be encoded
+            if (packet_offset == 0)
+            {
+                return 0;
+            }
+
             // Set the data length in the rr header
             rr_header->rdata_len = htons(packet_offset - rdata_offset);
 
@@ -557,6 +621,11 @@ static unsigned int dns_encode_rrs(
 //
 // Encode a DNS packet with outbound filtering
 //
+//   Returns the length of the encoded packet, or zero if everything has been
+//   filtered or the packet cannot be encoded. In the latter cases, the length
+//   of the send packet is also zero, so that it is never mistaken for the
+//   previous packet.
+//
 unsigned int dns_encode_packet(
     dns_state_t *               dns_state,
     const packet_t *            recv_packet,
@@ -573,17 +642,29 @@ unsigned int dns_encode_packet(
     // Reset the compression list
     clist_reset(state);
 
+    // NB: The length is set when the packet has been encoded
+    send_packet->bytes = 0;
+
     // Skip the header which will be filled in later
     packet_offset = sizeof(dns_header_t);
 
     // Encode the queries
+    // NB: If the packet cannot be encoded, it is dropped
     packet_offset = dns_encode_queries(state, send_packet, packet_offset, send_filter_list, &query_count);
+    if (packet_offset == 0)
+    {
+        return 0;
+    }
 
     // Encode the resource record sections (answer, authority, additional)
     for (rr_section_type = 0; rr_section_type < NUM_RR_SECTION_TYPES; rr_section_type++)
     {
         packet_offset = dns_encode_rrs(state, rr_section_type, send_packet, packet_offset,
             send_filter_list,  &rr_count[rr_section_type]);
+        if (packet_offset == 0)
+        {
+            return 0;
+        }
     }
 
     // If everything has been filtered, drop the packet
@@ -34,17 +34,8 @@
 #include <errno.h>
 
 #include "common.h"
-
-
-// Packet filtering enable flag
-unsigned int                    filtering_enabled = 1;
-
-// The global filter list
-filter_list_t *                	global_filter_list = NULL;
-
-// Count of unique outbound filters in use across all interfaces
-unsigned int                    unique_outbound_filter_count = 0;
-
+#include "probes.h"
+#include "profile.h"
 
 
 //
@@ -61,13 +52,16 @@ static int qsort_strcmp(
 //
 // Create a filter list
 //
-static filter_list_t * filter_list_create(
+//   The list of names is sorted, and duplicates are removed.
+//
+filter_list_t * filter_list_create(
     const filter_allow_deny_t   allow_deny,
     char **                     list,
     unsigned int                count)
 {
     filter_list_t *             filter_list;
     unsigned int                index;
+    unsigned int                ip_type;
 
     // Sort the array
     qsort(list, count, sizeof(list[0]), qsort_strcmp);
@@ -107,6 +101,17 @@ static filter_list_t * filter_list_create(
         filter_list->names[index] = dns_save_match_name(list[index]);
     }
 
+    // Allocate the hit and filtered counters
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        filter_list->hits[ip_type] = calloc(count + 1, sizeof(uint64_t));
+        if (filter_list->hits[ip_type] == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        filter_list->filtered[ip_type] = &filter_list->hits[ip_type][count];
+    }
+
     // Set the count and allow/deny flag
     filter_list->count = count;
     filter_list->allow_deny = allow_deny;
@@ -118,7 +123,7 @@ static filter_list_t * filter_list_create(
 //
 // Destroy a filter list
 //
-static void filter_list_destroy(
+void filter_list_destroy(
    filter_list_t *              filter_list)
 {
     unsigned int                index;
@@ -129,6 +134,12 @@ static void filter_list_destroy(
         free((void *) filter_list->names[index]);
     }
 
+    // Free the hit counters
+    for (index = 0; index < NUM_IP_TYPES; index++)
+    {
+        free(filter_list->hits[index]);
+    }
+
     // Free the names array and the list itself
     free(filter_list->names);
     free(filter_list);
@@ -164,31 +175,64 @@ static int filter_list_compare(
 }
 
 
+//
+// Add a filter list to the lists owned by a configuration
+//
+static void filter_list_register(
+    config_t *                  config,
+    filter_list_t *             filter_list)
+{
+    void *                      np;
+    unsigned int                count;
+
+    // Grow the array if necessary
+    if (config->filter_list_count >= config->filter_list_allocated)
+    {
+        count = config->filter_list_allocated ? config->filter_list_allocated * 2 : 8;
+        np = realloc(config->filter_lists, count * sizeof(filter_list_t *));
+        if (np == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        config->filter_lists = np;
+        config->filter_list_allocated = count;
+    }
+
+    filter_list->index = config->filter_list_count;
+    config->filter_lists[config->filter_list_count] = filter_list;
+    config->filter_list_count += 1;
+}
+
+
 //
 // Set the global filter list
 //
 unsigned int set_global_filter_list(
+    config_t *                  config,
     const filter_allow_deny_t   allow_deny,
     char **                     list,
     unsigned int                count)
 {
     // If a list was previously defined, return error
-    if (global_filter_list)
+    if (config->global_filter_list)
     {
         return 1;
     }
 
     // Create the list
-    global_filter_list = filter_list_create(allow_deny, list, count);
+    config->global_filter_list = filter_list_create(allow_deny, list, count);
+    filter_list_register(config, config->global_filter_list);
     return 0;
 }
 
 
 //
-// Set an interface inbound filter list
+// Set the inbound filter list for a set of interfaces
 //
 unsigned int set_interface_inbound_filter_list(
-    interface_t *               interface,
+    config_t *                  config,
+    interface_t * const *       interfaces,
+    unsigned int                interface_count,
     const filter_allow_deny_t   allow_deny,
     char **                     list,
     unsigned int                count)
@@ -197,18 +241,28 @@ unsigned int set_interface_inbound_filter_list(
     unsigned int                index;
 
     // If a list was previously defined, return error
-    if (interface->inbound_filter_list)
+    for (index = 0; index < interface_count; index++)
     {
-        return 1;
+        if (config->interface_config[interfaces[index]->index].inbound_filter_list)
+        {
+            return 1;
+        }
     }
 
     // Create the list
     filter_list = filter_list_create(allow_deny, list, count);
 
     // Check if this is a duplicate of the global list
-    if (global_filter_list && filter_list_compare(global_filter_list, filter_list) == 0)
+    if (config->global_filter_list && filter_list_compare(config->global_filter_list, filter_list) == 0)
     {
-        logger("Interface %s inbound filter discarded (duplicate of the global filter)\n", interface->name);
+        if (interface_count == 1)
+        {
+            logger("Interface %s inbound filter discarded (duplicate of the global filter)\n", interfaces[0]->name);
+        }
+        else
+        {
+            logger("Inbound filter for %u interfaces discarded (duplicate of the global filter)\n", interface_count);
+        }
         filter_list_destroy(filter_list);
         return 0;
     }
@@ -216,26 +270,37 @@ unsigned int set_interface_inbound_filter_list(
     // Check if this is a duplicate of an already existing interface filter list
     for (index = 0; index < configured_interface_count; index++)
     {
-        if (configured_interface_list[index].inbound_filter_list &&
-            filter_list_compare(configured_interface_list[index].inbound_filter_list, filter_list) == 0)
+        if (config->interface_config[index].inbound_filter_list &&
+            filter_list_compare(config->interface_config[index].inbound_filter_list, filter_list) == 0)
         {
             filter_list_destroy(filter_list);
-            filter_list = configured_interface_list[index].inbound_filter_list;
+            filter_list = config->interface_config[index].inbound_filter_list;
             break;
         }
     }
 
-    // Assign the list to the interface
-    interface->inbound_filter_list = filter_list;
+    // If the list is new, the configuration takes ownership of it
+    if (index == configured_interface_count)
+    {
+        filter_list_register(config, filter_list);
+    }
+
+    // Assign the list to the interfaces
+    for (index = 0; index < interface_count; index++)
+    {
+        config->interface_config[interfaces[index]->index].inbound_filter_list = filter_list;
+    }
     return 0;
 }
 
 
 //
-// Set an interface outbound filter list
+// Set the outbound filter list for a set of interfaces
 //
 unsigned int set_interface_outbound_filter_list(
-    interface_t *               interface,
+    config_t *                  config,
+    interface_t * const *       interfaces,
+    unsigned int                interface_count,
     const filter_allow_deny_t   allow_deny,
     char **                     list,
     unsigned int                count)
@@ -244,9 +309,12 @@ unsigned int set_interface_outbound_filter_list(
     unsigned int                index;
 
     // If a list was previously defined, return error
-    if (interface->outbound_filter_list)
+    for (index = 0; index < interface_count; index++)
     {
-        return 1;
+        if (config->interface_config[interfaces[index]->index].outbound_filter_list)
+        {
+            return 1;
+        }
     }
 
     // Create the list
@@ -255,19 +323,28 @@ unsigned int set_interface_outbound_filter_list(
     // Check if this is a duplicate of an already existing interface filter list
     for (index = 0; index < configured_interface_count; index++)
     {
-        if (configured_interface_list[index].outbound_filter_list &&
-            filter_list_compare(configured_interface_list[index].outbound_filter_list, filter_list) == 0)
+        if (config->interface_config[index].outbound_filter_list &&
+            filter_list_compare(config->interface_config[index].outbound_filter_list, filter_list) == 0)
         {
             // If the new list is a duplicate, adopt the existing list
             filter_list_destroy(filter_list);
-            filter_list = configured_interface_list[index].outbound_filter_list;
+            filter_list = config->interface_config[index].outbound_filter_list;
             break;
         }
     }
 
-    // Assign the list to the interface
-    interface->outbound_filter_list = filter_list;
-    unique_outbound_filter_count += 1;
+    // If the list is new, the configuration takes ownership of it
+    if (index == configured_interface_count)
+    {
+        filter_list_register(config, filter_list);
+    }
+
+    // Assign the list to the interfaces
+    for (index = 0; index < interface_count; index++)
+    {
+        config->interface_config[interfaces[index]->index].outbound_filter_list = filter_list;
+    }
+    config->unique_outbound_filter_count += 1;
     return 0;
 }
 
@@ -277,19 +354,26 @@ unsigned int set_interface_outbound_filter_list(
 //
 static unsigned int filter_list_allowed(
     const filter_list_t *       filter_list,
+    ip_type_t                   ip_type,
     const dns_name_t *          name)
 {
     unsigned int                index;
     unsigned int                match = 0;
 
+    PROFILE_START(profile_start);
     for (index = 0; index < filter_list->count; index++)
     {
         if (dns_subset_match(name, filter_list->names[index]))
         {
+            STATS_ADD(filter_list->hits[ip_type][index], 1);
             match = 1;
             break;
         }
     }
+    PROFILE_END(ip_type, PROFILE_FILTER, profile_start);
+
+    PROBE4(filter, filter_list->index, filter_list->allow_deny, match ? (int64_t) index : -1,
+           match == (filter_list->allow_deny == ALLOW));
 
     if ((match && filter_list->allow_deny == ALLOW) ||
        (!match && filter_list->allow_deny == DENY))
@@ -297,6 +381,7 @@ static unsigned int filter_list_allowed(
         return 1;
     }
 
+    STATS_ADD(*filter_list->filtered[ip_type], 1);
     return 0;
 }
 
@@ -305,21 +390,24 @@ static unsigned int filter_list_allowed(
 // Check if an name is allowed by the global and interface inbound filter lists
 //
 unsigned int allowed_inbound(
+    const config_t *            config,
     const interface_t *         interface,
+    ip_type_t                   ip_type,
     const dns_name_t *          name)
 {
+    const filter_list_t *       inbound_filter_list = config->interface_config[interface->index].inbound_filter_list;
     unsigned int                allowed = 1;
 
     // Check the global filter list
-    if (global_filter_list)
+    if (config->global_filter_list)
     {
-        allowed = filter_list_allowed(global_filter_list, name);
+        allowed = filter_list_allowed(config->global_filter_list, ip_type, name);
     }
 
     // Check the interface filter list
-    if (allowed && interface->inbound_filter_list)
+    if (allowed && inbound_filter_list)
     {
-        allowed = filter_list_allowed(interface->inbound_filter_list, name);
+        allowed = filter_list_allowed(inbound_filter_list, ip_type, name);
     }
 
     return allowed;
@@ -331,6 +419,7 @@ unsigned int allowed_inbound(
 //
 unsigned int allowed_outbound(
     const filter_list_t *       filter_list,
+    ip_type_t                   ip_type,
     const dns_name_t *          name)
 {
     unsigned int                allowed = 1;
@@ -338,7 +427,7 @@ unsigned int allowed_outbound(
     // Check the filter list
     if (filter_list)
     {
-        allowed = filter_list_allowed(filter_list, name);
+        allowed = filter_list_allowed(filter_list, ip_type, name);
     }
 
     return allowed;
@@ -0,0 +1,468 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "common.h"
+
+
+// Environment variable used to pass the handoff socket to the new process
+#define HANDOFF_ENV             "MDNS_BRIDGE_HANDOFF_FD"
+
+// Descriptor of the handoff socket in the new process
+#define HANDOFF_FD              3
+
+// Time to wait for the new process to confirm that it is running
+#define HANDOFF_TIMEOUT_MSEC    10000
+#define HANDOFF_POLL_MSEC       100
+
+// Handoff message, accompanied by a socket descriptor
+// NB: An empty name marks the end of the sockets. The metrics listener is
+//     sent with a name that cannot be an interface name.
+#define HANDOFF_METRICS_NAME    "/metrics"
+typedef struct
+{
+    char                        name[IF_NAMESIZE];
+} handoff_message_t;
+
+// Confirmation sent by the new process once it is running
+#define HANDOFF_READY           'R'
+
+
+
+//
+// Find a program in the PATH
+//
+//   Returns the path of the program, or NULL if it is not found.
+//
+static char * handoff_find_program(
+    const char *                program)
+{
+    const char *                path;
+    const char *                end;
+    char *                      candidate;
+    size_t                      len;
+
+    if (strchr(program, '/'))
+    {
+        return strdup(program);
+    }
+
+    path = getenv("PATH");
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    while (*path)
+    {
+        end = strchr(path, ':');
+        len = end ? (size_t) (end - path) : strlen(path);
+
+        candidate = malloc(len + strlen(program) + 2);
+        if (candidate == NULL)
+        {
+            return NULL;
+        }
+        if (len)
+        {
+            memcpy(candidate, path, len);
+            candidate[len] = '/';
+            strcpy(candidate + len + 1, program);
+        }
+        else
+        {
+            strcpy(candidate, program);
+        }
+        if (access(candidate, X_OK) == 0)
+        {
+            return candidate;
+        }
+        free(candidate);
+
+        path += len;
+        if (*path == ':')
+        {
+            path++;
+        }
+    }
+
+    return NULL;
+}
+
+
+//
+// Build the environment for the new process
+//
+static char ** handoff_environment(void)
+{
+    extern char **              environ;
+    static char                 handoff_var[sizeof(HANDOFF_ENV) + 16];
+    char **                     envp;
+    unsigned int                count;
+    unsigned int                index;
+
+    (void) snprintf(handoff_var, sizeof(handoff_var), "%s=%d", HANDOFF_ENV, HANDOFF_FD);
+    for (count = 0; environ[count]; count++);
+
+    envp = calloc(count + 2, sizeof(char *));
+    if (envp == NULL)
+    {
+        return NULL;
+    }
+    for (index = 0; index < count; index++)
+    {
+        envp[index] = environ[index];
+    }
+    envp[count] = handoff_var;
+
+    return envp;
+}
+
+
+//
+// Send a socket to the new process
+//
+static int handoff_send(
+    int                         fd,
+    const char *                name,
+    int                         sock)
+{
+    handoff_message_t           message;
+    struct iovec                iov;
+    struct msghdr               msg;
+    struct cmsghdr *            cmsg;
+    union
+    {
+        char                    buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr          align;
+    } control;
+
+    memset(&message, 0, sizeof(message));
+    if (name)
+    {
+        strncpy(message.name, name, sizeof(message.name) - 1);
+    }
+
+    iov.iov_base = &message;
+    iov.iov_len = sizeof(message);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (sock != -1)
+    {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &sock, sizeof(int));
+    }
+
+    return sendmsg(fd, &msg, 0) == -1 ? -1 : 0;
+}
+
+
+//
+// Hand the interface sockets off to a new process
+//
+//   The running program is executed again, and the bound interface sockets
+//   and the TCP metrics listener, if any, are passed to it. If the new process confirms that it is running, this
+//   process exits. Otherwise the new process is terminated, and this process
+//   continues to run.
+//
+void handoff_start(
+    char * const                argv[])
+{
+    char *                      program;
+    char **                     envp;
+    sigset_t                    sigset;
+    long                        max_fd;
+    int                         sv[2];
+    int                         fd;
+    pid_t                       pid;
+    interface_t *               interface;
+    unsigned int                ip_type;
+    unsigned int                index;
+    unsigned int                sent = 0;
+    struct pollfd               pfd;
+    char                        ready = 0;
+    unsigned int                waited;
+    int                         r;
+
+    // Prepare everything needed by the child before the fork
+    // NB: Only async-signal-safe functions may be used in the child
+    program = handoff_find_program(argv[0]);
+    if (program == NULL)
+    {
+        logger("Handoff failed: cannot find program %s\n", argv[0]);
+        return;
+    }
+    envp = handoff_environment();
+    if (envp == NULL)
+    {
+        logger("Handoff failed: Cannot allocate memory: %s\n", strerror(errno));
+        free(program);
+        return;
+    }
+    max_fd = sysconf(_SC_OPEN_MAX);
+    if (max_fd < 0)
+    {
+        max_fd = 1024;
+    }
+    sigemptyset(&sigset);
+
+    // NB: Datagrams preserve the message boundaries
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == -1)
+    {
+        logger("Handoff failed: socketpair: %s\n", strerror(errno));
+        free(envp);
+        free(program);
+        return;
+    }
+
+    pid = fork();
+    if (pid == -1)
+    {
+        logger("Handoff failed: fork: %s\n", strerror(errno));
+        (void) close(sv[0]);
+        (void) close(sv[1]);
+        free(envp);
+        free(program);
+        return;
+    }
+
+    if (pid == 0)
+    {
+        // Child: move the handoff socket into place and close everything else
+        (void) sigprocmask(SIG_SETMASK, &sigset, NULL);
+        if (sv[1] != HANDOFF_FD)
+        {
+            if (dup2(sv[1], HANDOFF_FD) == -1)
+            {
+                _exit(EXIT_FAILURE);
+            }
+        }
+        for (fd = HANDOFF_FD + 1; fd < max_fd; fd++)
+        {
+            (void) close(fd);
+        }
+
+        execve(program, argv, envp);
+        _exit(EXIT_FAILURE);
+    }
+
+    (void) close(sv[1]);
+    free(envp);
+    free(program);
+
+    // Send the sockets
+    // NB: The sockets are owned by the bridge threads, which continue to
+    //     forward until this process exits. The new process validates each
+    //     socket it receives.
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        for (index = 0; index < ip_interface_count[ip_type]; index++)
+        {
+            interface = ip_interface_list[ip_type][index];
+            if (interface->sock[ip_type] == -1)
+            {
+                continue;
+            }
+
+            if (handoff_send(sv[0], interface->name, interface->sock[ip_type]) == -1)
+            {
+                logger("Handoff of socket for %s failed: %s\n", interface->name, strerror(errno));
+                continue;
+            }
+            sent += 1;
+        }
+    }
+    fd = control_metrics_listener();
+    if (fd != -1)
+    {
+        if (handoff_send(sv[0], HANDOFF_METRICS_NAME, fd) == -1)
+        {
+            logger("Handoff of metrics listener failed: %s\n", strerror(errno));
+        }
+    }
+    (void) handoff_send(sv[0], NULL, -1);
+
+    // Wait for the new process to confirm that it is running
+    // NB: A datagram socket does not report the close of its peer, so the
+    //     new process is also checked for early exit
+    pfd.fd = sv[0];
+    pfd.events = POLLIN;
+    for (waited = 0; waited < HANDOFF_TIMEOUT_MSEC; waited += HANDOFF_POLL_MSEC)
+    {
+        r = poll(&pfd, 1, HANDOFF_POLL_MSEC);
+        if (r == 1)
+        {
+            if (recv(sv[0], &ready, sizeof(ready), 0) == sizeof(ready) && ready == HANDOFF_READY)
+            {
+                logger("Handed off %u sockets to process %d, exiting\n", sent, (int) pid);
+                exit(EXIT_SUCCESS);
+            }
+            break;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+        {
+            pid = -1;
+            break;
+        }
+    }
+
+    logger("Handoff to new process failed, continuing\n");
+    if (pid != -1)
+    {
+        (void) kill(pid, SIGTERM);
+        (void) waitpid(pid, NULL, 0);
+    }
+    (void) close(sv[0]);
+}
+
+
+//
+// Receive the interface sockets from a previous process
+//
+//   Returns the handoff socket, or -1 if this process was not started by a handoff.
+//
+int handoff_receive(void)
+{
+    const char *                env;
+    int                         fd;
+    int                         sock;
+    unsigned int                received = 0;
+    unsigned int                adopted = 0;
+    handoff_message_t           message;
+    struct iovec                iov;
+    struct msghdr               msg;
+    struct cmsghdr *            cmsg;
+    ssize_t                     rs;
+    union
+    {
+        char                    buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr          align;
+    } control;
+
+    env = getenv(HANDOFF_ENV);
+    if (env == NULL)
+    {
+        return -1;
+    }
+    fd = (int) strtol(env, NULL, 10);
+    (void) unsetenv(HANDOFF_ENV);
+
+    while (1)
+    {
+        iov.iov_base = &message;
+        iov.iov_len = sizeof(message);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        rs = recvmsg(fd, &msg, 0);
+        if (rs == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (rs != sizeof(message))
+        {
+            logger("Handoff receive failed: %s\n", rs == -1 ? strerror(errno) : "short message");
+            break;
+        }
+
+        // Extract the socket, if any
+        sock = -1;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                memcpy(&sock, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+
+        message.name[sizeof(message.name) - 1] = 0;
+        if (message.name[0] == 0)
+        {
+            break;
+        }
+        if (sock == -1)
+        {
+            continue;
+        }
+        if (strcmp(message.name, HANDOFF_METRICS_NAME) == 0)
+        {
+            control_adopt_metrics_listener(sock);
+            continue;
+        }
+
+        received += 1;
+        if (os_adopt_socket(sock, message.name) == 0)
+        {
+            adopted += 1;
+        }
+    }
+
+    logger("Received %u sockets by handoff, %u adopted\n", received, adopted);
+    return fd;
+}
+
+
+//
+// Confirm to the previous process that this process is running
+//
+void handoff_complete(
+    int                         fd)
+{
+    const char                  ready = HANDOFF_READY;
+
+    if (send(fd, &ready, sizeof(ready), 0) == -1)
+    {
+        logger("Handoff confirmation failed: %s\n", strerror(errno));
+    }
+    (void) close(fd);
+}
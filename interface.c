@@ -32,6 +32,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fnmatch.h>
+#include <net/if.h>
 
 #include "common.h"
 
@@ -44,16 +46,99 @@ unsigned int                    configured_interface_count = 0;
 interface_t **                  ip_interface_list[NUM_IP_TYPES]     = { NULL, NULL};
 unsigned int                    ip_interface_count[NUM_IP_TYPES]    = { 0, 0 };
 
+// Hash table of the configured interfaces by name
+// NB: The table size is a power of two, at least twice the number of interfaces
+static interface_t **           interface_hash = NULL;
+static unsigned int             interface_hash_mask = 0;
+
+
+
+//
+// Compare two strings for sort
+//
+static int qsort_strcmp(
+    const void *                p1,
+    const void *                p2)
+{
+    return strcmp(*(const char **) p1, *(const char **) p2);
+}
+
+
+//
+// Hash an interface name (FNV-1a)
+//
+static unsigned int hash_interface_name(
+    const char *                name)
+{
+    uint32_t                    hash = 2166136261u;
+
+    while (*name)
+    {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+//
+// Check if an interface name is a pattern
+//
+static unsigned int is_interface_pattern(
+    const char *                name)
+{
+    return strpbrk(name, "*?[") != NULL;
+}
+
+
+//
+// Add a name to a growable list of names
+//
+static void add_interface_name(
+    const char ***              names,
+    unsigned int *              count,
+    unsigned int *              allocated,
+    const char *                name)
+{
+    void *                      np;
+
+    if (*count >= *allocated)
+    {
+        *allocated = *allocated ? *allocated * 2 : 64;
+        np = realloc(*names, *allocated * sizeof(char *));
+        if (np == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        *names = np;
+    }
+
+    (*names)[*count] = name;
+    *count += 1;
+}
 
 
 //
 // Set the configured interface list
 //
+//   NOTE: Interface patterns are expanded against the system interface list.
+//         The resulting list is sorted by name, and duplicates are removed.
+//
 unsigned int set_interface_list(
     char **                     list,
     unsigned int                count)
 {
+    struct if_nameindex *       system_list = NULL;
+    struct if_nameindex *       system_interface;
+    const char **               names = NULL;
+    unsigned int                names_count = 0;
+    unsigned int                names_allocated = 0;
+    unsigned int                matched;
     unsigned int                index;
+    unsigned int                unique;
+    unsigned int                size;
+    unsigned int                slot;
 
     // If a list was previously defined, return error
     if (configured_interface_list != NULL)
@@ -61,24 +146,101 @@ unsigned int set_interface_list(
         return 1;
     }
 
+    // Expand the list
+    for (index = 0; index < count; index++)
+    {
+        if (is_interface_pattern(list[index]) == 0)
+        {
+            add_interface_name(&names, &names_count, &names_allocated, list[index]);
+            continue;
+        }
+
+        // Get the system interface list
+        if (system_list == NULL)
+        {
+            system_list = if_nameindex();
+            if (system_list == NULL)
+            {
+                fatal("if_nameindex failed: %s\n", strerror(errno));
+            }
+        }
+
+        // Add the matching system interfaces
+        matched = 0;
+        for (system_interface = system_list; system_interface->if_index; system_interface++)
+        {
+            if (fnmatch(list[index], system_interface->if_name, 0) == 0)
+            {
+                add_interface_name(&names, &names_count, &names_allocated, system_interface->if_name);
+                matched += 1;
+            }
+        }
+        if (matched == 0)
+        {
+            logger("Interface pattern \"%s\" does not match any interfaces\n", list[index]);
+        }
+    }
+
+    // Sort the list and remove duplicates
+    unique = 0;
+    if (names_count)
+    {
+        qsort(names, names_count, sizeof(names[0]), qsort_strcmp);
+        for (index = 1, unique = 1; index < names_count; index++)
+        {
+            if (strcmp(names[unique - 1], names[index]) != 0)
+            {
+                names[unique] = names[index];
+                unique += 1;
+            }
+        }
+    }
+
     // Allocate the list
-    configured_interface_list = calloc(count, sizeof(interface_t));
+    // NB: An empty list is allocated to indicate that the list has been defined
+    configured_interface_list = calloc(unique ? unique : 1, sizeof(interface_t));
     if (configured_interface_list == NULL)
     {
         fatal("Cannot allocate memory: %s\n", strerror(errno));
     }
 
     // Copy the interface names
-    for (index = 0; index < count; index++)
+    for (index = 0; index < unique; index++)
     {
-        configured_interface_list[index].name = strdup(list[index]);
+        configured_interface_list[index].index = index;
+        configured_interface_list[index].name = strdup(names[index]);
         if (configured_interface_list[index].name == NULL)
         {
             fatal("Cannot allocate memory: %s\n", strerror(errno));
         }
     }
 
-    configured_interface_count = count;
+    configured_interface_count = unique;
+
+    // Build the name hash table
+    for (size = 1; size < unique * 2; size <<= 1);
+    interface_hash = calloc(size, sizeof(interface_t *));
+    if (interface_hash == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    interface_hash_mask = size - 1;
+    for (index = 0; index < unique; index++)
+    {
+        slot = hash_interface_name(configured_interface_list[index].name) & interface_hash_mask;
+        while (interface_hash[slot])
+        {
+            slot = (slot + 1) & interface_hash_mask;
+        }
+        interface_hash[slot] = &configured_interface_list[index];
+    }
+
+    free(names);
+    if (system_list)
+    {
+        if_freenameindex(system_list);
+    }
+
     return 0;
 }
 
@@ -89,21 +251,65 @@ unsigned int set_interface_list(
 interface_t * get_interface_by_name(
     const char *                name)
 {
+    interface_t *               interface;
+    unsigned int                slot;
+
+    if (interface_hash == NULL)
+    {
+        return NULL;
+    }
+
+    for (slot = hash_interface_name(name) & interface_hash_mask; (interface = interface_hash[slot]); slot = (slot + 1) & interface_hash_mask)
+    {
+        if (strcmp(name, interface->name) == 0)
+        {
+            return interface;
+        }
+    }
+
+    return NULL;
+}
+
+
+//
+// Get the interfaces that match a name or pattern
+//
+//   NOTE: The list MUST be at least configured_interface_count in size.
+//
+unsigned int get_interfaces_by_pattern(
+    const char *                pattern,
+    interface_t **              list)
+{
+    interface_t *               interface;
+    unsigned int                count = 0;
     unsigned int                index;
 
+    if (is_interface_pattern(pattern) == 0)
+    {
+        interface = get_interface_by_name(pattern);
+        if (interface)
+        {
+            list[count] = interface;
+            count += 1;
+        }
+        return count;
+    }
+
     for (index = 0; index < configured_interface_count; index++)
     {
-        if (strcmp(name, configured_interface_list[index].name) == 0)
+        if (fnmatch(pattern, configured_interface_list[index].name, 0) == 0)
         {
-            return &configured_interface_list[index];
+            list[count] = &configured_interface_list[index];
+            count += 1;
         }
     }
-    return NULL;
+
+    return count;
 }
 
 
 //
-// Build and validate a list of interfaces for an ip type
+// Build the list of interfaces for an ip type
 //
 static void build_interface_list(
     ip_type_t                   ip_type)
@@ -112,21 +318,30 @@ static void build_interface_list(
     unsigned int                count;
     unsigned int                index;
 
+    // Count the interfaces
     count = 0;
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        if (configured_interface_list[index].disable_ip[ip_type] == 0)
+        {
+            count += 1;
+        }
+    }
 
     // Build the list of interfaces
-    if (ip_interface_count[ip_type] > 1)
+    if (count > 1)
     {
-        ip_interface_list[ip_type] = calloc(ip_interface_count[ip_type], sizeof(interface_t *));
+        ip_interface_list[ip_type] = calloc(count, sizeof(interface_t *));
         if (ip_interface_list[ip_type] == NULL)
         {
             fatal("Cannot allocate memory: %s\n", strerror(errno));
         }
 
+        count = 0;
         for (index = 0; index < configured_interface_count; index++)
         {
             interface = &configured_interface_list[index];
-            if (configured_interface_list[index].disable_ip[ip_type] == 0)
+            if (interface->disable_ip[ip_type] == 0)
             {
                 ip_interface_list[ip_type][count] = interface;
                 count += 1;
@@ -135,12 +350,12 @@ static void build_interface_list(
     }
 
     // If there just the one interface, disable it
-    if (count < 2)
+    if (count == 1)
     {
         for (index = 0; index < configured_interface_count; index++)
         {
             interface = &configured_interface_list[index];
-            if (configured_interface_list[index].disable_ip[ip_type] == 0)
+            if (interface->disable_ip[ip_type] == 0)
             {
                 logger("Interface \"%s\" does not have any %s peers (disabled)\n", interface->name, ip_type == IPV4 ? "IPv4" : "IPv6");
                 interface->disable_ip[ip_type] = 1;
@@ -155,77 +370,256 @@ static void build_interface_list(
 
 
 //
-// Set the configured interface list
+// Check if two interfaces share a forwarding domain
+//
+static inline unsigned int share_domain(
+    const config_t *            config,
+    const interface_t *         interface,
+    const interface_t *         peer)
+{
+    return (config->interface_config[interface->index].domains & config->interface_config[peer->index].domains) != 0;
+}
+
+
+//
+// Account for the outbound filter of a peer added to an interface
+//
+static void add_peer_filter(
+    const config_t *            config,
+    interface_t *               interface,
+    const interface_t *         peer,
+    ip_type_t                   ip_type)
+{
+    filter_list_t *             filter_list;
+    unsigned int                filter_index;
+
+    // Check if the peer has outbound filtering
+    filter_list = config->interface_config[peer->index].outbound_filter_list;
+    if (filter_list == NULL)
+    {
+        interface->peer_nofilter_count[ip_type] += 1;
+        return;
+    }
+
+    // Is the filter already in the list?
+    for (filter_index = 0; filter_index < interface->peer_filter_count[ip_type]; filter_index++)
+    {
+        if (filter_list == interface->peer_filter_list[ip_type][filter_index])
+        {
+            return;
+        }
+    }
+
+    // Add the filter to the list
+    interface->peer_filter_list[ip_type][filter_index] = filter_list;
+    interface->peer_filter_count[ip_type] += 1;
+}
+
+
+//
+// Account for the outbound filter of a peer removed from an interface
+//
+//   NOTE: The peer must already have been removed from the peer list.
+//
+static void remove_peer_filter(
+    const config_t *            config,
+    interface_t *               interface,
+    const interface_t *         peer,
+    ip_type_t                   ip_type)
+{
+    filter_list_t *             filter_list;
+    unsigned int                peer_index;
+    unsigned int                filter_index;
+    unsigned int                last;
+
+    // Check if the peer has outbound filtering
+    filter_list = config->interface_config[peer->index].outbound_filter_list;
+    if (filter_list == NULL)
+    {
+        interface->peer_nofilter_count[ip_type] -= 1;
+        return;
+    }
+
+    // Is the filter still used by another peer?
+    for (peer_index = 0; peer_index < interface->peer_count[ip_type]; peer_index++)
+    {
+        if (config->interface_config[interface->peer_list[ip_type][peer_index]->index].outbound_filter_list == filter_list)
+        {
+            return;
+        }
+    }
+
+    // Remove the filter from the list
+    for (filter_index = 0; filter_index < interface->peer_filter_count[ip_type]; filter_index++)
+    {
+        if (filter_list == interface->peer_filter_list[ip_type][filter_index])
+        {
+            last = interface->peer_filter_count[ip_type] - 1;
+            interface->peer_filter_list[ip_type][filter_index] = interface->peer_filter_list[ip_type][last];
+            interface->peer_filter_count[ip_type] = last;
+            return;
+        }
+    }
+}
+
+
+//
+// Build the peer lists and peer outbound filter lists for each interface
+//
+//   NOTE: The peer lists are sized for all interfaces that share a forwarding
+//         domain, but only contain interfaces that are active. Interfaces are
+//         added to and removed from the peer lists as they become active or
+//         inactive.
+//
+//   NOTE: Following startup, this is only called by the bridge thread for the
+//         ip type, which is the sole user of the peer lists.
 //
-static void build_interface_peer_lists(
+void set_interface_peer_lists(
+    const config_t *            config,
     ip_type_t                   ip_type)
 {
     interface_t *               interface;
     interface_t *               peer;
     unsigned int                index;
     unsigned int                peer_index;
-    unsigned int                filter_index;
+    unsigned int                count;
 
     for (index = 0; index < ip_interface_count[ip_type]; index++)
     {
         interface = ip_interface_list[ip_type][index];
 
-        // Allocate the peer list
-        interface->peer_list[ip_type] = calloc(ip_interface_count[ip_type] - 1, sizeof(interface_t *));
+        // Count the potential peers
+        count = 0;
+        for (peer_index = 0; peer_index < ip_interface_count[ip_type]; peer_index++)
+        {
+            peer = ip_interface_list[ip_type][peer_index];
+            if (peer != interface && share_domain(config, interface, peer))
+            {
+                count += 1;
+            }
+        }
+
+        // Replace the peer list
+        free(interface->peer_list[ip_type]);
+        interface->peer_list[ip_type] = calloc(count ? count : 1, sizeof(interface_t *));
         if (interface->peer_list[ip_type] == NULL)
         {
             fatal("Cannot allocate memory: %s\n", strerror(errno));
         }
+        interface->peer_count[ip_type] = 0;
 
-        // Allocate the peer outbound filter list if used
-        if (unique_outbound_filter_count)
+        // Add the active peers
+        if (interface->active[ip_type])
         {
-            interface->peer_filter_list[ip_type] = calloc(unique_outbound_filter_count, sizeof(filter_list_t *));
-            if (interface->peer_filter_list[ip_type] == NULL)
+            for (peer_index = 0; peer_index < ip_interface_count[ip_type]; peer_index++)
             {
-                fatal("Cannot allocate memory: %s\n", strerror(errno));
+                peer = ip_interface_list[ip_type][peer_index];
+                if (peer != interface && peer->active[ip_type] && share_domain(config, interface, peer))
+                {
+                    interface->peer_list[ip_type][interface->peer_count[ip_type]] = peer;
+                    interface->peer_count[ip_type] += 1;
+                }
             }
         }
 
-        // Process the peers
-        for (peer_index = 0; peer_index < ip_interface_count[ip_type]; peer_index++)
+        // Replace the peer outbound filter list
+        free(interface->peer_filter_list[ip_type]);
+        interface->peer_filter_list[ip_type] = NULL;
+        if (config->unique_outbound_filter_count)
         {
-            peer = ip_interface_list[ip_type][peer_index];
-            if (peer == interface)
+            interface->peer_filter_list[ip_type] = calloc(config->unique_outbound_filter_count, sizeof(filter_list_t *));
+            if (interface->peer_filter_list[ip_type] == NULL)
             {
-                // Skip the current interface
-                continue;
+                fatal("Cannot allocate memory: %s\n", strerror(errno));
             }
+        }
+        interface->peer_filter_count[ip_type] = 0;
+        interface->peer_nofilter_count[ip_type] = 0;
 
-            // Add the peer to the list
-            interface->peer_list[ip_type][interface->peer_count[ip_type]] = peer;
-            interface->peer_count[ip_type] += 1;
+        for (peer_index = 0; peer_index < interface->peer_count[ip_type]; peer_index++)
+        {
+            add_peer_filter(config, interface, interface->peer_list[ip_type][peer_index], ip_type);
+        }
+    }
+}
 
-            // Check if the peer has outbound filtering
-            if (peer->outbound_filter_list)
-            {
-                // Is the filter already in the list?
-                for (filter_index = 0; filter_index < interface->peer_filter_count[ip_type]; filter_index++)
-                {
-                    if (peer->outbound_filter_list == interface->peer_filter_list[ip_type][filter_index])
-                    {
-                        break;
-                    }
-                }
 
-                // If the filter is not in the list, add it
-                if (filter_index == interface->peer_filter_count[ip_type])
-                {
-                    interface->peer_filter_list[ip_type][filter_index] = peer->outbound_filter_list;
-                    interface->peer_filter_count[ip_type] += 1;
-                }
-            }
-            else
+//
+// Add an interface that has become active to the peer lists
+//
+// NOTE: Following startup, this is only called by the bridge thread for the
+//       ip type, which is the sole user of the peer lists.
+//
+void add_interface_peer(
+    const config_t *            config,
+    interface_t *               interface,
+    ip_type_t                   ip_type)
+{
+    interface_t *               peer;
+    unsigned int                index;
+
+    for (index = 0; index < ip_interface_count[ip_type]; index++)
+    {
+        peer = ip_interface_list[ip_type][index];
+        if (peer == interface || peer->active[ip_type] == 0 || !share_domain(config, interface, peer))
+        {
+            continue;
+        }
+
+        // Add the interface to the peer
+        peer->peer_list[ip_type][peer->peer_count[ip_type]] = interface;
+        peer->peer_count[ip_type] += 1;
+        add_peer_filter(config, peer, interface, ip_type);
+
+        // Add the peer to the interface
+        interface->peer_list[ip_type][interface->peer_count[ip_type]] = peer;
+        interface->peer_count[ip_type] += 1;
+        add_peer_filter(config, interface, peer, ip_type);
+    }
+
+    interface->active[ip_type] = 1;
+}
+
+
+//
+// Remove an interface that is no longer active from the peer lists
+//
+// NOTE: Following startup, this is only called by the bridge thread for the
+//       ip type, which is the sole user of the peer lists.
+//
+void remove_interface_peer(
+    const config_t *            config,
+    interface_t *               interface,
+    ip_type_t                   ip_type)
+{
+    interface_t *               peer;
+    unsigned int                index;
+    unsigned int                peer_index;
+    unsigned int                last;
+
+    interface->active[ip_type] = 0;
+
+    // Remove the interface from each of its peers
+    for (index = 0; index < interface->peer_count[ip_type]; index++)
+    {
+        peer = interface->peer_list[ip_type][index];
+        for (peer_index = 0; peer_index < peer->peer_count[ip_type]; peer_index++)
+        {
+            if (peer->peer_list[ip_type][peer_index] == interface)
             {
-                interface->peer_nofilter_count[ip_type] += 1;
+                last = peer->peer_count[ip_type] - 1;
+                peer->peer_list[ip_type][peer_index] = peer->peer_list[ip_type][last];
+                peer->peer_count[ip_type] = last;
+                remove_peer_filter(config, peer, interface, ip_type);
+                break;
             }
         }
     }
+
+    // Clear the peers of the interface
+    interface->peer_count[ip_type] = 0;
+    interface->peer_filter_count[ip_type] = 0;
+    interface->peer_nofilter_count[ip_type] = 0;
 }
 
 
@@ -235,28 +629,17 @@ static void build_interface_peer_lists(
 void set_ip_interface_lists(void)
 {
     // Build the list of interfaces
-    if (ip_interface_count[IPV4])
-    {
-        build_interface_list(IPV4);
-    }
-    if (ip_interface_count[IPV6])
-    {
-        build_interface_list(IPV6);
-    }
+    build_interface_list(IPV4);
+    build_interface_list(IPV6);
 
-    // If there are no active interfaces, exit
+    // If there are no enabled interfaces, exit
     if (ip_interface_count[IPV4] == 0 && ip_interface_count[IPV6] == 0)
     {
-        fatal("No active IPv4 or IPv6 interfaces... exiting\n");
+        fatal("No enabled IPv4 or IPv6 interfaces... exiting\n");
     }
 
     // Build the peer lists for each interface
-    if (ip_interface_count[IPV4])
-    {
-        build_interface_peer_lists(IPV4);
-    }
-    if (ip_interface_count[IPV6])
-    {
-        build_interface_peer_lists(IPV6);
-    }
+    // NB: The peer lists are populated as the interfaces become active
+    set_interface_peer_lists(current_config, IPV4);
+    set_interface_peer_lists(current_config, IPV6);
 }
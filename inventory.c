@@ -0,0 +1,642 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "dns.h"
+
+
+// Strings per record, and bytes of string storage per record
+#define INVENTORY_STRINGS_PER_RECORD 2
+#define INVENTORY_BYTES_PER_RECORD   48
+
+// Number of attempts to read a table that is being compacted
+#define INVENTORY_READ_ATTEMPTS 8
+
+// FNV-1a constants
+#define FNV_OFFSET_BASIS        0xcbf29ce484222325ULL
+#define FNV_PRIME               0x100000001b3ULL
+
+// Inventory record
+// NB: The owner and target are offsets of interned strings. A record is
+//     published by storing the owner last, so a slot is free if the owner
+//     is zero.
+typedef struct
+{
+    uint32_t                    owner;
+    uint32_t                    target;
+    uint16_t                    interface_index;
+    uint16_t                    type;
+    uint32_t                    ttl;
+    uint32_t                    last_seen;      // Seconds (see inventory_clock)
+} inventory_record_t;
+
+// Per thread table
+// NB: Only written by the bridge thread for the ip type. Strings are
+//     stored once, as a length byte followed by the data, and are never
+//     modified until the table is compacted. The table is compacted under
+//     a sequence lock, so that readers may copy it without blocking the
+//     bridge thread. The sequence is odd while the table is being compacted.
+//     The sizes are set by inventory_initialize and do not change.
+typedef struct
+{
+    uint32_t                    sequence;
+    uint64_t                    expired;
+    uint64_t                    evicted;
+    unsigned int                record_count;
+    unsigned int                string_count;
+    unsigned int                string_used;
+    unsigned int                record_max;     // Records in use at which the table is compacted
+    unsigned int                record_slots;   // Power of 2
+    unsigned int                string_max;     // Strings in use at which the table is compacted
+    unsigned int                string_slots;   // Power of 2
+    unsigned int                string_space_size;
+    inventory_record_t *        records;        // [record_slots]
+    uint32_t *                  strings;        // [string_slots]
+    unsigned char *             string_space;   // [string_space_size]
+
+    // Copies of the records and strings used by compaction
+    inventory_record_t *        compact_records;        // [record_max]
+    unsigned char *             compact_string_space;   // [string_space_size]
+} inventory_thread_t;
+
+static inventory_thread_t       inventory_thread[NUM_IP_TYPES];
+
+
+
+//
+// Get the number of hash slots for a number of entries
+//
+//   The slots are a power of 2, with at most 3/4 of them in use.
+//
+static unsigned int inventory_slots(
+    unsigned int                count)
+{
+    unsigned int                slots = 16;
+
+    while (slots / 4 * 3 < count)
+    {
+        slots *= 2;
+    }
+    return slots;
+}
+
+
+//
+// Allocate the service inventory
+//
+//   The size is the maximum number of records for each ip type.
+//
+//   NOTE: This MUST be called before the bridge threads are started.
+//
+void inventory_initialize(
+    unsigned int                size)
+{
+    inventory_thread_t *        thread;
+    unsigned int                ip_type;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        thread = &inventory_thread[ip_type];
+        thread->record_max = size;
+        thread->record_slots = inventory_slots(size);
+        thread->string_max = size * INVENTORY_STRINGS_PER_RECORD;
+        thread->string_slots = inventory_slots(thread->string_max);
+        thread->string_space_size = size * INVENTORY_BYTES_PER_RECORD;
+
+        thread->records = calloc(thread->record_slots, sizeof(inventory_record_t));
+        thread->strings = calloc(thread->string_slots, sizeof(uint32_t));
+        thread->string_space = calloc(thread->string_space_size, 1);
+        thread->compact_records = calloc(thread->record_max, sizeof(inventory_record_t));
+        thread->compact_string_space = calloc(thread->string_space_size, 1);
+        if (thread->records == NULL || thread->strings == NULL || thread->string_space == NULL ||
+            thread->compact_records == NULL || thread->compact_string_space == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+
+        // NB: Offset zero is reserved to mean no string
+        thread->string_used = 1;
+    }
+}
+
+
+//
+// Read the clock used for the inventory, in seconds
+//
+uint32_t inventory_clock(void)
+{
+    return (uint32_t) (timer_clock_ticks() / (1000 / TIMER_TICK_MSEC));
+}
+
+
+//
+// Hash a byte string
+//
+static uint64_t inventory_hash(
+    uint64_t                    hash,
+    const unsigned char *       data,
+    unsigned int                length)
+{
+    unsigned int                index;
+
+    for (index = 0; index < length; index++)
+    {
+        hash ^= data[index];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+//
+// Intern a string
+//
+//   Returns the offset of the string, or zero if the limit of strings or
+//   string storage has been reached.
+//
+static uint32_t inventory_intern(
+    inventory_thread_t *        thread,
+    const unsigned char *       data,
+    unsigned int                length,
+    unsigned int                string_max,
+    unsigned int                string_space_max)
+{
+    unsigned char *             string;
+    uint32_t                    offset;
+    unsigned int                index;
+
+    index = (unsigned int) inventory_hash(FNV_OFFSET_BASIS, data, length) & (thread->string_slots - 1);
+    while ((offset = thread->strings[index]) != 0)
+    {
+        string = &thread->string_space[offset];
+        if (string[0] == length && memcmp(string + 1, data, length) == 0)
+        {
+            return offset;
+        }
+        index = (index + 1) & (thread->string_slots - 1);
+    }
+
+    if (thread->string_count >= string_max ||
+        thread->string_used + 1 + length > string_space_max)
+    {
+        return 0;
+    }
+
+    // Store the string
+    offset = thread->string_used;
+    string = &thread->string_space[offset];
+    string[0] = (unsigned char) length;
+    memcpy(string + 1, data, length);
+    thread->string_used += 1 + length;
+
+    thread->strings[index] = offset;
+    thread->string_count += 1;
+    return offset;
+}
+
+
+//
+// Find the slot of a record, or the free slot where it would be added
+//
+static inventory_record_t * inventory_find(
+    inventory_thread_t *        thread,
+    unsigned int                interface_index,
+    unsigned int                type,
+    uint32_t                    owner,
+    uint32_t                    target)
+{
+    inventory_record_t *        record;
+    uint32_t                    key[4];
+    unsigned int                index;
+
+    key[0] = interface_index;
+    key[1] = type;
+    key[2] = owner;
+    key[3] = target;
+    index = (unsigned int) inventory_hash(FNV_OFFSET_BASIS, (const unsigned char *) key, sizeof(key)) & (thread->record_slots - 1);
+
+    while (1)
+    {
+        record = &thread->records[index];
+        if (record->owner == 0 ||
+            (record->owner == owner && record->target == target &&
+             record->interface_index == interface_index && record->type == type))
+        {
+            return record;
+        }
+        index = (index + 1) & (thread->record_slots - 1);
+    }
+}
+
+
+//
+// Compare records by the time last seen, most recent first
+//
+static int inventory_compare_seen(
+    const void *                p1,
+    const void *                p2)
+{
+    const inventory_record_t *  r1 = p1;
+    const inventory_record_t *  r2 = p2;
+
+    if (r1->last_seen != r2->last_seen)
+    {
+        return (int32_t) (r2->last_seen - r1->last_seen) < 0 ? -1 : 1;
+    }
+    return 0;
+}
+
+
+//
+// Compact a table that is full
+//
+//   Records whose TTL has passed are removed. The remaining records are
+//   added again, most recently seen first, until half of the records,
+//   strings or string storage are in use. The records that do not fit are
+//   evicted.
+//
+static void inventory_compact(
+    inventory_thread_t *        thread,
+    uint32_t                    now)
+{
+    inventory_record_t *        compact = thread->compact_records;
+    const unsigned char *       owner;
+    const unsigned char *       target;
+    inventory_record_t *        record;
+    uint32_t                    sequence = thread->sequence;
+    uint32_t                    owner_offset;
+    uint32_t                    target_offset;
+    unsigned int                count = 0;
+    unsigned int                live = 0;
+    unsigned int                index;
+
+    // Copy the records that have not expired, and the strings
+    for (index = 0; index < thread->record_slots; index++)
+    {
+        record = &thread->records[index];
+        if (record->owner == 0)
+        {
+            continue;
+        }
+        count += 1;
+        if (now - record->last_seen <= record->ttl)
+        {
+            compact[live] = *record;
+            live += 1;
+        }
+    }
+    thread->expired += count - live;
+    memcpy(thread->compact_string_space, thread->string_space, thread->string_used);
+    qsort(compact, live, sizeof(inventory_record_t), inventory_compare_seen);
+
+    __atomic_store_n(&thread->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memset(thread->records, 0, thread->record_slots * sizeof(inventory_record_t));
+    memset(thread->strings, 0, thread->string_slots * sizeof(uint32_t));
+    thread->record_count = 0;
+    thread->string_count = 0;
+    thread->string_used = 1;
+
+    // Add the records again
+    for (index = 0; index < live && thread->record_count < thread->record_max / 2; index++)
+    {
+        owner = &thread->compact_string_space[compact[index].owner];
+        target = &thread->compact_string_space[compact[index].target];
+        owner_offset = inventory_intern(thread, owner + 1, owner[0], thread->string_max / 2, thread->string_space_size / 2);
+        target_offset = owner_offset ? inventory_intern(thread, target + 1, target[0], thread->string_max / 2, thread->string_space_size / 2) : 0;
+        if (target_offset == 0)
+        {
+            break;
+        }
+
+        record = inventory_find(thread, compact[index].interface_index, compact[index].type, owner_offset, target_offset);
+        *record = compact[index];
+        record->owner = owner_offset;
+        record->target = target_offset;
+        thread->record_count += 1;
+    }
+    thread->evicted += live - thread->record_count;
+
+    __atomic_store_n(&thread->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+//
+// Record a resource record seen on an interface
+//
+//   The owner and target are the uncompressed labels of the names, or the
+//   address for A and AAAA records. If the table is full, it is compacted.
+//
+//   NOTE: Only called by the bridge thread for the ip type.
+//
+void inventory_record(
+    ip_type_t                   ip_type,
+    unsigned int                interface_index,
+    unsigned int                type,
+    const unsigned char *       owner,
+    unsigned int                owner_len,
+    const unsigned char *       target,
+    unsigned int                target_len,
+    uint32_t                    ttl,
+    uint32_t                    now)
+{
+    inventory_thread_t *        thread = &inventory_thread[ip_type];
+    inventory_record_t *        record;
+    uint32_t                    owner_offset;
+    uint32_t                    target_offset;
+    unsigned int                attempt;
+
+    // NB: Strings are stored with a length byte
+    if (owner_len == 0 || owner_len > UINT8_MAX || target_len == 0 || target_len > UINT8_MAX)
+    {
+        return;
+    }
+
+    // NB: If the table is full, it is compacted and the record is added again
+    for (attempt = 0; attempt < 2; attempt++)
+    {
+        owner_offset = inventory_intern(thread, owner, owner_len, thread->string_max, thread->string_space_size);
+        target_offset = owner_offset ? inventory_intern(thread, target, target_len, thread->string_max, thread->string_space_size) : 0;
+        if (target_offset == 0)
+        {
+            inventory_compact(thread, now);
+            continue;
+        }
+
+        record = inventory_find(thread, interface_index, type, owner_offset, target_offset);
+        if (record->owner)
+        {
+            __atomic_store_n(&record->ttl, ttl, __ATOMIC_RELAXED);
+            __atomic_store_n(&record->last_seen, now, __ATOMIC_RELAXED);
+            return;
+        }
+
+        if (thread->record_count >= thread->record_max)
+        {
+            inventory_compact(thread, now);
+            continue;
+        }
+
+        // Add the record
+        record->target = target_offset;
+        record->interface_index = (uint16_t) interface_index;
+        record->type = (uint16_t) type;
+        __atomic_store_n(&record->ttl, ttl, __ATOMIC_RELAXED);
+        __atomic_store_n(&record->last_seen, now, __ATOMIC_RELAXED);
+        __atomic_store_n(&record->owner, owner_offset, __ATOMIC_RELEASE);
+        thread->record_count += 1;
+        return;
+    }
+}
+
+
+//
+// Copy an interned string as text
+//
+//   The string is a name, or an address if family is set. Returns 1 if the
+//   string is valid, or 0 if it is not (the table is being compacted).
+//
+static unsigned int inventory_string(
+    const inventory_thread_t *  thread,
+    uint32_t                    offset,
+    int                         family,
+    char                        string[DNS_MAX_NAME_LEN])
+{
+    unsigned char               data[UINT8_MAX];
+    unsigned int                length;
+    unsigned int                index;
+
+    // Copy the string
+    if (offset == 0 || offset >= thread->string_space_size)
+    {
+        return 0;
+    }
+    length = __atomic_load_n(&thread->string_space[offset], __ATOMIC_RELAXED);
+    if (length == 0 || offset + 1 + length > thread->string_space_size)
+    {
+        return 0;
+    }
+    memcpy(data, &thread->string_space[offset + 1], length);
+
+    // Addresses
+    if (family)
+    {
+        if (length != (family == AF_INET ? 4 : 16))
+        {
+            return 0;
+        }
+        return inet_ntop(family, data, string, DNS_MAX_NAME_LEN) != NULL;
+    }
+
+    // Names
+    // NB: The labels are validated, as the copy may be inconsistent
+    for (index = 0; index < length && data[index]; index += data[index] + 1)
+    {
+        if (data[index] >= DNS_MAX_LABEL_LEN)
+        {
+            return 0;
+        }
+    }
+    if (index >= length)
+    {
+        return 0;
+    }
+    dns_labels_to_string(data, index + 1, (unsigned char *) string);
+    return 1;
+}
+
+
+//
+// Copy the records of a table
+//
+//   Returns the number of entries added, or -1 if the table was compacted
+//   while it was being copied.
+//
+static int inventory_copy(
+    const inventory_thread_t *  thread,
+    inventory_entry_t *         entries,
+    uint32_t                    now)
+{
+    const inventory_record_t *  record;
+    inventory_entry_t *         entry;
+    uint32_t                    sequence;
+    uint32_t                    owner;
+    uint32_t                    last_seen;
+    unsigned int                index;
+    int                         family;
+    int                         count = 0;
+
+    sequence = __atomic_load_n(&thread->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1)
+    {
+        return -1;
+    }
+
+    for (index = 0; index < thread->record_slots && count < (int) thread->record_max; index++)
+    {
+        record = &thread->records[index];
+        owner = __atomic_load_n(&record->owner, __ATOMIC_ACQUIRE);
+        if (owner == 0)
+        {
+            continue;
+        }
+
+        entry = &entries[count];
+        entry->interface_index = record->interface_index;
+        entry->type = record->type;
+        entry->ttl = __atomic_load_n(&record->ttl, __ATOMIC_RELAXED);
+        last_seen = __atomic_load_n(&record->last_seen, __ATOMIC_RELAXED);
+        entry->age = now - last_seen;
+        family = entry->type == DNS_TYPE_A ? AF_INET : entry->type == DNS_TYPE_AAAA ? AF_INET6 : 0;
+        if (entry->interface_index >= configured_interface_count ||
+            inventory_string(thread, owner, 0, entry->owner) == 0 ||
+            inventory_string(thread, record->target, family, entry->target) == 0)
+        {
+            continue;
+        }
+        count++;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&thread->sequence, __ATOMIC_RELAXED) != sequence)
+    {
+        return -1;
+    }
+    return count;
+}
+
+
+//
+// Compare inventory entries by interface, owner, type and target
+//
+static int inventory_compare(
+    const void *                p1,
+    const void *                p2)
+{
+    const inventory_entry_t *   e1 = p1;
+    const inventory_entry_t *   e2 = p2;
+    int                         r;
+
+    if (e1->interface_index != e2->interface_index)
+    {
+        return e1->interface_index < e2->interface_index ? -1 : 1;
+    }
+    r = strcasecmp(e1->owner, e2->owner);
+    if (r)
+    {
+        return r;
+    }
+    if (e1->type != e2->type)
+    {
+        return e1->type < e2->type ? -1 : 1;
+    }
+    return strcasecmp(e1->target, e2->target);
+}
+
+
+//
+// Read the service inventory
+//
+//   The ip types are combined, and the entries are sorted by interface,
+//   owner name, type and target. Entries seen on both ip types are merged,
+//   keeping the most recent. Returns the number of entries, and sets entries
+//   to an allocated array that must be freed by the caller. The number of
+//   records removed because their TTL passed, and the number evicted to make
+//   space, are also returned.
+//
+unsigned int inventory_read(
+    inventory_entry_t **        entries_ptr,
+    uint64_t *                  expired,
+    uint64_t *                  evicted)
+{
+    inventory_entry_t *         entries;
+    uint32_t                    now = inventory_clock();
+    unsigned int                count = 0;
+    unsigned int                unique;
+    unsigned int                ip_type;
+    unsigned int                attempt;
+    unsigned int                index;
+    int                         r;
+
+    entries = calloc(inventory_thread[IPV4].record_max + inventory_thread[IPV6].record_max, sizeof(inventory_entry_t));
+    if (entries == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+
+    *expired = 0;
+    *evicted = 0;
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        for (attempt = 0; attempt < INVENTORY_READ_ATTEMPTS; attempt++)
+        {
+            r = inventory_copy(&inventory_thread[ip_type], &entries[count], now);
+            if (r >= 0)
+            {
+                count += (unsigned int) r;
+                break;
+            }
+        }
+        *expired += __atomic_load_n(&inventory_thread[ip_type].expired, __ATOMIC_RELAXED);
+        *evicted += __atomic_load_n(&inventory_thread[ip_type].evicted, __ATOMIC_RELAXED);
+    }
+
+    // Sort and merge the duplicates
+    qsort(entries, count, sizeof(inventory_entry_t), inventory_compare);
+    unique = count ? 1 : 0;
+    for (index = 1; index < count; index++)
+    {
+        if (inventory_compare(&entries[unique - 1], &entries[index]) == 0)
+        {
+            if (entries[index].age < entries[unique - 1].age)
+            {
+                entries[unique - 1].age = entries[index].age;
+                entries[unique - 1].ttl = entries[index].ttl;
+            }
+            continue;
+        }
+        if (unique != index)
+        {
+            entries[unique] = entries[index];
+        }
+        unique++;
+    }
+
+    *entries_ptr = entries;
+    return unique;
+}
@@ -0,0 +1,576 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <netdb.h>
+
+#include "common.h"
+
+
+// Size of the log queue (must be a power of 2)
+#define LOG_QUEUE_SIZE          256
+
+// Maximum length of a log message
+#define LOG_MESSAGE_LEN         512
+
+// Maximum length of a log message including the host address
+#define LOG_FORMATTED_LEN       (LOG_MESSAGE_LEN + INET6_ADDRSTRLEN + 8)
+
+// Rate limit: messages of a type allowed in each interval
+#define LOG_RATE_BURST          10
+#define LOG_RATE_INTERVAL_SEC   10
+
+// Number of message types tracked for rate limiting (must be a power of 2)
+#define LOG_RATE_TYPES          128
+
+// Log queue entry
+// NB: The sequence implements a bounded multiple producer queue. A producer
+//     owns an entry when the sequence equals the position it has claimed, and
+//     publishes it by setting the sequence to the position + 1. The consumer
+//     releases the entry by setting the sequence to the position + the queue
+//     size.
+typedef struct
+{
+    uint64_t                    sequence;
+    const char *                type;           // Format of the message
+    unsigned int                has_address;
+    socket_address_t            address;
+    char                        message[LOG_MESSAGE_LEN];
+} log_entry_t;
+
+// Rate limit state of a message type
+typedef struct
+{
+    const char *                type;
+    time_t                      window_start;
+    unsigned int                count;
+    unsigned int                suppressed;
+    char                        last[LOG_FORMATTED_LEN];
+} log_rate_t;
+
+
+// Log destination
+static unsigned int             log_syslog = 0;
+
+// Log queue
+static log_entry_t              log_queue[LOG_QUEUE_SIZE];
+static uint64_t                 log_enqueue_position __attribute__ ((aligned (64)));
+static uint64_t                 log_dequeue_position __attribute__ ((aligned (64)));
+static uint64_t                 log_dropped;
+
+// Logging thread state
+// NB: The drain mutex serializes the consumers (the logging thread and
+//     logger_flush). Producers never take it.
+static unsigned int             log_started = 0;
+static unsigned int             log_sleeping = 0;
+static int                      log_wakeup[2] = { -1, -1 };
+static pthread_mutex_t          log_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static log_rate_t               log_rates[LOG_RATE_TYPES];
+static unsigned int             log_rate_pending = 0;
+
+
+
+//
+// Write a message to the log destination
+//
+static void log_write(
+    const char *                message)
+{
+    if (log_syslog)
+    {
+        syslog(LOG_WARNING, "%s", message);
+    }
+    else
+    {
+        (void) fputs(message, stderr);
+    }
+}
+
+
+//
+// Format a queue entry
+//
+static void log_format_entry(
+    const log_entry_t *         entry,
+    char *                      message,
+    size_t                      size)
+{
+    char                        addr_str[INET6_ADDRSTRLEN];
+    socklen_t                   addr_len;
+
+    if (entry->has_address == 0)
+    {
+        (void) snprintf(message, size, "%s", entry->message);
+        return;
+    }
+
+    addr_len = entry->address.sa.sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    if (getnameinfo(&entry->address.sa, addr_len, addr_str, sizeof(addr_str), NULL, 0, NI_NUMERICHOST) != 0)
+    {
+        strcpy(addr_str, "(unknown)");
+    }
+    (void) snprintf(message, size, "host %s %s", addr_str, entry->message);
+}
+
+
+//
+// Format and write a queue entry
+//
+static void log_write_entry(
+    const log_entry_t *         entry)
+{
+    char                        message[LOG_FORMATTED_LEN];
+
+    log_format_entry(entry, message, sizeof(message));
+    log_write(message);
+}
+
+
+//
+// Report the messages suppressed for a message type
+//
+static void log_rate_report(
+    log_rate_t *                rate)
+{
+    char                        message[LOG_FORMATTED_LEN + 64];
+
+    (void) snprintf(message, sizeof(message), "%u similar messages suppressed, last: %s",
+                    rate->suppressed, rate->last);
+    log_write(message);
+    rate->suppressed = 0;
+}
+
+
+//
+// Check the rate limit for a queue entry
+//
+//   Returns 1 if the entry should be written, or 0 if it is suppressed.
+//
+static unsigned int log_rate_check(
+    const log_entry_t *         entry,
+    time_t                      now)
+{
+    log_rate_t *                rate;
+    unsigned int                index;
+    unsigned int                probe;
+
+    // Find the message type
+    index = (unsigned int) (((uintptr_t) entry->type >> 3) * 2654435761u) & (LOG_RATE_TYPES - 1);
+    for (probe = 0; probe < LOG_RATE_TYPES; probe++)
+    {
+        rate = &log_rates[(index + probe) & (LOG_RATE_TYPES - 1)];
+        if (rate->type == entry->type || rate->type == NULL)
+        {
+            break;
+        }
+    }
+    if (probe == LOG_RATE_TYPES)
+    {
+        // Too many message types to track
+        return 1;
+    }
+
+    if (rate->type == NULL)
+    {
+        rate->type = entry->type;
+        rate->window_start = now;
+    }
+
+    // Start a new window if the interval has passed
+    if (now - rate->window_start >= LOG_RATE_INTERVAL_SEC)
+    {
+        if (rate->suppressed)
+        {
+            log_rate_report(rate);
+        }
+        rate->window_start = now;
+        rate->count = 0;
+    }
+
+    rate->count += 1;
+    if (rate->count <= LOG_RATE_BURST)
+    {
+        return 1;
+    }
+
+    // Suppress the message, keeping it for the summary
+    rate->suppressed += 1;
+    log_format_entry(entry, rate->last, sizeof(rate->last));
+    log_rate_pending = 1;
+    return 0;
+}
+
+
+//
+// Report the suppressed messages of message types whose window has passed
+//
+//   If final is set, all suppressed messages are reported.
+//
+static void log_rate_sweep(
+    time_t                      now,
+    unsigned int                final)
+{
+    unsigned int                index;
+    unsigned int                pending = 0;
+
+    for (index = 0; index < LOG_RATE_TYPES; index++)
+    {
+        if (log_rates[index].suppressed)
+        {
+            if (final || now - log_rates[index].window_start >= LOG_RATE_INTERVAL_SEC)
+            {
+                log_rate_report(&log_rates[index]);
+            }
+            else
+            {
+                pending = 1;
+            }
+        }
+    }
+    log_rate_pending = pending;
+}
+
+
+//
+// Read the monotonic clock in seconds
+//
+static time_t log_clock(void)
+{
+    struct timespec             ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+
+//
+// Drain the log queue
+//
+//   If final is set, all suppressed messages are reported.
+//
+//   NOTE: Called with log_drain_mutex held.
+//
+static void log_drain(
+    unsigned int                final)
+{
+    log_entry_t *               entry;
+    uint64_t                    position;
+    uint64_t                    dropped;
+    char                        message[64];
+    time_t                      now = log_clock();
+
+    while (1)
+    {
+        position = log_dequeue_position;
+        entry = &log_queue[position & (LOG_QUEUE_SIZE - 1)];
+        if (__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) != position + 1)
+        {
+            break;
+        }
+
+        if (log_rate_check(entry, now))
+        {
+            log_write_entry(entry);
+        }
+
+        __atomic_store_n(&entry->sequence, position + LOG_QUEUE_SIZE, __ATOMIC_RELEASE);
+        log_dequeue_position = position + 1;
+    }
+
+    dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped)
+    {
+        (void) snprintf(message, sizeof(message), "%llu log messages dropped (queue full)\n", (unsigned long long) dropped);
+        log_write(message);
+    }
+
+    if (log_rate_pending)
+    {
+        log_rate_sweep(now, final);
+    }
+}
+
+
+//
+// Logging thread
+//
+__attribute__ ((noreturn))
+static void * log_thread(
+    __attribute__ ((unused)) void * arg)
+{
+    struct pollfd               pfd;
+    char                        buffer[64];
+    sigset_t                    sigset;
+
+    // Signals are never handled by the logging thread, so that the
+    // termination handler can always flush the log
+    sigfillset(&sigset);
+    (void) pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    pfd.fd = log_wakeup[0];
+    pfd.events = POLLIN;
+
+    while (1)
+    {
+        pthread_mutex_lock(&log_drain_mutex);
+        log_drain(0);
+        pthread_mutex_unlock(&log_drain_mutex);
+
+        // Sleep until a producer wakes the thread
+        // NB: The queue is checked again after announcing the sleep, so that
+        //     an entry queued before the announcement is not missed.
+        __atomic_store_n(&log_sleeping, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&log_queue[log_dequeue_position & (LOG_QUEUE_SIZE - 1)].sequence, __ATOMIC_SEQ_CST) == log_dequeue_position + 1)
+        {
+            __atomic_store_n(&log_sleeping, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        (void) poll(&pfd, 1, log_rate_pending ? 1000 : -1);
+        __atomic_store_n(&log_sleeping, 0, __ATOMIC_RELAXED);
+        while (read(log_wakeup[0], buffer, sizeof(buffer)) > 0)
+        {
+            continue;
+        }
+    }
+}
+
+
+//
+// Queue a message
+//
+//   NB: Never blocks. If the queue is full, the message is dropped and
+//       counted.
+//
+static void log_enqueue(
+    const char *                type,
+    const socket_address_t *    address,
+    const char *                prefix,
+    const char *                format,
+    va_list                     args)
+{
+    log_entry_t *               entry;
+    uint64_t                    position;
+    uint64_t                    sequence;
+    int64_t                     diff;
+    size_t                      len = 0;
+
+    position = __atomic_load_n(&log_enqueue_position, __ATOMIC_RELAXED);
+    while (1)
+    {
+        entry = &log_queue[position & (LOG_QUEUE_SIZE - 1)];
+        sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+        diff = (int64_t) (sequence - position);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&log_enqueue_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The queue is full
+            (void) __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            position = __atomic_load_n(&log_enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+
+    entry->type = type;
+    entry->has_address = address != NULL;
+    if (address)
+    {
+        entry->address = *address;
+    }
+    if (prefix)
+    {
+        len = (size_t) snprintf(entry->message, sizeof(entry->message), "%s: ", prefix);
+    }
+    (void) vsnprintf(entry->message + len, sizeof(entry->message) - len, format, args);
+    if (address)
+    {
+        // Messages about hosts are formatted without a trailing newline
+        len = strlen(entry->message);
+        if (len < sizeof(entry->message) - 1)
+        {
+            entry->message[len] = '\n';
+            entry->message[len + 1] = 0;
+        }
+    }
+
+    // NB: Sequentially consistent, so that the store is ordered before the
+    //     check of log_sleeping below
+    __atomic_store_n(&entry->sequence, position + 1, __ATOMIC_SEQ_CST);
+
+    // Wake the logging thread if it is sleeping
+    if (__atomic_load_n(&log_sleeping, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&log_sleeping, 0, __ATOMIC_SEQ_CST))
+    {
+        (void) write(log_wakeup[1], "", 1);
+    }
+}
+
+
+//
+// Set the log destination
+//
+void logger_initialize(
+    unsigned int                use_syslog)
+{
+    unsigned int                index;
+
+    log_syslog = use_syslog;
+    for (index = 0; index < LOG_QUEUE_SIZE; index++)
+    {
+        log_queue[index].sequence = index;
+    }
+}
+
+
+//
+// Start the logging thread
+//
+//   Until the logging thread is started, messages are written directly.
+//
+//   NOTE: This MUST be called after the process has been backgrounded.
+//
+void logger_start(void)
+{
+    pthread_t                   thread_id;
+    int                         r;
+
+    if (pipe(log_wakeup) == -1)
+    {
+        fatal("cannot create log pipe: %s\n", strerror(errno));
+    }
+    (void) fcntl(log_wakeup[0], F_SETFL, O_NONBLOCK);
+    (void) fcntl(log_wakeup[1], F_SETFL, O_NONBLOCK);
+    (void) fcntl(log_wakeup[0], F_SETFD, FD_CLOEXEC);
+    (void) fcntl(log_wakeup[1], F_SETFD, FD_CLOEXEC);
+
+    r = pthread_create(&thread_id, NULL, &log_thread, NULL);
+    if (r != 0)
+    {
+        fatal("cannot create log thread: %s\n", strerror(r));
+    }
+    (void) pthread_detach(thread_id);
+
+    // Write any queued messages on exit
+    (void) atexit(logger_flush);
+    __atomic_store_n(&log_started, 1, __ATOMIC_RELEASE);
+}
+
+
+//
+// Write any queued messages, and report any suppressed messages
+//
+void logger_flush(void)
+{
+    if (__atomic_load_n(&log_started, __ATOMIC_ACQUIRE) == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&log_drain_mutex);
+    log_drain(1);
+    pthread_mutex_unlock(&log_drain_mutex);
+}
+
+
+//
+// Log abnormal events
+//
+//   Messages are rate limited by their format.
+//
+__attribute__ ((format (printf, 1, 2)))
+void logger(
+    const char *                format,
+    ...)
+{
+    va_list                     args;
+
+    va_start(args, format);
+    if (__atomic_load_n(&log_started, __ATOMIC_ACQUIRE))
+    {
+        log_enqueue(format, NULL, NULL, format, args);
+    }
+    else if (log_syslog)
+    {
+        vsyslog(LOG_WARNING, format, args);
+    }
+    else
+    {
+        vfprintf(stderr, format, args);
+    }
+    va_end(args);
+}
+
+
+//
+// Log an abnormal event caused by a host
+//
+//   The message is logged as "host <address> <what>: <message>". The address
+//   is formatted by the logging thread. Messages are rate limited by their
+//   format.
+//
+void vlogger_host(
+    const socket_address_t *    address,
+    const char *                what,
+    const char *                format,
+    va_list                     args)
+{
+    log_entry_t                 entry;
+
+    if (__atomic_load_n(&log_started, __ATOMIC_ACQUIRE))
+    {
+        log_enqueue(format, address, what, format, args);
+        return;
+    }
+
+    // Format the message directly
+    entry.has_address = 1;
+    entry.address = *address;
+    (void) snprintf(entry.message, sizeof(entry.message), "%s: ", what);
+    (void) vsnprintf(entry.message + strlen(entry.message), sizeof(entry.message) - strlen(entry.message), format, args);
+    (void) strncat(entry.message, "\n", sizeof(entry.message) - strlen(entry.message) - 1);
+    log_write_entry(&entry);
+}
@@ -36,10 +36,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
-#include <syslog.h>
+#include <pthread.h>
 #include <sys/file.h>
 
 #include "common.h"
+#include "profile.h"
 
 
 // Who we are
@@ -57,29 +58,6 @@ static const char *             pidfile_name = NULL;
 const char *                    config_filename = DEFAULT_CONFIG_FILE;
 
 
-//
-// Log abnormal events
-//
-__attribute__ ((format (printf, 1, 2)))
-void logger(
-    const char *                format,
-    ...)
-{
-    va_list                     args;
-
-    va_start(args, format);
-    if (flag_syslog)
-    {
-        vsyslog(LOG_WARNING, format, args);
-    }
-    else
-    {
-        vfprintf(stderr, format, args);
-    }
-    va_end(args);
-}
-
-
 //
 // Report a fatal error
 //
@@ -90,6 +68,9 @@ void fatal(
 {
     va_list                     args;
 
+    // Write any queued messages first
+    logger_flush();
+
     va_start(args, format);
     vfprintf(stderr, format, args);
     va_end(args);
@@ -110,6 +91,7 @@ static void term_handler(
     {
         (void) unlink(pidfile_name);
     }
+    control_cleanup();
     logger("exiting on signal %d\n", signum);
     exit(0);
 }
@@ -160,7 +142,8 @@ static void parse_args(
 //
 // Create pid file
 //
-static int create_pidfile(void)
+static int create_pidfile(
+    unsigned int                handoff)
 {
     int                         pidfile_fd = -1;
     char                        pidbuf[64];
@@ -201,8 +184,9 @@ static int create_pidfile(void)
         {
             pidbuf[rs] = 0;
 
+            // NB: Following a handoff, the pid is that of the previous process
             pid = (pid_t) strtol(pidbuf, NULL, 10);
-            if (pid > 0)
+            if (pid > 0 && (handoff == 0 || pid != getppid()))
             {
                 // Is the pid still alive?
                 r = kill(pid, 0);
@@ -265,11 +249,15 @@ int main(
     char                        *argv[])
 {
     int                         pidfile_fd = -1;
+    int                         handoff_fd;
     pid_t                       pid;
     struct sigaction            act;
+    sigset_t                    sigset;
+    int                         signum;
 
     // Handle command line args
     parse_args(argc, argv);
+    logger_initialize(flag_syslog);
 
     // Read config file
     read_config();
@@ -280,6 +268,15 @@ int main(
     // Set the IP specific interface lists
     set_ip_interface_lists();
 
+    // Allocate the statistics, service type accounting and service inventory
+    stats_initialize();
+    topk_initialize();
+    inventory_initialize(current_config->inventory_size);
+
+    // Receive the interface sockets if started by a handoff or a service manager
+    handoff_fd = handoff_receive();
+    os_adopt_listen_fds();
+
     // Initialize the sockets
     os_initialize_sockets();
 
@@ -287,6 +284,7 @@ int main(
     if (foreground)
     {
         dump_config();
+        os_dump_socket_timing();
     }
 
     // Termination handler
@@ -295,14 +293,19 @@ int main(
     (void) sigaction(SIGTERM, &act, NULL);
     (void) sigaction(SIGINT, &act, NULL);
 
+    // Ignore SIGPIPE
+    act.sa_handler = SIG_IGN;
+    (void) sigaction(SIGPIPE, &act, NULL);
+
     // Create pid file if requested
     if (pidfile_name)
     {
-        pidfile_fd = create_pidfile();
+        pidfile_fd = create_pidfile(handoff_fd != -1);
     }
 
     // Self background
-    if (foreground == 0)
+    // NB: Following a handoff, the process is already in the background
+    if (foreground == 0 && handoff_fd == -1)
     {
         pid = fork();
 
@@ -325,12 +328,63 @@ int main(
         write_pidfile(pidfile_fd);
     }
 
+    // Block the signals handled by the main thread
+    // NB: This must be done before the bridge threads are created so that
+    //     the signals are blocked in all threads.
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGHUP);
+    sigaddset(&sigset, SIGUSR2);
+#if defined(ENABLE_PROFILE)
+    sigaddset(&sigset, SIGUSR1);
+#endif
+    (void) pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    // Start the logging thread
+    logger_start();
+
+#if defined(ENABLE_PROFILE)
+    // Write the profile on exit
+    (void) atexit(profile_report);
+#endif
+
     // Start the bridge(s)
     logger("mDNS Bridge version %s starting\n", VERSION);
     start_bridges();
 
-    // Wait (forever)
-    pause();
+    // Start the control socket
+    control_start();
+
+    // Confirm the handoff
+    if (handoff_fd != -1)
+    {
+        handoff_complete(handoff_fd);
+    }
+
+    // Wait (forever) for signals
+    while (1)
+    {
+        if (sigwait(&sigset, &signum) != 0)
+        {
+            continue;
+        }
+
+        if (signum == SIGHUP)
+        {
+            logger("Reloading configuration on signal %d\n", signum);
+            reload_config();
+        }
+        else if (signum == SIGUSR2)
+        {
+            logger("Handing off to a new process on signal %d\n", signum);
+            handoff_start(argv);
+        }
+#if defined(ENABLE_PROFILE)
+        else if (signum == SIGUSR1)
+        {
+            profile_report();
+        }
+#endif
+    }
 
     return 0;
 }
@@ -0,0 +1,331 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/socket.h>
+
+#include "common.h"
+
+
+//
+// Ensure we have netlink or a routing socket
+//
+#if defined(__linux__)
+# define HAVE_NETLINK
+#elif defined(__FreeBSD__) || defined(__APPLE__)
+# define HAVE_ROUTE_SOCKET
+#endif
+
+#if defined(HAVE_NETLINK)
+# include <linux/netlink.h>
+# include <linux/rtnetlink.h>
+#elif defined(HAVE_ROUTE_SOCKET)
+# include <net/route.h>
+#else
+# error netlink or routing socket is required
+#endif
+
+
+// Size of the monitor receive buffer
+#define MONITOR_BUFFER_SIZE     8192
+
+
+
+//
+// Mark an interface as requiring a check
+//
+//   NOTE: An interface is matched by its last known index, or by name if the
+//         name is known. If the name is not known, it is looked up from the
+//         index to catch interfaces that did not exist at the last check.
+//
+static unsigned int mark_interface(
+    ip_type_t                   ip_type,
+    unsigned int                if_index,
+    const char *                name)
+{
+    interface_t *               interface;
+    char                        name_buffer[IF_NAMESIZE];
+    unsigned int                index;
+    unsigned int                count = 0;
+
+    if (name == NULL)
+    {
+        name = if_indextoname(if_index, name_buffer);
+    }
+
+    for (index = 0; index < ip_interface_count[ip_type]; index++)
+    {
+        interface = ip_interface_list[ip_type][index];
+        if (interface->if_index[ip_type] == if_index || (name && strcmp(interface->name, name) == 0))
+        {
+            interface->check_pending[ip_type] = 1;
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+
+//
+// Mark all interfaces as requiring a check
+//
+static unsigned int mark_all_interfaces(
+    ip_type_t                   ip_type)
+{
+    unsigned int                index;
+
+    for (index = 0; index < ip_interface_count[ip_type]; index++)
+    {
+        ip_interface_list[ip_type][index]->check_pending[ip_type] = 1;
+    }
+
+    return ip_interface_count[ip_type];
+}
+
+
+#if defined(HAVE_NETLINK)
+
+//
+// Open a monitor for system interface and address changes
+//
+int os_monitor_open(
+    ip_type_t                   ip_type)
+{
+    struct sockaddr_nl          snl;
+    int                         sock;
+    int                         r;
+
+    sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (sock == -1)
+    {
+        fatal("netlink socket creation failed: %s\n", strerror(errno));
+    }
+
+    // Subscribe to link changes, and address changes for the ip type
+    memset(&snl, 0, sizeof(snl));
+    snl.nl_family = AF_NETLINK;
+    snl.nl_groups = RTMGRP_LINK | (ip_type == IPV4 ? RTMGRP_IPV4_IFADDR : RTMGRP_IPV6_IFADDR);
+    r = bind(sock, (struct sockaddr *) &snl, sizeof(snl));
+    if (r == -1)
+    {
+        fatal("netlink bind failed: %s\n", strerror(errno));
+    }
+
+    (void) fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    (void) fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+    return sock;
+}
+
+
+//
+// Process a buffer of netlink messages
+//
+static unsigned int process_messages(
+    ip_type_t                   ip_type,
+    const void *                buffer,
+    int                         bytes)
+{
+    const struct nlmsghdr *     nlh;
+    const struct ifinfomsg *    ifi;
+    const struct ifaddrmsg *    ifa;
+    const struct rtattr *       rta;
+    const char *                name;
+    int                         rta_bytes;
+    unsigned int                count = 0;
+
+    for (nlh = buffer; NLMSG_OK(nlh, bytes); nlh = NLMSG_NEXT(nlh, bytes))
+    {
+        switch (nlh->nlmsg_type)
+        {
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+                ifi = NLMSG_DATA(nlh);
+
+                // Find the interface name
+                name = NULL;
+                rta_bytes = IFLA_PAYLOAD(nlh);
+                for (rta = IFLA_RTA(ifi); RTA_OK(rta, rta_bytes); rta = RTA_NEXT(rta, rta_bytes))
+                {
+                    if (rta->rta_type == IFLA_IFNAME)
+                    {
+                        name = RTA_DATA(rta);
+                        break;
+                    }
+                }
+
+                count += mark_interface(ip_type, ifi->ifi_index, name);
+                break;
+
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                ifa = NLMSG_DATA(nlh);
+                count += mark_interface(ip_type, ifa->ifa_index, NULL);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return count;
+}
+
+#elif defined(HAVE_ROUTE_SOCKET)
+
+//
+// Open a monitor for system interface and address changes
+//
+int os_monitor_open(
+    ip_type_t                   ip_type)
+{
+    int                         sock;
+
+    // NB: Interface messages are not specific to an address family, so all
+    //     messages are received. Address messages for the other ip type
+    //     cause a harmless check.
+    (void) ip_type;
+    sock = socket(PF_ROUTE, SOCK_RAW, AF_UNSPEC);
+    if (sock == -1)
+    {
+        fatal("routing socket creation failed: %s\n", strerror(errno));
+    }
+
+    (void) fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    (void) fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+    return sock;
+}
+
+
+//
+// Process a buffer of routing messages
+//
+static unsigned int process_messages(
+    ip_type_t                   ip_type,
+    const void *                buffer,
+    int                         bytes)
+{
+    const struct rt_msghdr *    rtm;
+    const char *                ptr = buffer;
+    unsigned int                count = 0;
+
+    while (bytes >= (int) sizeof(struct rt_msghdr))
+    {
+        rtm = (const struct rt_msghdr *) ptr;
+        if (rtm->rtm_msglen < sizeof(struct rt_msghdr) || rtm->rtm_msglen > bytes)
+        {
+            break;
+        }
+
+        if (rtm->rtm_version == RTM_VERSION)
+        {
+            switch (rtm->rtm_type)
+            {
+                case RTM_IFINFO:
+                    count += mark_interface(ip_type, ((const struct if_msghdr *) rtm)->ifm_index, NULL);
+                    break;
+
+                case RTM_NEWADDR:
+                case RTM_DELADDR:
+                    count += mark_interface(ip_type, ((const struct ifa_msghdr *) rtm)->ifam_index, NULL);
+                    break;
+
+#if defined(RTM_IFANNOUNCE)
+                case RTM_IFANNOUNCE:
+                    count += mark_interface(ip_type, ((const struct if_announcemsghdr *) rtm)->ifan_index,
+                                            ((const struct if_announcemsghdr *) rtm)->ifan_name);
+                    break;
+#endif
+
+                default:
+                    break;
+            }
+        }
+
+        ptr += rtm->rtm_msglen;
+        bytes -= rtm->rtm_msglen;
+    }
+
+    return count;
+}
+
+#endif
+
+
+//
+// Read interface change messages from the monitor
+//
+//   Returns the number of interfaces marked as requiring a check.
+//
+unsigned int os_monitor_read(
+    int                         monitor_fd,
+    ip_type_t                   ip_type)
+{
+    long                        buffer[MONITOR_BUFFER_SIZE / sizeof(long)];
+    ssize_t                     bytes;
+    unsigned int                count = 0;
+
+    while (1)
+    {
+        bytes = recv(monitor_fd, buffer, sizeof(buffer), 0);
+        if (bytes == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // If messages were lost, check everything
+            if (errno == ENOBUFS)
+            {
+                logger("Interface monitor overflow (checking all interfaces)\n");
+                count += mark_all_interfaces(ip_type);
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                logger("recv error on interface monitor: %s\n", strerror(errno));
+            }
+            break;
+        }
+
+        count += process_messages(ip_type, buffer, (int) bytes);
+    }
+
+    return count;
+}
@@ -0,0 +1,118 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef _PROBES_H
+#define _PROBES_H 1
+
+//
+// USDT (SystemTap/DTrace style) static probes
+//
+// Probes are compiled out unless mdns-bridge is built with ENABLE_PROBES
+// defined. When enabled, each probe is a single nop in the code, plus a
+// .note.stapsdt ELF note that describes the probe location and arguments to
+// tools such as bpftrace, perf and SystemTap. All arguments are passed as
+// signed 64 bit values.
+//
+// This is a minimal implementation of the note format defined by
+// <sys/sdt.h>, so that no external headers are required.
+//
+
+#if defined(ENABLE_PROBES)
+
+#include <stdint.h>
+
+#if __SIZEOF_POINTER__ == 8
+#define _PROBE_ADDR             ".8byte"
+#else
+#define _PROBE_ADDR             ".4byte"
+#endif
+
+#define _PROBE_ARG(n)           "-8@%[a" #n "]"
+#define _PROBE_OPERAND(n, v)    [a##n] "nor" ((int64_t) (v))
+
+#define _PROBE(name, args, ...)                                                 \
+    __asm__ __volatile__ (                                                      \
+        "990: nop\n"                                                            \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+        ".balign 4\n"                                                           \
+        ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+        "991: .asciz \"stapsdt\"\n"                                             \
+        "992: .balign 4\n"                                                      \
+        "993: " _PROBE_ADDR " 990b\n"                                           \
+        _PROBE_ADDR " _.stapsdt.base\n"                                         \
+        _PROBE_ADDR " 0\n"                                                      \
+        ".asciz \"mdns_bridge\"\n"                                              \
+        ".asciz \"" #name "\"\n"                                                \
+        ".asciz \"" args "\"\n"                                                 \
+        "994: .balign 4\n"                                                      \
+        ".popsection\n"                                                         \
+        ".ifndef _.stapsdt.base\n"                                              \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n"                                                \
+        ".hidden _.stapsdt.base\n"                                              \
+        "_.stapsdt.base: .space 1\n"                                            \
+        ".size _.stapsdt.base, 1\n"                                             \
+        ".popsection\n"                                                         \
+        ".endif\n"                                                              \
+        :: __VA_ARGS__)
+
+#define PROBE2(name, a1, a2)                                                    \
+    _PROBE(name, _PROBE_ARG(1) " " _PROBE_ARG(2),                               \
+           _PROBE_OPERAND(1, a1), _PROBE_OPERAND(2, a2))
+#define PROBE3(name, a1, a2, a3)                                                \
+    _PROBE(name, _PROBE_ARG(1) " " _PROBE_ARG(2) " " _PROBE_ARG(3),             \
+           _PROBE_OPERAND(1, a1), _PROBE_OPERAND(2, a2), _PROBE_OPERAND(3, a3))
+#define PROBE4(name, a1, a2, a3, a4)                                            \
+    _PROBE(name, _PROBE_ARG(1) " " _PROBE_ARG(2) " " _PROBE_ARG(3) " "          \
+           _PROBE_ARG(4),                                                       \
+           _PROBE_OPERAND(1, a1), _PROBE_OPERAND(2, a2), _PROBE_OPERAND(3, a3), \
+           _PROBE_OPERAND(4, a4))
+#define PROBE5(name, a1, a2, a3, a4, a5)                                        \
+    _PROBE(name, _PROBE_ARG(1) " " _PROBE_ARG(2) " " _PROBE_ARG(3) " "          \
+           _PROBE_ARG(4) " " _PROBE_ARG(5),                                     \
+           _PROBE_OPERAND(1, a1), _PROBE_OPERAND(2, a2), _PROBE_OPERAND(3, a3), \
+           _PROBE_OPERAND(4, a4), _PROBE_OPERAND(5, a5))
+#define PROBE6(name, a1, a2, a3, a4, a5, a6)                                    \
+    _PROBE(name, _PROBE_ARG(1) " " _PROBE_ARG(2) " " _PROBE_ARG(3) " "          \
+           _PROBE_ARG(4) " " _PROBE_ARG(5) " " _PROBE_ARG(6),                   \
+           _PROBE_OPERAND(1, a1), _PROBE_OPERAND(2, a2), _PROBE_OPERAND(3, a3), \
+           _PROBE_OPERAND(4, a4), _PROBE_OPERAND(5, a5), _PROBE_OPERAND(6, a6))
+
+#else
+
+#define PROBE2(name, a1, a2)                    do { } while (0)
+#define PROBE3(name, a1, a2, a3)                do { } while (0)
+#define PROBE4(name, a1, a2, a3, a4)            do { } while (0)
+#define PROBE5(name, a1, a2, a3, a4, a5)        do { } while (0)
+#define PROBE6(name, a1, a2, a3, a4, a5, a6)    do { } while (0)
+
+#endif
+
+
+#endif // _PROBES_H
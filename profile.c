@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+#include "profile.h"
+
+
+#if defined(ENABLE_PROFILE)
+
+// Profiles by ip type
+profile_thread_t                profile_threads[NUM_IP_TYPES];
+
+// Names of the profiled stages
+static const char *             profile_stage_names[NUM_PROFILE_STAGES] =
+{
+    "receive", "decode", "filter", "encode", "send", "total"
+};
+
+// Names of the ip types
+static const char *             profile_ip_type_names[NUM_IP_TYPES] = { "ipv4", "ipv6" };
+
+
+
+//
+// Write a profile table for an ip type
+//
+//   If calls is set, the table shows the calls of each stage per packet.
+//   Otherwise, it shows the time of each stage per packet.
+//
+static void profile_report_table(
+    const profile_thread_t *    profile,
+    unsigned int                calls)
+{
+    profile_counter_t           all[NUM_PROFILE_STAGES];
+    uint64_t                    all_packets = 0;
+    uint64_t                    packets;
+    uint64_t                    value;
+    unsigned int                stage;
+    unsigned int                size;
+
+    fprintf(stderr, "  %-11s %9s", "bytes", "packets");
+    for (stage = 0; stage < NUM_PROFILE_STAGES; stage++)
+    {
+        fprintf(stderr, " %9s", profile_stage_names[stage]);
+        all[stage].calls = 0;
+        all[stage].ticks = 0;
+    }
+    fprintf(stderr, "\n");
+
+    // One row for each size bucket, and one for all sizes
+    for (size = 0; size <= NUM_PROFILE_SIZES; size++)
+    {
+        if (size < NUM_PROFILE_SIZES)
+        {
+            packets = STATS_READ(profile->packets[size]);
+            if (packets == 0)
+            {
+                continue;
+            }
+            all_packets += packets;
+
+            if (size < NUM_PROFILE_SIZES - 1)
+            {
+                fprintf(stderr, "  %5u-%-5u %9llu", size ? 1u << (size + PROFILE_SIZE_MIN_BITS - 1) : 0,
+                        (1u << (size + PROFILE_SIZE_MIN_BITS)) - 1, (unsigned long long) packets);
+            }
+            else
+            {
+                fprintf(stderr, "  %5u+      %9llu", 1u << (size + PROFILE_SIZE_MIN_BITS - 1), (unsigned long long) packets);
+            }
+        }
+        else
+        {
+            if (all_packets == 0)
+            {
+                break;
+            }
+            packets = all_packets;
+            fprintf(stderr, "  %-11s %9llu", "all", (unsigned long long) packets);
+        }
+
+        for (stage = 0; stage < NUM_PROFILE_STAGES; stage++)
+        {
+            if (size < NUM_PROFILE_SIZES)
+            {
+                all[stage].calls += STATS_READ(profile->stages[stage][size].calls);
+                all[stage].ticks += STATS_READ(profile->stages[stage][size].ticks);
+                value = calls ? STATS_READ(profile->stages[stage][size].calls) : STATS_READ(profile->stages[stage][size].ticks);
+            }
+            else
+            {
+                value = calls ? all[stage].calls : all[stage].ticks;
+            }
+
+            if (calls)
+            {
+                fprintf(stderr, " %9.2f", (double) value / (double) packets);
+            }
+            else
+            {
+                fprintf(stderr, " %9.0f", (double) value / (double) packets);
+            }
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+
+//
+// Write the profile to stderr
+//
+//   NOTE: The counters are read without synchronization with the bridge
+//         threads.
+//
+void profile_report(void)
+{
+    const profile_thread_t *    profile;
+    uint64_t                    packets;
+    unsigned int                ip_type;
+    unsigned int                size;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        profile = &profile_threads[ip_type];
+
+        packets = 0;
+        for (size = 0; size < NUM_PROFILE_SIZES; size++)
+        {
+            packets += STATS_READ(profile->packets[size]);
+        }
+        if (packets == 0)
+        {
+            fprintf(stderr, "\n%s profile: no packets\n", profile_ip_type_names[ip_type]);
+            continue;
+        }
+
+        fprintf(stderr, "\n%s profile, %s per packet:\n", profile_ip_type_names[ip_type], PROFILE_UNIT);
+        profile_report_table(profile, 0);
+        fprintf(stderr, "%s profile, calls per packet:\n", profile_ip_type_names[ip_type]);
+        profile_report_table(profile, 1);
+    }
+    fflush(stderr);
+}
+
+#endif
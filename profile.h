@@ -0,0 +1,161 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef _PROFILE_H
+#define _PROFILE_H 1
+
+//
+// Stage profiler
+//
+// The profiler is compiled out unless mdns-bridge is built with
+// ENABLE_PROFILE defined (see "make profile"). When enabled, each stage of
+// the forwarding path is timed with the time stamp counter (or the
+// monotonic clock on processors without one), and the counts are kept by
+// ip type and the size of the received packet. The profile is written to
+// stderr on SIGUSR1 and at exit.
+//
+// NB: Requires common.h
+//
+
+#if defined(ENABLE_PROFILE)
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_UNIT            "cycles"
+#else
+#define PROFILE_UNIT            "nsec"
+#endif
+
+// Profiled stages
+// NB: Filter evaluations occur within decode and encode, and are included
+//     in their times
+typedef enum
+{
+    PROFILE_RECEIVE             = 0,    // Receive of the packet from the socket
+    PROFILE_DECODE              = 1,    // Decode, including inbound filtering
+    PROFILE_FILTER              = 2,    // Evaluation of a filter list
+    PROFILE_ENCODE              = 3,    // Encode, including outbound filtering
+    PROFILE_SEND                = 4,    // Send of the packet to a peer
+    PROFILE_TOTAL               = 5     // All processing of the packet
+} profile_stage_t;
+#define NUM_PROFILE_STAGES      6
+
+// Received packet sizes are bucketed by power of two from 128 bytes
+#define PROFILE_SIZE_MIN_BITS   7
+#define NUM_PROFILE_SIZES       6
+
+// Profile counter of a stage
+typedef struct
+{
+    uint64_t                    calls;
+    uint64_t                    ticks;
+} profile_counter_t;
+
+// Profile of a bridge thread
+// NB: Written only by the bridge thread of the ip type
+typedef struct
+{
+    unsigned int                size;           // Size bucket of the current packet
+    uint64_t                    packets[NUM_PROFILE_SIZES];
+    profile_counter_t           stages[NUM_PROFILE_STAGES][NUM_PROFILE_SIZES];
+} __attribute__ ((aligned (64))) profile_thread_t;
+
+// Profiles by ip type, defined in profile.c
+extern profile_thread_t         profile_threads[NUM_IP_TYPES];
+
+
+//
+// Read the profile clock
+//
+static inline uint64_t profile_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec             ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+
+//
+// Set the size bucket of the current packet
+//
+static inline void profile_packet(
+    ip_type_t                   ip_type,
+    size_t                      bytes)
+{
+    profile_thread_t *          profile = &profile_threads[ip_type];
+    unsigned int                size = 0;
+
+    bytes >>= PROFILE_SIZE_MIN_BITS;
+    while (bytes && size < NUM_PROFILE_SIZES - 1)
+    {
+        bytes >>= 1;
+        size++;
+    }
+    profile->size = size;
+    STATS_ADD(profile->packets[size], 1);
+}
+
+
+//
+// Record the time of a stage for the current packet
+//
+static inline void profile_record(
+    ip_type_t                   ip_type,
+    profile_stage_t             stage,
+    uint64_t                    ticks)
+{
+    profile_thread_t *          profile = &profile_threads[ip_type];
+    profile_counter_t *         counter = &profile->stages[stage][profile->size];
+
+    STATS_ADD(counter->calls, 1);
+    STATS_ADD(counter->ticks, ticks);
+}
+
+// Write the profile to stderr
+extern void profile_report(void);
+
+#define PROFILE_START(var)                  uint64_t var = profile_clock()
+#define PROFILE_END(ip_type, stage, var)    profile_record((ip_type), (stage), profile_clock() - (var))
+#define PROFILE_PACKET(ip_type, bytes)      profile_packet((ip_type), (size_t) (bytes))
+
+#else
+
+#define PROFILE_START(var)                  do { } while (0)
+#define PROFILE_END(ip_type, stage, var)    do { } while (0)
+#define PROFILE_PACKET(ip_type, bytes)      do { } while (0)
+
+#endif
+
+
+#endif // _PROFILE_H
@@ -28,14 +28,19 @@
 //
 
 
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 #include <ifaddrs.h>
 #include <net/if.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "common.h"
 
@@ -73,140 +78,336 @@ struct sockaddr_in6             ipv6_mcast_sockaddr;
 
 
 
+// Set once the sockets have been initialized
+static unsigned int             sockets_initialized = 0;
+
+
+// Socket setup worker pool used at startup
+#define SETUP_MAX_THREADS       8               // Maximum number of worker threads
+#define SETUP_SOCKETS_PER_THREAD 16             // Minimum number of sockets per worker thread
+
+// Socket setup steps
+typedef enum
+{
+    SETUP_CREATE                = 0,
+    SETUP_OPTIONS               = 1,
+    SETUP_BIND                  = 2,
+    SETUP_JOIN                  = 3
+} setup_step_t;
+#define NUM_SETUP_STEPS         4
+
+static const char *             setup_step_names[NUM_SETUP_STEPS] = { "create", "options", "bind", "join" };
+
+// Socket setup timing
+typedef struct
+{
+    uint64_t                    nsec[NUM_SETUP_STEPS];
+    uint64_t                    elapsed_nsec;
+    unsigned int                sockets;
+    unsigned int                adopted;
+    unsigned int                threads;
+} setup_timing_t;
+
+// Startup socket setup timing by ip type
+static setup_timing_t           startup_timing[NUM_IP_TYPES];
+
+// First descriptor passed by a service manager (sd_listen_fds)
+#define LISTEN_FDS_START        3
+
+// Sockets adopted from another process, by ip type and interface index (-1 if none)
+// NB: Adopted sockets are used in place of new sockets during startup. Any
+//     that remain unused at the end of startup are closed.
+static int *                    adopted_sock[NUM_IP_TYPES] = { NULL, NULL };
+
+// Socket setup work shared by the worker threads
+typedef struct
+{
+    interface_t **              list;
+    unsigned int                count;
+    ip_type_t                   ip_type;
+    unsigned int                next;           // Next list entry to set up (atomic)
+    unsigned int                threads;        // Number of threads started (atomic)
+    setup_timing_t              timing[SETUP_MAX_THREADS];
+} setup_work_t;
+
+
+// State of a configured interface in the system interface list
+typedef struct
+{
+    unsigned int                pending;        // State is wanted for the interface
+    unsigned int                if_index;
+    const char *                reason;         // NULL if the interface is usable
+    unsigned int                found;          // An address has been found
+    union
+    {
+        struct in_addr          ipv4;
+        struct in6_addr         ipv6;
+    } addr;
+} interface_state_t;
+
+
+//
+// Get the system indexes of the configured interfaces with pending state
+//
+//   NOTE: The system interface list is walked once, and dispatched through
+//         the configured interface name hash. Interfaces not found in the
+//         list (such as alternate names) fall back to if_nametoindex().
+//
+static void os_get_interface_indexes(
+    interface_state_t *         states)
+{
+    struct if_nameindex *       system_list;
+    struct if_nameindex *       system_interface;
+    interface_t *               interface;
+    unsigned int                index;
+
+    system_list = if_nameindex();
+    if (system_list)
+    {
+        for (system_interface = system_list; system_interface->if_index; system_interface++)
+        {
+            interface = get_interface_by_name(system_interface->if_name);
+            if (interface && states[interface->index].pending)
+            {
+                states[interface->index].if_index = system_interface->if_index;
+            }
+        }
+        if_freenameindex(system_list);
+    }
+    else
+    {
+        logger("if_nameindex failed: %s\n", strerror(errno));
+    }
+
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        if (states[index].pending && states[index].if_index == 0)
+        {
+            states[index].if_index = if_nametoindex(configured_interface_list[index].name);
+        }
+    }
+}
+
+
+
 //
 // Validate configured interfaces against the system interface list
 //
+//   NOTE: Interfaces that do not exist, are not up, or do not have a usable
+//         address are not fatal. They remain inactive until they become usable.
+//
 void os_validate_interfaces(void)
 {
+    interface_state_t *         states;
     interface_t *               interface;
-    struct ifaddrs *            ifaddr_list;
-    struct ifaddrs *            ifaddr_ptr;
-    struct sockaddr_in *        sin;
-    struct sockaddr_in6 *       sin6;
-    struct sockaddr *           sa;
+    interface_t **              index_hash;
+    unsigned int                index_hash_mask;
+    unsigned int                slot;
     unsigned int                index;
-    unsigned int                i;
-    int                         ipv4_found;
-    int                         ipv6_found;
 
     if (configured_interface_list == NULL)
     {
         fatal("No interface list defined\n");
     }
 
-    // Get interface indexes and validate interface names
+    // Allocate the interface states and a hash table of interfaces by system index
+    // NB: The hash table size is a power of two, at least twice the number of interfaces
+    for (index_hash_mask = 1; index_hash_mask < configured_interface_count * 2; index_hash_mask <<= 1);
+    states = calloc(configured_interface_count + 1, sizeof(interface_state_t));
+    index_hash = calloc(index_hash_mask, sizeof(interface_t *));
+    if (states == NULL || index_hash == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    index_hash_mask -= 1;
+
+    // Get the interface indexes
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        states[index].pending = 1;
+    }
+    os_get_interface_indexes(states);
+
+    // Confirm interfaces are unique
     for (index = 0; index < configured_interface_count; index++)
     {
         interface = &configured_interface_list[index];
+        interface->sock[IPV4] = -1;
+        interface->sock[IPV6] = -1;
 
-        interface->if_index = if_nametoindex(interface->name);
-        if (interface->if_index == 0)
+        interface->if_index[IPV4] = states[index].if_index;
+        interface->if_index[IPV6] = interface->if_index[IPV4];
+        if (interface->if_index[IPV4] == 0)
         {
-            fatal("Interface \"%s\" does not exist\n", interface->name);
+            continue;
         }
-        for (i = 0; i < index; i++)
+
+        for (slot = interface->if_index[IPV4] & index_hash_mask; index_hash[slot]; slot = (slot + 1) & index_hash_mask)
         {
-            if (interface->if_index == configured_interface_list[i].if_index)
+            if (interface->if_index[IPV4] == index_hash[slot]->if_index[IPV4])
             {
-                fatal("Interface \"%s\" and \"%s\" are identical\n", interface->name, configured_interface_list[i].name);
+                fatal("Interface \"%s\" and \"%s\" are identical\n", interface->name, index_hash[slot]->name);
             }
         }
+        index_hash[slot] = interface;
     }
 
-    // Search the system interface list for our selected interfaces and confirm flags and addresses
-    if (getifaddrs(&ifaddr_list) == -1)
-    {
-        fatal("getifaddrs failed: %s\n", strerror(errno));
-    }
-    for (index = 0; index < configured_interface_count; index++)
+    free(index_hash);
+    free(states);
+}
+
+
+//
+// Find the state of the interfaces with pending state in the system interface list
+//
+//   NOTE: The system interface list is walked once, and dispatched through
+//         the configured interface name hash. On return, the reason is NULL
+//         if the interface is usable, otherwise the reason it is not.
+//
+static void os_find_interface_states(
+    const struct ifaddrs *      ifaddr_list,
+    interface_state_t *         states,
+    ip_type_t                   ip_type)
+{
+    const struct ifaddrs *      ifaddr_ptr;
+    interface_state_t *         state;
+    interface_t *               interface;
+    struct sockaddr_in *        sin;
+    struct sockaddr_in6 *       sin6;
+    struct sockaddr *           sa;
+    unsigned int                index;
+
+    for (ifaddr_ptr = ifaddr_list; ifaddr_ptr != NULL; ifaddr_ptr = ifaddr_ptr->ifa_next)
     {
-        interface = &configured_interface_list[index];
-        ipv4_found = 0;
-        ipv6_found = 0;
+        sa = ifaddr_ptr->ifa_addr;
+        if (sa == NULL)
+        {
+            continue;
+        }
+
+        interface = get_interface_by_name(ifaddr_ptr->ifa_name);
+        if (interface == NULL)
+        {
+            continue;
+        }
+        state = &states[interface->index];
+        if (state->pending == 0 || state->reason)
+        {
+            continue;
+        }
+
+        // Confirm the interface is up and supports multicast
+        if (!IFF_VALID_INTERFACE(ifaddr_ptr->ifa_flags))
+        {
+            state->reason = "is not up or does not support multicast";
+            continue;
+        }
 
-        for (ifaddr_ptr = ifaddr_list; ifaddr_ptr != NULL; ifaddr_ptr = ifaddr_ptr->ifa_next)
+        // Check the IPv4 and IPv6 addresses
+        if (sa->sa_family == AF_INET && ip_type == IPV4)
         {
-            if (strcmp(ifaddr_ptr->ifa_name, interface->name) == 0)
+            sin = (struct sockaddr_in *) sa;
+            if (state->found)
             {
-                sa = ifaddr_ptr->ifa_addr;
-                if (sa)
+                // Favor global addresses over link-local ones
+                if (MDB_ADDR_IS_IPV4_LL(sin->sin_addr.s_addr))
                 {
-                    // Confirm the interface is up and supports multicast
-                    if (!IFF_VALID_INTERFACE(ifaddr_ptr->ifa_flags))
-                    {
-                        fatal("Interface \"%s\" is not up or does not support multicast\n", interface->name);
-                    }
-
-                    // Check the IPv4 and IPv6 addresses
-                    if (sa->sa_family == AF_INET && interface->disable_ip[IPV4] == 0)
-                    {
-                        sin = (struct sockaddr_in *) sa;
-                        if (ipv4_found)
-                        {
-                            // Favor global addresses over link-local ones
-                            if (MDB_ADDR_IS_IPV4_LL(sin->sin_addr.s_addr))
-                            {
-                                continue;
-                            }
-                        }
-
-                        ipv4_found = 1;
-                        memcpy(&interface->ipv4_addr, &sin->sin_addr, sizeof(interface->ipv4_addr));
-                        inet_ntop(AF_INET, &interface->ipv4_addr, interface->ipv4_addr_str, sizeof(interface->ipv4_addr_str));
-                    }
-                    else if (sa->sa_family == AF_INET6 && interface->disable_ip[IPV6] == 0)
-                    {
-                        sin6 = (struct sockaddr_in6 *) sa;
-                        if (ipv6_found)
-                        {
-                            // Favor global addresses over link-local or unique-local
-                            if (MDB_ADDR_IS_IPV6_LL(sin6->sin6_addr.s6_addr) || MDB_ADDR_IS_IPV6_ULA(sin6->sin6_addr.s6_addr))
-                            {
-                                continue;
-                            }
-                        }
-
-                        ipv6_found = 1;
-                        memcpy(&interface->ipv6_addr, &sin6->sin6_addr, sizeof(interface->ipv6_addr));
-                        inet_ntop(AF_INET6, &interface->ipv6_addr, interface->ipv6_addr_str, sizeof(interface->ipv6_addr_str));
-                    }
+                    continue;
                 }
             }
-        }
 
-        // Add the interface to the IPv4 list, or disable it if does have a valid IPv4 address
-        if (ipv4_found)
-        {
-            ip_interface_count[IPV4] += 1;
+            state->found = 1;
+            state->addr.ipv4 = sin->sin_addr;
         }
-        else if (interface->disable_ip[IPV4] == 0)
+        else if (sa->sa_family == AF_INET6 && ip_type == IPV6)
         {
-            logger("Interface \"%s\" does not have an IPv4 address (disabled)\n", interface->name);
-            interface->disable_ip[IPV4] = 1;
-        }
+            sin6 = (struct sockaddr_in6 *) sa;
+            if (state->found)
+            {
+                // Favor global addresses over link-local or unique-local
+                if (MDB_ADDR_IS_IPV6_LL(sin6->sin6_addr.s6_addr) || MDB_ADDR_IS_IPV6_ULA(sin6->sin6_addr.s6_addr))
+                {
+                    continue;
+                }
+            }
 
-        // Add the interface to the IPv6 list, or disable it if does have a valid IPv6 address
-        if (ipv6_found)
-        {
-            ip_interface_count[IPV6] += 1;
+            state->found = 1;
+            state->addr.ipv6 = sin6->sin6_addr;
         }
-        else if (interface->disable_ip[IPV6] == 0)
+    }
+
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        state = &states[index];
+        if (state->pending && state->reason == NULL && state->found == 0)
         {
-            logger("Interface \"%s\" does not have an IPv6 address (disabled)\n", interface->name);
-            interface->disable_ip[IPV6] = 1;
+            state->reason = ip_type == IPV4 ? "does not have an IPv4 address" : "does not have an IPv6 address";
         }
     }
+}
 
-    freeifaddrs(ifaddr_list);
+
+//
+// Get the current monotonic time in nanoseconds
+//
+static uint64_t os_clock_nsec(void)
+{
+    struct timespec             ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+
+//
+// Account the time of a socket setup step
+//
+static inline void os_setup_step(
+    setup_timing_t *            timing,
+    setup_step_t                step,
+    uint64_t *                  start)
+{
+    uint64_t                    now;
+
+    now = os_clock_nsec();
+    timing->nsec[step] += now - *start;
+    *start = now;
+}
+
+
+//
+// Request kernel receive timestamps on a socket
+//
+//   NB: Timestamps are only used for latency statistics, so failure is not
+//       an error.
+//
+static void os_enable_timestamps(
+    int                         sock)
+{
+#if defined(SO_TIMESTAMPNS)
+    const int                   on = 1;
+
+    (void) setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+#elif defined(SO_TIMESTAMP)
+    const int                   on = 1;
+
+    (void) setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+#else
+    (void) sock;
+#endif
 }
 
 
 //
 // Bind an IPv4 socket
 //
-static void os_bind_ipv4socket(
-    interface_t *               interface)
+//   Returns 0 on success, or -1 if the socket could not be bound.
+//
+static int os_bind_ipv4socket(
+    interface_t *               interface,
+    setup_timing_t *            timing)
 {
+    uint64_t                    start;
     int                         sock;
     const int                   on = 1;
     const int                   off = 0;
@@ -217,22 +418,29 @@ static void os_bind_ipv4socket(
     struct ip_mreqn             mreq;
 
     // Create the socket
+    start = os_clock_nsec();
     sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (sock == -1)
     {
-        fatal("IPv4 socket creation failed: %s\n", strerror(errno));
+        logger("IPv4 socket creation failed: %s\n", strerror(errno));
+        return -1;
     }
+    os_setup_step(timing, SETUP_CREATE, &start);
 
     // Set SO_REUSEADDR and SO_REUSEPORT
     r = setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
     if (r == -1)
     {
-        fatal("setsockopt(SO_REUSEADDR) failed: %s\n", strerror(errno));
+        logger("setsockopt(SO_REUSEADDR) failed: %s\n", strerror(errno));
+        close(sock);
+        return -1;
     }
     r = setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (void *)&on, sizeof(on));
     if (r == -1)
     {
-        fatal("setsockopt(SO_REUSEPORT) failed: %s\n", strerror(errno));
+        logger("setsockopt(SO_REUSEPORT) failed: %s\n", strerror(errno));
+        close(sock);
+        return -1;
     }
 
     // Set interface specific binding if available
@@ -240,13 +448,17 @@ static void os_bind_ipv4socket(
     r = setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, interface->name, strlen(interface->name));
     if (r == -1)
     {
-        fatal("setsockopt (SO_BINDTODEVICE) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (SO_BINDTODEVICE) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 #elif defined(IP_BOUND_IF)
-    r = setsockopt(sock, IPPROTO_IP, IP_BOUND_IF, &interface->if_index, sizeof(interface->if_index));
+    r = setsockopt(sock, IPPROTO_IP, IP_BOUND_IF, &interface->if_index[IPV4], sizeof(interface->if_index[IPV4]));
     if (r == -1)
     {
-        fatal("setsockopt (IP_BOUND_IF) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IP_BOUND_IF) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 #endif
 
@@ -254,55 +466,77 @@ static void os_bind_ipv4socket(
     r = setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
     if (r == -1)
     {
-        fatal("setsockopt (IPV6_MULTICAST_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IPV6_MULTICAST_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
     // Set the outbound interface
     r = setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &interface->ipv4_addr, sizeof(interface->ipv4_addr));
     if (r == -1)
     {
-        fatal("setsockopt (IP_MULTICAST_IF) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IP_MULTICAST_IF) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
     // Disable multicast loopback
     r = setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, (void *) &off, sizeof(off));
     if (r == -1)
     {
-        fatal("setsockopt (IP_MULTICAST_LOOP) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IP_MULTICAST_LOOP) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
+    os_enable_timestamps(sock);
+    os_setup_step(timing, SETUP_OPTIONS, &start);
+
     // Bind the socket
     sin = ipv4_any_sockaddr;
     r = bind(sock, (struct sockaddr *) &sin, sizeof(sin));
     if (r == -1)
     {
-        fatal("IPv4 bind to %s on %s failed: %s\n", IPV4_MCAST_ADDRESS, interface->name, strerror(errno));
+        logger("IPv4 bind to %s on %s failed: %s\n", IPV4_MCAST_ADDRESS, interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
+    os_setup_step(timing, SETUP_BIND, &start);
+
     // Join the multicast group
     memset(&mreq, 0, sizeof(mreq));
-    mreq.imr_ifindex = interface->if_index;
+    mreq.imr_ifindex = interface->if_index[IPV4];
     mreq.imr_multiaddr = ipv4_mcast_addr;
     mreq.imr_address = interface->ipv4_addr;
     r = setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
     if (r == -1)
     {
-        fatal("setsockopt (IP_ADD_MEMBERSHIP) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IP_ADD_MEMBERSHIP) for IPv4 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
+    os_setup_step(timing, SETUP_JOIN, &start);
+
     // Set non-blocking and return
     (void) fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
 
     interface->sock[IPV4] = sock;
+    return 0;
 }
 
 
 //
 // Bind an IPv6 socket
 //
-static void os_bind_ipv6socket(
-    interface_t *               interface)
+//   Returns 0 on success, or -1 if the socket could not be bound.
+//
+static int os_bind_ipv6socket(
+    interface_t *               interface,
+    setup_timing_t *            timing)
 {
+    uint64_t                    start;
     int                         sock;
     const int                   on = 1;
     const int                   off = 0;
@@ -313,11 +547,14 @@ static void os_bind_ipv6socket(
     struct ipv6_mreq            mreq6;
 
     // Create the socket
+    start = os_clock_nsec();
     sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
     if (sock == -1)
     {
-        fatal("IPv6 socket creation failed: %s\n", strerror(errno));
+        logger("IPv6 socket creation failed: %s\n", strerror(errno));
+        return -1;
     }
+    os_setup_step(timing, SETUP_CREATE, &start);
 
     // Ensure we don't end up with a mixed IPv4 / IPv6 socket
     setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (void *) &on, sizeof(on));
@@ -326,12 +563,16 @@ static void os_bind_ipv6socket(
     r = setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
     if (r == -1)
     {
-        fatal("setsockopt(SO_REUSEADDR) failed: %s\n", strerror(errno));
+        logger("setsockopt(SO_REUSEADDR) failed: %s\n", strerror(errno));
+        close(sock);
+        return -1;
     }
     r = setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (void *)&on, sizeof(on));
     if (r == -1)
     {
-        fatal("setsockopt(SO_REUSEPORT) failed: %s\n", strerror(errno));
+        logger("setsockopt(SO_REUSEPORT) failed: %s\n", strerror(errno));
+        close(sock);
+        return -1;
     }
 
     // Set interface specific binding if available
@@ -339,13 +580,17 @@ static void os_bind_ipv6socket(
     r = setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, interface->name, strlen(interface->name));
     if (r == -1)
     {
-        fatal("setsockopt (SO_BINDTODEVICE) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (SO_BINDTODEVICE) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 #elif defined(IPV6_BOUND_IF)
-    r = setsockopt(sock, IPPROTO_IPV6, IPV6_BOUND_IF, &interface->if_index, sizeof(interface->if_index));
+    r = setsockopt(sock, IPPROTO_IPV6, IPV6_BOUND_IF, &interface->if_index[IPV6], sizeof(interface->if_index[IPV6]));
     if (r == -1)
     {
-        fatal("setsockopt (IPV6_BOUND_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IPV6_BOUND_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 #endif
 
@@ -353,44 +598,513 @@ static void os_bind_ipv6socket(
     r = setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl));
     if (r == -1)
     {
-        fatal("setsockopt (IPV6_MULTICAST_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IPV6_MULTICAST_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
     // Set the outbound interface
-    r = setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &interface->if_index, sizeof(interface->if_index));
+    r = setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &interface->if_index[IPV6], sizeof(interface->if_index[IPV6]));
     if (r == -1)
     {
-        fatal("setsockopt (IPV6_MULTICAST_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IPV6_MULTICAST_IF) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
     // Disable multicast loopback
     r = setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, (void *) &off, sizeof(off));
     if (r == -1)
     {
-        fatal("setsockopt (IPV6_MULTICAST_LOOP) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IPV6_MULTICAST_LOOP) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
+    os_enable_timestamps(sock);
+    os_setup_step(timing, SETUP_OPTIONS, &start);
+
     // Bind the socket
     sin6 = ipv6_any_sockaddr;
     r = bind(sock, (struct sockaddr *) &sin6, sizeof(sin6));
     if (r == -1)
     {
-        fatal("IPv6 bind to %s on %s failed: %s\n", IPV6_MCAST_ADDRESS, interface->name, strerror(errno));
+        logger("IPv6 bind to %s on %s failed: %s\n", IPV6_MCAST_ADDRESS, interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
+    os_setup_step(timing, SETUP_BIND, &start);
+
     // Join the multicast group
-    mreq6.ipv6mr_interface = interface->if_index;
+    mreq6.ipv6mr_interface = interface->if_index[IPV6];
     mreq6.ipv6mr_multiaddr = ipv6_mcast_addr;
     r = setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6, sizeof(mreq6));
     if (r == -1)
     {
-        fatal("setsockopt (IPV6_JOIN_GROUP) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        logger("setsockopt (IPV6_JOIN_GROUP) for IPv6 on %s failed: %s\n", interface->name, strerror(errno));
+        close(sock);
+        return -1;
     }
 
+    os_setup_step(timing, SETUP_JOIN, &start);
+
     // Set non-blocking and return
     (void) fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
 
     interface->sock[IPV6] = sock;
+    return 0;
+}
+
+
+//
+// Adopt a bound socket from another process
+//
+//   The ip type and interface of the socket are determined from the socket
+//   where possible. Otherwise the interface name provided is used. Returns 0
+//   if the socket was adopted, or -1 if it is not usable. The socket is
+//   closed if it is not adopted.
+//
+//   NOTE: This MUST be called before os_initialize_sockets().
+//
+int os_adopt_socket(
+    int                         sock,
+    const char *                name)
+{
+    struct sockaddr_storage     ss;
+    socklen_t                   len;
+    ip_type_t                   ip_type;
+    interface_t *               interface;
+    unsigned int                index;
+#if defined(SO_BINDTODEVICE)
+    char                        bound_name[IF_NAMESIZE];
+#elif defined(IP_BOUND_IF)
+    char                        bound_name[IF_NAMESIZE];
+    unsigned int                bound_index = 0;
+#endif
+
+    // Confirm the socket is bound to the mDNS port
+    len = sizeof(ss);
+    memset(&ss, 0, sizeof(ss));
+    if (getsockname(sock, (struct sockaddr *) &ss, &len) == -1)
+    {
+        logger("Adopted socket is not usable: %s\n", strerror(errno));
+        (void) close(sock);
+        return -1;
+    }
+    if (ss.ss_family == AF_INET && ((struct sockaddr_in *) &ss)->sin_port == htons(MCAST_PORT))
+    {
+        ip_type = IPV4;
+    }
+    else if (ss.ss_family == AF_INET6 && ((struct sockaddr_in6 *) &ss)->sin6_port == htons(MCAST_PORT))
+    {
+        ip_type = IPV6;
+    }
+    else
+    {
+        logger("Adopted socket is not an mDNS socket\n");
+        (void) close(sock);
+        return -1;
+    }
+
+    // Determine the interface the socket is bound to
+#if defined(SO_BINDTODEVICE)
+    len = sizeof(bound_name);
+    memset(bound_name, 0, sizeof(bound_name));
+    if (getsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, bound_name, &len) == -1 || bound_name[0] == 0)
+    {
+        logger("Adopted socket is not bound to an interface\n");
+        (void) close(sock);
+        return -1;
+    }
+    if (name == NULL || (strcmp(name, bound_name) != 0 && if_nametoindex(name) != if_nametoindex(bound_name)))
+    {
+        name = bound_name;
+    }
+#elif defined(IP_BOUND_IF)
+    len = sizeof(bound_index);
+    if (ip_type == IPV4)
+    {
+        (void) getsockopt(sock, IPPROTO_IP, IP_BOUND_IF, &bound_index, &len);
+    }
+    else
+    {
+        (void) getsockopt(sock, IPPROTO_IPV6, IPV6_BOUND_IF, &bound_index, &len);
+    }
+    if (bound_index == 0 || if_indextoname(bound_index, bound_name) == NULL)
+    {
+        logger("Adopted socket is not bound to an interface\n");
+        (void) close(sock);
+        return -1;
+    }
+    name = bound_name;
+#endif
+
+    if (name == NULL || (interface = get_interface_by_name(name)) == NULL)
+    {
+        // NB: Not an error, the interface may have been removed from the configuration
+        (void) close(sock);
+        return -1;
+    }
+
+    // Allocate the adopted socket list for the ip type
+    if (adopted_sock[ip_type] == NULL)
+    {
+        adopted_sock[ip_type] = malloc(configured_interface_count * sizeof(int));
+        if (adopted_sock[ip_type] == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        for (index = 0; index < configured_interface_count; index++)
+        {
+            adopted_sock[ip_type][index] = -1;
+        }
+    }
+
+    if (adopted_sock[ip_type][interface->index] != -1)
+    {
+        logger("Interface \"%s\" has more than one adopted socket\n", interface->name);
+        (void) close(sock);
+        return -1;
+    }
+
+    adopted_sock[ip_type][interface->index] = sock;
+    return 0;
+}
+
+
+//
+// Adopt the sockets passed by a service manager
+//
+//   Sockets are passed using the LISTEN_PID, LISTEN_FDS and LISTEN_FDNAMES
+//   environment variables, starting at descriptor 3 (sd_listen_fds semantics).
+//   The interface of each socket is determined from the socket where
+//   possible, otherwise the descriptor name is used.
+//
+//   NOTE: This MUST be called before os_initialize_sockets().
+//
+void os_adopt_listen_fds(void)
+{
+    const char *                env;
+    char *                      names = NULL;
+    char *                      name;
+    char *                      next;
+    unsigned int                count;
+    unsigned int                index;
+    unsigned int                adopted = 0;
+    int                         sock;
+
+    env = getenv("LISTEN_PID");
+    if (env == NULL || (pid_t) strtol(env, NULL, 10) != getpid())
+    {
+        return;
+    }
+
+    env = getenv("LISTEN_FDS");
+    count = env ? (unsigned int) strtoul(env, NULL, 10) : 0;
+    env = getenv("LISTEN_FDNAMES");
+    if (env)
+    {
+        names = strdup(env);
+    }
+
+    name = names;
+    for (index = 0; index < count; index++)
+    {
+        next = name ? strchr(name, ':') : NULL;
+        if (next)
+        {
+            *next++ = 0;
+        }
+
+        sock = LISTEN_FDS_START + (int) index;
+        (void) fcntl(sock, F_SETFD, FD_CLOEXEC);
+        if (os_adopt_socket(sock, name) == 0)
+        {
+            adopted += 1;
+        }
+
+        name = next;
+    }
+
+    // NB: The variables are not passed on to child processes
+    (void) unsetenv("LISTEN_PID");
+    (void) unsetenv("LISTEN_FDS");
+    (void) unsetenv("LISTEN_FDNAMES");
+    free(names);
+
+    logger("Received %u sockets from the service manager, %u adopted\n", count, adopted);
+}
+
+
+//
+// Use an adopted socket for an interface
+//
+//   Returns 0 if an adopted socket is in use, or -1 if there is none.
+//
+static int os_use_adopted_socket(
+    interface_t *               interface,
+    ip_type_t                   ip_type)
+{
+    int                         sock;
+    const int                   off = 0;
+    const int                   ttl = 255;
+    struct ip_mreqn             mreq;
+    struct ipv6_mreq            mreq6;
+
+    sock = adopted_sock[ip_type][interface->index];
+    if (sock == -1)
+    {
+        return -1;
+    }
+    adopted_sock[ip_type][interface->index] = -1;
+
+    // Set the multicast options and join the group
+    // NB: A socket from a service manager may only be bound. The outbound
+    //     interface is set again in case the address has changed.
+    if (ip_type == IPV4)
+    {
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.imr_ifindex = interface->if_index[IPV4];
+        mreq.imr_multiaddr = ipv4_mcast_addr;
+        mreq.imr_address = interface->ipv4_addr;
+
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == -1 ||
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &interface->ipv4_addr, sizeof(interface->ipv4_addr)) == -1 ||
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, (void *) &off, sizeof(off)) == -1 ||
+            (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1 && errno != EADDRINUSE))
+        {
+            logger("Adopted IPv4 socket on %s is not usable: %s\n", interface->name, strerror(errno));
+            (void) close(sock);
+            return -1;
+        }
+    }
+    else
+    {
+        mreq6.ipv6mr_interface = interface->if_index[IPV6];
+        mreq6.ipv6mr_multiaddr = ipv6_mcast_addr;
+
+        if (setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl)) == -1 ||
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &interface->if_index[IPV6], sizeof(interface->if_index[IPV6])) == -1 ||
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, (void *) &off, sizeof(off)) == -1 ||
+            (setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6, sizeof(mreq6)) == -1 && errno != EADDRINUSE))
+        {
+            logger("Adopted IPv6 socket on %s is not usable: %s\n", interface->name, strerror(errno));
+            (void) close(sock);
+            return -1;
+        }
+    }
+
+    (void) fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    os_enable_timestamps(sock);
+
+    interface->sock[ip_type] = sock;
+    return 0;
+}
+
+
+//
+// Close any adopted sockets that were not used
+//
+static void os_release_adopted_sockets(void)
+{
+    unsigned int                ip_type;
+    unsigned int                index;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        if (adopted_sock[ip_type] == NULL)
+        {
+            continue;
+        }
+
+        for (index = 0; index < configured_interface_count; index++)
+        {
+            if (adopted_sock[ip_type][index] != -1)
+            {
+                (void) close(adopted_sock[ip_type][index]);
+            }
+        }
+        free(adopted_sock[ip_type]);
+        adopted_sock[ip_type] = NULL;
+    }
+}
+
+
+//
+// Socket setup worker thread
+//
+static void * os_setup_worker(
+    void *                      arg)
+{
+    setup_work_t *              work = arg;
+    setup_timing_t *            timing;
+    interface_t *               interface;
+    unsigned int                index;
+
+    timing = &work->timing[__atomic_fetch_add(&work->threads, 1, __ATOMIC_RELAXED)];
+
+    index = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+    while (index < work->count)
+    {
+        interface = work->list[index];
+        if (interface->sock[work->ip_type] != -1)
+        {
+            // Adopted socket
+            index = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        if (work->ip_type == IPV4)
+        {
+            (void) os_bind_ipv4socket(interface, timing);
+        }
+        else
+        {
+            (void) os_bind_ipv6socket(interface, timing);
+        }
+        timing->sockets += 1;
+
+        index = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+
+//
+// Bind the sockets for a list of interfaces
+//
+//   NOTE: At startup, large lists are bound by a pool of worker threads. The
+//         sockets of interfaces that could not be bound remain -1.
+//
+static void os_bind_interfaces(
+    interface_t **              list,
+    unsigned int                count,
+    ip_type_t                   ip_type)
+{
+    setup_timing_t *            timing = &startup_timing[ip_type];
+    setup_timing_t              runtime_timing;
+    setup_work_t *              work;
+    pthread_t                   threads[SETUP_MAX_THREADS];
+    unsigned int                thread_count;
+    unsigned int                index;
+    unsigned int                step;
+    uint64_t                    start;
+    int                         r;
+
+    // Following startup, bind the sockets in the bridge thread
+    if (sockets_initialized)
+    {
+        memset(&runtime_timing, 0, sizeof(runtime_timing));
+        for (index = 0; index < count; index++)
+        {
+            if (ip_type == IPV4)
+            {
+                (void) os_bind_ipv4socket(list[index], &runtime_timing);
+            }
+            else
+            {
+                (void) os_bind_ipv6socket(list[index], &runtime_timing);
+            }
+        }
+        return;
+    }
+
+    start = os_clock_nsec();
+
+    // Use any sockets adopted from another process
+    if (adopted_sock[ip_type])
+    {
+        for (index = 0; index < count; index++)
+        {
+            if (os_use_adopted_socket(list[index], ip_type) == 0)
+            {
+                timing->adopted += 1;
+            }
+        }
+    }
+
+    thread_count = count / SETUP_SOCKETS_PER_THREAD;
+    if (thread_count > SETUP_MAX_THREADS)
+    {
+        thread_count = SETUP_MAX_THREADS;
+    }
+    else if (thread_count == 0)
+    {
+        thread_count = 1;
+    }
+
+    work = calloc(1, sizeof(setup_work_t));
+    if (work == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    work->list = list;
+    work->count = count;
+    work->ip_type = ip_type;
+
+    // Start the workers
+    // NB: If a thread cannot be created, the remaining threads (or this thread) take up the work
+    for (index = 1; index < thread_count; index++)
+    {
+        r = pthread_create(&threads[index], NULL, os_setup_worker, work);
+        if (r != 0)
+        {
+            logger("Socket setup thread creation failed: %s\n", strerror(r));
+            break;
+        }
+    }
+    thread_count = index;
+    (void) os_setup_worker(work);
+    for (index = 1; index < thread_count; index++)
+    {
+        (void) pthread_join(threads[index], NULL);
+    }
+
+    // Accumulate the timing
+    for (index = 0; index < SETUP_MAX_THREADS; index++)
+    {
+        for (step = 0; step < NUM_SETUP_STEPS; step++)
+        {
+            timing->nsec[step] += work->timing[index].nsec[step];
+        }
+        timing->sockets += work->timing[index].sockets;
+    }
+    timing->threads = thread_count;
+    timing->elapsed_nsec += os_clock_nsec() - start;
+
+    free(work);
+}
+
+
+//
+// Dump the socket setup timing
+//
+void os_dump_socket_timing(void)
+{
+    const setup_timing_t *      timing;
+    unsigned int                ip_type;
+    unsigned int                step;
+
+    printf("Socket setup:\n");
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        timing = &startup_timing[ip_type];
+        if (timing->sockets == 0 && timing->adopted == 0)
+        {
+            continue;
+        }
+
+        printf(" %s: %u sockets, %u adopted, %u threads, %.3f ms elapsed\n", ip_type == IPV4 ? "ipv4" : "ipv6",
+               timing->sockets, timing->adopted, timing->threads, (double) timing->elapsed_nsec / 1000000.0);
+        printf("  step totals (all threads):");
+        for (step = 0; step < NUM_SETUP_STEPS; step++)
+        {
+            printf(" %s %.3f ms", setup_step_names[step], (double) timing->nsec[step] / 1000000.0);
+        }
+        printf("\n");
+    }
 }
 
 
@@ -401,6 +1115,7 @@ static void os_bind_ipv6socket(
 //
 void os_initialize_sockets(void)
 {
+    unsigned int                ip_type;
     unsigned int                index;
 
     // Initializers for socket addresses
@@ -444,15 +1159,271 @@ void os_initialize_sockets(void)
     ipv4_mcast_sockaddr = init_ipv4_mcast_sockaddr;
     ipv6_mcast_sockaddr = init_ipv6_mcast_sockaddr;
 
-    // Bind the IPv4 sockets
-    for (index = 0; index < ip_interface_count[IPV4]; index++)
+    // Bind the sockets for the interfaces that are usable
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        for (index = 0; index < ip_interface_count[ip_type]; index++)
+        {
+            ip_interface_list[ip_type][index]->check_pending[ip_type] = 1;
+        }
+        os_check_interfaces(current_config, ip_type, NULL, NULL, NULL);
+    }
+
+    os_release_adopted_sockets();
+    sockets_initialized = 1;
+}
+
+
+//
+// Receive a packet
+//
+//   Returns the number of bytes received, or -1 on error. If the kernel
+//   provided a receive timestamp, kernel_nsec is set to the time since the
+//   kernel received the packet (at least 1), otherwise it is set to 0.
+//
+//   NB: Kernel timestamps are wall clock time, and a clock step may produce
+//       a bogus delay. Negative delays are discarded.
+//
+ssize_t os_receive_packet(
+    int                         sock,
+    packet_t *                  packet,
+    uint64_t *                  kernel_nsec)
+{
+    struct iovec                iov;
+    struct msghdr               msg;
+    struct cmsghdr *            cmsg;
+    struct timespec             now;
+    struct timespec             received;
+#if !defined(SO_TIMESTAMPNS) && defined(SO_TIMESTAMP)
+    struct timeval              tv;
+#endif
+    union
+    {
+        struct cmsghdr          align;
+        unsigned char           buffer[CMSG_SPACE(sizeof(struct timespec))];
+    } control;
+    int64_t                     delay;
+    ssize_t                     bytes;
+
+    iov.iov_base = packet->buffer;
+    iov.iov_len = sizeof(packet->buffer);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &packet->src_addr;
+    msg.msg_namelen = sizeof(packet->src_addr.storage);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    *kernel_nsec = 0;
+    bytes = recvmsg(sock, &msg, 0);
+    if (bytes == -1)
+    {
+        return -1;
+    }
+    packet->src_addr_len = msg.msg_namelen;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+        {
+            continue;
+        }
+#if defined(SO_TIMESTAMPNS)
+        if (cmsg->cmsg_type != SCM_TIMESTAMPNS)
+        {
+            continue;
+        }
+        memcpy(&received, CMSG_DATA(cmsg), sizeof(received));
+#elif defined(SO_TIMESTAMP)
+        if (cmsg->cmsg_type != SCM_TIMESTAMP)
+        {
+            continue;
+        }
+        memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+        received.tv_sec = tv.tv_sec;
+        received.tv_nsec = tv.tv_usec * 1000;
+#else
+        continue;
+#endif
+
+        (void) clock_gettime(CLOCK_REALTIME, &now);
+        delay = (int64_t) (now.tv_sec - received.tv_sec) * 1000000000 + (now.tv_nsec - received.tv_nsec);
+        if (delay >= 0)
+        {
+            *kernel_nsec = delay ? (uint64_t) delay : 1;
+        }
+        break;
+    }
+
+    return bytes;
+}
+
+
+//
+// Check interfaces with a pending check against the system interface list
+//
+//   Interfaces that have become usable are bound and added to the peer lists.
+//   Interfaces that are no longer usable are closed and removed from the peer
+//   lists. Interfaces whose index or IPv4 address has changed are rebound.
+//   The bound callback, if provided, is invoked for each newly bound socket,
+//   and the unbound callback, if provided, for each socket before it is
+//   closed.
+//
+//   NOTE: Following startup, this is only called by the bridge thread for the
+//         ip type, which must remove a socket from its event notifier in the
+//         unbound callback. Closing the socket does not remove it if another
+//         process, such as a service manager that passed it, holds a copy.
+//
+void os_check_interfaces(
+    const config_t *            config,
+    ip_type_t                   ip_type,
+    interface_bound_callback_t  bound_callback,
+    interface_bound_callback_t  unbound_callback,
+    void *                      arg)
+{
+    const char *                ip_name = ip_type == IPV4 ? "IPv4" : "IPv6";
+    interface_t *               interface;
+    struct ifaddrs *            ifaddr_list;
+    interface_state_t *         states;
+    interface_state_t *         state;
+    interface_t **              bind_list;
+    unsigned int                bind_count = 0;
+    const char *                reason;
+    unsigned int                pending = 0;
+    unsigned int                index;
+
+    // NB: On failure, the checks remain pending until the next change
+    states = calloc(configured_interface_count + 1, sizeof(interface_state_t));
+    bind_list = calloc(configured_interface_count + 1, sizeof(interface_t *));
+    if (states == NULL || bind_list == NULL)
+    {
+        logger("Cannot allocate memory: %s\n", strerror(errno));
+        free(bind_list);
+        free(states);
+        return;
+    }
+    if (getifaddrs(&ifaddr_list) == -1)
+    {
+        logger("getifaddrs failed: %s\n", strerror(errno));
+        free(bind_list);
+        free(states);
+        return;
+    }
+
+    // Determine the current state of the interfaces with a pending check
+    for (index = 0; index < ip_interface_count[ip_type]; index++)
     {
-        os_bind_ipv4socket(ip_interface_list[IPV4][index]);
+        interface = ip_interface_list[ip_type][index];
+        if (interface->check_pending[ip_type])
+        {
+            states[interface->index].pending = 1;
+            pending += 1;
+        }
+    }
+    if (pending)
+    {
+        os_get_interface_indexes(states);
+        for (index = 0; index < configured_interface_count; index++)
+        {
+            if (states[index].pending && states[index].if_index == 0)
+            {
+                states[index].reason = "does not exist";
+            }
+        }
+        os_find_interface_states(ifaddr_list, states, ip_type);
+    }
+
+    for (index = 0; index < ip_interface_count[ip_type]; index++)
+    {
+        interface = ip_interface_list[ip_type][index];
+        if (interface->check_pending[ip_type] == 0)
+        {
+            continue;
+        }
+        interface->check_pending[ip_type] = 0;
+        state = &states[interface->index];
+        reason = state->reason;
+
+        // Close the socket if the interface is no longer usable or has changed
+        if (interface->active[ip_type])
+        {
+            if (reason)
+            {
+                logger("Interface \"%s\" %s (%s inactive)\n", interface->name, reason, ip_name);
+            }
+            else if (state->if_index != interface->if_index[ip_type])
+            {
+                logger("Interface \"%s\" index has changed (%s rebinding)\n", interface->name, ip_name);
+            }
+            else if (ip_type == IPV4 && memcmp(&state->addr.ipv4, &interface->ipv4_addr, sizeof(state->addr.ipv4)) != 0)
+            {
+                logger("Interface \"%s\" IPv4 address has changed (IPv4 rebinding)\n", interface->name);
+            }
+            else
+            {
+                continue;
+            }
+
+            remove_interface_peer(config, interface, ip_type);
+            if (unbound_callback)
+            {
+                unbound_callback(interface, arg);
+            }
+            (void) close(interface->sock[ip_type]);
+            interface->sock[ip_type] = -1;
+        }
+        else if (reason && sockets_initialized == 0)
+        {
+            logger("Interface \"%s\" %s (%s inactive)\n", interface->name, reason, ip_name);
+        }
+
+        // If the interface is not usable, there is nothing more to do
+        if (reason)
+        {
+            continue;
+        }
+
+        // Update the interface index and address
+        interface->if_index[ip_type] = state->if_index;
+        if (ip_type == IPV4)
+        {
+            interface->ipv4_addr = state->addr.ipv4;
+            inet_ntop(AF_INET, &interface->ipv4_addr, interface->ipv4_addr_str, sizeof(interface->ipv4_addr_str));
+        }
+        else
+        {
+            interface->ipv6_addr = state->addr.ipv6;
+            inet_ntop(AF_INET6, &interface->ipv6_addr, interface->ipv6_addr_str, sizeof(interface->ipv6_addr_str));
+        }
+        bind_list[bind_count] = interface;
+        bind_count += 1;
     }
+    freeifaddrs(ifaddr_list);
+    free(states);
 
-    // Bind the IPv6 sockets
-    for (index = 0; index < ip_interface_count[IPV6]; index++)
+    // Bind the sockets
+    os_bind_interfaces(bind_list, bind_count, ip_type);
+
+    for (index = 0; index < bind_count; index++)
     {
-        os_bind_ipv6socket(ip_interface_list[IPV6][index]);
+        interface = bind_list[index];
+
+        // NB: If the bind fails, the interface remains inactive until the next change
+        if (interface->sock[ip_type] != -1)
+        {
+            add_interface_peer(config, interface, ip_type);
+            if (sockets_initialized)
+            {
+                logger("Interface \"%s\" is active (%s)\n", interface->name, ip_name);
+            }
+            if (bound_callback)
+            {
+                bound_callback(interface, arg);
+            }
+        }
     }
+
+    free(bind_list);
 }
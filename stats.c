@@ -0,0 +1,1022 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+
+#include "common.h"
+#include "dns.h"
+
+
+// Statistics by ip type
+thread_stats_t                  thread_stats[NUM_IP_TYPES];
+
+// Names of the decode error reasons and encode classes
+static const char *             decode_error_names[NUM_DECODE_ERRORS] =
+{
+    "short", "count", "name", "record", "rdata", "type", "length"
+};
+static const char *             encode_class_names[NUM_ENCODE_CLASSES] =
+{
+    "inbound", "outbound"
+};
+
+// Names of the latency stages
+static const char *             latency_stage_names[NUM_LATENCY_STAGES] =
+{
+    "kernel", "decode", "encode_inbound", "encode_outbound", "send", "total"
+};
+
+// Reported latency percentiles, in thousandths
+#define NUM_LATENCY_PERCENTILES 4
+static const unsigned int       latency_permille[NUM_LATENCY_PERCENTILES] = { 500, 900, 990, 999 };
+static const char *             latency_percentile_names[NUM_LATENCY_PERCENTILES] = { "p50", "p90", "p99", "p99.9" };
+static const char *             latency_quantile_names[NUM_LATENCY_PERCENTILES] = { "0.5", "0.9", "0.99", "0.999" };
+
+// Summary of a latency histogram
+typedef struct
+{
+    uint64_t                    count;
+    uint64_t                    sum;
+    uint64_t                    max;
+    uint64_t                    percentiles[NUM_LATENCY_PERCENTILES];
+} latency_summary_t;
+
+// Names of the ip types
+static const char *             ip_type_names[NUM_IP_TYPES] = { "ipv4", "ipv6" };
+
+// Growable output buffer
+typedef struct
+{
+    char *                      data;
+    size_t                      length;
+    size_t                      allocated;
+} stats_buffer_t;
+
+// Filter window of the configuration in use
+// NB: Accessed with the configuration mutex held. The window is set for a
+//     configuration generation, and starts when that configuration was loaded.
+static unsigned int             filter_window_generation;
+static uint64_t                 filter_window_start;
+static uint64_t **              filter_window_hits;     // [filter list][name]
+static unsigned int             filter_window_list_count;
+
+
+
+//
+// Allocate the statistics
+//
+//   NOTE: This MUST be called after the interface list is set, and before the
+//         bridge threads are started.
+//
+void stats_initialize(void)
+{
+    unsigned int                ip_type;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        thread_stats[ip_type].interface = calloc(configured_interface_count, sizeof(interface_stats_t));
+        if (thread_stats[ip_type].interface == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+    }
+}
+
+
+//
+// Read the monotonic clock used for latency, in nanoseconds
+//
+uint64_t stats_latency_clock(void)
+{
+    struct timespec             ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+
+//
+// Record a latency in a histogram
+//
+//   The bucket is the power of two of the value, followed by the next
+//   LATENCY_SUB_BUCKET_BITS bits. Values below 2^(LATENCY_SUB_BUCKET_BITS + 1)
+//   have a bucket of their own.
+//
+void stats_latency_record(
+    latency_histogram_t *       histogram,
+    uint64_t                    nsec)
+{
+    uint64_t                    value = nsec;
+    unsigned int                shift = 0;
+    unsigned int                bucket;
+
+    if (value >= (uint64_t) 1 << LATENCY_MAX_BITS)
+    {
+        value = ((uint64_t) 1 << LATENCY_MAX_BITS) - 1;
+    }
+    if (value >> (LATENCY_SUB_BUCKET_BITS + 1))
+    {
+        shift = (63 - (unsigned int) __builtin_clzll(value)) - LATENCY_SUB_BUCKET_BITS;
+    }
+    bucket = (shift << LATENCY_SUB_BUCKET_BITS) + (unsigned int) (value >> shift);
+
+    STATS_ADD(histogram->buckets[bucket], 1);
+    STATS_ADD(histogram->count, 1);
+    STATS_ADD(histogram->sum, nsec);
+    if (nsec > histogram->max)
+    {
+        __atomic_store_n(&histogram->max, nsec, __ATOMIC_RELAXED);
+    }
+}
+
+
+//
+// Summarize a latency histogram
+//
+//   Percentiles are reported as the highest value of their bucket, limited
+//   to the maximum recorded value.
+//
+static void stats_latency_summary(
+    const latency_histogram_t * histogram,
+    latency_summary_t *         summary)
+{
+    uint64_t                    buckets[NUM_LATENCY_BUCKETS];
+    uint64_t                    cumulative = 0;
+    uint64_t                    target;
+    uint64_t                    mantissa;
+    unsigned int                shift;
+    unsigned int                bucket = 0;
+    unsigned int                index;
+
+    // Take a snapshot of the buckets so that the percentiles are consistent
+    summary->count = 0;
+    for (index = 0; index < NUM_LATENCY_BUCKETS; index++)
+    {
+        buckets[index] = STATS_READ(histogram->buckets[index]);
+        summary->count += buckets[index];
+    }
+    summary->sum = STATS_READ(histogram->sum);
+    summary->max = STATS_READ(histogram->max);
+
+    for (index = 0; index < NUM_LATENCY_PERCENTILES; index++)
+    {
+        summary->percentiles[index] = 0;
+        if (summary->count == 0)
+        {
+            continue;
+        }
+
+        target = (summary->count * latency_permille[index] + 999) / 1000;
+        while (bucket < NUM_LATENCY_BUCKETS - 1 && cumulative + buckets[bucket] < target)
+        {
+            cumulative += buckets[bucket];
+            bucket++;
+        }
+
+        shift = bucket < (2 << LATENCY_SUB_BUCKET_BITS) ? 0 : (bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+        mantissa = bucket - (shift << LATENCY_SUB_BUCKET_BITS);
+        summary->percentiles[index] = ((mantissa + 1) << shift) - 1;
+        if (summary->percentiles[index] > summary->max)
+        {
+            summary->percentiles[index] = summary->max;
+        }
+    }
+}
+
+
+//
+// Append formatted output to a buffer
+//
+__attribute__ ((format (printf, 2, 3)))
+static void stats_printf(
+    stats_buffer_t *            buffer,
+    const char *                format,
+    ...)
+{
+    va_list                     args;
+    size_t                      allocated;
+    void *                      np;
+    int                         len;
+
+    while (1)
+    {
+        va_start(args, format);
+        len = vsnprintf(buffer->data ? buffer->data + buffer->length : NULL, buffer->allocated - buffer->length, format, args);
+        va_end(args);
+        if (len < 0)
+        {
+            return;
+        }
+
+        if (buffer->length + (size_t) len < buffer->allocated)
+        {
+            buffer->length += (size_t) len;
+            return;
+        }
+
+        // Grow the buffer and try again
+        allocated = buffer->allocated ? buffer->allocated * 2 : 4096;
+        while (allocated <= buffer->length + (size_t) len)
+        {
+            allocated *= 2;
+        }
+        np = realloc(buffer->data, allocated);
+        if (np == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        buffer->data = np;
+        buffer->allocated = allocated;
+    }
+}
+
+
+//
+// Append a JSON string to a buffer
+//
+static void stats_json_string(
+    stats_buffer_t *            buffer,
+    const char *                string)
+{
+    stats_printf(buffer, "\"");
+    for (; *string; string++)
+    {
+        if (*string == '"' || *string == '\\')
+        {
+            stats_printf(buffer, "\\%c", *string);
+        }
+        else if ((unsigned char) *string < 0x20)
+        {
+            stats_printf(buffer, "\\u%04x", (unsigned int) (unsigned char) *string);
+        }
+        else
+        {
+            stats_printf(buffer, "%c", *string);
+        }
+    }
+    stats_printf(buffer, "\"");
+}
+
+
+//
+// Read the number of records matched by a filter list name
+//
+static uint64_t stats_filter_hits(
+    const filter_list_t *       filter_list,
+    unsigned int                name)
+{
+    uint64_t                    hits = 0;
+    unsigned int                ip_type;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        hits += STATS_READ(filter_list->hits[ip_type][name]);
+    }
+    return hits;
+}
+
+
+//
+// Read the number of records filtered by a filter list
+//
+static uint64_t stats_filter_filtered(
+    const filter_list_t *       filter_list)
+{
+    uint64_t                    filtered = 0;
+    unsigned int                ip_type;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        filtered += STATS_READ(*filter_list->filtered[ip_type]);
+    }
+    return filtered;
+}
+
+
+//
+// Format the statistics as text
+//
+static void stats_format_text(
+    stats_buffer_t *            buffer,
+    const config_t *            config)
+{
+    const thread_stats_t *      stats;
+    const interface_stats_t *   istats;
+    const interface_t *         interface;
+    const filter_list_t *       filter_list;
+    latency_summary_t           summary;
+    topk_entry_t                entries[NUM_IP_TYPES * TOPK_SIZE];
+    unsigned char               string[DNS_MAX_NAME_LEN];
+    unsigned int                ip_type;
+    unsigned int                index;
+    unsigned int                percentile;
+    unsigned int                name;
+    unsigned int                count;
+
+    stats_printf(buffer, "mDNS Bridge version %s\n", VERSION);
+    stats_printf(buffer, "configuration generation %u\n", config->generation);
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        stats = &thread_stats[ip_type];
+
+        stats_printf(buffer, "\n%s:\n", ip_type_names[ip_type]);
+        stats_printf(buffer, " receive errors: %llu\n", (unsigned long long) STATS_READ(stats->recv_errors));
+        stats_printf(buffer, " decode errors:");
+        for (index = 0; index < NUM_DECODE_ERRORS; index++)
+        {
+            stats_printf(buffer, "%s %s %llu", index ? "," : "", decode_error_names[index],
+                         (unsigned long long) STATS_READ(stats->decode_errors[index]));
+        }
+        stats_printf(buffer, "\n encodes:");
+        for (index = 0; index < NUM_ENCODE_CLASSES; index++)
+        {
+            stats_printf(buffer, "%s %s %llu", index ? "," : "", encode_class_names[index],
+                         (unsigned long long) STATS_READ(stats->encodes[index]));
+        }
+        stats_printf(buffer, "\n");
+
+        stats_printf(buffer, " latency (usec)      count");
+        for (index = 0; index < NUM_LATENCY_PERCENTILES; index++)
+        {
+            stats_printf(buffer, " %9s", latency_percentile_names[index]);
+        }
+        stats_printf(buffer, " %9s\n", "max");
+        for (index = 0; index < NUM_LATENCY_STAGES; index++)
+        {
+            stats_latency_summary(&stats->latency[index], &summary);
+            stats_printf(buffer, "  %-15s %7llu", latency_stage_names[index], (unsigned long long) summary.count);
+            for (percentile = 0; percentile < NUM_LATENCY_PERCENTILES; percentile++)
+            {
+                stats_printf(buffer, " %9.1f", (double) summary.percentiles[percentile] / 1000.0);
+            }
+            stats_printf(buffer, " %9.1f\n", (double) summary.max / 1000.0);
+        }
+    }
+
+    stats_printf(buffer, "\ninterfaces:\n");
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        interface = &configured_interface_list[index];
+        stats_printf(buffer, " %s\n", interface->name);
+
+        for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+        {
+            if (interface->disable_ip[ip_type])
+            {
+                continue;
+            }
+
+            istats = &thread_stats[ip_type].interface[index];
+            stats_printf(buffer, "  %s: %s, in %llu packets %llu bytes, out %llu packets %llu bytes, sendto errors %llu\n",
+                         ip_type_names[ip_type],
+                         __atomic_load_n(&interface->active[ip_type], __ATOMIC_RELAXED) ? "active" : "inactive",
+                         (unsigned long long) STATS_READ(istats->packets_in),
+                         (unsigned long long) STATS_READ(istats->bytes_in),
+                         (unsigned long long) STATS_READ(istats->packets_out),
+                         (unsigned long long) STATS_READ(istats->bytes_out),
+                         (unsigned long long) STATS_READ(istats->sendto_errors));
+        }
+    }
+
+    stats_printf(buffer, "\nfilter lists:\n");
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_list = config->filter_lists[index];
+        stats_printf(buffer, " %u (%s", index, filter_list->allow_deny == ALLOW ? "allow" : "deny");
+        for (name = 0; name < filter_list->count; name++)
+        {
+            dns_labels_to_string(filter_list->names[name]->labels, filter_list->names[name]->length, string);
+            stats_printf(buffer, "%s %s", name ? "," : "", string);
+        }
+        stats_printf(buffer, "): %llu records filtered\n", (unsigned long long) stats_filter_filtered(filter_list));
+    }
+
+    stats_printf(buffer, "\nservice types received (by bytes, estimated):\n");
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        count = topk_read(index, entries);
+        if (count == 0)
+        {
+            continue;
+        }
+
+        stats_printf(buffer, " %s\n", configured_interface_list[index].name);
+        for (name = 0; name < count; name++)
+        {
+            stats_printf(buffer, "  %s: %llu packets %llu bytes\n", entries[name].name,
+                         (unsigned long long) entries[name].packets, (unsigned long long) entries[name].bytes);
+        }
+    }
+}
+
+
+//
+// Format the statistics as JSON
+//
+static void stats_format_json(
+    stats_buffer_t *            buffer,
+    const config_t *            config)
+{
+    const thread_stats_t *      stats;
+    const interface_stats_t *   istats;
+    const interface_t *         interface;
+    const filter_list_t *       filter_list;
+    latency_summary_t           summary;
+    topk_entry_t                entries[NUM_IP_TYPES * TOPK_SIZE];
+    unsigned char               string[DNS_MAX_NAME_LEN];
+    unsigned int                ip_type;
+    unsigned int                index;
+    unsigned int                percentile;
+    unsigned int                name;
+    unsigned int                count;
+
+    stats_printf(buffer, "{\"version\":\"%s\",\"generation\":%u", VERSION, config->generation);
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        stats = &thread_stats[ip_type];
+
+        stats_printf(buffer, ",\"%s\":{\"recv_errors\":%llu,\"decode_errors\":{", ip_type_names[ip_type],
+                     (unsigned long long) STATS_READ(stats->recv_errors));
+        for (index = 0; index < NUM_DECODE_ERRORS; index++)
+        {
+            stats_printf(buffer, "%s\"%s\":%llu", index ? "," : "", decode_error_names[index],
+                         (unsigned long long) STATS_READ(stats->decode_errors[index]));
+        }
+        stats_printf(buffer, "},\"encodes\":{");
+        for (index = 0; index < NUM_ENCODE_CLASSES; index++)
+        {
+            stats_printf(buffer, "%s\"%s\":%llu", index ? "," : "", encode_class_names[index],
+                         (unsigned long long) STATS_READ(stats->encodes[index]));
+        }
+        stats_printf(buffer, "},\"latency_nsec\":{");
+        for (index = 0; index < NUM_LATENCY_STAGES; index++)
+        {
+            stats_latency_summary(&stats->latency[index], &summary);
+            stats_printf(buffer, "%s\"%s\":{\"count\":%llu,\"sum\":%llu", index ? "," : "", latency_stage_names[index],
+                         (unsigned long long) summary.count, (unsigned long long) summary.sum);
+            for (percentile = 0; percentile < NUM_LATENCY_PERCENTILES; percentile++)
+            {
+                stats_printf(buffer, ",\"%s\":%llu", latency_percentile_names[percentile],
+                             (unsigned long long) summary.percentiles[percentile]);
+            }
+            stats_printf(buffer, ",\"max\":%llu}", (unsigned long long) summary.max);
+        }
+        stats_printf(buffer, "}}");
+    }
+
+    stats_printf(buffer, ",\"interfaces\":[");
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        interface = &configured_interface_list[index];
+        stats_printf(buffer, "%s{\"name\":", index ? "," : "");
+        stats_json_string(buffer, interface->name);
+
+        for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+        {
+            if (interface->disable_ip[ip_type])
+            {
+                continue;
+            }
+
+            istats = &thread_stats[ip_type].interface[index];
+            stats_printf(buffer, ",\"%s\":{\"active\":%s,\"packets_in\":%llu,\"bytes_in\":%llu,"
+                         "\"packets_out\":%llu,\"bytes_out\":%llu,\"sendto_errors\":%llu}",
+                         ip_type_names[ip_type],
+                         __atomic_load_n(&interface->active[ip_type], __ATOMIC_RELAXED) ? "true" : "false",
+                         (unsigned long long) STATS_READ(istats->packets_in),
+                         (unsigned long long) STATS_READ(istats->bytes_in),
+                         (unsigned long long) STATS_READ(istats->packets_out),
+                         (unsigned long long) STATS_READ(istats->bytes_out),
+                         (unsigned long long) STATS_READ(istats->sendto_errors));
+        }
+
+        count = topk_read(index, entries);
+        stats_printf(buffer, ",\"services\":[");
+        for (name = 0; name < count; name++)
+        {
+            stats_printf(buffer, "%s{\"name\":", name ? "," : "");
+            stats_json_string(buffer, entries[name].name);
+            stats_printf(buffer, ",\"packets\":%llu,\"bytes\":%llu}",
+                         (unsigned long long) entries[name].packets, (unsigned long long) entries[name].bytes);
+        }
+        stats_printf(buffer, "]}");
+    }
+
+    stats_printf(buffer, "],\"filter_lists\":[");
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_list = config->filter_lists[index];
+        stats_printf(buffer, "%s{\"index\":%u,\"type\":\"%s\",\"names\":[", index ? "," : "", index,
+                     filter_list->allow_deny == ALLOW ? "allow" : "deny");
+        for (name = 0; name < filter_list->count; name++)
+        {
+            dns_labels_to_string(filter_list->names[name]->labels, filter_list->names[name]->length, string);
+            stats_printf(buffer, "%s", name ? "," : "");
+            stats_json_string(buffer, (const char *) string);
+        }
+        stats_printf(buffer, "],\"hits\":[");
+        for (name = 0; name < filter_list->count; name++)
+        {
+            stats_printf(buffer, "%s%llu", name ? "," : "", (unsigned long long) stats_filter_hits(filter_list, name));
+        }
+        stats_printf(buffer, "],\"filtered\":%llu}", (unsigned long long) stats_filter_filtered(filter_list));
+    }
+    stats_printf(buffer, "]}\n");
+}
+
+
+//
+// Append a Prometheus label value to a buffer
+//
+static void stats_prometheus_label(
+    stats_buffer_t *            buffer,
+    const char *                string)
+{
+    for (; *string; string++)
+    {
+        if (*string == '"' || *string == '\\')
+        {
+            stats_printf(buffer, "\\%c", *string);
+        }
+        else if (*string == '\n')
+        {
+            stats_printf(buffer, "\\n");
+        }
+        else
+        {
+            stats_printf(buffer, "%c", *string);
+        }
+    }
+}
+
+
+//
+// Append a Prometheus metric header to a buffer
+//
+static void stats_prometheus_header(
+    stats_buffer_t *            buffer,
+    const char *                name,
+    const char *                type,
+    const char *                help)
+{
+    stats_printf(buffer, "# HELP mdns_bridge_%s %s\n# TYPE mdns_bridge_%s %s\n", name, help, name, type);
+}
+
+
+//
+// Append Prometheus interface metrics to a buffer
+//
+//   The counter is selected by its offset in the interface statistics.
+//
+static void stats_prometheus_interface_metric(
+    stats_buffer_t *            buffer,
+    const char *                name,
+    const char *                help,
+    size_t                      offset)
+{
+    const interface_t *         interface;
+    unsigned int                ip_type;
+    unsigned int                index;
+    uint64_t *                  counter;
+
+    stats_prometheus_header(buffer, name, "counter", help);
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        interface = &configured_interface_list[index];
+        for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+        {
+            if (interface->disable_ip[ip_type])
+            {
+                continue;
+            }
+
+            counter = (uint64_t *) ((char *) &thread_stats[ip_type].interface[index] + offset);
+            stats_printf(buffer, "mdns_bridge_%s{interface=\"", name);
+            stats_prometheus_label(buffer, interface->name);
+            stats_printf(buffer, "\",family=\"%s\"} %llu\n", ip_type_names[ip_type], (unsigned long long) STATS_READ(*counter));
+        }
+    }
+}
+
+
+//
+// Format the statistics in Prometheus text exposition format
+//
+static void stats_format_prometheus(
+    stats_buffer_t *            buffer,
+    const config_t *            config)
+{
+    const thread_stats_t *      stats;
+    const interface_t *         interface;
+    const filter_list_t *       filter_list;
+    latency_summary_t           summary;
+    topk_entry_t                entries[NUM_IP_TYPES * TOPK_SIZE];
+    unsigned char               string[DNS_MAX_NAME_LEN];
+    unsigned int                ip_type;
+    unsigned int                index;
+    unsigned int                percentile;
+    unsigned int                name;
+    unsigned int                count;
+
+    stats_prometheus_header(buffer, "config_generation", "gauge", "Generation of the configuration in use.");
+    stats_printf(buffer, "mdns_bridge_config_generation %u\n", config->generation);
+
+    stats_prometheus_header(buffer, "interface_active", "gauge", "Whether the interface is active.");
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        interface = &configured_interface_list[index];
+        for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+        {
+            if (interface->disable_ip[ip_type] == 0)
+            {
+                stats_printf(buffer, "mdns_bridge_interface_active{interface=\"");
+                stats_prometheus_label(buffer, interface->name);
+                stats_printf(buffer, "\",family=\"%s\"} %u\n", ip_type_names[ip_type],
+                             __atomic_load_n(&interface->active[ip_type], __ATOMIC_RELAXED) ? 1 : 0);
+            }
+        }
+    }
+
+    stats_prometheus_interface_metric(buffer, "received_packets_total", "Packets received on the interface.",
+                                      offsetof(interface_stats_t, packets_in));
+    stats_prometheus_interface_metric(buffer, "received_bytes_total", "Bytes received on the interface.",
+                                      offsetof(interface_stats_t, bytes_in));
+    stats_prometheus_interface_metric(buffer, "sent_packets_total", "Packets sent on the interface.",
+                                      offsetof(interface_stats_t, packets_out));
+    stats_prometheus_interface_metric(buffer, "sent_bytes_total", "Bytes sent on the interface.",
+                                      offsetof(interface_stats_t, bytes_out));
+    stats_prometheus_interface_metric(buffer, "sendto_errors_total", "Send errors on the interface.",
+                                      offsetof(interface_stats_t, sendto_errors));
+
+    stats_prometheus_header(buffer, "receive_errors_total", "counter", "Receive errors.");
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        stats_printf(buffer, "mdns_bridge_receive_errors_total{family=\"%s\"} %llu\n", ip_type_names[ip_type],
+                     (unsigned long long) STATS_READ(thread_stats[ip_type].recv_errors));
+    }
+
+    stats_prometheus_header(buffer, "decode_errors_total", "counter", "Packet decode errors by reason.");
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        stats = &thread_stats[ip_type];
+        for (index = 0; index < NUM_DECODE_ERRORS; index++)
+        {
+            stats_printf(buffer, "mdns_bridge_decode_errors_total{family=\"%s\",reason=\"%s\"} %llu\n",
+                         ip_type_names[ip_type], decode_error_names[index],
+                         (unsigned long long) STATS_READ(stats->decode_errors[index]));
+        }
+    }
+
+    stats_prometheus_header(buffer, "encodes_total", "counter", "Packet encodes by filter class.");
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        stats = &thread_stats[ip_type];
+        for (index = 0; index < NUM_ENCODE_CLASSES; index++)
+        {
+            stats_printf(buffer, "mdns_bridge_encodes_total{family=\"%s\",class=\"%s\"} %llu\n",
+                         ip_type_names[ip_type], encode_class_names[index],
+                         (unsigned long long) STATS_READ(stats->encodes[index]));
+        }
+    }
+
+    stats_prometheus_header(buffer, "latency_seconds", "summary", "Forwarding latency by stage.");
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        stats = &thread_stats[ip_type];
+        for (index = 0; index < NUM_LATENCY_STAGES; index++)
+        {
+            stats_latency_summary(&stats->latency[index], &summary);
+            for (percentile = 0; percentile < NUM_LATENCY_PERCENTILES; percentile++)
+            {
+                stats_printf(buffer, "mdns_bridge_latency_seconds{family=\"%s\",stage=\"%s\",quantile=\"%s\"} %.9f\n",
+                             ip_type_names[ip_type], latency_stage_names[index], latency_quantile_names[percentile],
+                             (double) summary.percentiles[percentile] / 1e9);
+            }
+            stats_printf(buffer, "mdns_bridge_latency_seconds_sum{family=\"%s\",stage=\"%s\"} %.9f\n",
+                         ip_type_names[ip_type], latency_stage_names[index], (double) summary.sum / 1e9);
+            stats_printf(buffer, "mdns_bridge_latency_seconds_count{family=\"%s\",stage=\"%s\"} %llu\n",
+                         ip_type_names[ip_type], latency_stage_names[index], (unsigned long long) summary.count);
+        }
+    }
+
+    // NB: The service types reported may change, so the estimates are gauges
+    stats_prometheus_header(buffer, "service_received_bytes", "gauge",
+                            "Estimated bytes received for the top service types on the interface.");
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        count = topk_read(index, entries);
+        for (name = 0; name < count; name++)
+        {
+            stats_printf(buffer, "mdns_bridge_service_received_bytes{interface=\"");
+            stats_prometheus_label(buffer, configured_interface_list[index].name);
+            stats_printf(buffer, "\",service=\"");
+            stats_prometheus_label(buffer, entries[name].name);
+            stats_printf(buffer, "\"} %llu\n", (unsigned long long) entries[name].bytes);
+        }
+    }
+    stats_prometheus_header(buffer, "service_received_packets", "gauge",
+                            "Estimated packets received for the top service types on the interface.");
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        count = topk_read(index, entries);
+        for (name = 0; name < count; name++)
+        {
+            stats_printf(buffer, "mdns_bridge_service_received_packets{interface=\"");
+            stats_prometheus_label(buffer, configured_interface_list[index].name);
+            stats_printf(buffer, "\",service=\"");
+            stats_prometheus_label(buffer, entries[name].name);
+            stats_printf(buffer, "\"} %llu\n", (unsigned long long) entries[name].packets);
+        }
+    }
+
+    stats_prometheus_header(buffer, "filtered_records_total", "counter",
+                            "Records filtered by each filter list since the configuration was loaded.");
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_list = config->filter_lists[index];
+        // NB: The names of the list are the name labels of filter_matches_total
+        stats_printf(buffer, "mdns_bridge_filtered_records_total{filter_list=\"%u\",type=\"%s\"} %llu\n", index,
+                     filter_list->allow_deny == ALLOW ? "allow" : "deny",
+                     (unsigned long long) stats_filter_filtered(filter_list));
+    }
+
+    stats_prometheus_header(buffer, "filter_matches_total", "counter",
+                            "Records matched by each filter list name since the configuration was loaded.");
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_list = config->filter_lists[index];
+        for (name = 0; name < filter_list->count; name++)
+        {
+            dns_labels_to_string(filter_list->names[name]->labels, filter_list->names[name]->length, string);
+            stats_printf(buffer, "mdns_bridge_filter_matches_total{filter_list=\"%u\",type=\"%s\",name=\"", index,
+                         filter_list->allow_deny == ALLOW ? "allow" : "deny");
+            stats_prometheus_label(buffer, (const char *) string);
+            stats_printf(buffer, "\"} %llu\n", (unsigned long long) stats_filter_hits(filter_list, name));
+        }
+    }
+}
+
+
+//
+// Format the statistics
+//
+//   Returns an allocated string that must be freed by the caller.
+//
+//   NOTE: The counters are read without synchronization with the bridge
+//         threads. The configuration mutex is held to keep the filter lists
+//         from being destroyed by a reload.
+//
+char * stats_format(
+    stats_format_t              format)
+{
+    stats_buffer_t              buffer = { NULL, 0, 0 };
+
+    pthread_mutex_lock(&config_mutex);
+    switch (format)
+    {
+        case STATS_FORMAT_JSON:
+            stats_format_json(&buffer, current_config);
+            break;
+        case STATS_FORMAT_PROMETHEUS:
+            stats_format_prometheus(&buffer, current_config);
+            break;
+        default:
+            stats_format_text(&buffer, current_config);
+            break;
+    }
+    pthread_mutex_unlock(&config_mutex);
+
+    return buffer.data;
+}
+
+
+//
+// Set the filter window for a configuration
+//
+//   If the configuration has changed since the window was set, a new window
+//   is set that starts when the configuration was loaded.
+//
+//   NOTE: The configuration mutex MUST be held.
+//
+static void stats_filter_window_set(
+    const config_t *            config)
+{
+    unsigned int                index;
+
+    if (filter_window_hits && filter_window_generation == config->generation)
+    {
+        return;
+    }
+
+    for (index = 0; index < filter_window_list_count; index++)
+    {
+        free(filter_window_hits[index]);
+    }
+    free(filter_window_hits);
+
+    // NB: The extra entry allocates the array when there are no filter lists
+    filter_window_hits = calloc(config->filter_list_count + 1, sizeof(uint64_t *));
+    if (filter_window_hits == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_window_hits[index] = calloc(config->filter_lists[index]->count, sizeof(uint64_t));
+        if (filter_window_hits[index] == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+    }
+    filter_window_list_count = config->filter_list_count;
+    filter_window_generation = config->generation;
+    filter_window_start = config->load_ticks;
+}
+
+
+//
+// Format the filter list names and their matches in the filter window
+//
+//   The filter window starts when the configuration is loaded, and is
+//   restarted by stats_filter_window_start. If unused is set, only names
+//   without matches in the window are listed.
+//
+//   Returns an allocated string that must be freed by the caller.
+//
+char * stats_format_filters(
+    unsigned int                unused)
+{
+    stats_buffer_t              buffer = { NULL, 0, 0 };
+    const config_t *            config;
+    const filter_list_t *       filter_list;
+    unsigned char               string[DNS_MAX_NAME_LEN];
+    uint64_t                    hits;
+    uint64_t                    seconds;
+    unsigned int                index;
+    unsigned int                name;
+    unsigned int                count = 0;
+
+    pthread_mutex_lock(&config_mutex);
+    config = current_config;
+    stats_filter_window_set(config);
+
+    seconds = (timer_clock_ticks() - filter_window_start) * TIMER_TICK_MSEC / 1000;
+    stats_printf(&buffer, "%s in the last %llu seconds:\n",
+                 unused ? "filter names without matches" : "filter name matches",
+                 (unsigned long long) seconds);
+
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_list = config->filter_lists[index];
+        for (name = 0; name < filter_list->count; name++)
+        {
+            hits = stats_filter_hits(filter_list, name);
+            if (unused && hits != filter_window_hits[index][name])
+            {
+                continue;
+            }
+
+            dns_labels_to_string(filter_list->names[name]->labels, filter_list->names[name]->length, string);
+            if (unused)
+            {
+                stats_printf(&buffer, " %u (%s) %s\n", index, filter_list->allow_deny == ALLOW ? "allow" : "deny", string);
+            }
+            else
+            {
+                stats_printf(&buffer, " %u (%s) %s: %llu (%llu total)\n", index,
+                             filter_list->allow_deny == ALLOW ? "allow" : "deny", string,
+                             (unsigned long long) (hits - filter_window_hits[index][name]), (unsigned long long) hits);
+            }
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&config_mutex);
+
+    if (count == 0)
+    {
+        stats_printf(&buffer, " (none)\n");
+    }
+
+    return buffer.data;
+}
+
+
+//
+// Start a new filter window
+//
+void stats_filter_window_start(void)
+{
+    const config_t *            config;
+    const filter_list_t *       filter_list;
+    unsigned int                index;
+    unsigned int                name;
+
+    pthread_mutex_lock(&config_mutex);
+    config = current_config;
+    stats_filter_window_set(config);
+
+    for (index = 0; index < config->filter_list_count; index++)
+    {
+        filter_list = config->filter_lists[index];
+        for (name = 0; name < filter_list->count; name++)
+        {
+            filter_window_hits[index][name] = stats_filter_hits(filter_list, name);
+        }
+    }
+    filter_window_start = timer_clock_ticks();
+    pthread_mutex_unlock(&config_mutex);
+}
+
+
+//
+// Format the service inventory
+//
+//   Returns an allocated string that must be freed by the caller.
+//
+char * stats_format_inventory(void)
+{
+    stats_buffer_t              buffer = { NULL, 0, 0 };
+    inventory_entry_t *         entries;
+    const inventory_entry_t *   entry;
+    const char *                type;
+    char                        type_str[16];
+    uint64_t                    expired;
+    uint64_t                    evicted;
+    unsigned int                count;
+    unsigned int                index;
+    unsigned int                interface_index = UINT32_MAX;
+
+    count = inventory_read(&entries, &expired, &evicted);
+    stats_printf(&buffer, "service inventory: %u records, %llu expired, %llu evicted\n", count,
+                 (unsigned long long) expired, (unsigned long long) evicted);
+
+    for (index = 0; index < count; index++)
+    {
+        entry = &entries[index];
+        if (entry->interface_index != interface_index)
+        {
+            interface_index = entry->interface_index;
+            stats_printf(&buffer, " %s\n", configured_interface_list[interface_index].name);
+        }
+
+        switch (entry->type)
+        {
+            case DNS_TYPE_A:
+                type = "A";
+                break;
+            case DNS_TYPE_PTR:
+                type = "PTR";
+                break;
+            case DNS_TYPE_AAAA:
+                type = "AAAA";
+                break;
+            case DNS_TYPE_SRV:
+                type = "SRV";
+                break;
+            default:
+                (void) snprintf(type_str, sizeof(type_str), "TYPE%u", entry->type);
+                type = type_str;
+                break;
+        }
+
+        stats_printf(&buffer, "  %s %s %s, ttl %u, seen %u seconds ago\n",
+                     entry->owner, type, entry->target, entry->ttl, entry->age);
+    }
+
+    free(entries);
+    return buffer.data;
+}
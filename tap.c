@@ -0,0 +1,769 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+
+
+// mDNS port
+#define MCAST_PORT              5353
+
+// Maximum length of the tap status
+#define TAP_STATUS_LEN          512
+
+// Size of the queue for each bridge thread (must be a power of 2)
+#define TAP_QUEUE_SIZE          (1024 * 1024)
+
+// Interval at which the writer checks the queues when they are empty
+#define TAP_WRITER_INTERVAL_MSEC 10
+
+// Default and maximum file size and count
+#define TAP_DEFAULT_MEGABYTES   16
+#define TAP_DEFAULT_FILES       4
+#define TAP_MAX_MEGABYTES       4096
+#define TAP_MAX_FILES           100
+
+// Alignment of queue records
+#define TAP_ALIGN(len)          (((len) + 7) & ~((size_t) 7))
+
+// pcapng block types, options and link type
+#define PCAPNG_SHB              0x0A0D0D0A
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_END          0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_OPT_IF_NAME      2
+#define PCAPNG_OPT_EPB_FLAGS    2
+#define PCAPNG_OPT_SHB_USERAPPL 4
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_LINKTYPE_RAW     101
+#define PCAPNG_FLAG_INBOUND     1
+#define PCAPNG_FLAG_OUTBOUND    2
+
+// Maximum size of an enhanced packet block
+#define PCAPNG_MAX_BLOCK        (MDNS_MAX_PACKET_SIZE + 256)
+
+// Queue record kinds (in addition to tap_kind_t)
+#define TAP_PAD                 255
+
+// Queue record
+// NB: length and kind MUST be the first fields, as a pad record at the end of
+//     the queue may be as small as 8 bytes.
+typedef struct
+{
+    uint32_t                    length;         // Record length, including the header and alignment
+    uint8_t                     kind;
+    uint8_t                     verdict;
+    uint8_t                     ip_type;
+    uint8_t                     reserved;
+    uint32_t                    interface;
+    uint32_t                    filter_list;
+    uint64_t                    timestamp;      // Nanoseconds since the epoch
+    unsigned char               src_addr[16];
+    uint16_t                    src_port;
+    uint16_t                    bytes;
+    uint32_t                    reserved2;
+    unsigned char               data[];
+} tap_record_t;
+
+// Single producer (bridge thread), single consumer (writer thread) queue
+// NB: head is only written by the producer, and tail only by the consumer.
+typedef struct
+{
+    unsigned char *             data;
+    uint64_t                    head __attribute__ ((aligned (64)));
+    uint64_t                    tail __attribute__ ((aligned (64)));
+    uint64_t                    drops __attribute__ ((aligned (64)));
+} tap_queue_t;
+
+
+// Tap state
+unsigned int                    tap_enabled = 0;
+static tap_queue_t              tap_queue[NUM_IP_TYPES];
+
+// Writer state
+// NB: The file state is protected by tap_mutex. The writer thread holds the
+//     mutex while draining the queues, never the bridge threads.
+static pthread_mutex_t          tap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           tap_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int             tap_writer_started = 0;
+static char *                   tap_path = NULL;
+static size_t                   tap_file_size;
+static unsigned int             tap_file_count;
+static FILE *                   tap_fp = NULL;
+static size_t                   tap_file_bytes;
+static uint64_t                 tap_packets;
+static uint64_t                 tap_rotations;
+
+// Multicast destination addresses
+static const unsigned char      tap_ipv4_mcast[4] = { 224, 0, 0, 251 };
+static const unsigned char      tap_ipv6_mcast[16] = { 0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xfb };
+
+// Names of the record kinds and verdicts
+static const char *             tap_kind_names[] = { "ingress", "egress inbound filtered", "egress outbound filter list" };
+static const char *             tap_verdict_names[] = { "forwarded", "dropped" };
+
+
+
+//
+// Queue a packet for the tap
+//
+//   NB: If the queue is full, the packet is dropped and counted.
+//
+void tap_packet(
+    ip_type_t                   ip_type,
+    const interface_t *         interface,
+    tap_kind_t                  kind,
+    const filter_list_t *       filter_list,
+    tap_verdict_t               verdict,
+    const packet_t *            packet)
+{
+    tap_queue_t *               queue = &tap_queue[ip_type];
+    tap_record_t *              record;
+    struct timespec             ts;
+    uint64_t                    head;
+    uint64_t                    tail;
+    size_t                      offset;
+    size_t                      length;
+    size_t                      pad = 0;
+
+    head = queue->head;
+    tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    length = TAP_ALIGN(sizeof(tap_record_t) + packet->bytes);
+
+    // If the record does not fit before the end of the queue, pad to the end
+    offset = head & (TAP_QUEUE_SIZE - 1);
+    if (offset + length > TAP_QUEUE_SIZE)
+    {
+        pad = TAP_QUEUE_SIZE - offset;
+    }
+    if (head + pad + length - tail > TAP_QUEUE_SIZE)
+    {
+        STATS_ADD(queue->drops, 1);
+        return;
+    }
+    if (pad)
+    {
+        record = (tap_record_t *) (queue->data + offset);
+        record->length = pad;
+        record->kind = TAP_PAD;
+        head += pad;
+        offset = 0;
+    }
+
+    (void) clock_gettime(CLOCK_REALTIME, &ts);
+
+    record = (tap_record_t *) (queue->data + offset);
+    record->length = length;
+    record->kind = kind;
+    record->verdict = verdict;
+    record->ip_type = ip_type;
+    record->interface = interface->index;
+    record->filter_list = filter_list ? filter_list->index : 0;
+    record->timestamp = (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+    record->bytes = packet->bytes;
+
+    // The source address is only known for ingress packets
+    memset(record->src_addr, 0, sizeof(record->src_addr));
+    record->src_port = htons(MCAST_PORT);
+    if (kind == TAP_INGRESS)
+    {
+        if (ip_type == IPV4)
+        {
+            memcpy(record->src_addr, &packet->src_addr.sin.sin_addr, 4);
+            record->src_port = packet->src_addr.sin.sin_port;
+        }
+        else
+        {
+            memcpy(record->src_addr, &packet->src_addr.sin6.sin6_addr, 16);
+            record->src_port = packet->src_addr.sin6.sin6_port;
+        }
+    }
+
+    memcpy(record->data, packet->buffer, packet->bytes);
+    __atomic_store_n(&queue->head, head + length, __ATOMIC_RELEASE);
+}
+
+
+//
+// Compute an internet checksum
+//
+static uint32_t tap_checksum_add(
+    uint32_t                    sum,
+    const unsigned char *       data,
+    size_t                      len)
+{
+    size_t                      index;
+
+    for (index = 0; index + 1 < len; index += 2)
+    {
+        sum += (uint32_t) data[index] << 8 | data[index + 1];
+    }
+    if (len & 1)
+    {
+        sum += (uint32_t) data[len - 1] << 8;
+    }
+    return sum;
+}
+
+static uint16_t tap_checksum_fold(
+    uint32_t                    sum)
+{
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t) ~sum;
+}
+
+
+//
+// Build the IP and UDP headers for a record
+//
+//   Returns the length of the headers.
+//
+static size_t tap_build_headers(
+    const tap_record_t *        record,
+    unsigned char *             buffer)
+{
+    unsigned char *             udp;
+    size_t                      udp_len = 8 + record->bytes;
+    uint32_t                    sum;
+    uint16_t                    checksum;
+    size_t                      ip_len;
+
+    if (record->ip_type == IPV4)
+    {
+        ip_len = 20;
+        memset(buffer, 0, ip_len);
+        buffer[0] = 0x45;
+        buffer[2] = (unsigned char) ((ip_len + udp_len) >> 8);
+        buffer[3] = (unsigned char) (ip_len + udp_len);
+        buffer[8] = 255;
+        buffer[9] = IPPROTO_UDP;
+        memcpy(buffer + 12, record->src_addr, 4);
+        memcpy(buffer + 16, tap_ipv4_mcast, 4);
+        checksum = tap_checksum_fold(tap_checksum_add(0, buffer, ip_len));
+        buffer[10] = (unsigned char) (checksum >> 8);
+        buffer[11] = (unsigned char) checksum;
+    }
+    else
+    {
+        ip_len = 40;
+        memset(buffer, 0, ip_len);
+        buffer[0] = 0x60;
+        buffer[4] = (unsigned char) (udp_len >> 8);
+        buffer[5] = (unsigned char) udp_len;
+        buffer[6] = IPPROTO_UDP;
+        buffer[7] = 255;
+        memcpy(buffer + 8, record->src_addr, 16);
+        memcpy(buffer + 24, tap_ipv6_mcast, 16);
+    }
+
+    udp = buffer + ip_len;
+    memcpy(udp, &record->src_port, 2);
+    udp[2] = MCAST_PORT >> 8;
+    udp[3] = MCAST_PORT & 0xff;
+    udp[4] = (unsigned char) (udp_len >> 8);
+    udp[5] = (unsigned char) udp_len;
+    udp[6] = 0;
+    udp[7] = 0;
+
+    // The UDP checksum is optional for IPv4, but mandatory for IPv6
+    if (record->ip_type == IPV6)
+    {
+        sum = tap_checksum_add(0, buffer + 8, 32);
+        sum += (uint32_t) udp_len + IPPROTO_UDP;
+        sum = tap_checksum_add(sum, udp, 8);
+        sum = tap_checksum_add(sum, record->data, record->bytes);
+        checksum = tap_checksum_fold(sum);
+        if (checksum == 0)
+        {
+            checksum = 0xffff;
+        }
+        udp[6] = (unsigned char) (checksum >> 8);
+        udp[7] = (unsigned char) checksum;
+    }
+
+    return ip_len + 8;
+}
+
+
+//
+// Append a pcapng option to a block
+//
+//   Returns the new length of the block.
+//
+static size_t pcapng_option(
+    unsigned char *             block,
+    size_t                      length,
+    uint16_t                    code,
+    const void *                value,
+    size_t                      value_len)
+{
+    uint16_t                    header[2];
+
+    header[0] = code;
+    header[1] = (uint16_t) value_len;
+    memcpy(block + length, header, sizeof(header));
+    memcpy(block + length + sizeof(header), value, value_len);
+    length += sizeof(header) + value_len;
+    while (length & 3)
+    {
+        block[length++] = 0;
+    }
+    return length;
+}
+
+
+//
+// Complete a pcapng block and write it to the tap file
+//
+static void pcapng_write_block(
+    unsigned char *             block,
+    size_t                      length)
+{
+    uint32_t                    block_len;
+
+    // End of options, and the trailing block length
+    length = pcapng_option(block, length, PCAPNG_OPT_END, NULL, 0);
+    block_len = (uint32_t) (length + sizeof(block_len));
+    memcpy(block + 4, &block_len, sizeof(block_len));
+    memcpy(block + length, &block_len, sizeof(block_len));
+
+    if (fwrite(block, block_len, 1, tap_fp) != 1)
+    {
+        logger("tap write to %s failed: %s\n", tap_path, strerror(errno));
+    }
+    tap_file_bytes += block_len;
+}
+
+
+//
+// Write the section header and interface description blocks
+//
+static void pcapng_write_header(void)
+{
+    unsigned char               block[256];
+    const char *                application = "mDNS Bridge " VERSION;
+    const uint32_t              shb_header[3] = { PCAPNG_SHB, 0, PCAPNG_BYTE_ORDER_MAGIC };
+    const uint16_t              version[2] = { 1, 0 };
+    const int64_t               section_length = -1;
+    const uint32_t              idb_header[2] = { PCAPNG_IDB, 0 };
+    const uint16_t              link[2] = { PCAPNG_LINKTYPE_RAW, 0 };
+    const uint32_t              snaplen = 0;
+    const unsigned char         tsresol = 9;
+    const char *                name;
+    size_t                      length;
+    unsigned int                index;
+
+    memcpy(block, shb_header, sizeof(shb_header));
+    memcpy(block + 12, version, sizeof(version));
+    memcpy(block + 16, &section_length, sizeof(section_length));
+    length = pcapng_option(block, 24, PCAPNG_OPT_SHB_USERAPPL, application, strlen(application));
+    pcapng_write_block(block, length);
+
+    // One interface description per configured interface
+    for (index = 0; index < configured_interface_count; index++)
+    {
+        name = configured_interface_list[index].name;
+        memcpy(block, idb_header, sizeof(idb_header));
+        memcpy(block + 8, link, sizeof(link));
+        memcpy(block + 12, &snaplen, sizeof(snaplen));
+        length = pcapng_option(block, 16, PCAPNG_OPT_IF_NAME, name, strnlen(name, IF_NAMESIZE));
+        length = pcapng_option(block, length, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof(tsresol));
+        pcapng_write_block(block, length);
+    }
+}
+
+
+//
+// Write a record to the tap file as an enhanced packet block
+//
+static void pcapng_write_packet(
+    const tap_record_t *        record)
+{
+    unsigned char               block[PCAPNG_MAX_BLOCK];
+    char                        comment[128];
+    uint32_t                    header[7];
+    uint32_t                    flags;
+    size_t                      headers_len;
+    size_t                      length;
+    int                         len;
+
+    headers_len = tap_build_headers(record, block + sizeof(header));
+    memcpy(block + sizeof(header) + headers_len, record->data, record->bytes);
+
+    header[0] = PCAPNG_EPB;
+    header[1] = 0;
+    header[2] = record->interface;
+    header[3] = (uint32_t) (record->timestamp >> 32);
+    header[4] = (uint32_t) record->timestamp;
+    header[5] = (uint32_t) (headers_len + record->bytes);
+    header[6] = header[5];
+    memcpy(block, header, sizeof(header));
+
+    length = sizeof(header) + headers_len + record->bytes;
+    while (length & 3)
+    {
+        block[length++] = 0;
+    }
+
+    flags = record->kind == TAP_INGRESS ? PCAPNG_FLAG_INBOUND : PCAPNG_FLAG_OUTBOUND;
+    length = pcapng_option(block, length, PCAPNG_OPT_EPB_FLAGS, &flags, sizeof(flags));
+
+    if (record->kind == TAP_EGRESS_OUTBOUND)
+    {
+        len = snprintf(comment, sizeof(comment), "%s %u from %s: %s", tap_kind_names[record->kind], record->filter_list,
+                       configured_interface_list[record->interface].name, tap_verdict_names[record->verdict]);
+    }
+    else
+    {
+        len = snprintf(comment, sizeof(comment), "%s %s %s: %s", tap_kind_names[record->kind],
+                       record->kind == TAP_INGRESS ? "on" : "from",
+                       configured_interface_list[record->interface].name, tap_verdict_names[record->verdict]);
+    }
+    length = pcapng_option(block, length, PCAPNG_OPT_COMMENT, comment, (size_t) len < sizeof(comment) ? (size_t) len : sizeof(comment) - 1);
+
+    pcapng_write_block(block, length);
+    tap_packets += 1;
+}
+
+
+//
+// Open the tap file
+//
+//   Returns 0 on success, or -1 on error.
+//
+static int tap_open(void)
+{
+    tap_fp = fopen(tap_path, "w");
+    if (tap_fp == NULL)
+    {
+        return -1;
+    }
+
+    tap_file_bytes = 0;
+    pcapng_write_header();
+    return 0;
+}
+
+
+//
+// Rotate the tap files
+//
+//   The current file becomes path.1, path.1 becomes path.2, and so on. The
+//   oldest file is removed.
+//
+static void tap_rotate(void)
+{
+    char                        from[PATH_MAX];
+    char                        to[PATH_MAX];
+    unsigned int                index;
+
+    (void) fclose(tap_fp);
+    tap_fp = NULL;
+
+    for (index = tap_file_count - 1; index > 0; index--)
+    {
+        if (index > 1)
+        {
+            (void) snprintf(from, sizeof(from), "%s.%u", tap_path, index - 1);
+        }
+        else
+        {
+            (void) snprintf(from, sizeof(from), "%s", tap_path);
+        }
+        (void) snprintf(to, sizeof(to), "%s.%u", tap_path, index);
+        (void) rename(from, to);
+    }
+
+    if (tap_open() == -1)
+    {
+        logger("tap open of %s failed: %s\n", tap_path, strerror(errno));
+        __atomic_store_n(&tap_enabled, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    tap_rotations += 1;
+}
+
+
+//
+// Drain the tap queues
+//
+//   Returns the number of records drained.
+//
+//   NOTE: Called with tap_mutex held.
+//
+static unsigned int tap_drain(void)
+{
+    tap_queue_t *               queue;
+    const tap_record_t *        record;
+    uint64_t                    head;
+    uint64_t                    tail;
+    unsigned int                count = 0;
+    unsigned int                ip_type;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        queue = &tap_queue[ip_type];
+        if (queue->data == NULL)
+        {
+            continue;
+        }
+
+        head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        tail = queue->tail;
+        while (tail != head)
+        {
+            record = (const tap_record_t *) (queue->data + (tail & (TAP_QUEUE_SIZE - 1)));
+            if (record->kind != TAP_PAD && tap_fp)
+            {
+                pcapng_write_packet(record);
+                if (tap_file_bytes >= tap_file_size)
+                {
+                    tap_rotate();
+                }
+            }
+            tail += record->length;
+            __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+
+//
+// Tap writer thread
+//
+__attribute__ ((noreturn))
+static void * tap_writer_thread(
+    __attribute__ ((unused)) void * arg)
+{
+    struct timespec             interval;
+
+    interval.tv_sec = 0;
+    interval.tv_nsec = TAP_WRITER_INTERVAL_MSEC * 1000000L;
+
+    pthread_mutex_lock(&tap_mutex);
+    while (1)
+    {
+        if (tap_fp == NULL)
+        {
+            pthread_cond_wait(&tap_cond, &tap_mutex);
+            continue;
+        }
+
+        if (tap_drain() == 0)
+        {
+            // Flush while idle so that the file is current for readers
+            (void) fflush(tap_fp);
+
+            pthread_mutex_unlock(&tap_mutex);
+            (void) nanosleep(&interval, NULL);
+            pthread_mutex_lock(&tap_mutex);
+        }
+    }
+}
+
+
+//
+// Open the tap and start the writer
+//
+//   Returns NULL on success, or an error message.
+//
+//   NOTE: Called with tap_mutex held.
+//
+static const char * tap_start_locked(
+    unsigned int                file_megabytes,
+    unsigned int                file_count)
+{
+    pthread_t                   thread_id;
+    unsigned int                ip_type;
+    int                         r;
+
+    if (tap_fp)
+    {
+        return "The tap is already running\n";
+    }
+
+    // The tap file is taken from the current configuration
+    free(tap_path);
+    pthread_mutex_lock(&config_mutex);
+    tap_path = current_config->tap_file ? strdup(current_config->tap_file) : NULL;
+    pthread_mutex_unlock(&config_mutex);
+    if (tap_path == NULL)
+    {
+        return "No tap-file is configured\n";
+    }
+
+    // The queues are allocated on first use, and never freed
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        if (tap_queue[ip_type].data == NULL)
+        {
+            tap_queue[ip_type].data = malloc(TAP_QUEUE_SIZE);
+            if (tap_queue[ip_type].data == NULL)
+            {
+                fatal("Cannot allocate memory: %s\n", strerror(errno));
+            }
+        }
+
+        // Discard anything queued after the tap was last stopped
+        __atomic_store_n(&tap_queue[ip_type].tail, __atomic_load_n(&tap_queue[ip_type].head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+
+    tap_file_size = (size_t) file_megabytes * 1024 * 1024;
+    tap_file_count = file_count;
+    if (tap_open() == -1)
+    {
+        logger("tap open of %s failed: %s\n", tap_path, strerror(errno));
+        return "Cannot open the tap file\n";
+    }
+    tap_packets = 0;
+    tap_rotations = 0;
+
+    if (tap_writer_started == 0)
+    {
+        r = pthread_create(&thread_id, NULL, &tap_writer_thread, NULL);
+        if (r != 0)
+        {
+            fatal("cannot create tap writer thread: %s\n", strerror(r));
+        }
+        (void) pthread_detach(thread_id);
+        tap_writer_started = 1;
+    }
+
+    __atomic_store_n(&tap_enabled, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&tap_cond);
+    logger("tap started on %s\n", tap_path);
+    return NULL;
+}
+
+
+//
+// Start the packet tap
+//
+//   Returns NULL on success, or an error message.
+//
+//   NOTE: Called by the control thread.
+//
+const char * tap_start(
+    unsigned int                file_megabytes,
+    unsigned int                file_count)
+{
+    const char *                error;
+
+    if (file_megabytes == 0)
+    {
+        file_megabytes = TAP_DEFAULT_MEGABYTES;
+    }
+    if (file_count == 0)
+    {
+        file_count = TAP_DEFAULT_FILES;
+    }
+    if (file_megabytes > TAP_MAX_MEGABYTES || file_count > TAP_MAX_FILES)
+    {
+        return "Invalid tap file size or count\n";
+    }
+
+    pthread_mutex_lock(&tap_mutex);
+    error = tap_start_locked(file_megabytes, file_count);
+    pthread_mutex_unlock(&tap_mutex);
+
+    return error;
+}
+
+
+//
+// Stop the packet tap
+//
+//   NOTE: Called by the control thread.
+//
+void tap_stop(void)
+{
+    pthread_mutex_lock(&tap_mutex);
+    __atomic_store_n(&tap_enabled, 0, __ATOMIC_RELAXED);
+    if (tap_fp)
+    {
+        (void) tap_drain();
+        (void) fclose(tap_fp);
+        tap_fp = NULL;
+        logger("tap stopped on %s\n", tap_path);
+    }
+    pthread_mutex_unlock(&tap_mutex);
+}
+
+
+//
+// Format the packet tap status
+//
+//   Returns an allocated string that must be freed by the caller.
+//
+char * tap_status(void)
+{
+    char *                      status;
+
+    status = malloc(TAP_STATUS_LEN);
+    if (status == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+
+    pthread_mutex_lock(&tap_mutex);
+    if (tap_fp)
+    {
+        (void) snprintf(status, TAP_STATUS_LEN, "tap running on %s (%zu megabytes x %u files)\n"
+                     " packets written %llu, file rotations %llu\n"
+                     " queue drops: ipv4 %llu, ipv6 %llu\n",
+                     tap_path, tap_file_size / (1024 * 1024), tap_file_count,
+                     (unsigned long long) tap_packets, (unsigned long long) tap_rotations,
+                     (unsigned long long) STATS_READ(tap_queue[IPV4].drops),
+                     (unsigned long long) STATS_READ(tap_queue[IPV6].drops));
+    }
+    else
+    {
+        (void) snprintf(status, TAP_STATUS_LEN, "tap stopped\n");
+    }
+    pthread_mutex_unlock(&tap_mutex);
+
+    return status;
+}
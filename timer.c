@@ -0,0 +1,419 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "common.h"
+
+
+//
+// Ensure we have timerfd or kqueue
+//
+#if defined(__linux__)
+# define HAVE_TIMERFD
+#elif defined(__FreeBSD__) || defined(__APPLE__)
+# define HAVE_KQUEUE
+#endif
+
+#if defined(HAVE_TIMERFD)
+# include <sys/timerfd.h>
+#elif defined(HAVE_KQUEUE)
+# include <sys/event.h>
+#else
+# error timerfd or kqueue is required
+#endif
+
+
+// Mask for a slot index within a level
+#define TIMER_SLOT_MASK         (TIMER_SLOTS - 1)
+
+// Maximum number of ticks a timer may be scheduled in the future
+#define TIMER_MAX_TICKS         ((1ULL << (TIMER_LEVEL_BITS * TIMER_LEVELS)) - 1)
+
+
+
+//
+// Get the current monotonic time in ticks
+//
+uint64_t timer_clock_ticks(void)
+{
+    struct timespec             ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000) / TIMER_TICK_MSEC;
+}
+
+
+//
+// Arm the kernel timer source to fire at a given tick, or disarm it if the tick is zero
+//
+static void timer_wheel_arm(
+    timer_wheel_t *             wheel,
+    uint64_t                    deadline,
+    uint64_t                    now)
+{
+    uint64_t                    msec = 0;
+
+    if (deadline)
+    {
+        msec = deadline > now ? (deadline - now) * TIMER_TICK_MSEC : TIMER_TICK_MSEC;
+    }
+
+#if defined(HAVE_TIMERFD)
+    struct itimerspec           its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = msec / 1000;
+    its.it_value.tv_nsec = (msec % 1000) * 1000000L;
+
+    if (timerfd_settime(wheel->fd, 0, &its, NULL) == -1)
+    {
+        fatal("timerfd_settime: %s\n", strerror(errno));
+    }
+#elif defined(HAVE_KQUEUE)
+    struct kevent               event;
+
+    if (msec)
+    {
+        EV_SET(&event, 0, EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0, msec, NULL);
+        if (kevent(wheel->fd, &event, 1, NULL, 0, NULL) == -1)
+        {
+            fatal("kevent (EVFILT_TIMER): %s\n", strerror(errno));
+        }
+    }
+    else
+    {
+        // NB: The timer may have already fired and been removed
+        EV_SET(&event, 0, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+        (void) kevent(wheel->fd, &event, 1, NULL, 0, NULL);
+    }
+#endif
+
+    wheel->deadline = deadline;
+}
+
+
+//
+// Clear the readable state of the kernel timer source
+//
+static void timer_wheel_drain(
+    timer_wheel_t *             wheel)
+{
+#if defined(HAVE_TIMERFD)
+    uint64_t                    expirations;
+
+    (void) read(wheel->fd, &expirations, sizeof(expirations));
+#elif defined(HAVE_KQUEUE)
+    const struct timespec       zero = { 0, 0 };
+    struct kevent               event;
+
+    (void) kevent(wheel->fd, NULL, 0, &event, 1, &zero);
+#endif
+}
+
+
+//
+// Link a timer into the appropriate slot of the wheel
+//
+static void timer_link(
+    timer_wheel_t *             wheel,
+    wheel_timer_t *             timer)
+{
+    wheel_timer_t **            slot;
+    uint64_t                    delta;
+    unsigned int                level;
+
+    delta = timer->expires - wheel->tick;
+
+    // Find the level the timer belongs in
+    for (level = 0; level < TIMER_LEVELS - 1; level++)
+    {
+        if (delta < (1ULL << (TIMER_LEVEL_BITS * (level + 1))))
+        {
+            break;
+        }
+    }
+
+    slot = &wheel->slots[level][(timer->expires >> (TIMER_LEVEL_BITS * level)) & TIMER_SLOT_MASK];
+
+    // Insert at the head of the slot
+    timer->next = *slot;
+    if (timer->next)
+    {
+        timer->next->prev = &timer->next;
+    }
+    timer->prev = slot;
+    *slot = timer;
+}
+
+
+//
+// Unlink a timer from the wheel
+//
+static void timer_unlink(
+    wheel_timer_t *             timer)
+{
+    *timer->prev = timer->next;
+    if (timer->next)
+    {
+        timer->next->prev = timer->prev;
+    }
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+
+//
+// Find the next tick at which the wheel has work to do
+//
+//   NOTE: For levels above zero, this is the tick at which the first occupied
+//         slot will be cascaded rather than the precise expiration time.
+//
+static uint64_t timer_next_tick(
+    const timer_wheel_t *       wheel)
+{
+    uint64_t                    next = UINT64_MAX;
+    uint64_t                    position;
+    uint64_t                    candidate;
+    unsigned int                level;
+    unsigned int                shift;
+    unsigned int                i;
+
+    for (level = 0; level < TIMER_LEVELS; level++)
+    {
+        shift = TIMER_LEVEL_BITS * level;
+        position = wheel->tick >> shift;
+
+        for (i = 1; i <= TIMER_SLOTS; i++)
+        {
+            if (wheel->slots[level][(position + i) & TIMER_SLOT_MASK])
+            {
+                candidate = (position + i) << shift;
+                if (candidate < next)
+                {
+                    next = candidate;
+                }
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+
+//
+// Initialize a timer wheel
+//
+void timer_wheel_init(
+    timer_wheel_t *             wheel)
+{
+    memset(wheel, 0, sizeof(timer_wheel_t));
+
+#if defined(HAVE_TIMERFD)
+    wheel->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (wheel->fd == -1)
+    {
+        fatal("timerfd_create: %s\n", strerror(errno));
+    }
+#elif defined(HAVE_KQUEUE)
+    // NB: A kqueue descriptor is itself readable when it has pending events,
+    //     so the private kqueue can be added to the bridge event notifier.
+    wheel->fd = kqueue();
+    if (wheel->fd == -1)
+    {
+        fatal("kqueue: %s\n", strerror(errno));
+    }
+#endif
+
+    wheel->tick = timer_clock_ticks();
+}
+
+
+//
+// Start (or restart) a timer
+//
+void timer_start(
+    timer_wheel_t *             wheel,
+    wheel_timer_t *             timer,
+    unsigned int                msec,
+    timer_callback_t            callback,
+    void *                      arg)
+{
+    uint64_t                    now;
+    uint64_t                    ticks;
+
+    // If the timer is already running, remove it
+    if (timer->prev)
+    {
+        timer_unlink(timer);
+        wheel->count -= 1;
+    }
+
+    // If the wheel is empty, bring it up to date with the clock
+    now = timer_clock_ticks();
+    if (wheel->count == 0)
+    {
+        wheel->tick = now;
+    }
+
+    // Round up to the next tick, and always expire at least one tick in the future
+    ticks = (msec + TIMER_TICK_MSEC - 1) / TIMER_TICK_MSEC;
+    if (ticks == 0)
+    {
+        ticks = 1;
+    }
+
+    // NB: The wheel may lag the clock between runs. Expiration is relative to
+    //     the clock, but the wheel range is relative to the wheel position.
+    timer->expires = now + ticks;
+    if (timer->expires - wheel->tick > TIMER_MAX_TICKS)
+    {
+        timer->expires = wheel->tick + TIMER_MAX_TICKS;
+    }
+    timer->callback = callback;
+    timer->arg = arg;
+
+    timer_link(wheel, timer);
+    wheel->count += 1;
+
+    // Ensure the kernel timer will fire in time for the new timer
+    if (wheel->deadline == 0 || timer->expires < wheel->deadline)
+    {
+        timer_wheel_arm(wheel, timer->expires, now);
+    }
+}
+
+
+//
+// Stop a timer
+//
+void timer_stop(
+    timer_wheel_t *             wheel,
+    wheel_timer_t *             timer)
+{
+    // NB: The kernel timer is left armed and will be reset when it fires.
+    //     This avoids a system call per stop.
+    if (timer->prev)
+    {
+        timer_unlink(timer);
+        wheel->count -= 1;
+    }
+}
+
+
+//
+// Cascade a slot from a higher level into the levels below
+//
+static void timer_cascade(
+    timer_wheel_t *             wheel,
+    unsigned int                level)
+{
+    wheel_timer_t **            slot;
+    wheel_timer_t *             timer;
+
+    slot = &wheel->slots[level][(wheel->tick >> (TIMER_LEVEL_BITS * level)) & TIMER_SLOT_MASK];
+    while ((timer = *slot) != NULL)
+    {
+        timer_unlink(timer);
+        timer_link(wheel, timer);
+    }
+}
+
+
+//
+// Advance the wheel by one tick and run expired timers
+//
+static void timer_advance(
+    timer_wheel_t *             wheel)
+{
+    wheel_timer_t **            slot;
+    wheel_timer_t *             timer;
+    unsigned int                level;
+
+    wheel->tick += 1;
+
+    // Cascade higher levels as lower levels wrap
+    for (level = 1; level < TIMER_LEVELS; level++)
+    {
+        if (wheel->tick & ((1ULL << (TIMER_LEVEL_BITS * level)) - 1))
+        {
+            break;
+        }
+        timer_cascade(wheel, level);
+    }
+
+    // Run the expired timers
+    // NB: A callback may start or stop any timer, including itself, so
+    //     the slot head is re-read after each callback.
+    slot = &wheel->slots[0][wheel->tick & TIMER_SLOT_MASK];
+    while ((timer = *slot) != NULL)
+    {
+        timer_unlink(timer);
+        wheel->count -= 1;
+        timer->callback(timer, timer->arg);
+    }
+}
+
+
+//
+// Process timer wheel expirations
+//
+void timer_wheel_run(
+    timer_wheel_t *             wheel)
+{
+    uint64_t                    now;
+
+    timer_wheel_drain(wheel);
+
+    // Bring the wheel up to date with the clock
+    now = timer_clock_ticks();
+    while (wheel->tick < now && wheel->count)
+    {
+        timer_advance(wheel);
+    }
+    if (wheel->count == 0)
+    {
+        wheel->tick = now;
+    }
+
+    // Arm the kernel timer for the next work, or disarm it if the wheel is empty
+    if (wheel->count)
+    {
+        timer_wheel_arm(wheel, timer_next_tick(wheel), now);
+    }
+    else if (wheel->deadline)
+    {
+        timer_wheel_arm(wheel, 0, now);
+    }
+}
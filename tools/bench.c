@@ -0,0 +1,451 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+//
+// Offline replay benchmark
+//
+// Reads the mDNS packets of pcap or pcapng captures and passes each through
+// the decode and encode stages of the bridge, as configured by a bridge
+// configuration file, without any sockets. Each packet is treated as
+// received on one interface, and is encoded once for the inbound filters
+// and once for each unique outbound filter list of the peers of that
+// interface, as the bridge threads do. Forwarding policies are not applied.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "../common.h"
+#include "capture.h"
+
+
+// Who we are
+static const char *             progname;
+
+// Config file
+#define DEFAULT_CONFIG_FILE     "mdns-bridge.conf"
+const char *                    config_filename = DEFAULT_CONFIG_FILE;
+
+// Name of the receiving interface (NULL for the first interface of the ip type)
+static const char *             interface_name = NULL;
+
+// Number of passes over the captures
+static unsigned int             passes = 1;
+
+// Benchmarked stages
+typedef enum
+{
+    BENCH_DECODE                = 0,
+    BENCH_ENCODE_INBOUND        = 1,
+    BENCH_ENCODE_OUTBOUND       = 2,
+    BENCH_TOTAL                 = 3
+} bench_stage_t;
+#define NUM_BENCH_STAGES        4
+
+static const char *             bench_stage_names[NUM_BENCH_STAGES] =
+{
+    "decode", "encode inbound", "encode outbound", "total"
+};
+
+// Benchmark counters
+typedef struct
+{
+    uint64_t                    calls[NUM_BENCH_STAGES];
+    uint64_t                    nsec[NUM_BENCH_STAGES];
+    uint64_t                    packets;
+    uint64_t                    dropped;
+    uint64_t                    bytes_in;
+    uint64_t                    bytes_encoded;
+    uint64_t                    packets_sent;
+    uint64_t                    bytes_sent;
+} bench_counters_t;
+
+
+
+//
+// Report a fatal error
+//
+__attribute__ ((noreturn, format (printf, 1, 2)))
+void fatal(
+    const char *                format,
+    ...)
+{
+    va_list                     args;
+
+    // Write any queued messages first
+    logger_flush();
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
+
+
+//
+// Parse command line arguments
+//
+static void parse_args(
+    int                         argc,
+    char * const                argv[])
+{
+    int                         opt;
+
+    progname = argv[0];
+
+    while((opt = getopt(argc, argv, "hc:i:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            config_filename = optarg;
+            break;
+        case 'i':
+            interface_name = optarg;
+            break;
+        case 'n':
+            passes = (unsigned int) strtoul(optarg, NULL, 10);
+            if (passes == 0)
+            {
+                fatal("invalid number of passes: %s\n", optarg);
+            }
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Usage:\n");
+        fprintf(stderr, "  %s [-h] [-c config_file] [-i interface] [-n passes] capture_file ...\n", progname);
+        fprintf(stderr, "  options:\n");
+        fprintf(stderr, "    -h display usage\n");
+        fprintf(stderr, "    -c configuration file name\n");
+        fprintf(stderr, "    -i name of the receiving interface\n");
+        fprintf(stderr, "    -n number of passes over the captures\n");
+        exit(1);
+    }
+}
+
+
+//
+// Get the receiving interface for an ip type
+//
+static interface_t * bench_interface(
+    ip_type_t                   ip_type)
+{
+    unsigned int                index;
+
+    for (index = 0; index < ip_interface_count[ip_type]; index++)
+    {
+        if (interface_name == NULL || strcmp(ip_interface_list[ip_type][index]->name, interface_name) == 0)
+        {
+            return ip_interface_list[ip_type][index];
+        }
+    }
+
+    return NULL;
+}
+
+
+//
+// Get the number of peers of an interface that use an outbound filter list
+//
+static unsigned int bench_peer_count(
+    const config_t *            config,
+    const interface_t *         interface,
+    ip_type_t                   ip_type,
+    const filter_list_t *       filter_list)
+{
+    unsigned int                count = 0;
+    unsigned int                index;
+
+    for (index = 0; index < interface->peer_count[ip_type]; index++)
+    {
+        if (config->interface_config[interface->peer_list[ip_type][index]->index].outbound_filter_list == filter_list)
+        {
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+
+//
+// Replay a packet, mirroring the decode and encode path of the bridge threads
+//
+static void bench_packet(
+    bench_counters_t *          counters,
+    dns_state_t                 dns_state,
+    const config_t *            config,
+    const interface_t *         interface,
+    ip_type_t                   ip_type,
+    const packet_t *            recv_packet,
+    packet_t *                  send_packet)
+{
+    const packet_t *            packet = recv_packet;
+    filter_list_t *             filter_list;
+    unsigned int                filter_index;
+    unsigned int                peers;
+    uint64_t                    packet_nsec;
+    uint64_t                    start_nsec;
+    uint64_t                    end_nsec;
+    unsigned int                r;
+
+    counters->packets += 1;
+    counters->bytes_in += recv_packet->bytes;
+    packet_nsec = stats_latency_clock();
+
+    // Decode the packet
+    if (config->filtering_enabled)
+    {
+        r = dns_decode_packet(dns_state, recv_packet, config, interface);
+        end_nsec = stats_latency_clock();
+        counters->calls[BENCH_DECODE] += 1;
+        counters->nsec[BENCH_DECODE] += end_nsec - packet_nsec;
+        if (r == 0)
+        {
+            counters->dropped += 1;
+            counters->calls[BENCH_TOTAL] += 1;
+            counters->nsec[BENCH_TOTAL] += end_nsec - packet_nsec;
+            return;
+        }
+    }
+
+    // Encode for the peers that do not have outbound filters
+    if (interface->peer_nofilter_count[ip_type])
+    {
+        if (config->global_filter_list || config->interface_config[interface->index].inbound_filter_list)
+        {
+            start_nsec = stats_latency_clock();
+            r = dns_encode_packet(dns_state, recv_packet, send_packet, NULL);
+            counters->calls[BENCH_ENCODE_INBOUND] += 1;
+            counters->nsec[BENCH_ENCODE_INBOUND] += stats_latency_clock() - start_nsec;
+            counters->bytes_encoded += r ? send_packet->bytes : 0;
+            packet = r ? send_packet : NULL;
+        }
+
+        if (packet)
+        {
+            peers = bench_peer_count(config, interface, ip_type, NULL);
+            counters->packets_sent += peers;
+            counters->bytes_sent += (uint64_t) peers * packet->bytes;
+        }
+    }
+
+    // Encode for each outbound filter list of the peers
+    for (filter_index = 0; filter_index < interface->peer_filter_count[ip_type]; filter_index++)
+    {
+        filter_list = interface->peer_filter_list[ip_type][filter_index];
+
+        start_nsec = stats_latency_clock();
+        r = dns_encode_packet(dns_state, recv_packet, send_packet, filter_list);
+        counters->calls[BENCH_ENCODE_OUTBOUND] += 1;
+        counters->nsec[BENCH_ENCODE_OUTBOUND] += stats_latency_clock() - start_nsec;
+        if (r == 0)
+        {
+            continue;
+        }
+        counters->bytes_encoded += send_packet->bytes;
+
+        peers = bench_peer_count(config, interface, ip_type, filter_list);
+        counters->packets_sent += peers;
+        counters->bytes_sent += (uint64_t) peers * send_packet->bytes;
+    }
+
+    counters->calls[BENCH_TOTAL] += 1;
+    counters->nsec[BENCH_TOTAL] += stats_latency_clock() - packet_nsec;
+}
+
+
+//
+// Write the benchmark report
+//
+static void bench_report(
+    const bench_counters_t *    counters,
+    uint64_t                    elapsed_nsec)
+{
+    unsigned int                stage;
+
+    printf("packets:          %llu (%llu dropped by decode)\n",
+           (unsigned long long) counters->packets, (unsigned long long) counters->dropped);
+    printf("elapsed:          %.3f sec\n", (double) elapsed_nsec / 1e9);
+    printf("packets/sec:      %.0f\n", elapsed_nsec ? (double) counters->packets * 1e9 / (double) elapsed_nsec : 0.0);
+    printf("\n");
+
+    printf("%-16s %12s %12s %12s\n", "stage", "calls", "ns/call", "ns/packet");
+    for (stage = 0; stage < NUM_BENCH_STAGES; stage++)
+    {
+        printf("%-16s %12llu %12.0f %12.0f\n", bench_stage_names[stage],
+               (unsigned long long) counters->calls[stage],
+               counters->calls[stage] ? (double) counters->nsec[stage] / (double) counters->calls[stage] : 0.0,
+               counters->packets ? (double) counters->nsec[stage] / (double) counters->packets : 0.0);
+    }
+    printf("\n");
+
+    printf("bytes in:         %llu\n", (unsigned long long) counters->bytes_in);
+    printf("bytes encoded:    %llu\n", (unsigned long long) counters->bytes_encoded);
+    printf("packets sent:     %llu\n", (unsigned long long) counters->packets_sent);
+    printf("bytes sent:       %llu\n", (unsigned long long) counters->bytes_sent);
+}
+
+
+//
+// Main
+//
+int main(
+    int                         argc,
+    char                        *argv[])
+{
+    capture_t                   capture;
+    bench_counters_t            counters;
+    dns_state_t                 dns_state[NUM_IP_TYPES];
+    interface_t *               interface[NUM_IP_TYPES];
+    interface_t *               configured;
+    const config_t *            config;
+    packet_t *                  recv_packet;
+    packet_t *                  send_packet;
+    ip_type_t                   ip_type;
+    unsigned int                index;
+    unsigned int                pass;
+    unsigned int                undecodable = 0;
+    unsigned int                unmatched = 0;
+    uint64_t                    start_nsec;
+
+    parse_args(argc, argv);
+    logger_initialize(0);
+    logger_start();
+
+    // Load the configuration
+    read_config();
+    set_ip_interface_lists();
+    stats_initialize();
+    topk_initialize();
+    inventory_initialize(current_config->inventory_size);
+    config = current_config;
+
+    // Treat all the enabled interfaces as active, and build the peer lists
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        for (index = 0; index < ip_interface_count[ip_type]; index++)
+        {
+            configured = ip_interface_list[ip_type][index];
+            configured->active[ip_type] = 1;
+        }
+        set_interface_peer_lists(config, ip_type);
+
+        interface[ip_type] = bench_interface(ip_type);
+        dns_state[ip_type] = dns_state_create(ip_type);
+    }
+    if (interface_name && interface[IPV4] == NULL && interface[IPV6] == NULL)
+    {
+        fatal("interface %s is not an enabled interface\n", interface_name);
+    }
+
+    // Load the captures
+    memset(&capture, 0, sizeof(capture));
+    for (index = (unsigned int) optind; index < (unsigned int) argc; index++)
+    {
+        capture_load(&capture, argv[index]);
+    }
+
+    recv_packet = malloc(sizeof(packet_t));
+    send_packet = malloc(sizeof(packet_t));
+    if (recv_packet == NULL || send_packet == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+
+    // Exclude the packets that cannot be decoded, or have no receiving interface
+    // NB: Packets are compacted in place
+    pass = 0;
+    for (index = 0; index < capture.count; index++)
+    {
+        capture_copy(&capture.packets[index], recv_packet);
+        ip_type = recv_packet->src_addr.sa.sa_family == AF_INET ? IPV4 : IPV6;
+        if (test_dns_packet_decode(recv_packet) == 0)
+        {
+            undecodable += 1;
+            free(capture.packets[index].data);
+            continue;
+        }
+        if (interface[ip_type] == NULL)
+        {
+            unmatched += 1;
+            free(capture.packets[index].data);
+            continue;
+        }
+        capture.packets[pass++] = capture.packets[index];
+    }
+    capture.count = pass;
+
+    printf("captured mDNS packets: %u (%llu other frames, %u undecodable, %u without a receiving interface)\n",
+           capture.count + undecodable + unmatched, capture.skipped, undecodable, unmatched);
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        if (interface[ip_type])
+        {
+            printf("%s: received on %s, %u peers, %u outbound filter lists\n", ip_type == IPV4 ? "ipv4" : "ipv6",
+                   interface[ip_type]->name, interface[ip_type]->peer_count[ip_type],
+                   interface[ip_type]->peer_filter_count[ip_type]);
+        }
+    }
+    printf("passes: %u\n\n", passes);
+    if (capture.count == 0)
+    {
+        fatal("no packets to replay\n");
+    }
+
+    // Replay the packets
+    memset(&counters, 0, sizeof(counters));
+    start_nsec = stats_latency_clock();
+    for (pass = 0; pass < passes; pass++)
+    {
+        for (index = 0; index < capture.count; index++)
+        {
+            capture_copy(&capture.packets[index], recv_packet);
+            ip_type = recv_packet->src_addr.sa.sa_family == AF_INET ? IPV4 : IPV6;
+            bench_packet(&counters, dns_state[ip_type], config, interface[ip_type], ip_type, recv_packet, send_packet);
+        }
+    }
+    bench_report(&counters, stats_latency_clock() - start_nsec);
+
+    logger_flush();
+    return 0;
+}
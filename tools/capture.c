@@ -0,0 +1,516 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../common.h"
+#include "capture.h"
+
+
+// mDNS port
+#define MCAST_PORT              5353
+
+// pcap file header magic numbers (microsecond and nanosecond timestamps)
+#define PCAP_MAGIC_USEC         0xa1b2c3d4
+#define PCAP_MAGIC_NSEC         0xa1b23c4d
+#define PCAP_HEADER_LEN         24
+#define PCAP_RECORD_LEN         16
+
+// pcapng block types and byte order magic
+#define PCAPNG_SHB              0x0a0d0d0a
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_PB               0x00000002
+#define PCAPNG_SPB              0x00000003
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
+
+// Maximum number of interfaces in a pcapng section
+#define PCAPNG_MAX_INTERFACES   256
+
+// Link types
+#define LINKTYPE_NULL           0
+#define LINKTYPE_ETHERNET       1
+#define LINKTYPE_RAW            101
+#define LINKTYPE_LOOP           108
+#define LINKTYPE_LINUX_SLL      113
+#define LINKTYPE_IPV4           228
+#define LINKTYPE_IPV6           229
+#define LINKTYPE_LINUX_SLL2     276
+
+// Ethernet types
+#define ETHERTYPE_IPV4          0x0800
+#define ETHERTYPE_IPV6          0x86dd
+#define ETHERTYPE_VLAN          0x8100
+#define ETHERTYPE_QINQ          0x88a8
+
+// IP protocols and IPv6 extension headers
+#define IPPROTO_HOPOPTS_NUM     0
+#define IPPROTO_UDP_NUM         17
+#define IPPROTO_ROUTING_NUM     43
+#define IPPROTO_DSTOPTS_NUM     60
+
+
+
+//
+// Read a 16 or 32 bit value from a file, in the file byte order
+//
+static unsigned int capture_u16(
+    const unsigned char *       p,
+    unsigned int                swap)
+{
+    uint16_t                    v;
+
+    memcpy(&v, p, sizeof(v));
+    return swap ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t capture_u32(
+    const unsigned char *       p,
+    unsigned int                swap)
+{
+    uint32_t                    v;
+
+    memcpy(&v, p, sizeof(v));
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+
+//
+// Read a 16 bit value in network byte order
+//
+static unsigned int capture_n16(
+    const unsigned char *       p)
+{
+    return ((unsigned int) p[0] << 8) | p[1];
+}
+
+
+//
+// Add an mDNS packet to a capture
+//
+static void capture_add(
+    capture_t *                 capture,
+    const socket_address_t *    src_addr,
+    socklen_t                   src_addr_len,
+    const unsigned char *       data,
+    unsigned int                bytes)
+{
+    capture_packet_t *          packet;
+    void *                      np;
+    unsigned int                count;
+
+    if (bytes == 0 || bytes > MDNS_MAX_PACKET_SIZE)
+    {
+        capture->skipped += 1;
+        return;
+    }
+
+    // Grow the array if necessary
+    if (capture->count >= capture->allocated)
+    {
+        count = capture->allocated ? capture->allocated * 2 : 1024;
+        np = realloc(capture->packets, count * sizeof(capture_packet_t));
+        if (np == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        capture->packets = np;
+        capture->allocated = count;
+    }
+
+    packet = &capture->packets[capture->count];
+    packet->data = malloc(bytes);
+    if (packet->data == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    memcpy(packet->data, data, bytes);
+    packet->bytes = bytes;
+    packet->src_addr = *src_addr;
+    packet->src_addr_len = src_addr_len;
+    capture->count += 1;
+}
+
+
+//
+// Add the mDNS payload of an IP packet to a capture
+//
+static void capture_ip(
+    capture_t *                 capture,
+    const unsigned char *       ip,
+    size_t                      length)
+{
+    socket_address_t            src_addr;
+    socklen_t                   src_addr_len;
+    const unsigned char *       udp;
+    size_t                      header_len;
+    size_t                      udp_len;
+    unsigned int                protocol;
+
+    memset(&src_addr, 0, sizeof(src_addr));
+
+    if (length >= 20 && (ip[0] >> 4) == 4)
+    {
+        // IPv4, skipping fragments
+        header_len = (size_t) (ip[0] & 0x0f) * 4;
+        if (header_len < 20 || header_len > length || ip[9] != IPPROTO_UDP_NUM ||
+            (capture_n16(ip + 6) & 0x3fff) != 0)
+        {
+            capture->skipped += 1;
+            return;
+        }
+        if (capture_n16(ip + 2) >= header_len && capture_n16(ip + 2) < length)
+        {
+            length = capture_n16(ip + 2);
+        }
+
+        src_addr.sin.sin_family = AF_INET;
+        memcpy(&src_addr.sin.sin_addr, ip + 12, 4);
+        src_addr_len = sizeof(struct sockaddr_in);
+    }
+    else if (length >= 40 && (ip[0] >> 4) == 6)
+    {
+        // IPv6, skipping the common extension headers
+        if (capture_n16(ip + 4) + 40 < length)
+        {
+            length = capture_n16(ip + 4) + 40;
+        }
+        protocol = ip[6];
+        header_len = 40;
+        while (protocol == IPPROTO_HOPOPTS_NUM || protocol == IPPROTO_ROUTING_NUM || protocol == IPPROTO_DSTOPTS_NUM)
+        {
+            if (header_len + 8 > length)
+            {
+                break;
+            }
+            protocol = ip[header_len];
+            header_len += ((size_t) ip[header_len + 1] + 1) * 8;
+        }
+        if (protocol != IPPROTO_UDP_NUM || header_len > length)
+        {
+            capture->skipped += 1;
+            return;
+        }
+
+        src_addr.sin6.sin6_family = AF_INET6;
+        memcpy(&src_addr.sin6.sin6_addr, ip + 8, 16);
+        src_addr_len = sizeof(struct sockaddr_in6);
+    }
+    else
+    {
+        capture->skipped += 1;
+        return;
+    }
+
+    // UDP to or from the mDNS port
+    udp = ip + header_len;
+    length -= header_len;
+    if (length < 8 || (capture_n16(udp) != MCAST_PORT && capture_n16(udp + 2) != MCAST_PORT))
+    {
+        capture->skipped += 1;
+        return;
+    }
+    udp_len = capture_n16(udp + 4);
+    if (udp_len < 8 || udp_len > length)
+    {
+        udp_len = length;
+    }
+
+    // NB: The port is at the same offset in both address families
+    src_addr.sin.sin_port = htons((uint16_t) capture_n16(udp));
+    capture_add(capture, &src_addr, src_addr_len, udp + 8, (unsigned int) (udp_len - 8));
+}
+
+
+//
+// Add the mDNS payload of a link layer frame to a capture
+//
+static void capture_frame(
+    capture_t *                 capture,
+    unsigned int                linktype,
+    const unsigned char *       frame,
+    size_t                      length)
+{
+    size_t                      offset;
+    unsigned int                ethertype;
+
+    switch (linktype)
+    {
+        case LINKTYPE_ETHERNET:
+            if (length < 14)
+            {
+                break;
+            }
+            offset = 14;
+            ethertype = capture_n16(frame + 12);
+            while ((ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_QINQ) && offset + 4 <= length)
+            {
+                ethertype = capture_n16(frame + offset + 2);
+                offset += 4;
+            }
+            if (ethertype == ETHERTYPE_IPV4 || ethertype == ETHERTYPE_IPV6)
+            {
+                capture_ip(capture, frame + offset, length - offset);
+                return;
+            }
+            break;
+
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+            capture_ip(capture, frame, length);
+            return;
+
+        case LINKTYPE_NULL:
+        case LINKTYPE_LOOP:
+            if (length >= 4)
+            {
+                capture_ip(capture, frame + 4, length - 4);
+                return;
+            }
+            break;
+
+        case LINKTYPE_LINUX_SLL:
+            if (length >= 16)
+            {
+                capture_ip(capture, frame + 16, length - 16);
+                return;
+            }
+            break;
+
+        case LINKTYPE_LINUX_SLL2:
+            if (length >= 20)
+            {
+                capture_ip(capture, frame + 20, length - 20);
+                return;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    capture->skipped += 1;
+}
+
+
+//
+// Add the mDNS packets of a pcap file
+//
+static void capture_pcap(
+    capture_t *                 capture,
+    const char *                filename,
+    const unsigned char *       data,
+    size_t                      length)
+{
+    unsigned int                swap;
+    unsigned int                linktype;
+    size_t                      offset;
+    size_t                      caplen;
+    uint32_t                    magic;
+
+    memcpy(&magic, data, sizeof(magic));
+    swap = magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC;
+    linktype = capture_u32(data + 20, swap) & 0xffff;
+
+    offset = PCAP_HEADER_LEN;
+    while (offset + PCAP_RECORD_LEN <= length)
+    {
+        caplen = capture_u32(data + offset + 8, swap);
+        offset += PCAP_RECORD_LEN;
+        if (caplen > length - offset)
+        {
+            fprintf(stderr, "%s: truncated record\n", filename);
+            break;
+        }
+        capture_frame(capture, linktype, data + offset, caplen);
+        offset += caplen;
+    }
+}
+
+
+//
+// Add the mDNS packets of a pcapng file
+//
+static void capture_pcapng(
+    capture_t *                 capture,
+    const char *                filename,
+    const unsigned char *       data,
+    size_t                      length)
+{
+    unsigned int                linktypes[PCAPNG_MAX_INTERFACES];
+    unsigned int                interface_count = 0;
+    unsigned int                swap = 0;
+    unsigned int                interface_id;
+    uint32_t                    type;
+    uint32_t                    magic;
+    size_t                      offset = 0;
+    size_t                      block_len;
+    size_t                      caplen;
+
+    while (offset + 12 <= length)
+    {
+        // A section header sets the byte order of the section
+        memcpy(&type, data + offset, sizeof(type));
+        if (type == PCAPNG_SHB)
+        {
+            memcpy(&magic, data + offset + 8, sizeof(magic));
+            swap = magic != PCAPNG_BYTE_ORDER_MAGIC;
+            interface_count = 0;
+        }
+        else
+        {
+            type = capture_u32(data + offset, swap);
+        }
+
+        block_len = capture_u32(data + offset + 4, swap);
+        if (block_len < 12 || (block_len & 3) || block_len > length - offset)
+        {
+            fprintf(stderr, "%s: invalid block at offset %zu\n", filename, offset);
+            break;
+        }
+
+        switch (type)
+        {
+            case PCAPNG_IDB:
+                if (interface_count < PCAPNG_MAX_INTERFACES && block_len >= 20)
+                {
+                    linktypes[interface_count++] = capture_u16(data + offset + 8, swap);
+                }
+                break;
+
+            case PCAPNG_EPB:
+            case PCAPNG_PB:
+                if (block_len < 32)
+                {
+                    break;
+                }
+                interface_id = type == PCAPNG_EPB ? capture_u32(data + offset + 8, swap) : capture_u16(data + offset + 8, swap);
+                caplen = capture_u32(data + offset + 20, swap);
+                if (interface_id < interface_count && caplen <= block_len - 32)
+                {
+                    capture_frame(capture, linktypes[interface_id], data + offset + 28, caplen);
+                }
+                break;
+
+            case PCAPNG_SPB:
+                if (block_len < 16 || interface_count == 0)
+                {
+                    break;
+                }
+                caplen = capture_u32(data + offset + 8, swap);
+                if (caplen > block_len - 16)
+                {
+                    caplen = block_len - 16;
+                }
+                capture_frame(capture, linktypes[0], data + offset + 12, caplen);
+                break;
+
+            default:
+                break;
+        }
+
+        offset += block_len;
+    }
+}
+
+
+//
+// Add the mDNS packets of a pcap or pcapng file to a capture
+//
+void capture_load(
+    capture_t *                 capture,
+    const char *                filename)
+{
+    FILE *                      fp;
+    unsigned char *             data;
+    long                        size;
+    uint32_t                    magic;
+
+    // Read the file
+    fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        fatal("Cannot open %s: %s\n", filename, strerror(errno));
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fatal("Cannot read %s: %s\n", filename, strerror(errno));
+    }
+    data = malloc((size_t) size + 1);
+    if (data == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    if (fread(data, 1, (size_t) size, fp) != (size_t) size)
+    {
+        fatal("Cannot read %s: %s\n", filename, strerror(errno));
+    }
+    fclose(fp);
+
+    // Identify the format
+    if (size < PCAP_HEADER_LEN)
+    {
+        fatal("%s: not a pcap or pcapng file\n", filename);
+    }
+    memcpy(&magic, data, sizeof(magic));
+    if (magic == PCAPNG_SHB)
+    {
+        capture_pcapng(capture, filename, data, (size_t) size);
+    }
+    else if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC ||
+             magic == __builtin_bswap32(PCAP_MAGIC_USEC) || magic == __builtin_bswap32(PCAP_MAGIC_NSEC))
+    {
+        capture_pcap(capture, filename, data, (size_t) size);
+    }
+    else
+    {
+        fatal("%s: not a pcap or pcapng file\n", filename);
+    }
+
+    free(data);
+}
+
+
+//
+// Copy a captured packet to a packet buffer
+//
+void capture_copy(
+    const capture_packet_t *    captured,
+    packet_t *                  packet)
+{
+    packet->src_addr = captured->src_addr;
+    packet->src_addr_len = captured->src_addr_len;
+    packet->bytes = captured->bytes;
+    memcpy(packet->buffer, captured->data, captured->bytes);
+}
@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H 1
+
+//
+// Reading of mDNS packets from pcap and pcapng capture files, for tools
+//
+// NB: Requires common.h
+//
+
+// Captured mDNS packet
+typedef struct
+{
+    socket_address_t            src_addr;
+    socklen_t                   src_addr_len;
+    unsigned int                bytes;
+    unsigned char *             data;
+} capture_packet_t;
+
+// Captured mDNS packets
+typedef struct
+{
+    capture_packet_t *          packets;
+    unsigned int                count;
+    unsigned int                allocated;
+
+    // Frames that are not IPv4 or IPv6 UDP to or from the mDNS port
+    unsigned long long          skipped;
+} capture_t;
+
+// Add the mDNS packets of a pcap or pcapng file to a capture
+extern void capture_load(
+    capture_t *                 capture,
+    const char *                filename);
+
+// Copy a captured packet to a packet buffer
+extern void capture_copy(
+    const capture_packet_t *    captured,
+    packet_t *                  packet);
+
+
+#endif // _CAPTURE_H
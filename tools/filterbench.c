@@ -0,0 +1,371 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+//
+// Filter matching microbenchmark
+//
+// Measures the cost of filter list evaluation (filter_list_allowed(), by
+// way of allowed_outbound()) against the size of the filter list. For each
+// list size, allow and deny lists of synthetic service names are built with
+// dns_save_match_name(), and a corpus of synthetic names, some of which are
+// matched by a name in the list, is evaluated against them. Results are
+// written to stdout as CSV, one line per list size and verdict, with the
+// fastest time of several trials.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "../common.h"
+
+
+// Default list sizes
+static const unsigned int       default_sizes[] = { 1, 10, 100, 1000, 10000 };
+#define NUM_DEFAULT_SIZES       (sizeof(default_sizes) / sizeof(default_sizes[0]))
+#define MAX_SIZES               32
+
+// Who we are
+static const char *             progname;
+
+// Config file (unused, required by config.c)
+const char *                    config_filename = NULL;
+
+// Command line options
+static unsigned int             sizes[MAX_SIZES];
+static unsigned int             size_count = 0;
+static unsigned int             name_count = 1000;
+static unsigned int             match_percent = 10;
+static unsigned int             trials = 3;
+static unsigned int             target_msec = 100;
+
+
+
+//
+// Report a fatal error
+//
+__attribute__ ((noreturn, format (printf, 1, 2)))
+void fatal(
+    const char *                format,
+    ...)
+{
+    va_list                     args;
+
+    logger_flush();
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
+
+
+//
+// Parse command line arguments
+//
+static void parse_args(
+    int                         argc,
+    char * const                argv[])
+{
+    char *                      token;
+    int                         opt;
+
+    progname = argv[0];
+
+    while((opt = getopt(argc, argv, "hs:n:m:r:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            for (token = strtok(optarg, ","); token && size_count < MAX_SIZES; token = strtok(NULL, ","))
+            {
+                sizes[size_count] = (unsigned int) strtoul(token, NULL, 10);
+                if (sizes[size_count] == 0)
+                {
+                    fatal("invalid list size: %s\n", token);
+                }
+                size_count++;
+            }
+            break;
+        case 'n':
+            name_count = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            match_percent = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            trials = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            target_msec = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage:\n");
+            fprintf(stderr, "  %s [-h] [-s sizes] [-n names] [-m percent] [-r trials] [-t msec]\n", progname);
+            fprintf(stderr, "  options:\n");
+            fprintf(stderr, "    -h display usage\n");
+            fprintf(stderr, "    -s comma separated filter list sizes (default 1,10,100,1000,10000)\n");
+            fprintf(stderr, "    -n number of names in the corpus (default 1000)\n");
+            fprintf(stderr, "    -m percentage of names matched by the list (default 10)\n");
+            fprintf(stderr, "    -r number of trials (default 3)\n");
+            fprintf(stderr, "    -t minimum time of each trial in milliseconds (default 100)\n");
+            exit(1);
+        }
+    }
+
+    if (name_count == 0 || match_percent > 100 || trials == 0 || target_msec == 0)
+    {
+        fatal("invalid options\n");
+    }
+    if (size_count == 0)
+    {
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+        size_count = NUM_DEFAULT_SIZES;
+    }
+}
+
+
+//
+// Convert a string to a DNS name, as decoded from a packet
+//
+static void string_to_name(
+    const char *                string,
+    dns_name_t *                name)
+{
+    unsigned int                offset = 0;
+    unsigned int                count = 0;
+    unsigned int                len;
+
+    while (*string)
+    {
+        len = (unsigned int) strcspn(string, ".");
+        name->offset[count++] = (uint8_t) offset;
+        name->labels[offset++] = (unsigned char) len;
+        memcpy(name->labels + offset, string, len);
+        offset += len;
+        string += len;
+        if (*string == '.')
+        {
+            string++;
+        }
+    }
+
+    name->offset[count++] = (uint8_t) offset;
+    name->labels[offset++] = 0;
+    name->length = (uint16_t) offset;
+    name->count = (uint8_t) count;
+}
+
+
+//
+// Get the filter name at a position in a list
+//
+static void filter_name(
+    unsigned int                position,
+    char *                      string,
+    size_t                      size)
+{
+    (void) snprintf(string, size, "_svc-%05u", position);
+}
+
+
+//
+// Create a filter list of a given size
+//
+//   The list is created as by the configuration. The names sort in order of
+//   position, so the position of a match is known.
+//
+static filter_list_t * filter_list_build(
+    filter_allow_deny_t         allow_deny,
+    unsigned int                count)
+{
+    filter_list_t *             filter_list;
+    char **                     list;
+    unsigned int                index;
+
+    list = calloc(count, sizeof(char *));
+    if (list == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    for (index = 0; index < count; index++)
+    {
+        list[index] = malloc(DNS_MAX_NAME_LEN);
+        if (list[index] == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+        filter_name(index, list[index], DNS_MAX_NAME_LEN);
+    }
+
+    filter_list = filter_list_create(allow_deny, list, count);
+
+    for (index = 0; index < count; index++)
+    {
+        free(list[index]);
+    }
+    free(list);
+    return filter_list;
+}
+
+
+//
+// Build the name corpus for a list size
+//
+//   Names are service instance names. The matched names use a service type
+//   at a uniformly distributed position in the list, and the others use
+//   service types that are not in the list.
+//
+static void corpus_build(
+    dns_name_t *                names,
+    unsigned int                size)
+{
+    char                        service[64];
+    char                        string[DNS_MAX_NAME_LEN];
+    uint64_t                    state = 0x853C49E6748FEA9BULL;
+    unsigned int                index;
+
+    for (index = 0; index < name_count; index++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        if ((unsigned int) (state % 100) < match_percent)
+        {
+            filter_name((unsigned int) ((state >> 8) % size), service, sizeof(service));
+        }
+        else
+        {
+            (void) snprintf(service, sizeof(service), "_other-%05u", (unsigned int) ((state >> 8) % 100000));
+        }
+        (void) snprintf(string, sizeof(string), "Device %u.%s._tcp.local", index, service);
+        string_to_name(string, &names[index]);
+    }
+}
+
+
+//
+// Run one trial of a filter list against the corpus
+//
+//   Returns the time per name in nanoseconds, and the number of names
+//   allowed in a pass.
+//
+static double bench_trial(
+    const filter_list_t *       filter_list,
+    const dns_name_t *          names,
+    unsigned int *              allowed)
+{
+    uint64_t                    start;
+    uint64_t                    elapsed;
+    uint64_t                    passes = 0;
+    uint64_t                    target = (uint64_t) target_msec * 1000000;
+    unsigned int                count;
+    unsigned int                index;
+
+    start = stats_latency_clock();
+    do
+    {
+        count = 0;
+        for (index = 0; index < name_count; index++)
+        {
+            count += allowed_outbound(filter_list, IPV4, &names[index]);
+        }
+        passes += 1;
+        elapsed = stats_latency_clock() - start;
+    }
+    while (elapsed < target);
+
+    *allowed = count;
+    return (double) elapsed / (double) (passes * name_count);
+}
+
+
+//
+// Main
+//
+int main(
+    int                         argc,
+    char                        *argv[])
+{
+    static const char *         verdict_names[] = { "allow", "deny" };
+    filter_list_t *             filter_list;
+    dns_name_t *                names;
+    filter_allow_deny_t         allow_deny;
+    unsigned int                size_index;
+    unsigned int                trial;
+    unsigned int                allowed = 0;
+    double                      ns;
+    double                      best;
+
+    parse_args(argc, argv);
+    logger_initialize(0);
+
+    names = calloc(name_count, sizeof(dns_name_t));
+    if (names == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+
+    printf("list_size,verdict,names,match_percent,allowed_percent,ns_per_name\n");
+    for (size_index = 0; size_index < size_count; size_index++)
+    {
+        corpus_build(names, sizes[size_index]);
+
+        for (allow_deny = ALLOW; allow_deny <= DENY; allow_deny++)
+        {
+            filter_list = filter_list_build(allow_deny, sizes[size_index]);
+
+            best = 0.0;
+            for (trial = 0; trial < trials; trial++)
+            {
+                ns = bench_trial(filter_list, names, &allowed);
+                if (trial == 0 || ns < best)
+                {
+                    best = ns;
+                }
+            }
+
+            printf("%u,%s,%u,%u,%.2f,%.2f\n", sizes[size_index], verdict_names[allow_deny], name_count,
+                   match_percent, 100.0 * allowed / name_count, best);
+            fflush(stdout);
+
+            filter_list_destroy(filter_list);
+        }
+    }
+
+    free(names);
+    return 0;
+}
@@ -0,0 +1,392 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+//
+// Fuzzing harness for the decoder and encoder
+//
+// Each input is the payload of an mDNS packet. The packet is decoded with
+// global and inbound filter lists, and encoded with an outbound filter
+// list, chosen from a fixed set by a hash of the input. The harness aborts
+// if the encoder reports a length that is out of bounds, if filtering an
+// encoding makes it larger than the unfiltered encoding, if an encoded
+// packet cannot be decoded, or if decoding and encoding an encoded packet
+// does not reproduce it exactly.
+//
+// Built with FUZZ_LIBFUZZER defined (see "make fuzz"), the harness is a
+// libFuzzer target. Otherwise, it reads each input from a file named on
+// the command line, or from stdin, which is suitable for AFL and for
+// checking a corpus.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "../common.h"
+
+
+// Names used in the filter lists
+static const char *             fuzz_filter_names[] =
+{
+    "local", "_tcp", "_udp", "_ipp", "_airplay._tcp", "_googlecast._tcp.local",
+    "printer", "a", "_services._dns-sd._udp.local", "host"
+};
+#define NUM_FUZZ_FILTER_NAMES   (sizeof(fuzz_filter_names) / sizeof(fuzz_filter_names[0]))
+
+// Sets of filter names, by bit in fuzz_filter_names
+static const unsigned int       fuzz_filter_sets[] =
+{
+    0x001, 0x002, 0x00c, 0x010, 0x030, 0x041, 0x180, 0x3ff
+};
+#define NUM_FUZZ_FILTER_SETS    (sizeof(fuzz_filter_sets) / sizeof(fuzz_filter_sets[0]))
+
+// Configurations: one for each filter set as an allow and a deny list, and
+// one without filters
+#define NUM_FUZZ_CONFIGS        (NUM_FUZZ_FILTER_SETS * 2 + 1)
+static config_t *               fuzz_configs[NUM_FUZZ_CONFIGS];
+
+// Receiving interface
+static interface_t              fuzz_interface = { .name = "fuzz0" };
+
+// DNS states for the input and for the check of encoded packets
+static dns_state_t              fuzz_state;
+static dns_state_t              check_state;
+
+// Packets
+static packet_t                 recv_packet;
+static packet_t                 send_packet;
+static packet_t                 full_packet;
+static packet_t                 check_packet;
+
+// Config file (unused, required by config.c)
+const char *                    config_filename = NULL;
+
+
+
+//
+// Report a fatal error
+//
+__attribute__ ((noreturn, format (printf, 1, 2)))
+void fatal(
+    const char *                format,
+    ...)
+{
+    va_list                     args;
+
+    logger_flush();
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    abort();
+}
+
+
+//
+// Report a failed check
+//
+#define FUZZ_CHECK(condition)                                                       \
+    do                                                                              \
+    {                                                                               \
+        if (!(condition))                                                           \
+        {                                                                           \
+            fatal("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);     \
+        }                                                                           \
+    } while (0)
+
+
+//
+// Create a configuration with a global filter list and, for some, an
+// inbound filter list
+//
+static config_t * fuzz_config_create(
+    unsigned int                number)
+{
+    config_t *                  config;
+    interface_t *               interface = &fuzz_interface;
+    char *                      list[NUM_FUZZ_FILTER_NAMES];
+    unsigned int                set;
+    unsigned int                count;
+    unsigned int                index;
+
+    config = config_create();
+    config->interface_config = calloc(1, sizeof(interface_config_t));
+    if (config->interface_config == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    if (number == NUM_FUZZ_CONFIGS - 1)
+    {
+        return config;
+    }
+
+    // Global filter list
+    set = fuzz_filter_sets[number / 2];
+    for (count = 0, index = 0; index < NUM_FUZZ_FILTER_NAMES; index++)
+    {
+        if (set & (1u << index))
+        {
+            list[count++] = (char *) fuzz_filter_names[index];
+        }
+    }
+    (void) set_global_filter_list(config, number & 1 ? DENY : ALLOW, list, count);
+
+    // Inbound filter list for every third configuration
+    if (number % 3 == 0)
+    {
+        set = fuzz_filter_sets[(number * 5 + 3) % NUM_FUZZ_FILTER_SETS];
+        for (count = 0, index = 0; index < NUM_FUZZ_FILTER_NAMES; index++)
+        {
+            if (set & (1u << index))
+            {
+                list[count++] = (char *) fuzz_filter_names[index];
+            }
+        }
+        (void) set_interface_inbound_filter_list(config, &interface, 1, DENY, list, count);
+    }
+
+    return config;
+}
+
+
+//
+// Initialize the harness
+//
+static void fuzz_initialize(void)
+{
+    unsigned int                index;
+
+    configured_interface_count = 1;
+    logger_initialize(0);
+    logger_start();
+    stats_initialize();
+    topk_initialize();
+    inventory_initialize(INVENTORY_DEFAULT_SIZE);
+
+    for (index = 0; index < NUM_FUZZ_CONFIGS; index++)
+    {
+        fuzz_configs[index] = fuzz_config_create(index);
+    }
+
+    fuzz_state = dns_state_create(IPV4);
+    check_state = dns_state_create(IPV4);
+
+    recv_packet.src_addr.sin.sin_family = AF_INET;
+    recv_packet.src_addr_len = sizeof(struct sockaddr_in);
+    check_packet.src_addr = recv_packet.src_addr;
+    check_packet.src_addr_len = recv_packet.src_addr_len;
+}
+
+
+//
+// Hash an input (FNV-1a)
+//
+static uint32_t fuzz_hash(
+    const uint8_t *             data,
+    size_t                      size)
+{
+    uint32_t                    hash = 2166136261u;
+
+    while (size--)
+    {
+        hash = (hash ^ *data++) * 16777619u;
+    }
+    return hash;
+}
+
+
+//
+// Check an encoded packet
+//
+//   The encoded packet must decode without filtering, and encoding it again
+//   must reproduce it exactly.
+//
+static void fuzz_check_encoded(
+    const packet_t *            encoded)
+{
+    const config_t *            config = fuzz_configs[NUM_FUZZ_CONFIGS - 1];
+    unsigned int                r;
+
+    memcpy(check_packet.buffer, encoded->buffer, encoded->bytes);
+    check_packet.bytes = encoded->bytes;
+
+    r = dns_decode_packet(check_state, &check_packet, config, &fuzz_interface);
+    FUZZ_CHECK(r == encoded->bytes);
+
+    r = dns_encode_packet(check_state, &check_packet, &send_packet, NULL);
+    FUZZ_CHECK(r == encoded->bytes);
+    FUZZ_CHECK(memcmp(send_packet.buffer, encoded->buffer, r) == 0);
+}
+
+
+//
+// Run one input
+//
+static void fuzz_one(
+    const uint8_t *             data,
+    size_t                      size)
+{
+    const config_t *            config;
+    const filter_list_t *       outbound;
+    uint32_t                    hash;
+    unsigned int                r;
+    unsigned int                full;
+
+    if (size > MDNS_MAX_PACKET_SIZE)
+    {
+        return;
+    }
+    memcpy(recv_packet.buffer, data, size);
+    recv_packet.bytes = (unsigned int) size;
+
+    // Choose the filters
+    hash = fuzz_hash(data, size);
+    config = fuzz_configs[hash % NUM_FUZZ_CONFIGS];
+    outbound = fuzz_configs[(hash >> 8) % NUM_FUZZ_CONFIGS]->global_filter_list;
+
+    // Decode with inbound filtering
+    r = dns_decode_packet(fuzz_state, &recv_packet, config, &fuzz_interface);
+    if (r == 0)
+    {
+        return;
+    }
+    FUZZ_CHECK(r == size);
+
+    // Encode without outbound filtering
+    full = dns_encode_packet(fuzz_state, &recv_packet, &full_packet, NULL);
+    if (full)
+    {
+        FUZZ_CHECK(full == full_packet.bytes);
+        FUZZ_CHECK(full >= sizeof(uint16_t) * 6 && full <= MDNS_MAX_PACKET_SIZE);
+        fuzz_check_encoded(&full_packet);
+    }
+
+    // Encode with outbound filtering
+    // NB: Filtering never makes the encoding larger
+    r = dns_encode_packet(fuzz_state, &recv_packet, &send_packet, outbound);
+    if (r)
+    {
+        FUZZ_CHECK(full != 0 && r <= full);
+        FUZZ_CHECK(r == send_packet.bytes);
+        memcpy(full_packet.buffer, send_packet.buffer, r);
+        full_packet.bytes = r;
+        fuzz_check_encoded(&full_packet);
+    }
+}
+
+
+#if defined(FUZZ_LIBFUZZER)
+
+//
+// libFuzzer entry points
+//
+int LLVMFuzzerInitialize(
+    int *                       argc,
+    char ***                    argv)
+{
+    (void) argc;
+    (void) argv;
+
+    fuzz_initialize();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(
+    const uint8_t *             data,
+    size_t                      size)
+{
+    fuzz_one(data, size);
+    return 0;
+}
+
+#else
+
+//
+// Read an input from a file
+//
+static size_t fuzz_read(
+    FILE *                      fp,
+    uint8_t *                   data,
+    size_t                      size)
+{
+    size_t                      len;
+
+    len = fread(data, 1, size, fp);
+    if (ferror(fp))
+    {
+        fatal("read error: %s\n", strerror(errno));
+    }
+    return len;
+}
+
+
+//
+// Main
+//
+int main(
+    int                         argc,
+    char                        *argv[])
+{
+    static uint8_t              data[MDNS_MAX_PACKET_SIZE + 1];
+    FILE *                      fp;
+    size_t                      size;
+    int                         index;
+
+    fuzz_initialize();
+
+    if (argc < 2)
+    {
+        size = fuzz_read(stdin, data, sizeof(data));
+        fuzz_one(data, size);
+        return 0;
+    }
+
+    for (index = 1; index < argc; index++)
+    {
+        fp = fopen(argv[index], "rb");
+        if (fp == NULL)
+        {
+            fatal("Cannot open %s: %s\n", argv[index], strerror(errno));
+        }
+        size = fuzz_read(fp, data, sizeof(data));
+        fclose(fp);
+        fuzz_one(data, size);
+    }
+
+    logger_flush();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,989 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+//
+// Synthetic mDNS workload generator
+//
+// Writes a corpus of synthetic mDNS packets as a pcap file (raw IP, UDP
+// port 5353), for use by the replay benchmark (tools/mdns-bench) and the
+// network namespace test rig (tools/mdns-loadgen -f). Packets are queries
+// or responses with a configurable number of questions and resource
+// records. The service types and instances are drawn from Zipf
+// distributions, so that a few services dominate as on production
+// networks, and names are compressed as by common responders. The packets
+// can also be written one per file, without headers, as a seed corpus for
+// the fuzzing harness (tools/mdns-fuzz).
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+#include <strings.h>
+#include <arpa/inet.h>
+
+#include "../common.h"
+#include "../dns.h"
+
+
+// mDNS port
+#define MCAST_PORT              5353
+
+// pcap file parameters
+#define PCAP_MAGIC_USEC         0xa1b2c3d4
+#define PCAP_VERSION_MAJOR      2
+#define PCAP_VERSION_MINOR      4
+#define LINKTYPE_RAW            101
+
+// IP and UDP header sizes
+#define IPV4_HEADER_LEN         20
+#define IPV6_HEADER_LEN         40
+#define UDP_HEADER_LEN          8
+
+// Maximum size of generated DNS payloads
+// NB: Records that would exceed this size are not added
+#define GENERATE_MAX_PAYLOAD    1400
+
+// Maximum number of names remembered for compression in a packet
+#define MAX_COMPRESSION_NAMES   256
+
+// Common service types, in approximate order of popularity
+static const char *             common_service_types[] =
+{
+    "_airplay._tcp", "_raop._tcp", "_googlecast._tcp", "_companion-link._tcp",
+    "_ipp._tcp", "_printer._tcp", "_pdl-datastream._tcp", "_ipps._tcp",
+    "_hap._tcp", "_homekit._tcp", "_spotify-connect._tcp", "_sleep-proxy._udp",
+    "_device-info._tcp", "_smb._tcp", "_afpovertcp._tcp", "_http._tcp",
+    "_scanner._tcp", "_uscan._tcp", "_ssh._tcp", "_sftp-ssh._tcp",
+    "_rdlink._tcp", "_touch-able._tcp", "_mediaremotetv._tcp", "_amzn-wplay._tcp"
+};
+#define NUM_COMMON_SERVICE_TYPES (sizeof(common_service_types) / sizeof(common_service_types[0]))
+
+// Words used to build instance names
+static const char *             instance_places[] =
+{
+    "Living Room", "Kitchen", "Office", "Bedroom", "Lobby", "Conference Room",
+    "Lab", "Studio", "Library", "Reception", "Classroom", "Warehouse"
+};
+static const char *             instance_devices[] =
+{
+    "TV", "Speaker", "Printer", "Apple TV", "HomePod", "Chromecast",
+    "Display", "Scanner", "NAS", "Camera", "Hub", "Laptop"
+};
+#define NUM_INSTANCE_PLACES     (sizeof(instance_places) / sizeof(instance_places[0]))
+#define NUM_INSTANCE_DEVICES    (sizeof(instance_devices) / sizeof(instance_devices[0]))
+
+// Zipf distribution
+typedef struct
+{
+    double *                    cdf;
+    unsigned int                count;
+} zipf_t;
+
+// Compression table of a packet
+// NB: Each entry is a name (or name suffix) in the string pool, and its
+//     offset in the packet
+typedef struct
+{
+    unsigned int                offset[MAX_COMPRESSION_NAMES];
+    unsigned int                name[MAX_COMPRESSION_NAMES];
+    unsigned int                count;
+    char                        pool[8192];
+    unsigned int                pool_used;
+} compression_t;
+
+// Packet under construction
+typedef struct
+{
+    unsigned char               buffer[MDNS_MAX_PACKET_SIZE];
+    unsigned int                bytes;
+    compression_t               compression;
+} generate_packet_t;
+
+// Who we are
+static const char *             progname;
+
+// Command line options
+static const char *             output_filename = NULL;
+static const char *             corpus_dirname = NULL;
+static unsigned int             packet_count = 10000;
+static unsigned int             max_questions = 4;
+static unsigned int             max_answers = 6;
+static unsigned int             max_additional = 4;
+static unsigned int             query_percent = 50;
+static unsigned int             service_type_count = 32;
+static unsigned int             instance_count = 1000;
+static double                   zipf_exponent = 1.0;
+static unsigned int             flag_ipv6 = 0;
+static unsigned long            seed = 1;
+
+// Zipf distributions of the service types and instances
+static zipf_t                   service_zipf;
+static zipf_t                   instance_zipf;
+
+// Random number state (xorshift64*)
+static uint64_t                 random_state;
+
+
+
+//
+// Report a fatal error
+//
+__attribute__ ((noreturn, format (printf, 1, 2)))
+void fatal(
+    const char *                format,
+    ...)
+{
+    va_list                     args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
+
+
+//
+// Parse command line arguments
+//
+static void parse_args(
+    int                         argc,
+    char * const                argv[])
+{
+    int                         opt;
+
+    progname = argv[0];
+
+    while((opt = getopt(argc, argv, "h6o:w:n:q:a:x:p:s:i:z:S:")) != -1)
+    {
+        switch (opt)
+        {
+        case '6':
+            flag_ipv6 = 1;
+            break;
+        case 'o':
+            output_filename = optarg;
+            break;
+        case 'w':
+            corpus_dirname = optarg;
+            break;
+        case 'n':
+            packet_count = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            max_questions = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'a':
+            max_answers = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'x':
+            max_additional = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            query_percent = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            service_type_count = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            instance_count = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'z':
+            zipf_exponent = strtod(optarg, NULL);
+            break;
+        case 'S':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            output_filename = NULL;
+            corpus_dirname = NULL;
+            optind = argc;
+            break;
+        }
+    }
+
+    if ((output_filename == NULL && corpus_dirname == NULL) || packet_count == 0 || max_questions == 0 || max_answers == 0 ||
+        query_percent > 100 || service_type_count == 0 || instance_count == 0 || zipf_exponent < 0.0)
+    {
+        fprintf(stderr, "Usage:\n");
+        fprintf(stderr, "  %s [-h] [-6] {-o file | -w directory} [-n packets] [-q questions] [-a answers] [-x additional]\n", progname);
+        fprintf(stderr, "      [-p percent] [-s service_types] [-i instances] [-z exponent] [-S seed]\n");
+        fprintf(stderr, "  options:\n");
+        fprintf(stderr, "    -h display usage\n");
+        fprintf(stderr, "    -6 write IPv6 packets (default is IPv4)\n");
+        fprintf(stderr, "    -o output pcap file name\n");
+        fprintf(stderr, "    -w output directory for the packets as a fuzzing seed corpus\n");
+        fprintf(stderr, "    -n number of packets (default 10000)\n");
+        fprintf(stderr, "    -q maximum questions in a query (default 4)\n");
+        fprintf(stderr, "    -a maximum answer records in a response (default 6)\n");
+        fprintf(stderr, "    -x maximum additional records in a response (default 4)\n");
+        fprintf(stderr, "    -p percentage of packets that are queries (default 50)\n");
+        fprintf(stderr, "    -s number of service types (default 32)\n");
+        fprintf(stderr, "    -i number of service instances (default 1000)\n");
+        fprintf(stderr, "    -z Zipf exponent of the service type and instance distributions (default 1.0)\n");
+        fprintf(stderr, "    -S random seed (default 1)\n");
+        exit(1);
+    }
+}
+
+
+//
+// Get a random number
+//
+static uint64_t random_next(void)
+{
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+
+//
+// Get a random number in the range [0, limit)
+//
+static unsigned int random_below(
+    unsigned int                limit)
+{
+    return (unsigned int) (random_next() % limit);
+}
+
+
+//
+// Get a random number in the range [0, 1)
+//
+static double random_double(void)
+{
+    return (double) (random_next() >> 11) / (double) (1ULL << 53);
+}
+
+
+//
+// Initialize a Zipf distribution of count ranks
+//
+static void zipf_initialize(
+    zipf_t *                    zipf,
+    unsigned int                count)
+{
+    double                      sum = 0.0;
+    unsigned int                rank;
+
+    zipf->cdf = malloc(count * sizeof(double));
+    if (zipf->cdf == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+    zipf->count = count;
+
+    for (rank = 0; rank < count; rank++)
+    {
+        sum += 1.0 / pow((double) (rank + 1), zipf_exponent);
+        zipf->cdf[rank] = sum;
+    }
+    for (rank = 0; rank < count; rank++)
+    {
+        zipf->cdf[rank] /= sum;
+    }
+}
+
+
+//
+// Draw a rank from a Zipf distribution
+//
+static unsigned int zipf_draw(
+    const zipf_t *              zipf)
+{
+    double                      r = random_double();
+    unsigned int                low = 0;
+    unsigned int                high = zipf->count - 1;
+    unsigned int                mid;
+
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (zipf->cdf[mid] < r)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+//
+// Get the name of a service type
+//
+static void service_type_name(
+    unsigned int                service,
+    char *                      name,
+    size_t                      size)
+{
+    if (service < NUM_COMMON_SERVICE_TYPES)
+    {
+        (void) snprintf(name, size, "%s.local", common_service_types[service]);
+    }
+    else
+    {
+        (void) snprintf(name, size, "_svc%u._tcp.local", service);
+    }
+}
+
+
+//
+// Get the service type, and the instance and host names of an instance
+//
+//   Instances are spread over the service types by the service type
+//   distribution, so popular service types have more instances.
+//
+static unsigned int instance_names(
+    unsigned int                instance,
+    char *                      instance_label,
+    size_t                      instance_size,
+    char *                      host,
+    size_t                      host_size)
+{
+    uint64_t                    saved_state = random_state;
+    unsigned int                service;
+
+    // Derive the service type of the instance from the instance number
+    random_state = 0x9E3779B97F4A7C15ULL * (instance + 1) ^ seed;
+    (void) random_next();
+    service = zipf_draw(&service_zipf);
+    random_state = saved_state;
+
+    (void) snprintf(instance_label, instance_size, "%s %s %u",
+                    instance_places[instance % NUM_INSTANCE_PLACES],
+                    instance_devices[(instance / NUM_INSTANCE_PLACES) % NUM_INSTANCE_DEVICES],
+                    (unsigned int) (instance / (NUM_INSTANCE_PLACES * NUM_INSTANCE_DEVICES) + 1));
+    (void) snprintf(host, host_size, "host-%04x.local", instance / 2);
+
+    return service;
+}
+
+
+//
+// Append a name to a packet, compressing it against previous names
+//
+//   The name is a dot separated string of labels. Returns the offset of the
+//   name in the packet.
+//
+static unsigned int put_name(
+    generate_packet_t *         packet,
+    const char *                name)
+{
+    compression_t *             compression = &packet->compression;
+    const char *                suffix = name;
+    const char *                dot;
+    unsigned int                index;
+    unsigned int                len;
+    unsigned int                start = packet->bytes;
+    uint16_t                    pointer;
+
+    while (*suffix)
+    {
+        // Use a pointer if the suffix has already been written
+        for (index = 0; index < compression->count; index++)
+        {
+            if (strcasecmp(compression->pool + compression->name[index], suffix) == 0)
+            {
+                pointer = OFFSET_TO_POINTER(compression->offset[index]);
+                memcpy(packet->buffer + packet->bytes, &pointer, sizeof(pointer));
+                packet->bytes += sizeof(pointer);
+                return start;
+            }
+        }
+
+        // Remember the suffix
+        // NB: Pointers are limited to 14 bits of offset
+        len = (unsigned int) strlen(suffix) + 1;
+        if (compression->count < MAX_COMPRESSION_NAMES && compression->pool_used + len <= sizeof(compression->pool) &&
+            packet->bytes < 0x3FFF)
+        {
+            memcpy(compression->pool + compression->pool_used, suffix, len);
+            compression->name[compression->count] = compression->pool_used;
+            compression->offset[compression->count] = packet->bytes;
+            compression->pool_used += len;
+            compression->count++;
+        }
+
+        dot = strchr(suffix, '.');
+        len = dot ? (unsigned int) (dot - suffix) : (unsigned int) strlen(suffix);
+        packet->buffer[packet->bytes++] = (unsigned char) len;
+        memcpy(packet->buffer + packet->bytes, suffix, len);
+        packet->bytes += len;
+        suffix += dot ? len + 1 : len;
+    }
+
+    packet->buffer[packet->bytes++] = 0;
+    return start;
+}
+
+
+//
+// Append a question to a packet
+//
+static void put_question(
+    generate_packet_t *         packet,
+    const char *                name,
+    unsigned int                type,
+    unsigned int                unicast)
+{
+    dns_query_header_t          query;
+
+    (void) put_name(packet, name);
+    query.type = htons((uint16_t) type);
+    query.class = htons(unicast ? 0x8001 : 0x0001);
+    memcpy(packet->buffer + packet->bytes, &query, sizeof(query));
+    packet->bytes += sizeof(query);
+}
+
+
+//
+// Append the header of a resource record to a packet
+//
+//   Returns the offset of the header. The rdata length is set by
+//   end_rr().
+//
+static unsigned int begin_rr(
+    generate_packet_t *         packet,
+    const char *                name,
+    unsigned int                type,
+    unsigned int                cache_flush,
+    unsigned int                ttl)
+{
+    dns_rr_header_t             rr;
+    unsigned int                offset;
+
+    (void) put_name(packet, name);
+    offset = packet->bytes;
+    rr.type = htons((uint16_t) type);
+    rr.class = htons(cache_flush ? 0x8001 : 0x0001);
+    rr.ttl = htonl(ttl);
+    rr.rdata_len = 0;
+    memcpy(packet->buffer + packet->bytes, &rr, sizeof(rr));
+    packet->bytes += sizeof(rr);
+    return offset;
+}
+
+static void end_rr(
+    generate_packet_t *         packet,
+    unsigned int                offset)
+{
+    dns_rr_header_t             rr;
+
+    memcpy(&rr, packet->buffer + offset, sizeof(rr));
+    rr.rdata_len = htons((uint16_t) (packet->bytes - offset - sizeof(rr)));
+    memcpy(packet->buffer + offset, &rr, sizeof(rr));
+}
+
+
+//
+// Append a record of a service instance to a packet
+//
+//   The records of an instance are, in order, the PTR of its service type,
+//   its SRV and TXT, and the A and AAAA of its host.
+//
+#define NUM_INSTANCE_RECORDS    5
+
+static void put_instance_rr(
+    generate_packet_t *         packet,
+    unsigned int                instance,
+    unsigned int                record)
+{
+    dns_rr_srv_data_t           srv;
+    char                        label[64];
+    char                        service[64];
+    char                        name[160];
+    char                        host[32];
+    char                        txt[64];
+    char *                      string;
+    unsigned int                offset;
+    unsigned int                len;
+    uint32_t                    ipv4;
+
+    service_type_name(instance_names(instance, label, sizeof(label), host, sizeof(host)), service, sizeof(service));
+    (void) snprintf(name, sizeof(name), "%s.%s", label, service);
+
+    switch (record)
+    {
+        case 0:
+            offset = begin_rr(packet, service, DNS_TYPE_PTR, 0, 4500);
+            (void) put_name(packet, name);
+            break;
+
+        case 1:
+            offset = begin_rr(packet, name, DNS_TYPE_SRV, 1, 120);
+            srv.priority = 0;
+            srv.weight = 0;
+            srv.port = htons((uint16_t) (1024 + instance % 50000));
+            memcpy(packet->buffer + packet->bytes, &srv, sizeof(srv));
+            packet->bytes += sizeof(srv);
+            (void) put_name(packet, host);
+            break;
+
+        case 2:
+            offset = begin_rr(packet, name, DNS_TYPE_TXT, 1, 4500);
+            (void) snprintf(txt, sizeof(txt), "txtvers=1|model=%s|id=%08x|features=0x%x",
+                            instance_devices[(instance / NUM_INSTANCE_PLACES) % NUM_INSTANCE_DEVICES],
+                            instance * 2654435761u, instance % 4096);
+            for (string = strtok(txt, "|"); string; string = strtok(NULL, "|"))
+            {
+                len = (unsigned int) strlen(string);
+                packet->buffer[packet->bytes++] = (unsigned char) len;
+                memcpy(packet->buffer + packet->bytes, string, len);
+                packet->bytes += len;
+            }
+            break;
+
+        case 3:
+            offset = begin_rr(packet, host, DNS_TYPE_A, 1, 120);
+            ipv4 = htonl(0x0a000000 | (instance / 2 + 1));
+            memcpy(packet->buffer + packet->bytes, &ipv4, sizeof(ipv4));
+            packet->bytes += sizeof(ipv4);
+            break;
+
+        default:
+            offset = begin_rr(packet, host, DNS_TYPE_AAAA, 1, 120);
+            memset(packet->buffer + packet->bytes, 0, 16);
+            packet->buffer[packet->bytes] = 0xfe;
+            packet->buffer[packet->bytes + 1] = 0x80;
+            packet->buffer[packet->bytes + 14] = (unsigned char) ((instance / 2) >> 8);
+            packet->buffer[packet->bytes + 15] = (unsigned char) (instance / 2);
+            packet->bytes += 16;
+            break;
+    }
+
+    end_rr(packet, offset);
+}
+
+
+//
+// Save and restore the state of a packet
+//
+//   A question or record that would make the packet larger than
+//   GENERATE_MAX_PAYLOAD is removed by restoring the state.
+//
+typedef struct
+{
+    unsigned int                bytes;
+    unsigned int                count;
+    unsigned int                pool_used;
+} packet_mark_t;
+
+static void packet_mark(
+    const generate_packet_t *   packet,
+    packet_mark_t *             mark)
+{
+    mark->bytes = packet->bytes;
+    mark->count = packet->compression.count;
+    mark->pool_used = packet->compression.pool_used;
+}
+
+static unsigned int packet_fits(
+    generate_packet_t *         packet,
+    const packet_mark_t *       mark)
+{
+    if (packet->bytes <= GENERATE_MAX_PAYLOAD)
+    {
+        return 1;
+    }
+
+    packet->bytes = mark->bytes;
+    packet->compression.count = mark->count;
+    packet->compression.pool_used = mark->pool_used;
+    return 0;
+}
+
+
+//
+// Build a query
+//
+//   Most questions are for the PTR records of a service type, and the rest
+//   are for the SRV record of an instance or the addresses of a host. Some
+//   queries for PTR records carry known answers.
+//
+static void build_query(
+    generate_packet_t *         packet)
+{
+    dns_header_t *              header = (dns_header_t *) packet->buffer;
+    packet_mark_t               mark;
+    char                        label[64];
+    char                        service[64];
+    char                        name[160];
+    char                        host[32];
+    unsigned int                questions;
+    unsigned int                answers = 0;
+    unsigned int                ptr_service = UINT_MAX;
+    unsigned int                service_index;
+    unsigned int                instance;
+    unsigned int                count;
+    unsigned int                r;
+
+    questions = 1 + random_below(max_questions);
+    for (count = 0; count < questions; count++)
+    {
+        packet_mark(packet, &mark);
+        r = random_below(100);
+        if (r < 70)
+        {
+            service_index = zipf_draw(&service_zipf);
+            if (count == 0)
+            {
+                ptr_service = service_index;
+            }
+            service_type_name(service_index, service, sizeof(service));
+            put_question(packet, service, DNS_TYPE_PTR, random_below(100) < 20);
+        }
+        else
+        {
+            instance = zipf_draw(&instance_zipf);
+            service_type_name(instance_names(instance, label, sizeof(label), host, sizeof(host)), service, sizeof(service));
+            if (r < 90)
+            {
+                (void) snprintf(name, sizeof(name), "%s.%s", label, service);
+                put_question(packet, name, DNS_TYPE_SRV, random_below(100) < 20);
+            }
+            else
+            {
+                put_question(packet, host, r < 95 ? DNS_TYPE_A : DNS_TYPE_AAAA, 0);
+            }
+        }
+        if (packet_fits(packet, &mark) == 0)
+        {
+            break;
+        }
+    }
+    header->query_count = htons((uint16_t) count);
+
+    // Known answers if the first question is for PTR records
+    if (ptr_service != UINT_MAX && random_below(100) < 30)
+    {
+        service_type_name(ptr_service, service, sizeof(service));
+        questions = 1 + random_below(max_answers);
+        for (count = 0; count < questions; count++)
+        {
+            packet_mark(packet, &mark);
+            instance = zipf_draw(&instance_zipf);
+            (void) instance_names(instance, label, sizeof(label), host, sizeof(host));
+            (void) snprintf(name, sizeof(name), "%s.%s", label, service);
+            r = begin_rr(packet, service, DNS_TYPE_PTR, 0, 4500);
+            (void) put_name(packet, name);
+            end_rr(packet, r);
+            if (packet_fits(packet, &mark) == 0)
+            {
+                break;
+            }
+            answers += 1;
+        }
+    }
+    header->answer_count = htons((uint16_t) answers);
+}
+
+
+//
+// Build a response
+//
+//   The answers and additional records are the records of one or more
+//   instances, in order, so that a response with three answers and two
+//   additional records is a typical announcement of an instance.
+//
+static void build_response(
+    generate_packet_t *         packet)
+{
+    dns_header_t *              header = (dns_header_t *) packet->buffer;
+    packet_mark_t               mark;
+    unsigned int                counts[2];
+    unsigned int                section;
+    unsigned int                instance;
+    unsigned int                record = 0;
+    unsigned int                count;
+
+    header->flags = htons(0x8400);
+    counts[0] = 1 + random_below(max_answers);
+    counts[1] = random_below(max_additional + 1);
+
+    instance = zipf_draw(&instance_zipf);
+    for (section = 0; section < 2; section++)
+    {
+        for (count = 0; count < counts[section]; count++)
+        {
+            packet_mark(packet, &mark);
+            put_instance_rr(packet, instance, record);
+            if (packet_fits(packet, &mark) == 0)
+            {
+                break;
+            }
+
+            record += 1;
+            if (record == NUM_INSTANCE_RECORDS)
+            {
+                record = 0;
+                instance = zipf_draw(&instance_zipf);
+            }
+        }
+        counts[section] = count;
+    }
+    header->answer_count = htons((uint16_t) counts[0]);
+    header->additional_count = htons((uint16_t) counts[1]);
+}
+
+
+//
+// Compute an internet checksum
+//
+static uint32_t checksum_add(
+    uint32_t                    sum,
+    const unsigned char *       data,
+    unsigned int                len)
+{
+    while (len > 1)
+    {
+        sum += (uint32_t) data[0] << 8 | data[1];
+        data += 2;
+        len -= 2;
+    }
+    if (len)
+    {
+        sum += (uint32_t) data[0] << 8;
+    }
+    return sum;
+}
+
+static uint16_t checksum_fold(
+    uint32_t                    sum)
+{
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t) ~sum;
+}
+
+
+//
+// Write a packet to the pcap file, with IP and UDP headers
+//
+static void write_packet(
+    FILE *                      fp,
+    const generate_packet_t *   packet,
+    unsigned int                number,
+    unsigned int                source)
+{
+    unsigned char               headers[IPV6_HEADER_LEN + UDP_HEADER_LEN];
+    unsigned char *             udp;
+    uint32_t                    record[4];
+    uint32_t                    sum;
+    unsigned int                ip_len;
+    unsigned int                udp_len = UDP_HEADER_LEN + packet->bytes;
+    uint16_t                    check;
+
+    memset(headers, 0, sizeof(headers));
+    if (flag_ipv6)
+    {
+        ip_len = IPV6_HEADER_LEN;
+        headers[0] = 0x60;
+        headers[4] = (unsigned char) (udp_len >> 8);
+        headers[5] = (unsigned char) udp_len;
+        headers[6] = IPPROTO_UDP;
+        headers[7] = 255;
+        headers[8] = 0xfe;
+        headers[9] = 0x80;
+        headers[22] = (unsigned char) (source >> 8);
+        headers[23] = (unsigned char) source;
+        (void) inet_pton(AF_INET6, "ff02::fb", headers + 24);
+        sum = checksum_add(0, headers + 8, 32);
+    }
+    else
+    {
+        ip_len = IPV4_HEADER_LEN;
+        headers[0] = 0x45;
+        headers[2] = (unsigned char) ((ip_len + udp_len) >> 8);
+        headers[3] = (unsigned char) (ip_len + udp_len);
+        headers[8] = 255;
+        headers[9] = IPPROTO_UDP;
+        headers[12] = 10;
+        headers[14] = (unsigned char) (source >> 8);
+        headers[15] = (unsigned char) source;
+        (void) inet_pton(AF_INET, "224.0.0.251", headers + 16);
+        check = htons(checksum_fold(checksum_add(0, headers, IPV4_HEADER_LEN)));
+        memcpy(headers + 10, &check, sizeof(check));
+        sum = checksum_add(0, headers + 12, 8);
+    }
+
+    // UDP header and checksum (over the pseudo header, UDP header and payload)
+    udp = headers + ip_len;
+    udp[0] = MCAST_PORT >> 8;
+    udp[1] = MCAST_PORT & 0xff;
+    udp[2] = MCAST_PORT >> 8;
+    udp[3] = MCAST_PORT & 0xff;
+    udp[4] = (unsigned char) (udp_len >> 8);
+    udp[5] = (unsigned char) udp_len;
+    sum += IPPROTO_UDP + udp_len;
+    sum = checksum_add(sum, udp, UDP_HEADER_LEN);
+    sum = checksum_add(sum, packet->buffer, packet->bytes);
+    check = htons(checksum_fold(sum));
+    if (check == 0)
+    {
+        check = 0xffff;
+    }
+    memcpy(udp + 6, &check, sizeof(check));
+
+    // Packets are spaced 1 millisecond apart
+    record[0] = number / 1000;
+    record[1] = (number % 1000) * 1000;
+    record[2] = ip_len + udp_len;
+    record[3] = ip_len + udp_len;
+    if (fwrite(record, sizeof(record), 1, fp) != 1 ||
+        fwrite(headers, ip_len + UDP_HEADER_LEN, 1, fp) != 1 ||
+        fwrite(packet->buffer, packet->bytes, 1, fp) != 1)
+    {
+        fatal("Cannot write %s: %s\n", output_filename, strerror(errno));
+    }
+}
+
+
+//
+// Write a packet to a file in the seed corpus directory, without headers
+//
+static void write_seed(
+    const generate_packet_t *   packet,
+    unsigned int                number)
+{
+    char                        filename[PATH_MAX];
+    FILE *                      fp;
+
+    (void) snprintf(filename, sizeof(filename), "%s/seed-%06u", corpus_dirname, number);
+    fp = fopen(filename, "wb");
+    if (fp == NULL)
+    {
+        fatal("Cannot open %s: %s\n", filename, strerror(errno));
+    }
+    if (fwrite(packet->buffer, packet->bytes, 1, fp) != 1 || fclose(fp) != 0)
+    {
+        fatal("Cannot write %s: %s\n", filename, strerror(errno));
+    }
+}
+
+
+//
+// Main
+//
+int main(
+    int                         argc,
+    char                        *argv[])
+{
+    generate_packet_t *         packet;
+    FILE *                      fp = NULL;
+    uint32_t                    header[6];
+    unsigned long long          bytes = 0;
+    unsigned int                queries = 0;
+    unsigned int                number;
+    unsigned int                source;
+
+    parse_args(argc, argv);
+    random_state = 0x853C49E6748FEA9BULL ^ seed;
+    zipf_initialize(&service_zipf, service_type_count);
+    zipf_initialize(&instance_zipf, instance_count);
+
+    packet = malloc(sizeof(generate_packet_t));
+    if (packet == NULL)
+    {
+        fatal("Cannot allocate memory: %s\n", strerror(errno));
+    }
+
+    if (output_filename)
+    {
+        fp = fopen(output_filename, "wb");
+        if (fp == NULL)
+        {
+            fatal("Cannot open %s: %s\n", output_filename, strerror(errno));
+        }
+
+        // pcap file header
+        header[0] = PCAP_MAGIC_USEC;
+        header[1] = PCAP_VERSION_MAJOR | PCAP_VERSION_MINOR << 16;
+        header[2] = 0;
+        header[3] = 0;
+        header[4] = MDNS_MAX_PACKET_SIZE;
+        header[5] = LINKTYPE_RAW;
+        if (fwrite(header, sizeof(header), 1, fp) != 1)
+        {
+            fatal("Cannot write %s: %s\n", output_filename, strerror(errno));
+        }
+    }
+
+    for (number = 0; number < packet_count; number++)
+    {
+        memset(packet->buffer, 0, sizeof(dns_header_t));
+        packet->bytes = sizeof(dns_header_t);
+        packet->compression.count = 0;
+        packet->compression.pool_used = 0;
+
+        if (random_below(100) < query_percent)
+        {
+            build_query(packet);
+            queries += 1;
+        }
+        else
+        {
+            build_response(packet);
+        }
+
+        source = 1 + random_below(instance_count / 2 + 1);
+        if (fp)
+        {
+            write_packet(fp, packet, number, source);
+        }
+        if (corpus_dirname)
+        {
+            write_seed(packet, number);
+        }
+        bytes += packet->bytes;
+    }
+
+    if (fp && fclose(fp) != 0)
+    {
+        fatal("Cannot write %s: %s\n", output_filename, strerror(errno));
+    }
+
+    printf("%u packets (%u queries, %u responses), %llu bytes of mDNS payload, average %.0f bytes\n",
+           packet_count, queries, packet_count - queries, bytes, (double) bytes / packet_count);
+    return 0;
+}
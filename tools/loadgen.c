@@ -0,0 +1,804 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+//
+// Load generator for the network namespace test rig
+//
+// The sender multicasts a synthetic mix of mDNS announcements and queries
+// on an interface at a controlled rate. The first label of the first name
+// in each packet is a marker that carries the sender id, a sequence number
+// and the send time, and is preserved by the bridge whether or not the
+// packet is re-encoded. Alternatively, the sender replays the packets of a
+// capture or corpus (see tools/generate.c), adding the marker to each as an
+// additional A record, which is never filtered. The receiver counts the
+// marked packets that arrive on an interface and reports the delivery and
+// latency. Send and receive times are taken from the monotonic clock, which
+// is shared by all network namespaces of a host.
+//
+// See tools/netns-rig.sh.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+
+#include "../common.h"
+#include "../dns.h"
+#include "capture.h"
+
+
+// mDNS addresses
+#define IPV4_MCAST_ADDRESS      "224.0.0.251"
+#define IPV6_MCAST_ADDRESS      "ff02::fb"
+#define MCAST_PORT              5353
+
+// Marker label: "lg", sender id, sequence number and send time in hex
+#define MARKER_PREFIX           "lg"
+#define MARKER_FORMAT           MARKER_PREFIX "%02x%08x%016llx"
+#define MARKER_LEN              (2 + 2 + 8 + 16)
+
+// Size of the receive socket buffer
+#define RECEIVE_BUFFER_SIZE     (4 * 1024 * 1024)
+
+// Pacing interval of the sender (nanoseconds)
+#define SEND_INTERVAL_NSEC      100000
+
+// Service types and host names used in the synthetic packets
+static const char *             service_types[] =
+{
+    "_airplay", "_raop", "_ipp", "_ipps", "_printer", "_pdl-datastream", "_scanner",
+    "_googlecast", "_spotify-connect", "_companion-link", "_homekit", "_hap",
+    "_smb", "_afpovertcp", "_ssh", "_sftp-ssh", "_http", "_device-info"
+};
+#define NUM_SERVICE_TYPES       (sizeof(service_types) / sizeof(service_types[0]))
+#define NUM_HOSTS               64
+
+// Who we are
+static const char *             progname;
+
+// Command line options
+static unsigned int             flag_ipv6 = 0;
+static const char *             interface_name = NULL;
+static unsigned int             rate = 1000;
+static unsigned int             duration = 5;
+static unsigned int             announce_percent = 50;
+static unsigned int             sender_id = 0;
+static const char *             corpus_filename = NULL;
+
+
+
+//
+// Report a fatal error
+//
+__attribute__ ((noreturn, format (printf, 1, 2)))
+void fatal(
+    const char *                format,
+    ...)
+{
+    va_list                     args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
+
+
+//
+// Display usage and exit
+//
+__attribute__ ((noreturn))
+static void usage(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "  %s send [-6] -i interface [-r rate] [-d seconds] [-m percent] [-s id] [-f file]\n", progname);
+    fprintf(stderr, "  %s recv [-6] -i interface [-d seconds]\n", progname);
+    fprintf(stderr, "  options:\n");
+    fprintf(stderr, "    -6 use IPv6 (default is IPv4)\n");
+    fprintf(stderr, "    -i interface name\n");
+    fprintf(stderr, "    -r packets per second to send (default 1000)\n");
+    fprintf(stderr, "    -d seconds to send or receive (default 5)\n");
+    fprintf(stderr, "    -m percentage of packets that are announcements (default 50)\n");
+    fprintf(stderr, "    -s sender id (0-255, default 0)\n");
+    fprintf(stderr, "    -f pcap or pcapng file of packets to send instead of the synthetic mix\n");
+    exit(1);
+}
+
+
+//
+// Parse command line arguments
+//
+static void parse_args(
+    int                         argc,
+    char * const                argv[])
+{
+    int                         opt;
+
+    while((opt = getopt(argc, argv, "h6i:r:d:m:s:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case '6':
+            flag_ipv6 = 1;
+            break;
+        case 'i':
+            interface_name = optarg;
+            break;
+        case 'r':
+            rate = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            duration = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            announce_percent = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            corpus_filename = optarg;
+            break;
+        case 's':
+            sender_id = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+        }
+    }
+
+    if (interface_name == NULL || rate == 0 || duration == 0 || announce_percent > 100 || sender_id > 255)
+    {
+        usage();
+    }
+}
+
+
+//
+// Get the monotonic clock in nanoseconds
+//
+static uint64_t loadgen_clock(void)
+{
+    struct timespec             ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+
+//
+// Create a multicast socket on the interface
+//
+static int loadgen_socket(
+    unsigned int                if_index,
+    unsigned int                join)
+{
+    socket_address_t            addr;
+    struct ip_mreqn             mreq;
+    struct ipv6_mreq            mreq6;
+    int                         sock;
+    int                         on = 1;
+    int                         ttl = 255;
+    int                         size = RECEIVE_BUFFER_SIZE;
+
+    memset(&addr, 0, sizeof(addr));
+    sock = socket(flag_ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+    if (sock == -1)
+    {
+        fatal("socket: %s\n", strerror(errno));
+    }
+    (void) setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    (void) setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    if (join)
+    {
+        (void) setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    if (flag_ipv6)
+    {
+        (void) setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+        addr.sin6.sin6_family = AF_INET6;
+        addr.sin6.sin6_port = htons(MCAST_PORT);
+        if (bind(sock, &addr.sa, sizeof(addr.sin6)) == -1)
+        {
+            fatal("bind: %s\n", strerror(errno));
+        }
+
+        memset(&mreq6, 0, sizeof(mreq6));
+        (void) inet_pton(AF_INET6, IPV6_MCAST_ADDRESS, &mreq6.ipv6mr_multiaddr);
+        mreq6.ipv6mr_interface = if_index;
+        if ((join && setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6, sizeof(mreq6)) == -1) ||
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &if_index, sizeof(if_index)) == -1 ||
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl)) == -1)
+        {
+            fatal("setsockopt (IPv6 multicast): %s\n", strerror(errno));
+        }
+    }
+    else
+    {
+        addr.sin.sin_family = AF_INET;
+        addr.sin.sin_port = htons(MCAST_PORT);
+        if (bind(sock, &addr.sa, sizeof(addr.sin)) == -1)
+        {
+            fatal("bind: %s\n", strerror(errno));
+        }
+
+        memset(&mreq, 0, sizeof(mreq));
+        (void) inet_pton(AF_INET, IPV4_MCAST_ADDRESS, &mreq.imr_multiaddr);
+        mreq.imr_ifindex = (int) if_index;
+        if ((join && setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) ||
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)) == -1 ||
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == -1)
+        {
+            fatal("setsockopt (IPv4 multicast): %s\n", strerror(errno));
+        }
+    }
+
+    return sock;
+}
+
+
+//
+// Append a name to a packet
+//
+//   The name is a dot separated string. If suffix is non-zero, the name is
+//   terminated by a pointer to the suffix offset instead of the root label.
+//
+static unsigned int put_name(
+    unsigned char *             buffer,
+    unsigned int                offset,
+    const char *                name,
+    unsigned int                suffix)
+{
+    const char *                dot;
+    unsigned int                len;
+
+    while (*name)
+    {
+        dot = strchr(name, '.');
+        len = dot ? (unsigned int) (dot - name) : (unsigned int) strlen(name);
+        buffer[offset++] = (unsigned char) len;
+        memcpy(buffer + offset, name, len);
+        offset += len;
+        name += dot ? len + 1 : len;
+    }
+
+    if (suffix)
+    {
+        buffer[offset++] = (unsigned char) (0xC0 | (suffix >> 8));
+        buffer[offset++] = (unsigned char) suffix;
+    }
+    else
+    {
+        buffer[offset++] = 0;
+    }
+    return offset;
+}
+
+
+//
+// Append a 16 or 32 bit value to a packet in network byte order
+//
+static unsigned int put_u16(
+    unsigned char *             buffer,
+    unsigned int                offset,
+    unsigned int                value)
+{
+    buffer[offset] = (unsigned char) (value >> 8);
+    buffer[offset + 1] = (unsigned char) value;
+    return offset + 2;
+}
+
+static unsigned int put_u32(
+    unsigned char *             buffer,
+    unsigned int                offset,
+    uint32_t                    value)
+{
+    offset = put_u16(buffer, offset, value >> 16);
+    return put_u16(buffer, offset, value & 0xffff);
+}
+
+
+//
+// Build a synthetic announcement or query
+//
+//   An announcement is a response with the SRV record of a service
+//   instance, the PTR record of the service type, and the address record of
+//   the host. A query asks for the SRV record of an instance and the PTR
+//   records of its service type. In both, the first name is the instance
+//   name, whose first label is the marker.
+//
+static unsigned int build_packet(
+    unsigned char *             buffer,
+    unsigned int                announce,
+    uint32_t                    seq,
+    uint64_t                    now)
+{
+    dns_header_t *              header = (dns_header_t *) buffer;
+    char                        marker[MARKER_LEN + 1];
+    char                        host[32];
+    const char *                service;
+    unsigned int                instance_offset;
+    unsigned int                type_offset;
+    unsigned int                host_offset;
+    unsigned int                rdata_offset;
+    unsigned int                offset;
+
+    service = service_types[seq % NUM_SERVICE_TYPES];
+    (void) snprintf(marker, sizeof(marker), MARKER_FORMAT, sender_id, seq, (unsigned long long) now);
+    (void) snprintf(host, sizeof(host), "host%u", (unsigned int) ((seq / NUM_SERVICE_TYPES) % NUM_HOSTS));
+
+    memset(header, 0, sizeof(dns_header_t));
+    offset = sizeof(dns_header_t);
+
+    // Instance name: marker, service type, protocol and domain
+    instance_offset = offset;
+    offset = put_name(buffer, offset, marker, 0) - 1;
+    type_offset = offset;
+    offset = put_name(buffer, offset, service, 0) - 1;
+    offset = put_name(buffer, offset, "_tcp.local", 0);
+
+    if (announce)
+    {
+        header->flags = htons(0x8400);
+        header->answer_count = htons(3);
+
+        // SRV record of the instance
+        offset = put_u16(buffer, offset, DNS_TYPE_SRV);
+        offset = put_u16(buffer, offset, 0x8001);
+        offset = put_u32(buffer, offset, 120);
+        rdata_offset = offset;
+        offset = put_u16(buffer, offset, 0);
+        offset = put_u16(buffer, offset, 0);
+        offset = put_u16(buffer, offset, 0);
+        offset = put_u16(buffer, offset, 8000 + seq % 1000);
+        host_offset = offset;
+        offset = put_name(buffer, offset, host, instance_offset + 1 + MARKER_LEN + 1 + (unsigned int) strlen(service) + 1 + 4);
+        (void) put_u16(buffer, rdata_offset, offset - rdata_offset - 2);
+
+        // PTR record of the service type
+        offset = put_name(buffer, offset, "", type_offset);
+        offset = put_u16(buffer, offset, DNS_TYPE_PTR);
+        offset = put_u16(buffer, offset, 1);
+        offset = put_u32(buffer, offset, 4500);
+        offset = put_u16(buffer, offset, 2);
+        offset = put_name(buffer, offset, "", instance_offset);
+
+        // Address record of the host
+        offset = put_name(buffer, offset, "", host_offset);
+        if (flag_ipv6)
+        {
+            offset = put_u16(buffer, offset, DNS_TYPE_AAAA);
+            offset = put_u16(buffer, offset, 0x8001);
+            offset = put_u32(buffer, offset, 120);
+            offset = put_u16(buffer, offset, 16);
+            memset(buffer + offset, 0, 16);
+            buffer[offset] = 0xfe;
+            buffer[offset + 1] = 0x80;
+            buffer[offset + 15] = (unsigned char) seq;
+            offset += 16;
+        }
+        else
+        {
+            offset = put_u16(buffer, offset, DNS_TYPE_A);
+            offset = put_u16(buffer, offset, 0x8001);
+            offset = put_u32(buffer, offset, 120);
+            offset = put_u16(buffer, offset, 4);
+            offset = put_u32(buffer, offset, 0x0a000000 | (seq & 0xffff));
+        }
+    }
+    else
+    {
+        header->query_count = htons(2);
+
+        // Query for the SRV record of the instance
+        offset = put_u16(buffer, offset, DNS_TYPE_SRV);
+        offset = put_u16(buffer, offset, 1);
+
+        // Query for the PTR records of the service type
+        offset = put_name(buffer, offset, "", type_offset);
+        offset = put_u16(buffer, offset, DNS_TYPE_PTR);
+        offset = put_u16(buffer, offset, 1);
+    }
+
+    return offset;
+}
+
+
+//
+// Copy a corpus packet, adding the marker as an additional A record
+//
+//   Returns the length of the packet, or zero if there is no room for the
+//   marker.
+//
+static unsigned int mark_packet(
+    unsigned char *             buffer,
+    const capture_packet_t *    captured,
+    uint32_t                    seq,
+    uint64_t                    now)
+{
+    dns_header_t *              header = (dns_header_t *) buffer;
+    char                        marker[MARKER_LEN + 1];
+    unsigned int                offset;
+
+    if (captured->bytes < sizeof(dns_header_t) ||
+        captured->bytes + 1 + MARKER_LEN + 7 + sizeof(dns_rr_header_t) + 4 > MDNS_MAX_PACKET_SIZE)
+    {
+        return 0;
+    }
+    memcpy(buffer, captured->data, captured->bytes);
+
+    (void) snprintf(marker, sizeof(marker), MARKER_FORMAT, sender_id, seq, (unsigned long long) now);
+    offset = put_name(buffer, captured->bytes, marker, 0) - 1;
+    offset = put_name(buffer, offset, "local", 0);
+    offset = put_u16(buffer, offset, DNS_TYPE_A);
+    offset = put_u16(buffer, offset, 1);
+    offset = put_u32(buffer, offset, 120);
+    offset = put_u16(buffer, offset, 4);
+    offset = put_u32(buffer, offset, 0);
+    header->additional_count = htons(ntohs(header->additional_count) + 1);
+
+    return offset;
+}
+
+
+//
+// Send packets at the requested rate
+//
+static void loadgen_send(
+    unsigned int                if_index)
+{
+    capture_t                   corpus;
+    unsigned char               buffer[MDNS_MAX_PACKET_SIZE];
+    socket_address_t            dest;
+    socklen_t                   dest_len;
+    struct timespec             ts;
+    uint64_t                    start;
+    uint64_t                    now;
+    uint64_t                    due;
+    uint64_t                    sent = 0;
+    uint64_t                    errors = 0;
+    uint64_t                    bytes = 0;
+    unsigned int                len;
+    int                         sock;
+
+    sock = loadgen_socket(if_index, 0);
+
+    // Load the corpus
+    memset(&corpus, 0, sizeof(corpus));
+    if (corpus_filename)
+    {
+        capture_load(&corpus, corpus_filename);
+        if (corpus.count == 0)
+        {
+            fatal("%s: no mDNS packets\n", corpus_filename);
+        }
+    }
+
+    memset(&dest, 0, sizeof(dest));
+    if (flag_ipv6)
+    {
+        dest.sin6.sin6_family = AF_INET6;
+        dest.sin6.sin6_port = htons(MCAST_PORT);
+        dest.sin6.sin6_scope_id = if_index;
+        (void) inet_pton(AF_INET6, IPV6_MCAST_ADDRESS, &dest.sin6.sin6_addr);
+        dest_len = sizeof(dest.sin6);
+    }
+    else
+    {
+        dest.sin.sin_family = AF_INET;
+        dest.sin.sin_port = htons(MCAST_PORT);
+        (void) inet_pton(AF_INET, IPV4_MCAST_ADDRESS, &dest.sin.sin_addr);
+        dest_len = sizeof(dest.sin);
+    }
+
+    start = loadgen_clock();
+    now = start;
+    while (now - start < (uint64_t) duration * 1000000000)
+    {
+        // Send the packets that are due
+        due = (now - start) * rate / 1000000000 + 1;
+        while (sent < due)
+        {
+            if (corpus.count)
+            {
+                len = mark_packet(buffer, &corpus.packets[sent % corpus.count], (uint32_t) sent, loadgen_clock());
+            }
+            else
+            {
+                // NB: Stepping by 37 spreads the announcements evenly through each 100 packets
+                len = build_packet(buffer, (sent * 37) % 100 < announce_percent, (uint32_t) sent, loadgen_clock());
+            }
+            if (len == 0)
+            {
+                errors += 1;
+            }
+            else if (sendto(sock, buffer, len, 0, &dest.sa, dest_len) == -1)
+            {
+                errors += 1;
+            }
+            bytes += len;
+            sent += 1;
+        }
+
+        ts.tv_sec = 0;
+        ts.tv_nsec = SEND_INTERVAL_NSEC;
+        (void) nanosleep(&ts, NULL);
+        now = loadgen_clock();
+    }
+
+    printf("sent=%llu errors=%llu bytes=%llu rate=%.0f\n", (unsigned long long) sent, (unsigned long long) errors,
+           (unsigned long long) bytes, (double) sent * 1e9 / (double) (now - start));
+}
+
+
+//
+// Parse a hex field of a marker
+//
+static unsigned int parse_hex(
+    const unsigned char *       p,
+    unsigned int                len,
+    uint64_t *                  value)
+{
+    unsigned int                c;
+
+    *value = 0;
+    while (len--)
+    {
+        c = *p++;
+        if (c >= '0' && c <= '9')
+        {
+            c -= '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            c -= 'a' - 10;
+        }
+        else
+        {
+            return 0;
+        }
+        *value = (*value << 4) | c;
+    }
+    return 1;
+}
+
+
+//
+// Find the marker label in a packet
+//
+//   The marker is the first label of the first name of a synthetic packet,
+//   or of the last record of a corpus packet.
+//
+static const unsigned char * find_marker(
+    const unsigned char *       buffer,
+    size_t                      len)
+{
+    size_t                      offset;
+
+    for (offset = sizeof(dns_header_t); offset + 1 + MARKER_LEN <= len; offset++)
+    {
+        if (buffer[offset] == MARKER_LEN && memcmp(buffer + offset + 1, MARKER_PREFIX, 2) == 0)
+        {
+            return buffer + offset;
+        }
+    }
+
+    return NULL;
+}
+
+
+//
+// Compare latencies for qsort
+//
+static int compare_latency(
+    const void *                a,
+    const void *                b)
+{
+    uint64_t                    la = *(const uint64_t *) a;
+    uint64_t                    lb = *(const uint64_t *) b;
+
+    return la < lb ? -1 : la > lb;
+}
+
+
+//
+// Receive packets for the requested duration
+//
+static void loadgen_recv(
+    unsigned int                if_index)
+{
+    unsigned char               buffer[MDNS_MAX_PACKET_SIZE];
+    const unsigned char *       marker;
+    unsigned char *             seen = NULL;
+    uint64_t *                  latency = NULL;
+    size_t                      seen_allocated = 0;
+    size_t                      latency_allocated = 0;
+    uint64_t                    received = 0;
+    uint64_t                    unique = 0;
+    uint64_t                    duplicates = 0;
+    uint64_t                    other = 0;
+    uint64_t                    bytes = 0;
+    uint64_t                    max_seq = 0;
+    uint64_t                    start;
+    uint64_t                    now;
+    uint64_t                    sender;
+    uint64_t                    seq;
+    uint64_t                    sent_nsec;
+    struct timeval              tv;
+    void *                      np;
+    size_t                      size;
+    ssize_t                     len;
+    int                         sock;
+
+    sock = loadgen_socket(if_index, 1);
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    (void) setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    start = loadgen_clock();
+    now = start;
+    while (now - start < (uint64_t) duration * 1000000000)
+    {
+        len = recv(sock, buffer, sizeof(buffer), 0);
+        now = loadgen_clock();
+        if (len <= 0)
+        {
+            continue;
+        }
+
+        // Find the marker
+        marker = find_marker(buffer, (size_t) len);
+        if (marker == NULL ||
+            parse_hex(marker + 3, 2, &sender) == 0 ||
+            parse_hex(marker + 5, 8, &seq) == 0 ||
+            parse_hex(marker + 13, 16, &sent_nsec) == 0 ||
+            sender != sender_id)
+        {
+            other += 1;
+            continue;
+        }
+        received += 1;
+        bytes += (uint64_t) len;
+
+        // Check for duplicates
+        if (seq >= seen_allocated)
+        {
+            size = seen_allocated ? seen_allocated : 65536;
+            while (size <= seq)
+            {
+                size *= 2;
+            }
+            np = realloc(seen, size);
+            if (np == NULL)
+            {
+                fatal("Cannot allocate memory: %s\n", strerror(errno));
+            }
+            seen = np;
+            memset(seen + seen_allocated, 0, size - seen_allocated);
+            seen_allocated = size;
+        }
+        if (seen[seq])
+        {
+            duplicates += 1;
+            continue;
+        }
+        seen[seq] = 1;
+        if (seq > max_seq)
+        {
+            max_seq = seq;
+        }
+
+        // Record the latency
+        if (unique >= latency_allocated)
+        {
+            latency_allocated = latency_allocated ? latency_allocated * 2 : 65536;
+            np = realloc(latency, latency_allocated * sizeof(uint64_t));
+            if (np == NULL)
+            {
+                fatal("Cannot allocate memory: %s\n", strerror(errno));
+            }
+            latency = np;
+        }
+        latency[unique++] = now > sent_nsec ? now - sent_nsec : 0;
+    }
+
+    printf("received=%llu unique=%llu duplicates=%llu other=%llu bytes=%llu max_seq=%llu",
+           (unsigned long long) received, (unsigned long long) unique, (unsigned long long) duplicates,
+           (unsigned long long) other, (unsigned long long) bytes, (unsigned long long) max_seq);
+    if (unique)
+    {
+        qsort(latency, unique, sizeof(uint64_t), compare_latency);
+        printf(" p50_us=%.1f p90_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f",
+               (double) latency[unique * 50 / 100] / 1000.0, (double) latency[unique * 90 / 100] / 1000.0,
+               (double) latency[unique * 99 / 100] / 1000.0, (double) latency[unique * 999 / 1000] / 1000.0,
+               (double) latency[unique - 1] / 1000.0);
+    }
+    printf("\n");
+
+    free(seen);
+    free(latency);
+}
+
+
+//
+// Main
+//
+int main(
+    int                         argc,
+    char                        *argv[])
+{
+    unsigned int                if_index;
+    unsigned int                send;
+
+    progname = argv[0];
+    if (argc < 2)
+    {
+        usage();
+    }
+    if (strcmp(argv[1], "send") == 0)
+    {
+        send = 1;
+    }
+    else if (strcmp(argv[1], "recv") == 0)
+    {
+        send = 0;
+    }
+    else
+    {
+        usage();
+    }
+    parse_args(argc - 1, argv + 1);
+
+    if_index = if_nametoindex(interface_name);
+    if (if_index == 0)
+    {
+        fatal("interface %s: %s\n", interface_name, strerror(errno));
+    }
+
+    // Write each result line as soon as it is complete
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (send)
+    {
+        loadgen_send(if_index);
+    }
+    else
+    {
+        loadgen_recv(if_index);
+    }
+
+    return 0;
+}
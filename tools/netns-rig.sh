@@ -0,0 +1,202 @@
+#!/bin/sh
+#
+# Network namespace end-to-end throughput test rig
+#
+# Builds a bridge namespace and N peer namespaces, each peer connected to
+# the bridge namespace by a veth pair, and runs mdns-bridge across the N
+# bridge side interfaces. The load generator in the first peer sends a mix
+# of announcements and queries at a controlled rate, and the load generator
+# in each of the other peers reports the packets delivered to it, the loss,
+# and the latency percentiles.
+#
+# Requires root, iproute2, and mdns-bridge and tools/mdns-loadgen built
+# (make all loadgen).
+#
+
+set -eu
+
+usage()
+{
+    cat >&2 <<EOF
+Usage:
+  $0 [-6] [-n interfaces] [-r rate] [-d seconds] [-m percent] [-f file] [-x file] [-b bridge] [-l loadgen]
+  options:
+    -6 use IPv6 (default is IPv4)
+    -n number of interfaces (2-250, default 2)
+    -r packets per second sent (default 1000)
+    -d seconds to send (default 5)
+    -m percentage of packets that are announcements (default 50)
+    -f pcap or pcapng file of packets to send instead of the synthetic mix
+    -x file of configuration to append to the generated configuration
+    -b path of mdns-bridge (default ./mdns-bridge)
+    -l path of the load generator (default ./tools/mdns-loadgen)
+
+  The bridge side interfaces are named vb0 .. vbN-1. Peer 0 sends.
+EOF
+    exit 1
+}
+
+family=4
+count=2
+rate=1000
+duration=5
+mix=50
+corpus=
+extra=
+bridge=./mdns-bridge
+loadgen=./tools/mdns-loadgen
+
+while getopts "h6n:r:d:m:f:x:b:l:" opt
+do
+    case $opt in
+    6) family=6 ;;
+    n) count=$OPTARG ;;
+    r) rate=$OPTARG ;;
+    d) duration=$OPTARG ;;
+    m) mix=$OPTARG ;;
+    f) corpus=$OPTARG ;;
+    x) extra=$OPTARG ;;
+    b) bridge=$OPTARG ;;
+    l) loadgen=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+
+if [ "$count" -lt 2 ] || [ "$count" -gt 250 ]
+then
+    usage
+fi
+if [ ! -x "$bridge" ] || [ ! -x "$loadgen" ]
+then
+    echo "$0: $bridge and $loadgen must be built (make all loadgen)" >&2
+    exit 1
+fi
+if [ "$family" = 6 ]
+then
+    loadgen_family=-6
+else
+    loadgen_family=
+fi
+if [ -n "$corpus" ]
+then
+    loadgen_source="-f $corpus"
+    source=$corpus
+else
+    loadgen_source="-m $mix"
+    source="announce=$mix%"
+fi
+
+prefix=mbr$$
+bns=${prefix}b
+work=$(mktemp -d)
+bridge_pid=
+
+cleanup()
+{
+    if [ -n "$bridge_pid" ]
+    then
+        kill "$bridge_pid" 2>/dev/null || true
+        wait "$bridge_pid" 2>/dev/null || true
+    fi
+    for ns in $(ip netns list | awk '{ print $1 }' | grep "^$prefix" || true)
+    do
+        ip netns del "$ns" 2>/dev/null || true
+    done
+    rm -rf "$work"
+}
+trap cleanup EXIT INT TERM
+
+# Build the namespaces
+ip netns add "$bns"
+ip -n "$bns" link set lo up
+ip netns exec "$bns" sysctl -qw net.ipv6.conf.default.accept_dad=0
+i=0
+while [ $i -lt "$count" ]
+do
+    pns=${prefix}p$i
+    ip netns add "$pns"
+    ip -n "$pns" link set lo up
+    ip netns exec "$pns" sysctl -qw net.ipv6.conf.default.accept_dad=0
+    ip link add vb$i netns "$bns" type veth peer name eth0 netns "$pns"
+    ip -n "$bns" addr add 10.99.$i.1/24 dev vb$i
+    ip -n "$pns" addr add 10.99.$i.2/24 dev eth0
+    ip -n "$bns" link set vb$i up
+    ip -n "$pns" link set eth0 up
+    i=$((i + 1))
+done
+
+# Generate the configuration
+{
+    echo "[global]"
+    printf "  interfaces = vb0"
+    i=1
+    while [ $i -lt "$count" ]
+    do
+        printf ", vb%d" $i
+        i=$((i + 1))
+    done
+    echo
+    if [ "$family" = 6 ]
+    then
+        echo "  disable-ipv4 = yes"
+    else
+        echo "  disable-ipv6 = yes"
+    fi
+    if [ -n "$extra" ]
+    then
+        cat "$extra"
+    fi
+} > "$work/mdns-bridge.conf"
+
+# Start the bridge
+ip netns exec "$bns" "$bridge" -f -c "$work/mdns-bridge.conf" > "$work/bridge.log" 2>&1 &
+bridge_pid=$!
+sleep 1
+if ! kill -0 "$bridge_pid" 2>/dev/null
+then
+    cat "$work/bridge.log" >&2
+    exit 1
+fi
+
+# Start the receivers, then the sender
+receivers=
+i=1
+while [ $i -lt "$count" ]
+do
+    ip netns exec ${prefix}p$i "$loadgen" recv $loadgen_family -i eth0 -d $((duration + 2)) > "$work/recv$i" &
+    receivers="$receivers $!"
+    i=$((i + 1))
+done
+sleep 0.5
+ip netns exec ${prefix}p0 "$loadgen" send $loadgen_family -i eth0 -r "$rate" -d "$duration" $loadgen_source > "$work/send"
+wait $receivers
+
+# Report
+sent=$(sed -n 's/.*sent=\([0-9]*\).*/\1/p' "$work/send")
+echo "interfaces=$count ipv$family rate=$rate duration=$duration $source"
+cat "$work/send"
+i=1
+while [ $i -lt "$count" ]
+do
+    printf "vb%d " $i
+    cat "$work/recv$i"
+    i=$((i + 1))
+done | awk -v sent="$sent" '
+{
+    print
+    for (f = 2; f <= NF; f++)
+    {
+        split($f, kv, "=")
+        v[kv[1]] = kv[2]
+    }
+    peers++
+    unique += v["unique"]
+    if (v["p99_us"] + 0 > p99) p99 = v["p99_us"] + 0
+    if (v["max_us"] + 0 > max) max = v["max_us"] + 0
+    delete v
+}
+END {
+    expected = sent * peers
+    printf "total: peers=%d expected=%d delivered=%d loss=%.3f%% worst_p99_us=%.1f worst_max_us=%.1f\n",
+           peers, expected, unique, expected ? 100.0 * (expected - unique) / expected : 0, p99, max
+}'
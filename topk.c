@@ -0,0 +1,306 @@
+//
+// Copyright (c) 2024, Denny Page
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+
+
+// Count-min sketch dimensions (width must be a power of 2)
+#define TOPK_SKETCH_DEPTH       4
+#define TOPK_SKETCH_WIDTH       1024
+
+// FNV-1a constants
+#define FNV_OFFSET_BASIS        0xcbf29ce484222325ULL
+#define FNV_PRIME               0x100000001b3ULL
+
+// Sketch cell
+typedef struct
+{
+    uint64_t                    packets;
+    uint64_t                    bytes;
+} topk_cell_t;
+
+// Heavy hitter slot
+// NB: The name is replaced under a sequence lock, so that readers may copy
+//     it without blocking the bridge thread. The sequence is odd while the
+//     name is being replaced.
+typedef struct
+{
+    uint32_t                    sequence;
+    char                        name[DNS_MAX_LABEL_LEN];
+    uint64_t                    packets;
+    uint64_t                    bytes;
+} topk_slot_t;
+
+// Per thread state
+// NB: Only written by the bridge thread for the ip type. The sketch is
+//     private to the thread, and the slots are read by the statistics.
+typedef struct
+{
+    topk_cell_t *               sketch;         // [depth][width]
+    topk_slot_t *               slots;          // [interface index][TOPK_SIZE]
+} topk_thread_t;
+
+static topk_thread_t            topk_thread[NUM_IP_TYPES];
+
+
+
+//
+// Allocate the service type accounting
+//
+//   NOTE: This MUST be called after the interface list is set, and before the
+//         bridge threads are started.
+//
+void topk_initialize(void)
+{
+    unsigned int                ip_type;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        topk_thread[ip_type].sketch = calloc(TOPK_SKETCH_DEPTH * TOPK_SKETCH_WIDTH, sizeof(topk_cell_t));
+        topk_thread[ip_type].slots = calloc(configured_interface_count * TOPK_SIZE, sizeof(topk_slot_t));
+        if (topk_thread[ip_type].sketch == NULL || topk_thread[ip_type].slots == NULL)
+        {
+            fatal("Cannot allocate memory: %s\n", strerror(errno));
+        }
+    }
+}
+
+
+//
+// Hash an interface index and service type
+//
+static uint64_t topk_hash(
+    unsigned int                interface_index,
+    const char *                name)
+{
+    uint64_t                    hash = FNV_OFFSET_BASIS;
+    unsigned int                index;
+
+    for (index = 0; index < sizeof(interface_index); index++)
+    {
+        hash ^= (interface_index >> (index * 8)) & 0xff;
+        hash *= FNV_PRIME;
+    }
+    for (; *name; name++)
+    {
+        hash ^= (unsigned char) *name;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+//
+// Replace the service type in a heavy hitter slot
+//
+static void topk_slot_replace(
+    topk_slot_t *               slot,
+    const char *                name,
+    uint64_t                    packets,
+    uint64_t                    bytes)
+{
+    uint32_t                    sequence = slot->sequence;
+
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    strcpy(slot->name, name);
+    __atomic_store_n(&slot->packets, packets, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->bytes, bytes, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+//
+// Record a packet for the service types it contains
+//
+//   Each service type is charged the full packet. The count-min sketch
+//   estimates the packets and bytes for each interface and service type, and
+//   the service types with the most bytes for each interface are kept in the
+//   heavy hitter slots.
+//
+//   NOTE: Only called by the bridge thread for the ip type.
+//
+void topk_record(
+    ip_type_t                   ip_type,
+    unsigned int                interface_index,
+    const char                  services[][DNS_MAX_LABEL_LEN],
+    unsigned int                count,
+    unsigned int                bytes)
+{
+    topk_thread_t *             thread = &topk_thread[ip_type];
+    topk_slot_t *               slots = &thread->slots[interface_index * TOPK_SIZE];
+    topk_slot_t *               slot;
+    topk_cell_t *               cell;
+    uint64_t                    hash;
+    uint64_t                    packets_estimate;
+    uint64_t                    bytes_estimate;
+    uint32_t                    h1;
+    uint32_t                    h2;
+    unsigned int                service;
+    unsigned int                row;
+    unsigned int                index;
+
+    for (service = 0; service < count; service++)
+    {
+        // Update the sketch
+        // NB: The row hashes are derived from a single hash (Kirsch-Mitzenmacher)
+        hash = topk_hash(interface_index, services[service]);
+        h1 = (uint32_t) hash;
+        h2 = (uint32_t) (hash >> 32) | 1;
+        packets_estimate = UINT64_MAX;
+        bytes_estimate = UINT64_MAX;
+        for (row = 0; row < TOPK_SKETCH_DEPTH; row++)
+        {
+            cell = &thread->sketch[row * TOPK_SKETCH_WIDTH + ((h1 + row * h2) & (TOPK_SKETCH_WIDTH - 1))];
+            cell->packets += 1;
+            cell->bytes += bytes;
+            if (cell->packets < packets_estimate)
+            {
+                packets_estimate = cell->packets;
+            }
+            if (cell->bytes < bytes_estimate)
+            {
+                bytes_estimate = cell->bytes;
+            }
+        }
+
+        // Update the heavy hitters, finding the slot with the fewest bytes
+        slot = &slots[0];
+        for (index = 0; index < TOPK_SIZE; index++)
+        {
+            if (strcmp(slots[index].name, services[service]) == 0)
+            {
+                break;
+            }
+            if (slots[index].bytes < slot->bytes)
+            {
+                slot = &slots[index];
+            }
+        }
+
+        if (index < TOPK_SIZE)
+        {
+            __atomic_store_n(&slots[index].packets, packets_estimate, __ATOMIC_RELAXED);
+            __atomic_store_n(&slots[index].bytes, bytes_estimate, __ATOMIC_RELAXED);
+        }
+        else if (bytes_estimate > slot->bytes)
+        {
+            topk_slot_replace(slot, services[service], packets_estimate, bytes_estimate);
+        }
+    }
+}
+
+
+//
+// Compare entries by bytes (descending)
+//
+static int topk_compare(
+    const void *                p1,
+    const void *                p2)
+{
+    const topk_entry_t *        e1 = p1;
+    const topk_entry_t *        e2 = p2;
+
+    if (e1->bytes != e2->bytes)
+    {
+        return e1->bytes < e2->bytes ? 1 : -1;
+    }
+    return e1->packets < e2->packets ? 1 : e1->packets > e2->packets ? -1 : 0;
+}
+
+
+//
+// Read the top service types for an interface
+//
+//   The ip types are combined, and the entries are sorted by bytes. Returns
+//   the number of entries.
+//
+unsigned int topk_read(
+    unsigned int                interface_index,
+    topk_entry_t                entries[NUM_IP_TYPES * TOPK_SIZE])
+{
+    const topk_slot_t *         slot;
+    topk_entry_t                entry;
+    uint32_t                    sequence;
+    unsigned int                count = 0;
+    unsigned int                ip_type;
+    unsigned int                index;
+    unsigned int                merge;
+
+    for (ip_type = 0; ip_type < NUM_IP_TYPES; ip_type++)
+    {
+        for (index = 0; index < TOPK_SIZE; index++)
+        {
+            slot = &topk_thread[ip_type].slots[interface_index * TOPK_SIZE + index];
+
+            // Copy the slot under the sequence lock
+            do
+            {
+                sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+                memcpy(entry.name, slot->name, sizeof(entry.name));
+                entry.packets = __atomic_load_n(&slot->packets, __ATOMIC_RELAXED);
+                entry.bytes = __atomic_load_n(&slot->bytes, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            }
+            while ((sequence & 1) || __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence);
+
+            entry.name[sizeof(entry.name) - 1] = 0;
+            if (entry.name[0] == 0)
+            {
+                continue;
+            }
+
+            // Combine with the same service type from the other ip type
+            for (merge = 0; merge < count; merge++)
+            {
+                if (strcmp(entries[merge].name, entry.name) == 0)
+                {
+                    entries[merge].packets += entry.packets;
+                    entries[merge].bytes += entry.bytes;
+                    break;
+                }
+            }
+            if (merge == count)
+            {
+                entries[count++] = entry;
+            }
+        }
+    }
+
+    qsort(entries, count, sizeof(topk_entry_t), topk_compare);
+    return count;
+}